@@ -5,9 +5,16 @@
 */
 
 #define _GNU_SOURCE
+#include <sys/prctl.h>
 #include <sys/resource.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
 #include <grp.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -16,10 +23,300 @@
 #include <stdio.h>
 #include <pwd.h>
 
+#ifndef CLOSE_RANGE_CLOEXEC
+#define CLOSE_RANGE_CLOEXEC (1U << 2)
+#endif
+
+// Mark every descriptor from 3 upwards close-on-exec with a single syscall.
+// Returns -1 if the running kernel (or the build headers) lack close_range().
+static int close_fds_with_close_range(void)
+{
+#ifdef SYS_close_range
+  return syscall(SYS_close_range, 3U, ~0U, CLOSE_RANGE_CLOEXEC);
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+// Close only the descriptors that are actually open, as listed in
+// /proc/self/fd, except keep_fd. Returns -1 if /proc is not available.
+static int close_fds_from_proc(int keep_fd)
+{
+  DIR *dir = opendir("/proc/self/fd");
+  if (!dir)
+    return -1;
+  int dir_fd = dirfd(dir);
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    char *end;
+    long fd = strtol(entry->d_name, &end, 10);
+    if (entry->d_name[0] == '\0' || *end != '\0')
+      continue;
+    if (fd < 3 || fd == dir_fd || fd == keep_fd)
+      continue;
+    close(fd);
+  }
+  closedir(dir);
+  return 0;
+}
+
+// Only these apt options may be passed through to apt-get, so that the
+// wrapper can't be used to run hooks such as APT::Update::Pre-Invoke.
+static const char *allowed_options[] = {
+  "Acquire::QueueHost::Limit=",
+  "Acquire::http::Pipeline-Depth=",
+  NULL
+};
+
+static int is_allowed_option(const char *option)
+{
+  const char **allowed;
+  for (allowed = allowed_options; *allowed; allowed++) {
+    if (strncmp(option, *allowed, strlen(*allowed)) == 0)
+      return 1;
+  }
+  return 0;
+}
+
+// Last resort: blindly close every descriptor number below the limit,
+// except keep_fd.
+static int close_fds_up_to_limit(int keep_fd)
+{
+  struct rlimit rlp;
+  if (getrlimit(RLIMIT_NOFILE, &rlp) == -1)
+    return -1;
+  int file_max;
+  if (rlp.rlim_max == RLIM_INFINITY || rlp.rlim_max > 4096)
+    file_max = 4096;
+  else
+    file_max = rlp.rlim_max;
+  int file;
+  for (file = 3; file < file_max; file++) {
+    if (file != keep_fd)
+      close(file);
+  }
+  return 0;
+}
+
+static double elapsed_seconds(const struct timespec *start)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static double timeval_seconds(const struct timeval *tv)
+{
+  return tv->tv_sec + tv->tv_usec / 1e6;
+}
+
+// apt-get prints this once it fetched the indexes, when it starts parsing
+// them to rebuild its package cache, which it does in a single pass. Its
+// messages aren't translated, as it runs without any locale variable.
+static const char cache_marker[] = "Reading package lists";
+
+static volatile pid_t apt_pid = -1;
+
+// Pass the signals asking us to stop on to apt-get, and wait for it.
+static void forward_signal(int signum)
+{
+  if (apt_pid > 0)
+    kill(apt_pid, signum);
+}
+
+// Write all the data to fd, retrying after interruptions.
+static void write_all(int fd, const char *data, size_t size)
+{
+  while (size > 0) {
+    ssize_t written = write(fd, data, size);
+    if (written == -1) {
+      if (errno == EINTR)
+        continue;
+      return;
+    }
+    data += written;
+    size -= written;
+  }
+}
+
+// Copy the output of apt-get from out_fd to our standard output, until it
+// exits. Return the time it printed the cache_marker line at, relative to
+// start, or -1 if it didn't.
+static double copy_output(int out_fd, const struct timespec *start)
+{
+  double marker_time = -1;
+  // How much of the current line matches the marker, -1 if it doesn't.
+  int matched = 0;
+  char buffer[4096];
+  for (;;) {
+    ssize_t size = read(out_fd, buffer, sizeof(buffer));
+    if (size == -1 && errno == EINTR)
+      continue;
+    if (size <= 0)
+      return marker_time;
+    ssize_t i;
+    for (i = 0; i < size && marker_time < 0; i++) {
+      if (buffer[i] == '\n')
+        matched = 0;
+      else if (matched >= 0 && buffer[i] == cache_marker[matched]) {
+        if (++matched == sizeof(cache_marker) - 1)
+          marker_time = elapsed_seconds(start);
+      } else
+        matched = -1;
+    }
+    write_all(STDOUT_FILENO, buffer, size);
+  }
+}
+
+// Run apt-get in a child process and write timing and resource usage
+// statistics as a JSON object to stats_fd once it exits. The exit status
+// of apt-get is passed on as our own.
+//
+// The update time is split between the time apt-get takes to fetch the
+// indexes and the time it takes to parse them and rebuild its cache, as
+// told by its output, which goes through us.
+static int run_with_stats(char *apt_argv[], char *apt_envp[], int stats_fd,
+                          double setup_time)
+{
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  int out_pipe[2];
+  if (pipe2(out_pipe, O_CLOEXEC) == -1) {
+    perror("error: Unable to create apt-get output pipe");
+    return 1;
+  }
+
+  // The stop signals are blocked until apt-get's pid is known, so that
+  // none is lost.
+  sigset_t stop_signals, saved_mask;
+  sigemptyset(&stop_signals);
+  sigaddset(&stop_signals, SIGTERM);
+  sigaddset(&stop_signals, SIGINT);
+  sigaddset(&stop_signals, SIGHUP);
+  sigprocmask(SIG_BLOCK, &stop_signals, &saved_mask);
+  struct sigaction action = {0};
+  action.sa_handler = forward_signal;
+  sigaction(SIGTERM, &action, NULL);
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGHUP, &action, NULL);
+
+  pid_t parent = getpid();
+  pid_t pid = fork();
+  if (pid == -1) {
+    perror("error: Unable to fork apt-get");
+    return 1;
+  }
+  if (pid == 0) {
+    // Don't outlive the wrapper if it's killed, even before the death
+    // signal is set. apt-get running as root clears it when it switches
+    // to its sandbox user to check file permissions, so only the signals
+    // forwarded by the wrapper stop it after that.
+    if (prctl(PR_SET_PDEATHSIG, SIGKILL) == -1) {
+      perror("error: Unable to set parent death signal");
+      _exit(1);
+    }
+    if (getppid() != parent)
+      _exit(1);
+    // A stop signal still pending must stop us, not be forwarded to an
+    // apt_pid we don't have.
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGHUP, SIG_DFL);
+    sigprocmask(SIG_SETMASK, &saved_mask, NULL);
+    if (dup2(out_pipe[1], STDOUT_FILENO) == -1) {
+      perror("error: Unable to redirect apt-get output");
+      _exit(1);
+    }
+    execve(apt_argv[0], apt_argv, apt_envp);
+    perror("error: Unable to execute apt-get");
+    _exit(1);
+  }
+  apt_pid = pid;
+  sigprocmask(SIG_SETMASK, &saved_mask, NULL);
+  close(out_pipe[1]);
+
+  double fetch_time = copy_output(out_pipe[0], &start);
+  close(out_pipe[0]);
+
+  int status;
+  while (waitpid(pid, &status, 0) == -1) {
+    if (errno != EINTR) {
+      perror("error: Unable to wait for apt-get");
+      return 1;
+    }
+  }
+  double update_time = elapsed_seconds(&start);
+
+  struct rusage usage;
+  if (getrusage(RUSAGE_CHILDREN, &usage) == -1) {
+    perror("error: Unable to get apt-get resource usage");
+    memset(&usage, 0, sizeof(usage));
+  }
+
+  dprintf(stats_fd,
+          "{\"setup-time\": %.6f, \"update-time\": %.6f, "
+          "\"update-user-time\": %.6f, \"update-system-time\": %.6f, "
+          "\"update-max-rss\": %ld",
+          setup_time, update_time, timeval_seconds(&usage.ru_utime),
+          timeval_seconds(&usage.ru_stime), usage.ru_maxrss);
+  if (fetch_time >= 0)
+    dprintf(stats_fd, ", \"fetch-time\": %.6f, \"cache-time\": %.6f",
+            fetch_time, update_time - fetch_time);
+  dprintf(stats_fd, "}\n");
+  close(stats_fd);
+
+  if (WIFSIGNALED(status)) {
+    signal(WTERMSIG(status), SIG_DFL);
+    kill(getpid(), WTERMSIG(status));
+  }
+  return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
+
 int main(int argc, char *argv[], char *envp[])
 {
-  char *apt_argv[] = {"/usr/bin/apt-get", "-q", "update", NULL};
   char *apt_envp[] = {"PATH=/bin:/usr/bin", NULL, NULL, NULL, NULL};
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  // Build the apt-get command line, passing through "-o Name=Value" options.
+  // With "--stats-fd N", statistics are written to descriptor N.
+  int stats_fd = -1;
+  char **apt_argv = calloc(2 * argc + 3, sizeof(char *));
+  if (!apt_argv) {
+    perror("error: Unable to allocate apt-get arguments");
+    exit(1);
+  }
+  int apt_argc = 0;
+  apt_argv[apt_argc++] = "/usr/bin/apt-get";
+  apt_argv[apt_argc++] = "-q";
+  int arg;
+  for (arg = 1; arg < argc; arg++) {
+    if (strcmp(argv[arg], "--stats-fd") == 0 && arg + 1 < argc) {
+      char *end;
+      stats_fd = strtol(argv[++arg], &end, 10);
+      if (*argv[arg] == '\0' || *end != '\0' || stats_fd < 3 ||
+          fcntl(stats_fd, F_GETFD) == -1) {
+        fprintf(stderr, "error: Invalid statistics descriptor '%s'\n",
+                argv[arg]);
+        exit(1);
+      }
+      continue;
+    }
+    if (strcmp(argv[arg], "-o") != 0 || arg + 1 == argc) {
+      fprintf(stderr, "error: Invalid argument '%s'\n", argv[arg]);
+      exit(1);
+    }
+    if (!is_allowed_option(argv[++arg])) {
+      fprintf(stderr, "error: Option not allowed '%s'\n", argv[arg]);
+      exit(1);
+    }
+    apt_argv[apt_argc++] = "-o";
+    apt_argv[apt_argc++] = argv[arg];
+  }
+  apt_argv[apt_argc++] = "update";
+  apt_argv[apt_argc] = NULL;
 
   // Set the HOME environment variable
   struct passwd *pwd = getpwuid(geteuid());
@@ -68,20 +365,17 @@ int main(int argc, char *argv[], char *envp[])
     exit(1);
   }
 
-  // Close all file descriptors except the standard ones
-  struct rlimit rlp;
-  if (getrlimit(RLIMIT_NOFILE, &rlp) == -1) {
+  // Close all file descriptors except the standard ones. The statistics
+  // descriptor is kept open for us, but apt-get doesn't inherit it.
+  if (close_fds_with_close_range() == -1 &&
+      close_fds_from_proc(stats_fd) == -1 &&
+      close_fds_up_to_limit(stats_fd) == -1) {
     perror("error: Unable to determine file descriptor limits");
     exit(1);
   }
-  int file_max;
-  if (rlp.rlim_max == RLIM_INFINITY || rlp.rlim_max > 4096)
-    file_max = 4096;
-  else
-    file_max = rlp.rlim_max;
-  int file;
-  for (file = 3; file < file_max; file++) {
-    close(file);
+  if (stats_fd != -1 && fcntl(stats_fd, F_SETFD, FD_CLOEXEC) == -1) {
+    perror("error: Unable to set up statistics descriptor");
+    exit(1);
   }
 
   // Set umask to 022
@@ -93,6 +387,8 @@ int main(int argc, char *argv[], char *envp[])
   }
 
   // Run apt-get update
+  if (stats_fd != -1)
+    return run_with_stats(apt_argv, apt_envp, stats_fd, elapsed_seconds(&start));
   execve(apt_argv[0], apt_argv, apt_envp);
   perror("error: Unable to execute apt-get");
   return 1;
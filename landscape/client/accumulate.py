@@ -90,6 +90,102 @@ class Accumulator:
         return step_data
 
 
+class BatchAccumulator:
+    """Accumulate the values of many series sampled at the same times.
+
+    This gives the same results as calling an L{Accumulator} for each
+    series, but the state of all series is kept in the persist as a
+    single C{(names, timestamps, accumulated_values)} tuple of columns,
+    under C{key}, and the step boundaries are only computed once for all
+    the series last sampled at the same time.
+
+    @param persist: The L{Persist} to keep the state in.
+    @param step_size: The step size, in seconds.
+    @param key: The persist key of the state of all series. A dict found
+        there is taken as the state an L{Accumulator} left, when called
+        with C{(key, name)} keys.
+    @param legacy_key: Optionally, a function returning the key used by
+        an L{Accumulator} for a series, to take its state over.
+    """
+
+    def __init__(self, persist, step_size, key, legacy_key=None):
+        self._persist = persist
+        self._step_size = step_size
+        self._key = key
+        self._legacy_key = legacy_key
+
+    def _get_state(self):
+        state = self._persist.get(self._key)
+        if state is None:
+            return {}
+        if type(state) is dict:
+            return state
+        names, timestamps, accumulated_values = state
+        return dict(zip(names, zip(timestamps, accumulated_values)))
+
+    def __call__(self, new_timestamp, new_values):
+        """Accumulate the values of the series sampled at C{new_timestamp}.
+
+        @param new_values: A dict mapping series names to their values.
+        @return: A dict mapping the names of the series which crossed a
+            step boundary to their step data.
+        """
+        if not new_values:
+            return {}
+        step_size = self._step_size
+        # Series missing from this sample keep their state, like they
+        # would with an Accumulator.
+        state = self._get_state()
+        series = {}
+        for name, new_value in new_values.items():
+            previous = state.get(name)
+            if previous is None and self._legacy_key is not None:
+                legacy_key = self._legacy_key(name)
+                previous = self._persist.get(legacy_key)
+                if previous is not None:
+                    self._persist.remove(legacy_key)
+            previous_timestamp, accumulated_value = previous or (0, 0)
+            series.setdefault(previous_timestamp, []).append(
+                (name, accumulated_value, new_value),
+            )
+
+        all_step_data = {}
+        new_step = new_timestamp // step_size
+        step_boundary = new_step * step_size
+        for previous_timestamp, values in series.items():
+            step_diff = new_step - previous_timestamp // step_size
+            if step_diff == 0:
+                diff = new_timestamp - previous_timestamp
+                for name, accumulated_value, new_value in values:
+                    accumulated_value += diff * new_value
+                    state[name] = (new_timestamp, accumulated_value)
+            elif step_diff == 1:
+                diff = step_boundary - previous_timestamp
+                next_diff = new_timestamp - step_boundary
+                for name, accumulated_value, new_value in values:
+                    accumulated_value += diff * new_value
+                    step_value = float(accumulated_value) / step_size
+                    all_step_data[name] = (step_boundary, step_value)
+                    state[name] = (new_timestamp, next_diff * new_value)
+            else:
+                diff = new_timestamp - step_boundary
+                for name, _, new_value in values:
+                    state[name] = (new_timestamp, diff * new_value)
+
+        # Tuples are stored as they are, rather than deep-copied like
+        # dicts and lists.
+        names = tuple(state)
+        self._persist.set(
+            self._key,
+            (
+                names,
+                tuple(state[name][0] for name in names),
+                tuple(state[name][1] for name in names),
+            ),
+        )
+        return all_step_data
+
+
 def accumulate(
     previous_timestamp,
     accumulated_value,
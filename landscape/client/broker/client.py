@@ -11,6 +11,7 @@ from twisted.internet.defer import succeed
 
 from landscape.client.amp import remote
 from landscape.lib.format import format_object
+from landscape.lib.monitor import health_stats
 from landscape.lib.twisted_util import gather_results
 
 
@@ -138,9 +139,16 @@ class BrokerClientPlugin:
 
     def _run_with_error_log(self):
         """Wrap self.run in a Deferred with a logging error handler."""
+        start = health_stats.time()
         deferred = maybeDeferred(self.run)
+        deferred.addBoth(self._record_run_time, start)
         return deferred.addErrback(self._error_log)
 
+    def _record_run_time(self, result, start):
+        """Record the time taken by the run, until it completed."""
+        health_stats.record_since(f"run-time:{type(self).__name__}", start)
+        return result
+
     def _error_log(self, failure):
         """Errback to log and reraise uncaught run errors."""
         cls = type(self).__name__
@@ -32,6 +32,8 @@ class BrokerConfiguration(Configuration):
               - C{http_proxy}
               - C{https_proxy}
               - C{hostagent_uid}
+              - C{message_store_journal} (C{False})
+              - C{http2} (C{False})
         """
         parser = super().make_parser()
 
@@ -100,6 +102,19 @@ class BrokerConfiguration(Configuration):
             "managed by Landscape, in which case set it to be the uid that "
             "Landscape assigned to the host machine.",
         )
+        parser.add_option(
+            "--message-store-journal",
+            default=False,
+            action="store_true",
+            help="Queue messages in append-only journal files, instead of "
+            "one file per message.",
+        )
+        parser.add_option(
+            "--http2",
+            default=False,
+            action="store_true",
+            help="Negotiate HTTP/2 with the server for message exchanges.",
+        )
 
         return parser
 
@@ -108,6 +123,11 @@ class BrokerConfiguration(Configuration):
         """Get the path to the message store."""
         return os.path.join(self.data_path, "messages")
 
+    @property
+    def message_journal_path(self):
+        """Get the path to the message store, when it's a journal."""
+        return os.path.join(self.data_path, "message-journal")
+
     def load(self, args):
         """
         Load options from command line arguments and a config file.
@@ -82,6 +82,7 @@ Additionally, payloads to registered clients will include these fields::
   {'next-expected-sequence': EXPECTED_SEQUENCE_NUMBER,
    'next-expected-token': EXPECTED_EXCHANGE_TOKEN,
    'client-accepted-types-hash': CLIENT_ACCEPTED_TYPES_DIGEST,
+   'accepted-encodings': ACCEPTED_ENCODINGS (optional)}
 
 where:
 
@@ -100,6 +101,13 @@ where:
     to know whether to send to the server an up-to-date list the message types
     it now accepts (see CLIENT_ACCEPTED_TYPES in the client->server payload).
 
+  - C{ACCEPTED_ENCODINGS}: Optionally, a list of the content encodings, like
+    "gzip" or "zstd", that the server accepts for the payloads the client
+    sends. The client compresses the next payloads with its preferred one
+    among them, and names it in a C{Content-Encoding} header. If the server
+    then answers with a 415 HTTP error, the client goes back to uncompressed
+    payloads until the server sends this field again.
+
 Individual Messages
 ===================
 
@@ -352,6 +360,7 @@ from landscape import CLIENT_API
 from landscape import DEFAULT_SERVER_API
 from landscape import SERVER_API
 from landscape.lib.backoff import ExponentialBackoff
+from landscape.lib.batching import AdaptiveBatch
 from landscape.lib.compat import _PY3
 from landscape.lib.fetch import HTTPCodeError
 from landscape.lib.fetch import PyCurlError
@@ -381,6 +390,9 @@ class MessageExchange:
     # The highest server API that we are capable of speaking
     _api = SERVER_API
 
+    # The seconds between the exchanges delivering a backlog of messages.
+    backlog_exchange_interval = 1
+
     def __init__(
         self,
         reactor,
@@ -402,6 +414,9 @@ class MessageExchange:
             the time interval between subsequent exchanges of non-urgent
             messages, and the time interval between subsequent exchanges
             of urgent messages.
+        @param max_messages: The number of messages in a payload, before
+            it's adapted to the throughput of the past exchanges, see
+            L{AdaptiveBatch}.
         """
         self._reactor = reactor
         self._message_store = store
@@ -410,12 +425,13 @@ class MessageExchange:
         self._config = config
         self._exchange_interval = config.exchange_interval
         self._urgent_exchange_interval = config.urgent_exchange_interval
-        self._max_messages = max_messages
+        self._batch = AdaptiveBatch(max_messages)
         self._max_log_text_bytes = 100000  # 100KB
         self._notification_id = None
         self._exchange_id = None
         self._exchanging = False
         self._urgent_exchange = False
+        self._delivering_backlog = False
         self._client_accepted_types = set()
         self._client_accepted_types_hash = None
         self._message_handlers = {}
@@ -581,6 +597,7 @@ class MessageExchange:
         self._reactor.fire("pre-exchange")
 
         payload = self._make_payload()
+        size = sum(len(message) for message in payload["messages"])
 
         start_time = time.time()
         if self._urgent_exchange:
@@ -606,7 +623,13 @@ class MessageExchange:
 
         def handle_result(result):
             self._exchanging = False
+            self._delivering_backlog = False
             if result:
+                self._batch.record(
+                    size,
+                    len(payload["messages"]),
+                    time.time() - start_time,
+                )
                 if self._urgent_exchange:
                     logging.info("Switching to normal exchange mode.")
                     self._urgent_exchange = False
@@ -620,6 +643,14 @@ class MessageExchange:
 
         def handle_failure(error_class, error, traceback):
             self._exchanging = False
+            self._delivering_backlog = False
+
+            if isinstance(error, PyCurlError) or (
+                isinstance(error, HTTPCodeError) and error.http_code == 413
+            ):
+                # The payload may have been too big to be delivered in time,
+                # or at all, so let's send smaller ones.
+                self._batch.record_failure()
 
             if isinstance(error, HTTPCodeError) and error.http_code == 404:
                 # If we got a 404 HTTP error it could be that we're trying to
@@ -632,6 +663,15 @@ class MessageExchange:
                     self.exchange()
                     return
 
+            if isinstance(error, HTTPCodeError) and error.http_code == 415:
+                # The server doesn't accept the content encoding of the
+                # payload anymore, let's send it uncompressed until it tells
+                # us again which encodings it accepts.
+                if self._message_store.get_accepted_encodings():
+                    self._message_store.set_accepted_encodings([])
+                    self.exchange()
+                    return
+
             if isinstance(error, HTTPCodeError):
                 if error.http_code == 429 or (500 <= error.http_code <= 599):
                     # We add an exponentially increasing delay ("backoff") if
@@ -668,6 +708,7 @@ class MessageExchange:
             self._registration_info.secure_id,
             self._get_exchange_token(),
             payload.get("server-api"),
+            self._message_store.get_accepted_encodings(),
         )
         return deferred
 
@@ -715,14 +756,21 @@ class MessageExchange:
                     "seconds".format(backoff_delay),
                 )
                 interval += backoff_delay
+            elif self._delivering_backlog:
+                # The server took all the messages of the last exchange, the
+                # next ones can follow right away. The impending exchange was
+                # already notified for the first exchange of the backlog.
+                interval = min(interval, self.backlog_exchange_interval)
 
             if self._notification_id is not None:
                 self._reactor.cancel_call(self._notification_id)
-            notification_interval = interval - 10
-            self._notification_id = self._reactor.call_later(
-                notification_interval,
-                self._notify_impending_exchange,
-            )
+                self._notification_id = None
+            if not self._delivering_backlog:
+                notification_interval = interval - 10
+                self._notification_id = self._reactor.call_later(
+                    notification_interval,
+                    self._notify_impending_exchange,
+                )
 
             self._exchange_id = self._reactor.call_later(
                 interval,
@@ -756,12 +804,16 @@ class MessageExchange:
         """Return a dict representing the complete exchange payload.
 
         The payload will contain all pending messages eligible for
-        delivery, up to a maximum of C{max_messages} as passed to
-        the L{__init__} method.
+        delivery, up to the number of messages and bytes the L{AdaptiveBatch}
+        of the exchanger allows. Messages are included as they were
+        serialized by the store, see L{SerializedMessage}.
         """
         store = self._message_store
         accepted_types_digest = self._hash_types(store.get_accepted_types())
-        messages = store.get_pending_messages(self._max_messages)
+        messages = store.get_serialized_pending_messages(
+            self._batch.max_messages,
+            max_bytes=self._batch.max_bytes,
+        )
         total_messages = store.count_pending_messages()
         if messages:
             # Each message is tagged with the API that the client was
@@ -769,9 +821,9 @@ class MessageExchange:
             # logic below will make sure that all messages which are added
             # to the payload being built will have the same api, and any
             # other messages will be postponed to the next exchange.
-            server_api = messages[0].get("api")
+            server_api = messages[0].api
             for i, message in enumerate(messages):
-                if message.get("api") != server_api:
+                if message.api != server_api:
                     break
             else:
                 i = None
@@ -875,6 +927,15 @@ class MessageExchange:
             lowest_server_api = sort_versions([server_api, self._api])[-1]
             message_store.set_server_api(lowest_server_api)
 
+        # The content encodings the server accepts for the payloads. Servers
+        # that only accept uncompressed payloads don't send this field.
+        message_store.set_accepted_encodings(
+            [
+                maybe_bytes(encoding)
+                for encoding in result.get("accepted-encodings", ())
+            ],
+        )
+
         message_store.commit()
 
         sequence = message_store.get_server_sequence()
@@ -894,6 +955,11 @@ class MessageExchange:
             # Either the server asked us for old messages, or we
             # otherwise have more messages even after transferring
             # what we could.
+            sent = len(payload["messages"])
+            if sent and next_expected == old_sequence + sent:
+                # The server took all the messages we sent, let's deliver
+                # the rest of the backlog in back-to-back exchanges.
+                self._delivering_backlog = True
             if next_expected != old_sequence:
                 self.schedule_exchange(urgent=True)
 
@@ -44,12 +44,17 @@ from twisted.python.failure import Failure
 from twisted.internet import defer
 
 from landscape.lib import bpickle
+from landscape.lib.fetch import CurlHandle
 from landscape.lib.fetch import fetch
 from landscape.lib.log import log_failure
 
 
 class PingClient:
-    """An HTTP client which knows how to talk to the ping server."""
+    """An HTTP client which knows how to talk to the ping server.
+
+    The pings are made with the same L{CurlHandle}, so that they reuse
+    the connection to the ping server while it's kept alive.
+    """
 
     def __init__(self, reactor, get_page=None, cainfo=None):
         if get_page is None:
@@ -57,6 +62,7 @@ class PingClient:
         self._reactor = reactor
         self.get_page = get_page
         self._cainfo = cainfo
+        self._curl_handle = CurlHandle()
 
     def ping(self, url, insecure_id):
         """Ask the question: are there messages for this computer ID?
@@ -85,6 +91,7 @@ class PingClient:
                 data=data,
                 headers=headers,
                 cainfo=self._cainfo,
+                handle=self._curl_handle,
             )
             page_deferred.addCallback(self._got_result)
             return page_deferred
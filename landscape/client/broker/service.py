@@ -10,10 +10,13 @@ from landscape.client.broker.registration import Identity
 from landscape.client.broker.registration import RegistrationHandler
 from landscape.client.broker.server import BrokerServer
 from landscape.client.broker.store import get_default_message_store
+from landscape.client.broker.store import JournalMessageStore
 from landscape.client.broker.transport import HTTPTransport
+from landscape.client.health import get_health_message
 from landscape.client.service import LandscapeService
 from landscape.client.service import run_landscape_service
 from landscape.client.watchdog import bootstrap_list
+from landscape.lib.monitor import health_stats
 
 
 class BrokerService(LandscapeService):
@@ -47,6 +50,7 @@ class BrokerService(LandscapeService):
 
     def __init__(self, config):
         self._config = config
+        self._health_call = None
         self.persist_filename = os.path.join(
             config.data_path,
             f"{self.service_name}.bpickle",
@@ -57,11 +61,19 @@ class BrokerService(LandscapeService):
             self.reactor,
             config.url,
             config.ssl_public_key,
+            http2=config.http2,
         )
-        self.message_store = get_default_message_store(
-            self.persist,
-            config.message_store_path,
-        )
+        if config.message_store_journal:
+            self.message_store = get_default_message_store(
+                self.persist,
+                config.message_journal_path,
+                store_class=JournalMessageStore,
+            )
+        else:
+            self.message_store = get_default_message_store(
+                self.persist,
+                config.message_store_path,
+            )
         self.identity = Identity(self.config, self.persist)
         exchange_store = ExchangeStore(self.config.exchange_store_path)
         self.exchanger = MessageExchange(
@@ -105,7 +117,8 @@ class BrokerService(LandscapeService):
 
         Create a L{BrokerServer} listening on C{broker_socket_path} for clients
         connecting with the L{BrokerServerConnector}, and start the
-        L{MessageExchange} and L{Pinger} services.
+        L{MessageExchange} and L{Pinger} services, and send the health
+        statistics of the broker every C{client_health_interval} seconds.
         """
         super().startService()
         bootstrap_list.bootstrap(
@@ -115,12 +128,28 @@ class BrokerService(LandscapeService):
         self.publisher.start()
         self.exchanger.start()
         self.pinger.start()
+        if self._config.client_health_interval:
+            self._health_call = self.reactor.call_every(
+                self._config.client_health_interval,
+                self.send_health,
+            )
+
+    def send_health(self):
+        """Queue a C{client-health} message with the broker statistics."""
+        if self.message_store.accepts("client-health"):
+            self.exchanger.send(get_health_message(self.service_name))
+            # The message is queued, start the next period.
+            health_stats.reset()
 
     def stopService(self):  # noqa: N802
-        """Stop the broker."""
+        """Stop the broker, and close the message store."""
         deferred = self.publisher.stop()
         self.exchanger.stop()
         self.pinger.stop()
+        if self._health_call is not None:
+            self.reactor.cancel_call(self._health_call)
+            self._health_call = None
+        self.message_store.close()
         super().stopService()
         return deferred
 
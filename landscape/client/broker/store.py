@@ -95,6 +95,7 @@ import itertools
 import logging
 import os
 import shutil
+import struct
 import traceback
 import uuid
 
@@ -104,6 +105,7 @@ from landscape import DEFAULT_SERVER_API
 from landscape.lib import bpickle
 from landscape.lib.fs import create_binary_file
 from landscape.lib.fs import read_binary_file
+from landscape.lib.monitor import health_stats
 from landscape.lib.versioning import is_version_higher
 from landscape.lib.versioning import sort_versions
 
@@ -112,6 +114,16 @@ HELD = "h"
 BROKEN = "b"
 
 
+def is_deliverable(flags):
+    """Whether a message with the given C{flags} can be delivered."""
+    return HELD not in flags and BROKEN not in flags
+
+
+# Flags of journal records, as stored in their segment's flags file.
+JOURNAL_FLAGS = {HELD: 1, BROKEN: 2}
+JOURNAL_DELETED = 4
+
+
 class MessageStore:
     """A message store which stores its messages in a file system hierarchy.
 
@@ -137,6 +149,10 @@ class MessageStore:
     # in case the server supports it.
     _api = DEFAULT_SERVER_API
 
+    # The name of the backend, saved along with the pending offset, which
+    # only makes sense for the messages of the backend that stored them.
+    backend = "files"
+
     def __init__(
         self,
         persist,
@@ -150,15 +166,31 @@ class MessageStore:
         self._max_dirs = max_dirs  # Maximum number of directories in store
         self._max_size_mb = max_size_mb  # Maximum size of message store
         self._schemas = {}
+        # The schema applied to the messages of a type, by server API.
+        self._chosen_schemas = {}
         self._original_persist = persist
         self._persist = persist.root_at("message-store")
         message_dir = self._message_dir()
         if not os.path.isdir(message_dir):
             os.makedirs(message_dir)
+        self._load_index()
+        if self._persist.get("backend", "files") != self.backend:
+            # The store was switched to this backend: the pending offset is
+            # the one of the other backend, and the messages left here from
+            # before any previous switch are stale. The sequence is shared,
+            # the exchange resynchronizes it with the server as usual.
+            logging.info(f"Switching the message store to {self.backend}.")
+            self.delete_all_messages()
+            self._persist.set("backend", self.backend)
+            self.commit()
 
     def commit(self):
         """Persist metadata to disk."""
-        self._original_persist.save()
+        with health_stats.timed("store-commit-time"):
+            self._original_persist.save()
+
+    def close(self):
+        """Release the resources of the store, there are none to release."""
 
     def set_accepted_types(self, types):
         """Specify the types of messages that the server will expect from us.
@@ -241,6 +273,14 @@ class MessageStore:
         """
         self._persist.set("server_api", server_api)
 
+    def get_accepted_encodings(self):
+        """Return the payload content encodings the server accepts."""
+        return self._persist.get("accepted_encodings", [])
+
+    def set_accepted_encodings(self, encodings):
+        """Change the payload content encodings the server accepts."""
+        self._persist.set("accepted_encodings", encodings)
+
     def get_exchange_token(self):
         """Get the authentication token to use for the next exchange."""
         return self._persist.get("exchange_token")
@@ -267,20 +307,55 @@ class MessageStore:
 
     def count_pending_messages(self):
         """Return the number of pending messages."""
-        return sum(1 for x in self._walk_pending_messages())
+        return max(0, self._deliverable - self.get_pending_offset())
 
     def get_pending_messages(self, max=None):
         """Get any pending messages that aren't being held, up to max."""
+        return [message for message, data in self._load_pending_messages(max)]
+
+    def get_serialized_pending_messages(self, max=None, max_bytes=None):
+        """Like L{get_pending_messages}, but return L{SerializedMessage}s.
+
+        These hold the messages as they're stored on disk, so that they can
+        go in an exchange payload without being encoded again.
+
+        @param max_bytes: Optionally, the most bytes the serialized messages
+            may add up to. The first message is returned whatever its size.
+        """
+        return [
+            SerializedMessage(data, message["type"], message["api"])
+            for message, data in self._load_pending_messages(
+                max,
+                max_bytes,
+                fields=("type", "api"),
+            )
+        ]
+
+    def _load_pending_messages(self, max, max_bytes=None, fields=None):
+        """
+        Yield C{(message, data)} pairs for the pending messages that aren't
+        being held, up to max, where C{data} is the serialized message.
+
+        @param fields: Optionally, the only keys of the messages to load,
+            the other values are skipped without being decoded.
+        """
         accepted_types = self.get_accepted_types()
         server_api = self.get_server_api()
-        messages = []
+        count = 0
+        size = 0
         for filename in self._walk_pending_messages():
-            if max is not None and len(messages) >= max:
+            if max is not None and count >= max:
                 break
-            data = read_binary_file(self._message_dir(filename))
+            data = self._read_message(filename)
             try:
                 # don't reinterpret messages that are meant to be sent out
-                message = bpickle.loads(data, as_is=True)
+                if fields is None:
+                    message = bpickle.loads(data, as_is=True)
+                else:
+                    message = bpickle.loads_fields(data, fields)
+                    if "type" not in message:
+                        # The keys of legacy messages are bytes, see below.
+                        message = bpickle.loads(data, as_is=True)
             except ValueError as e:
                 logging.exception(e)
                 self._add_flags(filename, BROKEN)
@@ -296,23 +371,22 @@ class MessageStore:
                         for k, v in message.items()
                     }
                     message["type"] = message["type"].decode("ascii")
+                    data = bpickle.dumps(message)
 
                 unknown_type = message["type"] not in accepted_types
                 unknown_api = not is_version_higher(server_api, message["api"])
                 if unknown_type or unknown_api:
                     self._add_flags(filename, HELD)
                 else:
-                    messages.append(message)
-        return messages
+                    size += len(data)
+                    if max_bytes is not None and count and size > max_bytes:
+                        break
+                    count += 1
+                    yield message, data
 
     def get_messages_total_size(self):
         """Get total size of messages directory"""
-        sizes = []
-        for dirname in os.listdir(self._directory):
-            dirpath = os.path.join(self._directory, dirname)
-            dirsize = sum(file.stat().st_size for file in os.scandir(dirpath))
-            sizes.append(dirsize)
-        return sum(sizes)
+        return sum(directory[1] for directory in self._directories.values())
 
     def delete_messages_over_limit(self):
         """
@@ -320,8 +394,7 @@ class MessageStore:
         messages are queued up but not able to be sent
         """
 
-        cur_dirs = os.listdir(self._directory)
-        cur_dirs.sort(key=int)  # Since you could have 0, .., 9, 10
+        cur_dirs = list(self._directories)  # Sorted, as 0, .., 9, 10
         num_dirs = len(cur_dirs)
 
         num_dirs_to_delete = max(0, num_dirs - self._max_dirs)  # No negatives
@@ -336,6 +409,10 @@ class MessageStore:
                 logging.warning(traceback.format_exc())
                 logging.warning("Unable to delete message directory!")
                 logging.warning(dirpath)
+            else:
+                del self._directories[dirname]
+                for key in [key for key in self._index if key[0] == dirname]:
+                    self._remove_from_index(key)
 
         # Something is wrong if after deleting a bunch of files, we are still
         # using too much space. Rather then look around for big files, we just
@@ -348,20 +425,21 @@ class MessageStore:
 
     def delete_old_messages(self):
         """Delete messages which are unlikely to be needed in the future."""
-        for fn in itertools.islice(
-            self._walk_messages(exclude=HELD + BROKEN),
-            self.get_pending_offset(),
-        ):
-            os.unlink(fn)
-            containing_dir = os.path.split(fn)[0]
-            if not os.listdir(containing_dir):
-                os.rmdir(containing_dir)
+        filenames = list(
+            itertools.islice(
+                self._walk_messages(exclude=HELD + BROKEN),
+                self.get_pending_offset(),
+            ),
+        )
+        for fn in filenames:
+            self._delete_message(fn)
 
     def delete_all_messages(self):
         """Remove ALL stored messages."""
         self.set_pending_offset(0)
-        for filename in self._walk_messages():
+        for filename in list(self._walk_messages()):
             os.unlink(filename)
+            self._remove_from_index(self._index_key(filename))
 
     def add_schema(self, schema):
         """Add a schema to be applied to messages of the given type.
@@ -372,6 +450,7 @@ class MessageStore:
         api = schema.api if schema.api else self._api
         schemas = self._schemas.setdefault(schema.type, {})
         schemas[api] = schema
+        self._chosen_schemas.clear()
 
     def is_pending(self, message_id):
         """Return bool indicating if C{message_id} still hasn't been delivered.
@@ -382,9 +461,9 @@ class MessageStore:
         pending_offset = self.get_pending_offset()
         for filename in self._walk_messages(exclude=BROKEN):
             flags = self._get_flags(filename)
-            if (HELD in flags or i >= pending_offset) and os.stat(
-                filename,
-            ).st_ino == message_id:
+            if (
+                HELD in flags or i >= pending_offset
+            ) and self._get_message_id(filename) == message_id:
                 return True
             if BROKEN not in flags and HELD not in flags:
                 i += 1
@@ -431,60 +510,153 @@ class MessageStore:
             logging.debug("Dropped message, awaiting resync.")
             return
 
-        self.delete_messages_over_limit()
+        with health_stats.timed("store-add-time"):
+            self.delete_messages_over_limit()
 
-        server_api = self.get_server_api()
+            server_api = self.get_server_api()
 
-        if "api" not in message:
-            message["api"] = server_api
+            if "api" not in message:
+                message["api"] = server_api
 
-        # We apply the schema with the highest API version that is greater
-        # or equal to the API version the message is tagged with.
-        schemas = self._schemas[message["type"]]
-        for api in sort_versions(schemas.keys()):
-            if is_version_higher(server_api, api):
-                schema = schemas[api]
-                break
-        message = schema.coerce(message)
+            schema = self._get_schema(message["type"], server_api)
+            message = schema.coerce(message)
 
-        message_data = bpickle.dumps(message)
+            message_data = bpickle.dumps(message)
 
+            flags = "" if self.accepts(message["type"]) else HELD
+            filename = self._write_message(message_data, flags)
+        return self._get_message_id(filename)
+
+    def _get_schema(self, message_type, server_api):
+        """Return the schema to apply to a message of the given type.
+
+        It's the schema with the highest API version that is lower or
+        equal to the server API version, it's looked up once per type and
+        server API.
+        """
+        key = (message_type, server_api)
+        schema = self._chosen_schemas.get(key)
+        if schema is None:
+            schemas = self._schemas[message_type]
+            for api in sort_versions(schemas.keys()):
+                if is_version_higher(server_api, api):
+                    schema = self._chosen_schemas[key] = schemas[api]
+                    break
+        return schema
+
+    def _write_message(self, data, flags):
+        """Write a new message with the given C{flags}, return its filename."""
         filename = self._get_next_message_filename()
         temp_path = filename + ".tmp"
-        create_binary_file(temp_path, message_data)
+        create_binary_file(temp_path, data)
         os.rename(temp_path, filename)
+        self._add_to_index(self._index_key(filename), "", len(data))
 
-        if not self.accepts(message["type"]):
-            filename = self._set_flags(filename, HELD)
+        if flags:
+            filename = self._set_flags(filename, flags)
+        return filename
+
+    def _read_message(self, filename):
+        """Return the serialized message stored in C{filename}."""
+        return read_binary_file(filename)
 
+    def _get_message_id(self, filename):
+        """Return the message id of the message in C{filename}."""
         # For now we use the inode as the message id, as it will work
         # correctly even faced with holding/unholding.  It will break
         # if the store is copied over for some reason, but this shouldn't
         # present an issue given the current uses.  In the future we
         # should have a nice transactional storage (e.g. sqlite) which
         # will offer a more strong primary key.
-        message_id = os.stat(filename).st_ino
-
-        return message_id
+        return os.stat(filename).st_ino
+
+    def _requeue_message(self, filename, flags):
+        """Move a message after all the others, setting its C{flags}."""
+        new_filename = self._get_next_message_filename()
+        os.rename(filename, new_filename)
+        key = self._index_key(filename)
+        size = self._index[key][1]
+        self._remove_from_index(key)
+        self._add_to_index(self._index_key(new_filename), "", size)
+        return self._set_flags(new_filename, flags)
+
+    def _delete_message(self, filename):
+        """Delete a message, and its directory if it's now empty."""
+        os.unlink(filename)
+        key = self._index_key(filename)
+        self._remove_from_index(key)
+        if not self._directories[key[0]][0]:
+            os.rmdir(os.path.split(filename)[0])
+            del self._directories[key[0]]
+
+    def _load_index(self):
+        """Index the messages in the store.
+
+        The index maps C{(directory, number)} keys to the C{[flags, size]}
+        of each message, in the order messages are delivered, and is kept
+        up to date as messages are added or changed. The C{_directories}
+        dict maps directory names to the C{[count, size, last]} of the
+        messages they hold, C{last} being the highest message number used,
+        and C{_deliverable} counts messages which are neither held nor
+        broken. This way adding a message or counting pending ones doesn't
+        require scanning the store.
+        """
+        self._index = {}
+        self._directories = {}
+        self._deliverable = 0
+        for message_dir in self._get_sorted_filenames():
+            self._directories[message_dir] = [0, 0, 0]
+            for filename in self._get_sorted_filenames(message_dir):
+                path = self._message_dir(message_dir, filename)
+                self._add_to_index(
+                    self._index_key(path),
+                    self._get_flags(path),
+                    os.path.getsize(path),
+                )
+
+    def _index_key(self, filename):
+        dirname, basename = os.path.split(filename)
+        return os.path.basename(dirname), basename.split("_")[0]
+
+    def _add_to_index(self, key, flags, size):
+        self._index[key] = [flags, size]
+        directory = self._directories.setdefault(key[0], [0, 0, 0])
+        directory[0] += 1
+        directory[1] += size
+        directory[2] = max(directory[2], int(key[1]))
+        self._deliverable += is_deliverable(flags)
+
+    def _set_index_flags(self, key, flags):
+        entry = self._index[key]
+        self._deliverable += is_deliverable(flags) - is_deliverable(entry[0])
+        entry[0] = flags
+
+    def _remove_from_index(self, key):
+        flags, size = self._index.pop(key)
+        directory = self._directories.get(key[0])
+        if directory is not None:
+            directory[0] -= 1
+            directory[1] -= size
+        self._deliverable -= is_deliverable(flags)
 
     def _get_next_message_filename(self):
-        message_dirs = self._get_sorted_filenames()
-        if message_dirs:
-            newest_dir = message_dirs[-1]
+        if self._directories:
+            newest_dir = next(reversed(self._directories))
         else:
             os.makedirs(self._message_dir("0"))
             newest_dir = "0"
+            self._directories[newest_dir] = [0, 0, 0]
 
-        message_filenames = self._get_sorted_filenames(newest_dir)
-        if not message_filenames:
+        count, size, last = self._directories[newest_dir]
+        if not count:
             filename = self._message_dir(newest_dir, "0")
-        elif len(message_filenames) < self._directory_size:
-            filename = str(int(message_filenames[-1].split("_")[0]) + 1)
-            filename = self._message_dir(newest_dir, filename)
+        elif count < self._directory_size:
+            filename = self._message_dir(newest_dir, str(last + 1))
         else:
-            newest_dir = self._message_dir(str(int(newest_dir) + 1))
-            os.makedirs(newest_dir)
-            filename = os.path.join(newest_dir, "0")
+            newest_dir = str(int(newest_dir) + 1)
+            os.makedirs(self._message_dir(newest_dir))
+            self._directories[newest_dir] = [0, 0, 0]
+            filename = self._message_dir(newest_dir, "0")
 
         return filename
 
@@ -498,14 +670,17 @@ class MessageStore:
                 yield filename
 
     def _walk_messages(self, exclude=None):
-        if exclude:
-            exclude = set(exclude)
-        message_dirs = self._get_sorted_filenames()
-        for message_dir in message_dirs:
-            for filename in self._get_sorted_filenames(message_dir):
-                flags = set(self._get_flags(filename))
-                if not exclude or not exclude & flags:
-                    yield self._message_dir(message_dir, filename)
+        """Walk the messages in the index, except those with C{exclude} flags.
+
+        Messages can have their flags changed while walking, but not be
+        added or removed.
+        """
+        exclude = set(exclude or ())
+        for (message_dir, number), (flags, size) in self._index.items():
+            if not exclude & set(flags):
+                if flags:
+                    number += "_" + flags
+                yield self._message_dir(message_dir, number)
 
     def _get_sorted_filenames(self, dir=""):
         message_files = [
@@ -527,10 +702,10 @@ class MessageStore:
         offset = 0
         pending_offset = self.get_pending_offset()
         accepted_types = self.get_accepted_types()
-        for old_filename in self._walk_messages():
+        for old_filename in list(self._walk_messages()):
             flags = self._get_flags(old_filename)
             try:
-                message = bpickle.loads(read_binary_file(old_filename))
+                message = bpickle.loads(self._read_message(old_filename))
             except ValueError as e:
                 logging.exception(e)
                 if HELD not in flags:
@@ -539,9 +714,10 @@ class MessageStore:
                 accepted = message["type"] in accepted_types
                 if HELD in flags:
                     if accepted:
-                        new_filename = self._get_next_message_filename()
-                        os.rename(old_filename, new_filename)
-                        self._set_flags(new_filename, set(flags) - set(HELD))
+                        self._requeue_message(
+                            old_filename,
+                            set(flags) - set(HELD),
+                        )
                 else:
                     if not accepted and offset >= pending_offset:
                         self._set_flags(old_filename, set(flags) | set(HELD))
@@ -559,6 +735,7 @@ class MessageStore:
         if flags:
             new_path += "_" + "".join(sorted(set(flags)))
         os.rename(path, new_path)
+        self._set_index_flags(self._index_key(path), self._get_flags(new_path))
         return new_path
 
     def _add_flags(self, path, flags):
@@ -608,13 +785,388 @@ class MessageStore:
         self._persist.set("session-ids", new_session_ids)
 
 
-def get_default_message_store(*args, **kwargs):
+class JournalMessageStore(MessageStore):
+    """A L{MessageStore} which appends messages to journal segment files.
+
+    Instead of one file per message, messages are appended to numbered
+    segment files holding up to C{directory_size} messages each, which are
+    indexed in memory when the store is created. Each record in a segment
+    is a header with the message id and the data length, followed by the
+    serialized message. The flags of each record are kept in a side file,
+    one byte per record, so holding or deleting a message never rewrites
+    a segment, and a segment file is removed once all its messages are.
+
+    Records are synced to disk every C{sync_interval} messages, and when
+    the store is committed. A record that was only partly written, for
+    example because of a power loss, is discarded when loading the store.
+
+    The C{max_dirs} limit applies to the number of segments.
+    """
+
+    backend = "journal"
+    _header = struct.Struct("<QI")
+
+    def __init__(
+        self,
+        persist,
+        directory,
+        directory_size=1000,
+        max_dirs=4,
+        max_size_mb=400,
+        sync_interval=100,
+    ):
+        self._sync_interval = sync_interval
+        self._unsynced = 0
+        self._closed = False
+        super().__init__(
+            persist,
+            directory,
+            directory_size,
+            max_dirs,
+            max_size_mb,
+        )
+
+    def add(self, message):
+        """Queue a message for delivery, see L{MessageStore.add}.
+
+        @raise ValueError: If the store is closed.
+        """
+        self._check_open()
+        return super().add(message)
+
+    def commit(self):
+        """Persist metadata and sync appended messages to disk.
+
+        @raise ValueError: If the store is closed.
+        """
+        self._check_open()
+        with health_stats.timed("store-sync-time"):
+            self._sync()
+        super().commit()
+
+    def close(self):
+        """Close all the segment files, the store can't be used anymore."""
+        if self._closed:
+            return
+        self._sync()
+        for segment in self._segments:
+            segment.close()
+        self._closed = True
+
+    def _check_open(self):
+        if self._closed:
+            raise ValueError("The message store is closed.")
+
+    def get_messages_total_size(self):
+        """Get total size of the journal segments."""
+        return sum(segment.size for segment in self._segments)
+
+    def delete_messages_over_limit(self):
+        """
+        Delete the oldest segments if there's more than the maximum, which
+        happens if messages are queued up but not able to be sent.
+        """
+        while len(self._segments) > self._max_dirs:
+            segment = self._segments[0]
+            logging.debug(f"Trimming message store: {segment.path}")
+            try:
+                segment.remove()
+            except Exception:  # We want to continue like normal if any error
+                logging.warning(traceback.format_exc())
+                logging.warning("Unable to delete message segment!")
+                logging.warning(segment.path)
+                break
+            del self._segments[0]
+            records = {}
+            for record in self._records:
+                if record.segment is segment:
+                    self._deliverable -= is_deliverable(record.flags)
+                else:
+                    records[record] = None
+            self._records = records
+
+        num_mb = self.get_messages_total_size() / 1e6
+        if num_mb > self._max_size_mb:
+            logging.warning("Messages too large! Clearing all messages!")
+            self.delete_all_messages()
+
+    def delete_old_messages(self):
+        """Delete messages which are unlikely to be needed in the future."""
+        self._delete_records(
+            itertools.islice(
+                self._walk_messages(exclude=HELD + BROKEN),
+                self.get_pending_offset(),
+            ),
+        )
+
+    def delete_all_messages(self):
+        """Remove ALL stored messages."""
+        self.set_pending_offset(0)
+        for segment in self._segments:
+            segment.remove()
+        self._segments = []
+        self._records = {}
+        self._deliverable = 0
+
+    def _load_index(self):
+        """Index the records of all the segments in the store."""
+        self._segments = []
+        # The records of all messages, in order. It's a dict used as an
+        # ordered set, so that deleting a record doesn't scan the others.
+        self._records = {}
+        self._deliverable = 0
+        numbers = sorted(
+            int(name[: -len(".journal")])
+            for name in os.listdir(self._directory)
+            if name.endswith(".journal")
+        )
+        next_id = self._persist.get("next-message-id", 0)
+        records_by_id = {}
+        for number in numbers:
+            segment = self._open_segment(number)
+            for record in self._load_segment(segment):
+                next_id = max(next_id, record.id + 1)
+                if record.flags is None:
+                    continue
+                if record.id in records_by_id:
+                    # The message got moved to the end of the store, but we
+                    # didn't get to delete the original record.
+                    self._delete_records([records_by_id[record.id]])
+                records_by_id[record.id] = record
+                self._records[record] = None
+                self._deliverable += is_deliverable(record.flags)
+        for segment in self._segments[:-1]:
+            if not segment.live:
+                segment.remove()
+                self._segments.remove(segment)
+        self._next_id = next_id
+
+    def _load_segment(self, segment):
+        """
+        Yield the records in C{segment}, deleted records have C{None} flags.
+        """
+        size = os.fstat(segment.fd).st_size
+        flags_size = os.fstat(segment.flags_fd).st_size
+        flags = os.pread(segment.flags_fd, flags_size, 0)
+        with open(segment.path, "rb") as fd:
+            while segment.size < size:
+                header = fd.read(self._header.size)
+                offset = segment.size + len(header)
+                if len(header) == self._header.size:
+                    message_id, length = self._header.unpack(header)
+                if len(header) < self._header.size or offset + length > size:
+                    logging.warning(
+                        "Discarding partly written message in "
+                        f"{segment.path}.",
+                    )
+                    os.ftruncate(segment.fd, segment.size)
+                    return
+                fd.seek(length, os.SEEK_CUR)
+
+                record = _JournalRecord(
+                    message_id,
+                    segment,
+                    segment.records,
+                    offset,
+                    length,
+                )
+                bits = 0
+                if record.index < len(flags):
+                    bits = flags[record.index]
+                if bits & JOURNAL_DELETED:
+                    record.flags = None
+                else:
+                    record.flags = "".join(
+                        flag
+                        for flag, bit in sorted(JOURNAL_FLAGS.items())
+                        if bits & bit
+                    )
+                    segment.live += 1
+                segment.records += 1
+                segment.size = offset + length
+                yield record
+
+    def _open_segment(self, number):
+        segment = _JournalSegment(
+            os.path.join(self._directory, f"{number:d}.journal"),
+            number,
+        )
+        self._segments.append(segment)
+        return segment
+
+    def _sync(self):
+        for segment in self._segments:
+            segment.sync()
+        self._unsynced = 0
+
+    def _append(self, message_id, data, flags):
+        """Append a record to the newest segment, return it."""
+        segment = self._segments[-1] if self._segments else None
+        if segment is None or segment.records >= self._directory_size:
+            number = segment.number + 1 if segment else 0
+            segment = self._open_segment(number)
+        header = self._header.pack(message_id, len(data))
+        segment.write(header + data)
+        record = _JournalRecord(
+            message_id,
+            segment,
+            segment.records - 1,
+            segment.size - len(data),
+            len(data),
+        )
+        segment.live += 1
+        self._records[record] = None
+        self._deliverable += 1
+        if flags:
+            self._set_flags(record, flags)
+
+        self._unsynced += 1
+        if self._unsynced >= self._sync_interval:
+            self._sync()
+        return record
+
+    def _delete_records(self, records):
+        """Flag C{records} as deleted, and remove the segments left empty."""
+        records = set(records)
+        if not records:
+            return
+        for record in records:
+            record.segment.set_flags(record.index, JOURNAL_DELETED)
+            record.segment.live -= 1
+            self._deliverable -= is_deliverable(record.flags)
+            del self._records[record]
+        for segment in {record.segment for record in records}:
+            if not segment.live and segment is not self._segments[-1]:
+                segment.remove()
+                self._segments.remove(segment)
+
+    def _write_message(self, data, flags):
+        record = self._append(self._next_id, data, flags)
+        self._next_id += 1
+        self._persist.set("next-message-id", self._next_id)
+        return record
+
+    def _read_message(self, record):
+        return os.pread(record.segment.fd, record.length, record.offset)
+
+    def _get_message_id(self, record):
+        return record.id
+
+    def _requeue_message(self, record, flags):
+        # The record is copied before the original one gets deleted, so that
+        # the message isn't lost if we stop half way: the copy wins when
+        # loading the store.
+        data = self._read_message(record)
+        new_record = self._append(record.id, data, flags)
+        self._delete_records([record])
+        return new_record
+
+    def _delete_message(self, record):
+        self._delete_records([record])
+
+    def _walk_messages(self, exclude=None):
+        exclude = set(exclude or ())
+        for record in self._records:
+            if not exclude & set(record.flags):
+                yield record
+
+    def _get_flags(self, record):
+        return record.flags
+
+    def _set_flags(self, record, flags):
+        flags = "".join(sorted(set(flags)))
+        self._deliverable += is_deliverable(flags)
+        self._deliverable -= is_deliverable(record.flags)
+        record.flags = flags
+        bits = 0
+        for flag in record.flags:
+            bits |= JOURNAL_FLAGS[flag]
+        record.segment.set_flags(record.index, bits)
+        return record
+
+
+class _JournalSegment:
+    """A journal segment file, along with its flags file."""
+
+    def __init__(self, path, number):
+        self.path = path
+        self.number = number
+        flags = os.O_RDWR | os.O_CREAT | os.O_CLOEXEC
+        self.fd = os.open(path, flags, 0o666)
+        self.flags_fd = os.open(path + ".flags", flags, 0o666)
+        self.records = 0  # Including deleted ones.
+        self.live = 0
+        self.size = 0
+        self._dirty = False
+
+    def write(self, data):
+        """Append a record to the segment."""
+        if os.pwrite(self.fd, data, self.size) != len(data):
+            raise OSError(f"Short write to {self.path}")
+        self.size += len(data)
+        self.records += 1
+        self._dirty = True
+
+    def set_flags(self, index, bits):
+        os.pwrite(self.flags_fd, bytes([bits]), index)
+        self._dirty = True
+
+    def sync(self):
+        if self._dirty:
+            os.fsync(self.fd)
+            os.fsync(self.flags_fd)
+            self._dirty = False
+
+    def close(self):
+        os.close(self.fd)
+        os.close(self.flags_fd)
+        # Fail if used again, rather than use descriptors reused by others.
+        self.fd = self.flags_fd = -1
+
+    def remove(self):
+        for path in (self.path, self.path + ".flags"):
+            if os.path.exists(path):
+                os.unlink(path)
+        self.close()
+
+
+class _JournalRecord:
+    """The location of a message in the journal, and its flags."""
+
+    __slots__ = ("id", "segment", "index", "offset", "length", "flags")
+
+    def __init__(self, message_id, segment, index, offset, length):
+        self.id = message_id
+        self.segment = segment
+        self.index = index
+        self.offset = offset
+        self.length = length
+        self.flags = ""
+
+
+class SerializedMessage(bpickle.Serialized):
+    """A message from the store, serialized with L{bpickle}.
+
+    @ivar type: the type of the message.
+    @ivar api: the server API the message was tagged with.
+    """
+
+    def __new__(cls, data, type, api):
+        message = super().__new__(cls, data)
+        message.type = type
+        message.api = api
+        return message
+
+
+def get_default_message_store(*args, store_class=MessageStore, **kwargs):
     """
     Get a L{MessageStore} object with all Landscape message schemas added.
+
+    @param store_class: The L{MessageStore} class to use.
     """
     from landscape.message_schemas.server_bound import message_schemas
 
-    store = MessageStore(*args, **kwargs)
+    store = store_class(*args, **kwargs)
     for schema in message_schemas:
         store.add_schema(schema)
     return store
@@ -821,6 +821,53 @@ class MessageExchangeTest(LandscapeTest):
         exchanger.exchange()
         self.assertEqual(self.transport.payloads[0]["total-messages"], 2)
 
+    def test_backlog_exchanges_follow_right_away(self):
+        """
+        If messages remain after an exchange whose messages were all taken
+        by the server, the next exchange follows right away, without an
+        C{impending-exchange} event.
+        """
+        exchanger = MessageExchange(
+            self.reactor,
+            self.mstore,
+            self.transport,
+            self.identity,
+            self.exchange_store,
+            self.config,
+            max_messages=1,
+        )
+        events = []
+        self.reactor.call_on("impending-exchange", lambda: events.append(True))
+        self.mstore.set_accepted_types(["empty"])
+        self.mstore.add({"type": "empty"})
+        self.mstore.add({"type": "empty"})
+        exchanger.exchange()
+        self.assertEqual(len(self.transport.payloads[0]["messages"]), 1)
+        self.reactor.advance(exchanger.backlog_exchange_interval)
+        self.assertEqual(len(self.transport.payloads), 2)
+        self.assertEqual(len(self.transport.payloads[1]["messages"]), 1)
+        self.assertEqual(events, [])
+        # Once the backlog is delivered, exchanges are back to normal.
+        self.wait_for_exchange(urgent=True)
+        self.assertEqual(len(self.transport.payloads), 2)
+
+    def test_payload_byte_budget(self):
+        """
+        The messages of a payload are limited to the byte budget of the
+        exchanger, which is halved when an exchange fails.
+        """
+        self.mstore.set_accepted_types(["data"])
+        for i in range(3):
+            self.mstore.add({"type": "data", "data": i})
+        [message] = self.mstore.get_serialized_pending_messages(1)
+        self.exchanger._batch.max_bytes = len(message) * 2
+        self.exchanger._batch._min_bytes = 1
+        self.transport.responses.append(PyCurlError(28, "Timed out"))
+        self.exchanger.exchange()
+        self.assertEqual(len(self.transport.payloads[0]["messages"]), 2)
+        self.exchanger.exchange()
+        self.assertEqual(len(self.transport.payloads[1]["messages"]), 1)
+
     def test_impending_exchange(self):
         """
         A reactor event is emitted shortly (10 seconds) before an exchange
@@ -1076,6 +1123,30 @@ class MessageExchangeTest(LandscapeTest):
         self.exchanger.exchange()
         self.assertEqual(b"3.3", self.mstore.get_server_api())
 
+    def test_accepted_encodings(self):
+        """
+        The content encodings the server says it accepts are stored, and
+        passed to the transport at the next exchange.
+        """
+        self.transport.extra["accepted-encodings"] = [b"zstd", b"gzip"]
+        self.exchanger.exchange()
+        self.assertEqual(self.transport.accepted_encodings, [])
+        self.assertEqual(
+            ["zstd", "gzip"],
+            self.mstore.get_accepted_encodings(),
+        )
+        self.exchanger.exchange()
+        self.assertEqual(self.transport.accepted_encodings, ["zstd", "gzip"])
+
+    def test_accepted_encodings_with_old_server(self):
+        """
+        If a server doesn't say which content encodings it accepts, the
+        payloads are sent uncompressed.
+        """
+        self.mstore.set_accepted_encodings(["gzip"])
+        self.exchanger.exchange()
+        self.assertEqual([], self.mstore.get_accepted_encodings())
+
     def test_server_uuid_is_stored_on_message_store(self):
         self.transport.extra["server-uuid"] = b"first-uuid"
         self.exchanger.exchange()
@@ -1321,6 +1392,18 @@ class MessageExchangeTest(LandscapeTest):
         self.exchanger.exchange()
         self.assertEqual(b"3.2", self.mstore.get_server_api())
 
+    def test_exchange_error_with_415_sends_uncompressed_payload(self):
+        """
+        If we get a 415, the server doesn't accept the content encoding of
+        the payload, so we exchange again without compressing it.
+        """
+        self.mstore.set_accepted_encodings(["gzip"])
+        self.transport.responses.append(HTTPCodeError(415, ""))
+        self.exchanger.exchange()
+        self.assertEqual([], self.mstore.get_accepted_encodings())
+        self.assertEqual(len(self.transport.payloads), 2)
+        self.assertEqual(self.transport.accepted_encodings, [])
+
     def test_500_backoff(self):
         """
         If we get a server error then the exponential backoff is triggered
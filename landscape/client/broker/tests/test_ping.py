@@ -5,6 +5,7 @@ from landscape.client.broker.ping import Pinger
 from landscape.client.broker.tests.helpers import ExchangeHelper
 from landscape.client.tests.helpers import LandscapeTest
 from landscape.lib import bpickle
+from landscape.lib.fetch import CurlHandle
 from landscape.lib.fetch import fetch
 from landscape.lib.testing import FakeReactor
 
@@ -15,8 +16,17 @@ class FakePageGetter:
     def __init__(self, response):
         self.response = response
         self.fetches = []
-
-    def get_page(self, url, post, headers, data, cainfo=None):
+        self.handles = []
+
+    def get_page(
+        self,
+        url,
+        post,
+        headers,
+        data,
+        cainfo=None,
+        handle=None,
+    ):
         """
         A method which is supposed to act like a limited version of
         L{landscape.lib.fetch.fetch}.
@@ -25,9 +35,18 @@ class FakePageGetter:
         data.
         """
         self.fetches.append((url, post, headers, data))
+        self.handles.append(handle)
         return bpickle.dumps(self.response)
 
-    def failing_get_page(self, url, post, headers, data, cainfo=None):
+    def failing_get_page(
+        self,
+        url,
+        post,
+        headers,
+        data,
+        cainfo=None,
+        handle=None,
+    ):
         """
         A method which is supposed to act like a limited version of
         L{landscape.lib.fetch.fetch}.
@@ -73,6 +92,18 @@ class PingClientTest(LandscapeTest):
             ],
         )
 
+    def test_ping_reuses_curl_handle(self):
+        """
+        The pings of a L{PingClient} are made with the same L{CurlHandle},
+        so that they reuse the connection to the ping server.
+        """
+        client = FakePageGetter(None)
+        pinger = PingClient(self.reactor, get_page=client.get_page)
+        pinger.ping("http://localhost/ping", 10)
+        pinger.ping("http://localhost/ping", 10)
+        self.assertIsInstance(client.handles[0], CurlHandle)
+        self.assertIs(client.handles[0], client.handles[1])
+
     def test_ping_no_insecure_id(self):
         """
         If a L{PingClient} does not have an insecure-id yet, then the ping
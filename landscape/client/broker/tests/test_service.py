@@ -3,9 +3,11 @@ from unittest.mock import Mock
 
 from landscape.client.broker.amp import RemoteBrokerConnector
 from landscape.client.broker.service import BrokerService
+from landscape.client.broker.store import JournalMessageStore
 from landscape.client.broker.tests.helpers import BrokerConfigurationHelper
 from landscape.client.broker.transport import HTTPTransport
 from landscape.client.tests.helpers import LandscapeTest
+from landscape.lib.monitor import health_stats
 from landscape.lib.testing import FakeReactor
 
 
@@ -37,12 +39,32 @@ class BrokerServiceTest(LandscapeTest):
         self.assertTrue(isinstance(self.service.transport, HTTPTransport))
         self.assertEqual(self.service.transport.get_url(), self.config.url)
 
+    def test_transport_http2(self):
+        """
+        The C{transport} negotiates HTTP/2 if the C{http2} option is set.
+        """
+        self.assertFalse(self.service.transport._curl_handle._http2)
+        self.config.http2 = True
+        service = BrokerService(self.config)
+        self.assertTrue(service.transport._curl_handle._http2)
+
     def test_message_store(self):
         """
         A L{BrokerService} instance has a proper C{message_store} attribute.
         """
         self.assertEqual(self.service.message_store.get_accepted_types(), ())
 
+    def test_message_store_journal(self):
+        """
+        The message store is a L{JournalMessageStore} if the
+        C{message_store_journal} option is set.
+        """
+        self.config.message_store_journal = True
+        service = BrokerService(self.config)
+        self.assertIsInstance(service.message_store, JournalMessageStore)
+        self.assertTrue(os.path.isdir(self.config.message_journal_path))
+        service.message_store.close()
+
     def test_identity(self):
         """
         A L{BrokerService} instance has a proper C{identity} attribute.
@@ -87,3 +109,50 @@ class BrokerServiceTest(LandscapeTest):
         self.service.exchanger.start.assert_called_with()
         self.service.pinger.start.assert_called_with()
         self.service.exchanger.stop.assert_called_with()
+
+    def test_stop_closes_message_store(self):
+        """
+        The L{BrokerService.stopService} method closes the message store.
+        """
+        self.service.message_store.close = Mock()
+        self.service.exchanger.start = Mock()
+        self.service.pinger.start = Mock()
+        self.service.startService()
+        self.service.stopService()
+        self.service.message_store.close.assert_called_once_with()
+
+    def test_send_health(self):
+        """
+        The health statistics of the broker are queued every
+        C{client_health_interval} seconds, if the server accepts them, and
+        reset once queued.
+        """
+        health_stats.record("exchange-time", 3)
+        self.config.client_health_interval = 60
+        self.service.message_store.set_accepted_types(["client-health"])
+        self.service.exchanger.start = Mock()
+        self.service.pinger.start = Mock()
+        self.service.startService()
+        self.addCleanup(self.service.stopService)
+
+        self.service.reactor.advance(60)
+        [message] = self.service.message_store.get_pending_messages()
+        self.assertEqual(message["type"], "client-health")
+        self.assertEqual(message["component"], "broker")
+        self.assertIn("exchange-time", message["histograms"])
+        self.assertEqual(health_stats.get_summary()["histograms"], {})
+
+    def test_stop_cancels_send_health(self):
+        """
+        The L{BrokerService.stopService} method stops sending the health
+        statistics.
+        """
+        self.config.client_health_interval = 60
+        self.service.message_store.set_accepted_types(["client-health"])
+        self.service.exchanger.start = Mock()
+        self.service.pinger.start = Mock()
+        self.service.startService()
+        self.service.stopService()
+
+        self.service.reactor.advance(60)
+        self.assertEqual(self.service.message_store.get_pending_messages(), [])
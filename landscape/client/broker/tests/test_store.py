@@ -3,9 +3,13 @@ from unittest import mock
 
 from twisted.python.compat import intToBytes
 
+from landscape.client.broker.store import JournalMessageStore
 from landscape.client.broker.store import MessageStore
+from landscape.client.broker.store import SerializedMessage
 from landscape.client.tests.helpers import LandscapeTest
 from landscape.lib.bpickle import dumps
+from landscape.lib.bpickle import loads
+from landscape.lib.monitor import health_stats
 from landscape.lib.persist import Persist
 from landscape.lib.schema import Bytes
 from landscape.lib.schema import Int
@@ -32,6 +36,14 @@ class MessageStoreTest(LandscapeTest):
         store.add_schema(Message("resynchronize", {}))
         return store
 
+    def break_first_message(self):
+        """Overwrite the first stored message with garbage."""
+        filename = os.path.join(self.temp_dir, "0", "0")
+        self.assertTrue(os.path.isfile(filename))
+
+        with open(filename, "w") as fh:
+            fh.write("bpickle will break reading this")
+
     def test_get_set_sequence(self):
         self.assertEqual(self.store.get_sequence(), 0)
         self.store.set_sequence(3)
@@ -42,6 +54,15 @@ class MessageStoreTest(LandscapeTest):
         store = self.create_store()
         self.assertEqual(store.get_sequence(), 3)
 
+    def test_health_stats(self):
+        """The time taken by adding messages and committing is recorded."""
+        health_stats.reset()
+        self.store.add({"type": "data", "data": b"A thing"})
+        self.store.commit()
+        histograms = health_stats.get_summary()["histograms"]
+        self.assertEqual(histograms["store-add-time"]["count"], 1)
+        self.assertEqual(histograms["store-commit-time"]["count"], 1)
+
     def test_get_set_server_sequence(self):
         self.assertEqual(self.store.get_server_sequence(), 0)
         self.store.set_server_sequence(3)
@@ -103,6 +124,45 @@ class MessageStoreTest(LandscapeTest):
         self.store.add_pending_offset(-3)
         self.assertEqual(self.store.get_pending_offset(), 3)
 
+    def test_no_directory_scans(self):
+        """
+        Adding messages, counting them and building payloads only use the
+        in-memory index of the store, not the file system.
+        """
+        self.store.add({"type": "data", "data": b"first"})
+        with mock.patch("os.listdir") as listdir, mock.patch(
+            "os.scandir",
+        ) as scandir:
+            for i in range(45):
+                self.store.add({"type": "data", "data": intToBytes(i)})
+            self.store.add({"type": "unaccepted", "data": b"held"})
+            self.assertEqual(46, self.store.count_pending_messages())
+            self.store.set_pending_offset(10)
+            self.assertEqual(36, self.store.count_pending_messages())
+            self.assertEqual(5, len(self.store.get_pending_messages(5)))
+            self.assertNotEqual(0, self.store.get_messages_total_size())
+            self.store.delete_old_messages()
+        listdir.assert_not_called()
+        scandir.assert_not_called()
+
+    def test_index_loaded(self):
+        """The index is rebuilt from what's on disk when loading a store."""
+        for i in range(30):
+            self.store.add({"type": "data", "data": intToBytes(i)})
+        self.store.add({"type": "unaccepted", "data": b"held"})
+        self.store.get_pending_messages()
+        self.store.set_pending_offset(3)
+        self.store.commit()
+        size = self.store.get_messages_total_size()
+
+        store = self.create_store()
+        self.assertEqual(27, store.count_pending_messages())
+        self.assertEqual(size, store.get_messages_total_size())
+        self.assertEqual(
+            [intToBytes(i) for i in range(3, 30)],
+            [message["data"] for message in store.get_pending_messages()],
+        )
+
     def test_no_pending_messages(self):
         self.assertEqual(self.store.get_pending_messages(1), [])
 
@@ -322,11 +382,7 @@ class MessageStoreTest(LandscapeTest):
         self.store.add({"type": "empty"})
         self.store.add({"type": "empty2"})
 
-        filename = os.path.join(self.temp_dir, "0", "0")
-        self.assertTrue(os.path.isfile(filename))
-
-        with open(filename, "w") as fh:
-            fh.write("bpickle will break reading this")
+        self.break_first_message()
 
         self.assertEqual(self.store.get_pending_messages(), [])
 
@@ -354,11 +410,7 @@ class MessageStoreTest(LandscapeTest):
         self.store.add({"type": "data", "data": b"1"})
         self.store.add({"type": "data", "data": b"2"})
 
-        filename = os.path.join(self.temp_dir, "0", "0")
-        self.assertTrue(os.path.isfile(filename))
-
-        with open(filename, "w") as fh:
-            fh.write("bpickle will break reading this")
+        self.break_first_message()
 
         messages = self.store.get_pending_messages()
 
@@ -414,6 +466,19 @@ class MessageStoreTest(LandscapeTest):
         self.store.set_server_api(b"3.3")
         self.assertEqual(b"3.3", self.store.get_server_api())
 
+    def test_get_accepted_encodings_default(self):
+        """
+        By default the server isn't known to accept compressed payloads.
+        """
+        self.assertEqual([], self.store.get_accepted_encodings())
+
+    def test_set_accepted_encodings(self):
+        """
+        It's possible to change the content encodings accepted by the server.
+        """
+        self.store.set_accepted_encodings(["gzip"])
+        self.assertEqual(["gzip"], self.store.get_accepted_encodings())
+
     def test_default_api_on_messages(self):
         """
         By default messages are tagged with the 3.2 server API.
@@ -514,6 +579,31 @@ class MessageStoreTest(LandscapeTest):
             [{"type": "data", "api": b"3.2", "data": b"foo"}],
         )
 
+    def test_message_schema_follows_server_api(self):
+        """
+        The schema applied to a type of message is picked again when the
+        server API changes, or when a new schema is added.
+        """
+        self.store.set_server_api(b"3.2")
+        self.store.add({"type": "data", "data": b"foo"})
+        self.store.add_schema(Message("data", {"data": Int()}, api=b"3.3"))
+        self.store.add({"type": "data", "data": b"bar"})
+        self.store.set_server_api(b"3.3")
+        self.store.add({"type": "data", "data": 123})
+        self.assertRaises(
+            InvalidError,
+            self.store.add,
+            {"type": "data", "data": b"baz"},
+        )
+        self.assertEqual(
+            self.store.get_pending_messages(),
+            [
+                {"type": "data", "api": b"3.2", "data": b"foo"},
+                {"type": "data", "api": b"3.2", "data": b"bar"},
+                {"type": "data", "api": b"3.3", "data": 123},
+            ],
+        )
+
     def test_count_pending_messages(self):
         """It is possible to get the total number of pending messages."""
         self.assertEqual(self.store.count_pending_messages(), 0)
@@ -549,11 +639,7 @@ class MessageStoreTest(LandscapeTest):
         # For the same reason we break the first message.
         self.store.add({"type": "empty"})
 
-        filename = os.path.join(self.temp_dir, "0", "0")
-        self.assertTrue(os.path.isfile(filename))
-
-        with open(filename, "w") as fh:
-            fh.write("bpickle will break reading this")
+        self.break_first_message()
 
         # And hold the second one.
         self.store.add({"type": "data", "data": b"A thing"})
@@ -591,11 +677,7 @@ class MessageStoreTest(LandscapeTest):
 
         id = self.store.add({"type": "empty"})
 
-        filename = os.path.join(self.temp_dir, "0", "0")
-        self.assertTrue(os.path.isfile(filename))
-
-        with open(filename, "w") as fh:
-            fh.write("bpickle will break reading this")
+        self.break_first_message()
 
         self.assertEqual(self.store.get_pending_messages(), [])
 
@@ -752,6 +834,8 @@ class MessageStoreTest(LandscapeTest):
             fh.write(
                 dumps({b"type": b"data", b"data": b"A thing", b"api": b"3.2"}),
             )
+        # The message was there before the store was loaded.
+        self.store._load_index()
         [message] = self.store.get_pending_messages()
         # message keys are decoded
         self.assertIn("type", message)
@@ -759,3 +843,322 @@ class MessageStoreTest(LandscapeTest):
         self.assertIsInstance(message["api"], bytes)  # api is bytes
         self.assertEqual("data", message["type"])  # message type is decoded
         self.assertEqual(b"A thing", message["data"])  # other are kept as-is
+
+    def test_get_serialized_pending_messages(self):
+        """
+        Serialized pending messages hold the message data as stored, along
+        with their type and API.
+        """
+        self.store.add(dict(type="data", data=b"A thing"))
+        self.store.add(dict(type="unaccepted", data=b"Held"))
+        self.store.add(dict(type="empty"))
+        [first, second] = self.store.get_serialized_pending_messages()
+        self.assertIsInstance(first, SerializedMessage)
+        self.assertEqual(
+            dumps({"type": "data", "data": b"A thing", "api": b"3.2"}),
+            first,
+        )
+        self.assertEqual("data", first.type)
+        self.assertEqual(b"3.2", first.api)
+        self.assertEqual("empty", second.type)
+        self.assertEqual(1, len(self.store.get_serialized_pending_messages(1)))
+
+    def test_get_serialized_pending_messages_not_decoded(self):
+        """
+        Only the type and API of serialized pending messages are loaded,
+        the messages aren't decoded whole.
+        """
+        self.store.add(dict(type="data", data=b"A thing"))
+        with mock.patch("landscape.lib.bpickle.loads") as loads_mock:
+            [message] = self.store.get_serialized_pending_messages()
+        loads_mock.assert_not_called()
+        self.assertEqual("data", message.type)
+
+    def test_get_serialized_pending_messages_max_bytes(self):
+        """
+        Serialized pending messages can be limited to a number of bytes,
+        but the first message is always returned.
+        """
+        self.store.add(dict(type="data", data=b"x" * 100))
+        self.store.add(dict(type="data", data=b"y" * 100))
+        self.store.add(dict(type="empty"))
+        [first] = self.store.get_serialized_pending_messages(max_bytes=10)
+        self.assertEqual(b"x" * 100, loads(first)["data"])
+        messages = self.store.get_serialized_pending_messages(
+            max_bytes=len(first) * 2,
+        )
+        self.assertEqual(2, len(messages))
+        messages = self.store.get_serialized_pending_messages(
+            max_bytes=len(first) * 3,
+        )
+        self.assertEqual(3, len(messages))
+
+    def test_wb_get_serialized_pending_legacy_messages(self):
+        """Pending messages queued by legacy py27 are serialized again."""
+        filename = os.path.join(self.temp_dir, "0", "0")
+        os.makedirs(os.path.dirname(filename))
+        with open(filename, "wb") as fh:
+            fh.write(
+                dumps({b"type": b"data", b"data": b"A thing", b"api": b"3.2"}),
+            )
+        # The message was there before the store was loaded.
+        self.store._load_index()
+        [message] = self.store.get_serialized_pending_messages()
+        self.assertEqual(
+            dumps({"type": "data", "data": b"A thing", "api": b"3.2"}),
+            message,
+        )
+        self.assertEqual("data", message.type)
+
+
+class JournalMessageStoreTest(MessageStoreTest):
+    """Run the L{MessageStore} tests against the journal backend."""
+
+    def setUp(self):
+        self.stores = []
+        super().setUp()
+
+    def tearDown(self):
+        for store in self.stores:
+            store.close()
+        super().tearDown()
+
+    def create_store(self):
+        persist = Persist(filename=self.persist_filename)
+        store = JournalMessageStore(persist, self.temp_dir, 20)
+        self.stores.append(store)
+        store.set_accepted_types(["empty", "data", "resynchronize"])
+        store.add_schema(Message("empty", {}))
+        store.add_schema(Message("empty2", {}))
+        store.add_schema(Message("data", {"data": Bytes()}))
+        store.add_schema(Message("unaccepted", {"data": Bytes()}))
+        store.add_schema(Message("resynchronize", {}))
+        return store
+
+    def reload_store(self):
+        """Commit the store, and load it again from disk."""
+        self.store.commit()
+        persist = Persist(filename=self.persist_filename)
+        store = JournalMessageStore(persist, self.temp_dir, 20)
+        store._schemas = self.store._schemas
+        self.stores.append(store)
+        self.store = store
+        return store
+
+    def break_first_message(self):
+        """Overwrite the data of the first record with garbage."""
+        filename = os.path.join(self.temp_dir, "0.journal")
+        with open(filename, "r+b") as fh:
+            header = fh.read(12)
+            length = int.from_bytes(header[8:], "little")
+            fh.write((b"bpickle will break reading this" * length)[:length])
+
+    def test_closed(self):
+        """
+        Once closed, messages can't be added to the store nor committed, and
+        closing it again is fine.
+        """
+        self.store.add({"type": "data", "data": b"a"})
+        self.store.close()
+        self.assertRaises(
+            ValueError,
+            self.store.add,
+            {"type": "data", "data": b"b"},
+        )
+        self.assertRaises(ValueError, self.store.commit)
+        self.store.close()
+
+    def test_wb_clean_up_empty_directories(self):
+        """Segments are removed once all their messages are deleted."""
+        for i in range(60):
+            self.store.add(dict(type="data", data=intToBytes(i)))
+        self.assertEqual(
+            set(os.listdir(self.temp_dir)),
+            {
+                "0.journal",
+                "0.journal.flags",
+                "1.journal",
+                "1.journal.flags",
+                "2.journal",
+                "2.journal.flags",
+            },
+        )
+
+        self.store.set_pending_offset(60)
+        self.store.delete_old_messages()
+        # The newest segment is kept, to append the next messages to it.
+        self.assertEqual(
+            set(os.listdir(self.temp_dir)),
+            {"2.journal", "2.journal.flags"},
+        )
+
+    @mock.patch("os.unlink")
+    def test_exception_on_message_limit(self, unlink_mock):
+        """
+        If an exception occurs while deleting it shouldn't affect the next
+        message sent
+        """
+        unlink_mock.side_effect = IOError("Error!")
+        self.store._directory_size = 1
+        self.store._max_dirs = 1
+        self.store.add({"type": "data", "data": b"a"})
+        self.store.add({"type": "data", "data": b"b"})
+        self.store.add({"type": "data", "data": b"c"})
+        messages = self.store.get_pending_messages(200)
+
+        self.assertMessages(
+            messages,
+            [
+                {"type": "data", "data": b"a"},
+                {"type": "data", "data": b"b"},
+                {"type": "data", "data": b"c"},
+            ],
+        )
+
+    def test_atomic_message_writing(self):
+        """
+        If the server gets unplugged halfway through appending a message,
+        the partly written record is discarded when loading the store.
+        """
+        self.store.add_schema(Message("data", {"data": Int()}))
+        self.store.add({"type": "data", "data": 1})
+        self.store.commit()
+        filename = os.path.join(self.temp_dir, "0.journal")
+        with open(filename, "ab") as fh:
+            fh.write(b"\x01\x00\x00\x00\x00\x00\x00\x00\xff\x00\x00\x00d")
+
+        store = self.reload_store()
+        self.assertEqual(
+            store.get_pending_messages(),
+            [{"type": "data", "data": 1, "api": b"3.2"}],
+        )
+        self.assertIn(
+            "Discarding partly written message",
+            self.logfile.getvalue(),
+        )
+        store.add({"type": "data", "data": 2})
+        store = self.reload_store()
+        self.assertEqual(
+            [message["data"] for message in store.get_pending_messages()],
+            [1, 2],
+        )
+
+    def test_reload(self):
+        """
+        Messages, their flags and their ids are the same after loading the
+        store again.
+        """
+        held_id = self.store.add({"type": "unaccepted", "data": b"held"})
+        message_id = self.store.add({"type": "data", "data": b"A thing"})
+        store = self.reload_store()
+        self.assertEqual(
+            [message["data"] for message in store.get_pending_messages()],
+            [b"A thing"],
+        )
+        self.assertTrue(store.is_pending(held_id))
+        self.assertTrue(store.is_pending(message_id))
+        store.set_accepted_types(["data", "unaccepted"])
+
+        store = self.reload_store()
+        self.assertEqual(
+            [message["data"] for message in store.get_pending_messages()],
+            [b"A thing", b"held"],
+        )
+        self.assertTrue(store.is_pending(held_id))
+        self.assertNotIn(
+            store.add({"type": "data", "data": b"new"}),
+            (held_id, message_id),
+        )
+
+    def test_reload_after_interrupted_requeue(self):
+        """
+        If a message was copied to the end of the store but its original
+        record wasn't deleted, the copy is kept.
+        """
+        self.store.set_accepted_types(["data"])
+        self.store.add({"type": "unaccepted", "data": b"held"})
+        self.store.add({"type": "data", "data": b"A thing"})
+        with mock.patch.object(self.store, "_delete_records"):
+            self.store.set_accepted_types(["data", "unaccepted"])
+
+        store = self.reload_store()
+        self.assertEqual(
+            [message["data"] for message in store.get_pending_messages()],
+            [b"A thing", b"held"],
+        )
+
+    def test_switch_backend(self):
+        """
+        When the store switches to the other backend, its pending offset
+        is reset, and the sequence is kept.
+        """
+        persist = Persist(filename=self.persist_filename)
+        store = MessageStore(persist, self.makeDir())
+        store.set_accepted_types(["empty"])
+        store.add_schema(Message("empty", {}))
+        store.add({"type": "empty"})
+        store.add({"type": "empty"})
+        store.set_pending_offset(2)
+        store.set_sequence(2)
+        store.commit()
+
+        persist = Persist(filename=self.persist_filename)
+        store = JournalMessageStore(persist, self.temp_dir)
+        self.stores.append(store)
+        self.assertEqual(0, store.get_pending_offset())
+        self.assertEqual(2, store.get_sequence())
+        self.assertEqual(0, store.count_pending_messages())
+
+    def test_switch_backend_stale_messages(self):
+        """
+        The messages left in a backend the store is switched back to are
+        deleted, they were queued before an earlier switch.
+        """
+        self.store.add({"type": "empty"})
+        self.store.commit()
+        message_dir = self.makeDir()
+        persist = Persist(filename=self.persist_filename)
+        MessageStore(persist, message_dir).commit()
+
+        persist = Persist(filename=self.persist_filename)
+        store = JournalMessageStore(persist, self.temp_dir)
+        self.stores.append(store)
+        self.assertEqual(0, store.count_pending_messages())
+        self.assertEqual([], os.listdir(self.temp_dir))
+
+    def test_batched_sync(self):
+        """Segments are synced every C{sync_interval} messages."""
+        self.store._sync_interval = 3
+        with mock.patch("os.fsync") as fsync_mock:
+            self.store.add({"type": "empty"})
+            self.store.add({"type": "empty"})
+            self.assertEqual(fsync_mock.call_count, 0)
+            self.store.add({"type": "empty"})
+            self.assertEqual(fsync_mock.call_count, 2)
+            self.store.commit()
+            self.assertEqual(fsync_mock.call_count, 2)
+            self.store.add({"type": "empty"})
+            self.store.commit()
+            self.assertEqual(fsync_mock.call_count, 4)
+
+    def test_wb_get_pending_legacy_messages(self):
+        """Pending messages queued by legacy py27 are converted."""
+        self.store._write_message(
+            dumps({b"type": b"data", b"data": b"A thing", b"api": b"3.2"}),
+            "",
+        )
+        [message] = self.store.get_pending_messages()
+        self.assertEqual("data", message["type"])
+        self.assertEqual(b"A thing", message["data"])
+
+    def test_wb_get_serialized_pending_legacy_messages(self):
+        """Pending messages queued by legacy py27 are serialized again."""
+        self.store._write_message(
+            dumps({b"type": b"data", b"data": b"A thing", b"api": b"3.2"}),
+            "",
+        )
+        [message] = self.store.get_serialized_pending_messages()
+        self.assertEqual(
+            dumps({"type": "data", "data": b"A thing", "api": b"3.2"}),
+            message,
+        )
@@ -1,4 +1,5 @@
 import os
+import zlib
 
 from twisted.internet import reactor
 from twisted.internet.ssl import DefaultOpenSSLContextFactory
@@ -7,10 +8,14 @@ from twisted.web import resource
 from twisted.web import server
 
 from landscape import VERSION
+from landscape.client.broker.transport import compress_chunks
+from landscape.client.broker.transport import get_content_encodings
+from landscape.client.broker.transport import GZIP
 from landscape.client.broker.transport import HTTPTransport
 from landscape.client.tests.helpers import LandscapeTest
 from landscape.lib import bpickle
 from landscape.lib.fetch import PyCurlError
+from landscape.lib.monitor import health_stats
 from landscape.lib.testing import LogKeeperHelper
 
 
@@ -50,7 +55,7 @@ class HTTPTransportTest(LandscapeTest):
         for port in self.ports:
             port.stopListening()
 
-    def request_with_payload(self, payload):
+    def request_with_payload(self, payload, expected=None):
         resource = DataCollectingResource()
         port = reactor.listenTCP(
             0,
@@ -86,7 +91,10 @@ class HTTPTransportTest(LandscapeTest):
                 [f"landscape-client/{VERSION}"],
             )
             self.assertEqual(get_header("x-message-api"), ["X.Y"])
-            self.assertEqual(bpickle.loads(resource.content), payload)
+            self.assertEqual(
+                bpickle.loads(resource.content),
+                payload if expected is None else expected,
+            )
 
         result.addCallback(got_result)
         return result
@@ -117,6 +125,101 @@ class HTTPTransportTest(LandscapeTest):
         """
         return self.request_with_payload(payload="проба")
 
+    def test_request_data_serialized(self):
+        """
+        Serialized values in the payload, like messages from the store, are
+        sent as they are.
+        """
+        message = bpickle.Serialized(bpickle.dumps({"type": "test"}))
+        return self.request_with_payload(
+            payload={"messages": [message, message]},
+            expected={"messages": [{"type": "test"}, {"type": "test"}]},
+        )
+
+    def test_request_health_stats(self):
+        """
+        The time taken by the exchanges, and the sizes of their payloads and
+        responses, are recorded in the health statistics.
+        """
+        health_stats.reset()
+        result = self.request_with_payload(payload="HI")
+
+        def check(ignored):
+            histograms = health_stats.get_summary()["histograms"]
+            self.assertEqual(histograms["exchange-time"]["count"], 1)
+            self.assertEqual(
+                histograms["exchange-payload-bytes"]["sum"],
+                len(bpickle.dumps("HI")),
+            )
+            self.assertEqual(histograms["exchange-response-bytes"]["count"], 1)
+
+        return result.addCallback(check)
+
+    def test_request_data_compressed(self):
+        """
+        If the server accepts one of the content encodings of the client,
+        the payload is compressed with it and the encoding is named in a
+        C{Content-Encoding} header.
+        """
+        resource = DataCollectingResource()
+        port = reactor.listenTCP(
+            0,
+            server.Site(resource),
+            interface="127.0.0.1",
+        )
+        self.ports.append(port)
+        transport = HTTPTransport(
+            None,
+            f"http://localhost:{port.getHost().port:d}/",
+        )
+        payload = {"messages": [{"type": "test", "data": "x" * 1000}]}
+        result = deferToThread(
+            transport.exchange,
+            payload,
+            accepted_encodings=["unknown", GZIP],
+        )
+
+        def got_result(response):
+            self.assertEqual(response, "Great.")
+            get_header = resource.request.requestHeaders.getRawHeaders
+            self.assertEqual(get_header("content-encoding"), [GZIP])
+            content = zlib.decompress(resource.content, 16 + zlib.MAX_WBITS)
+            self.assertLess(len(resource.content), len(content))
+            self.assertEqual(bpickle.loads(content), payload)
+
+        result.addCallback(got_result)
+        return result
+
+    def test_request_data_not_compressed(self):
+        """
+        If the server accepts none of the content encodings of the client,
+        the payload is sent uncompressed.
+        """
+        resource = DataCollectingResource()
+        port = reactor.listenTCP(
+            0,
+            server.Site(resource),
+            interface="127.0.0.1",
+        )
+        self.ports.append(port)
+        transport = HTTPTransport(
+            None,
+            f"http://localhost:{port.getHost().port:d}/",
+        )
+        result = deferToThread(
+            transport.exchange,
+            "HI",
+            accepted_encodings=["unknown"],
+        )
+
+        def got_result(ignored):
+            get_header = resource.request.requestHeaders.getRawHeaders
+            self.assertIsNone(get_header("content-encoding"))
+            self.assertEqual(bpickle.loads(resource.content), "HI")
+
+        result.addCallback(got_result)
+        return result
+
     def test_ssl_verification_positive(self):
         """
         The client transport should complete an upload of messages to
@@ -206,3 +309,22 @@ class HTTPTransportTest(LandscapeTest):
 
         result.addErrback(got_result)
         return result
+
+
+class CompressChunksTest(LandscapeTest):
+    def test_content_encodings(self):
+        """gzip is always one of the content encodings of the client."""
+        self.assertIn(GZIP, get_content_encodings())
+
+    def test_compress_chunks_gzip(self):
+        """The chunks are compressed as a single gzip stream."""
+        chunks = [b"first ", b"second ", b"first second"]
+        compressed = compress_chunks(chunks, GZIP)
+        self.assertEqual(
+            zlib.decompress(b"".join(compressed), 16 + zlib.MAX_WBITS),
+            b"first second first second",
+        )
+
+    def test_compress_chunks_unknown_encoding(self):
+        """A C{ValueError} is raised for unsupported encodings."""
+        self.assertRaises(ValueError, compress_chunks, [b"data"], "unknown")
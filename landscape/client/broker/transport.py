@@ -3,29 +3,69 @@ import logging
 import pprint
 import time
 import uuid
-
-import pycurl
+import zlib
 
 from landscape import SERVER_API
 from landscape import VERSION
 from landscape.lib import bpickle
 from landscape.lib.compat import _PY3
 from landscape.lib.compat import unicode
+from landscape.lib.fetch import CurlHandle
 from landscape.lib.fetch import fetch
 from landscape.lib.format import format_delta
+from landscape.lib.monitor import health_stats
+
+try:
+    import zstandard
+except ImportError:
+    zstandard = None
+
+
+GZIP = "gzip"
+ZSTD = "zstd"
+
+
+def get_content_encodings():
+    """Return the payload encodings this client can send, preferred first."""
+    if zstandard is not None:
+        return [ZSTD, GZIP]
+    return [GZIP]
+
+
+def compress_chunks(chunks, content_encoding):
+    """Compress the chunks of a payload as a single stream.
+
+    @param chunks: The chunks of the payload, as C{bytes}.
+    @param content_encoding: One of L{get_content_encodings}.
+    @return: The list of the chunks of the compressed payload.
+    """
+    if content_encoding == GZIP:
+        compressor = zlib.compressobj(6, zlib.DEFLATED, 16 + zlib.MAX_WBITS)
+    elif content_encoding == ZSTD and zstandard is not None:
+        compressor = zstandard.ZstdCompressor().compressobj()
+    else:
+        raise ValueError(f"Unsupported content encoding {content_encoding!r}")
+    compressed = [compressor.compress(chunk) for chunk in chunks]
+    compressed.append(compressor.flush())
+    return [chunk for chunk in compressed if chunk]
 
 
 class HTTPTransport:
     """Transport makes a request to exchange message data over HTTP.
 
+    The exchanges are made with the same L{CurlHandle}, so that they
+    reuse the connection to the server while it's kept alive.
+
     @param url: URL of the remote Landscape server message system.
     @param pubkey: SSH public key used for secure communication.
+    @param http2: If true, negotiate HTTP/2 with the server.
     """
 
-    def __init__(self, reactor, url, pubkey=None):
+    def __init__(self, reactor, url, pubkey=None, http2=False):
         self._reactor = reactor
         self._url = url
         self._pubkey = pubkey
+        self._curl_handle = CurlHandle(http2=http2)
 
     def get_url(self):
         """Get the URL of the remote message system."""
@@ -35,7 +75,14 @@ class HTTPTransport:
         """Set the URL of the remote message system."""
         self._url = url
 
-    def _curl(self, payload, computer_id, exchange_token, message_api):
+    def _curl(
+        self,
+        payload,
+        computer_id,
+        exchange_token,
+        message_api,
+        content_encoding=None,
+    ):
         # There are a few "if _PY3" checks below, because for Python 3 we
         # want to convert a number of values from bytes to string, before
         # assigning them to the headers.
@@ -46,6 +93,8 @@ class HTTPTransport:
             "User-Agent": f"landscape-client/{VERSION}",
             "Content-Type": "application/octet-stream",
         }
+        if content_encoding:
+            headers["Content-Encoding"] = content_encoding
         if computer_id:
             if _PY3 and isinstance(computer_id, bytes):
                 computer_id = computer_id.decode("ascii")
@@ -54,17 +103,13 @@ class HTTPTransport:
             if _PY3 and isinstance(exchange_token, bytes):
                 exchange_token = exchange_token.decode("ascii")
             headers["X-Exchange-Token"] = str(exchange_token)
-        curl = pycurl.Curl()
-        return (
-            curl,
-            fetch(
-                self._url,
-                post=True,
-                data=payload,
-                headers=headers,
-                cainfo=self._pubkey,
-                curl=curl,
-            ),
+        return fetch(
+            self._url,
+            post=True,
+            data=payload,
+            headers=headers,
+            cainfo=self._pubkey,
+            handle=self._curl_handle,
         )
 
     def exchange(
@@ -73,15 +118,20 @@ class HTTPTransport:
         computer_id=None,
         exchange_token=None,
         message_api=SERVER_API,
+        accepted_encodings=(),
     ):
         """Exchange message data with the server.
 
         @param payload: The object to send, it must be L{bpickle}-compatible.
+            It may contain L{bpickle.Serialized} values.
         @param computer_id: The computer ID to send the message as (see
             also L{Identity}).
         @param exchange_token: The token that the server has given us at the
             last exchange. It's used to prove that we are still the same
             client.
+        @param accepted_encodings: The content encodings the server said
+            it accepts. The payload is compressed with the first of
+            L{get_content_encodings} among them, if any.
 
         @type: C{dict}
         @return: The server's response to sent message or C{None} in case
@@ -90,32 +140,62 @@ class HTTPTransport:
         @note: This code is thread safe (HOPEFULLY).
 
         """
-        spayload = bpickle.dumps(payload)
+        # Messages coming from the store are already serialized, so the
+        # payload is encoded once into chunks that reference them, rather
+        # than into a single string. The same chunks give the size of the
+        # payload and are sent.
+        chunks = list(bpickle.dumps_iter(payload))
+        size = data_size = sum(len(chunk) for chunk in chunks)
         start_time = time.time()
         if logging.getLogger().getEffectiveLevel() <= logging.DEBUG:
-            logging.debug("Sending payload:\n%s", pprint.pformat(payload))
-        try:
-            curly, data = self._curl(
-                spayload,
-                computer_id,
-                exchange_token,
-                message_api,
+            spayload = b"".join(chunks)
+            logging.debug(
+                "Sending payload:\n%s",
+                pprint.pformat(bpickle.loads(spayload)),
             )
+        content_encoding = None
+        for encoding in get_content_encodings():
+            if encoding in accepted_encodings:
+                content_encoding = encoding
+                chunks = compress_chunks(chunks, encoding)
+                data_size = sum(len(chunk) for chunk in chunks)
+                break
+        try:
+            with health_stats.timed("exchange-time"):
+                body = self._curl(
+                    chunks,
+                    computer_id,
+                    exchange_token,
+                    message_api,
+                    content_encoding=content_encoding,
+                )
         except Exception:
             logging.exception(f"Error contacting the server at {self._url}.")
             raise
         else:
-            logging.info(
-                "Sent %d bytes and received %d bytes in %s.",
-                len(spayload),
-                len(data),
-                format_delta(time.time() - start_time),
-            )
+            health_stats.record("exchange-payload-bytes", size)
+            health_stats.record("exchange-response-bytes", len(body))
+            if content_encoding:
+                logging.info(
+                    "Sent %d bytes (%d with %s) and received %d bytes in %s.",
+                    size,
+                    data_size,
+                    content_encoding,
+                    len(body),
+                    format_delta(time.time() - start_time),
+                )
+            else:
+                logging.info(
+                    "Sent %d bytes and received %d bytes in %s.",
+                    size,
+                    len(body),
+                    format_delta(time.time() - start_time),
+                )
 
         try:
-            response = bpickle.loads(data)
+            response = bpickle.loads(body)
         except Exception:
-            logging.exception(f"Server returned invalid data: {data!r}")
+            logging.exception(f"Server returned invalid data: {body!r}")
             return None
         else:
             if logging.getLogger().getEffectiveLevel() <= logging.DEBUG:
@@ -130,7 +210,7 @@ class HTTPTransport:
 class FakeTransport:
     """Fake transport for testing purposes."""
 
-    def __init__(self, reactor=None, url=None, pubkey=None):
+    def __init__(self, reactor=None, url=None, pubkey=None, http2=False):
         self._pubkey = pubkey
         self.payloads = []
         self.responses = []
@@ -139,6 +219,7 @@ class FakeTransport:
         self.computer_id = None
         self.exchange_token = None
         self.message_api = None
+        self.accepted_encodings = ()
         self.extra = {}
         self._url = url
         self._reactor = reactor
@@ -155,11 +236,23 @@ class FakeTransport:
         computer_id=None,
         exchange_token=None,
         message_api=SERVER_API,
+        accepted_encodings=(),
     ):
+        if "messages" in payload:
+            # Decode messages streamed from the store, so that tests can
+            # inspect them.
+            payload = dict(payload)
+            payload["messages"] = [
+                bpickle.loads(message, as_is=True)
+                if isinstance(message, bpickle.Serialized)
+                else message
+                for message in payload["messages"]
+            ]
         self.payloads.append(payload)
         self.computer_id = computer_id
         self.exchange_token = exchange_token
         self.message_api = message_api
+        self.accepted_encodings = accepted_encodings
         self.next_expected_sequence += len(payload.get("messages", []))
 
         if self._current_response < len(self.responses):
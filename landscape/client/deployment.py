@@ -18,6 +18,7 @@ from landscape.lib.config import BaseConfiguration as _BaseConfiguration
 from landscape.lib.format import expandvars
 from landscape.lib.network import get_active_device_info
 from landscape.lib.network import get_fqdn
+from landscape.lib.persist import JournalBackend
 from landscape.lib.persist import Persist
 
 
@@ -99,6 +100,10 @@ class Configuration(BaseConfiguration):
               - C{ssl_public_key}
               - C{ignore_sigint} (C{False})
               - C{stagger_launch} (C{0.1})
+              - C{timer_slack} (C{0})
+              - C{load_plugins_over} (C{0})
+              - C{client_health_interval} (C{0})
+              - C{stats_socket} (C{False})
         """
         parser = super().make_parser()
         logging.add_cli_options(parser, logdir="/var/log/landscape")
@@ -161,6 +166,38 @@ class Configuration(BaseConfiguration):
             help="Ratio, between 0 and 1, by which to stagger "
             "various tasks of landscape.",
         )
+        parser.add_option(
+            "--timer-slack",
+            metavar="SECONDS",
+            default=0,
+            type=float,
+            help="Run the timers due within this many seconds of each "
+            "other in a single wakeup (default: 0).",
+        )
+        parser.add_option(
+            "--load-plugins-over",
+            metavar="SECONDS",
+            default=0,
+            type=int,
+            help="Import the plugins one after the other over this many "
+            "seconds once started, instead of all of them on startup "
+            "(default: 0).",
+        )
+        parser.add_option(
+            "--client-health-interval",
+            metavar="SECONDS",
+            default=0,
+            type=int,
+            help="Send the health statistics of the client processes to the "
+            "server every this many seconds (default: 0, never).",
+        )
+        parser.add_option(
+            "--stats-socket",
+            action="store_true",
+            default=False,
+            help="Serve the health statistics of each client process on a "
+            "<process>.stats socket in the sockets directory.",
+        )
         parser.add_option(
             "--snap-monitor-interval",
             default=30 * 60,
@@ -222,9 +259,13 @@ def get_versioned_persist(service):
     """Get a L{Persist} database with upgrade rules applied.
 
     Load a L{Persist} database for the given C{service} and upgrade or
-    mark as current, as necessary.
+    mark as current, as necessary. Saving it just appends the changes
+    to a journal, most of the time.
     """
-    persist = Persist(filename=service.persist_filename)
+    persist = Persist(
+        backend=JournalBackend(),
+        filename=service.persist_filename,
+    )
     upgrade_manager = UPGRADE_MANAGERS[service.service_name]
     if os.path.exists(service.persist_filename):
         upgrade_manager.apply(persist)
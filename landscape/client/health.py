@@ -0,0 +1,95 @@
+"""Report the health statistics of the client processes.
+
+The hot paths of each process, like the exchanges with the server, the
+message store and the plugin runs, record how long they take in the
+L{health_stats} of the process. They're sent to the server in
+C{client-health} messages every C{client_health_interval} seconds, so that
+slow hosts can be found, and can be read locally from the
+C{<component>.stats} socket when C{stats_socket} is set.
+"""
+import json
+
+from twisted.internet.protocol import Factory
+from twisted.internet.protocol import Protocol
+
+from landscape.client.broker.client import BrokerClientPlugin
+from landscape.lib.monitor import health_stats
+
+
+def get_health_message(component, stats=health_stats):
+    """
+    Return a C{client-health} message with the statistics recorded since
+    the last one. They're reset by L{reset_health_stats} once the message
+    is sent, so that they aren't lost if it can't be.
+
+    @param component: The name of the process the statistics are of.
+    @param stats: The L{HealthStats} to report.
+    """
+    message = stats.get_summary()
+    message["type"] = "client-health"
+    message["component"] = component
+    return message
+
+
+def reset_health_stats(result, stats=health_stats):
+    """
+    Reset the statistics once their C{client-health} message is sent,
+    passing C{result} through, for use as a callback.
+    """
+    stats.reset()
+    return result
+
+
+class ClientHealth(BrokerClientPlugin):
+    """Send the health statistics of a broker client process.
+
+    @param component: The name of the process.
+    @param run_interval: The interval, in seconds, between the messages.
+    """
+
+    message_type = "client-health"
+    run_immediately = False
+
+    def __init__(self, component, run_interval):
+        self._component = component
+        self.run_interval = run_interval
+
+    def run(self):
+        return self.registry.broker.call_if_accepted(
+            self.message_type,
+            self.send_message,
+        )
+
+    def send_message(self):
+        message = get_health_message(self._component)
+        result = self.registry.broker.send_message(message, self._session_id)
+        return result.addCallback(reset_health_stats)
+
+
+class StatsProtocol(Protocol):
+    """Write the health statistics as a JSON line, and disconnect."""
+
+    def connectionMade(self):  # noqa: N802
+        summary = self.factory.stats.get_summary()
+        summary["component"] = self.factory.component
+        self.transport.write(
+            json.dumps(summary, sort_keys=True).encode("utf-8") + b"\n",
+        )
+        self.transport.loseConnection()
+
+
+class StatsFactory(Factory):
+    """Serve the health statistics on the stats socket of a process.
+
+    Reading them doesn't reset them, they keep accumulating until the next
+    C{client-health} message, if any.
+
+    @param component: The name of the process.
+    @param stats: The L{HealthStats} to serve.
+    """
+
+    protocol = StatsProtocol
+
+    def __init__(self, component, stats=health_stats):
+        self.component = component
+        self.stats = stats
@@ -0,0 +1,375 @@
+"""Spawn the manager processes through the native launcher helper.
+
+Forking the manager for each script run or package helper copies the
+page tables of a big Python process, and the copy-on-write faults that
+follow. The launcher is a small C program, started once, which forks and
+executes the processes on the manager's behalf.
+"""
+import array
+import errno
+import logging
+import os
+import signal
+import socket
+
+from twisted.internet.error import ProcessDone
+from twisted.internet.error import ProcessExitedAlready
+from twisted.internet.error import ProcessTerminated
+from twisted.internet.process import ProcessReader
+from twisted.internet.process import ProcessWriter
+from twisted.internet.protocol import ProcessProtocol
+from twisted.python.failure import Failure
+
+
+# The descriptors of the launched processes, which are always pipes.
+DEFAULT_CHILD_FDS = {0: "w", 1: "r", 2: "r"}
+
+# The status reported for the processes whose exit can't be known, because
+# the launcher went away.
+UNKNOWN_EXIT_STATUS = 255 << 8
+
+
+def _get_reason(status):
+    """Return the process ended reason matching a C{waitpid} status."""
+    exit_code = sig = None
+    if os.WIFEXITED(status):
+        exit_code = os.WEXITSTATUS(status)
+    else:
+        sig = os.WTERMSIG(status)
+    if exit_code == 0:
+        return Failure(ProcessDone(status))
+    return Failure(ProcessTerminated(exit_code, sig, status))
+
+
+class LaunchedProcess:
+    """The process transport of a process spawned by the launcher.
+
+    It behaves like the process transports of the reactor, talking to the
+    process through pipes, except that the process is a child of the
+    launcher, which reports its exit.
+    """
+
+    def __init__(self, reactor, protocol, stdin, stdout, stderr):
+        self.pid = None
+        self.status = None
+        self.proto = protocol
+        self.pipes = {
+            0: ProcessWriter(reactor, self, 0, stdin),
+            1: ProcessReader(reactor, self, 1, stdout),
+            2: ProcessReader(reactor, self, 2, stderr),
+        }
+
+    def write(self, data):
+        self.writeToChild(0, data)
+
+    def writeSequence(self, seq):  # noqa: N802
+        self.write(b"".join(seq))
+
+    def writeToChild(self, childFD, data):  # noqa: N802,N803
+        self.pipes[childFD].write(data)
+
+    def closeChildFD(self, childFD):  # noqa: N802,N803
+        if childFD in self.pipes:
+            self.pipes[childFD].loseConnection()
+
+    def closeStdin(self):  # noqa: N802
+        self.closeChildFD(0)
+
+    def closeStdout(self):  # noqa: N802
+        self.closeChildFD(1)
+
+    def closeStderr(self):  # noqa: N802
+        self.closeChildFD(2)
+
+    def loseConnection(self):  # noqa: N802
+        for childFD in (0, 1, 2):  # noqa: N806
+            self.closeChildFD(childFD)
+
+    def signalProcess(self, signalID):  # noqa: N802,N803
+        if self.pid is None:
+            raise ProcessExitedAlready()
+        if signalID in ("HUP", "STOP", "INT", "KILL", "TERM"):
+            signalID = getattr(signal, "SIG" + signalID)  # noqa: N806
+        os.kill(self.pid, signalID)
+
+    def childDataReceived(self, name, data):  # noqa: N802
+        self.proto.childDataReceived(name, data)
+
+    def childConnectionLost(self, childFD, reason):  # noqa: N802,N803
+        os.close(self.pipes[childFD].fileno())
+        del self.pipes[childFD]
+        self.proto.childConnectionLost(childFD)
+        self._maybe_ended()
+
+    def started(self, pid):
+        self.pid = pid
+
+    def exited(self, status):
+        """The process exited, with the given C{waitpid} status."""
+        self.pid = None
+        self.status = status
+        self.proto.processExited(_get_reason(status))
+        self._maybe_ended()
+
+    def _maybe_ended(self):
+        # Like for the processes spawned by the reactor, the protocol is
+        # told that the process ended once its output has been read.
+        if self.pipes or self.status is None:
+            return
+        self.proto.processEnded(_get_reason(self.status))
+
+
+class LauncherProtocol(ProcessProtocol):
+    """Log what the launcher prints, and tell the factory when it exits."""
+
+    def __init__(self, factory):
+        self._factory = factory
+
+    def errReceived(self, data):  # noqa: N802
+        logging.warning(
+            "Process launcher: " + data.decode("utf-8", "replace").strip(),
+        )
+
+    def processEnded(self, reason):  # noqa: N802
+        self._factory.launcher_ended(reason)
+
+
+class LauncherProcessFactory:
+    """An L{IReactorProcess} provider which spawns through the launcher.
+
+    Processes are spawned by the launcher once it is L{start}ed, and by the
+    reactor when it's not available, or for the requests it can't handle,
+    like the ones using a PTY or specific descriptors.
+
+    @param reactor: The twisted reactor to run the launcher, and to spawn
+        the processes with when the launcher can't.
+    """
+
+    launcher_filename = "/usr/lib/landscape/launcher"
+
+    def __init__(self, reactor):
+        self._reactor = reactor
+        self._socket = None
+        self._request_id = 0
+        self._requested = {}
+        self._processes = {}
+
+    def start(self):
+        """Start the launcher, if it's installed.
+
+        @return: Whether the launcher is being used.
+        """
+        if not os.access(self.launcher_filename, os.X_OK):
+            return False
+        parent_socket, child_socket = socket.socketpair(
+            socket.AF_UNIX,
+            socket.SOCK_SEQPACKET,
+        )
+        try:
+            self._reactor.spawnProcess(
+                LauncherProtocol(self),
+                self.launcher_filename,
+                args=[self.launcher_filename, "--socket-fd", "3"],
+                env={},
+                childFDs={**DEFAULT_CHILD_FDS, 3: child_socket.fileno()},
+            )
+        except OSError as error:
+            logging.warning(f"Unable to start the process launcher: {error}")
+            parent_socket.close()
+            return False
+        finally:
+            child_socket.close()
+        parent_socket.setblocking(False)
+        self._socket = parent_socket
+        self._reactor.addReader(self)
+        return True
+
+    def stop(self):
+        """Stop using the launcher, which exits once its socket is closed."""
+        if self._socket is None:
+            return
+        self._reactor.removeReader(self)
+        self._socket.close()
+        self._socket = None
+        # The exits won't be reported anymore.
+        for process in list(self._requested.values()):
+            process.exited(UNKNOWN_EXIT_STATUS)
+        for process in list(self._processes.values()):
+            process.exited(UNKNOWN_EXIT_STATUS)
+        self._requested.clear()
+        self._processes.clear()
+
+    def launcher_ended(self, reason):
+        """Called when the launcher exited."""
+        if self._socket is not None:
+            logging.warning(
+                "The process launcher exited, spawning processes directly.",
+            )
+        self.stop()
+
+    def spawnProcess(  # noqa: N802
+        self,
+        processProtocol,  # noqa: N803
+        executable,
+        args=(),
+        env={},
+        path=None,
+        uid=None,
+        gid=None,
+        usePTY=0,  # noqa: N803
+        childFDs=None,  # noqa: N803
+    ):
+        """Spawn a process, see L{IReactorProcess.spawnProcess}."""
+        if (
+            self._socket is not None
+            and not usePTY
+            and childFDs in (None, DEFAULT_CHILD_FDS)
+        ):
+            process = self._launch(
+                processProtocol,
+                executable,
+                args,
+                env,
+                path,
+                uid,
+                gid,
+            )
+            if process is not None:
+                return process
+        return self._reactor.spawnProcess(
+            processProtocol,
+            executable,
+            args=args,
+            env=env,
+            path=path,
+            uid=uid,
+            gid=gid,
+            usePTY=usePTY,
+            childFDs=childFDs,
+        )
+
+    def _launch(self, protocol, executable, args, env, path, uid, gid):
+        """Ask the launcher to spawn the process.
+
+        @return: The L{LaunchedProcess}, or C{None} if the request couldn't
+            be sent, like when it's too big.
+        """
+        self._request_id += 1
+        request_id = self._request_id
+        fields = [
+            str(request_id),
+            "" if uid is None else str(uid),
+            "" if gid is None else str(gid),
+            path or "",
+            executable,
+            str(len(args)),
+        ]
+        fields.extend(args)
+        if env is None:
+            env = os.environ
+        fields.append(str(len(env)))
+        fields.extend(
+            os.fsencode(key) + b"=" + os.fsencode(value)
+            for key, value in env.items()
+        )
+        data = b"".join(os.fsencode(field) + b"\0" for field in fields)
+
+        child_stdin, stdin = os.pipe()
+        stdout, child_stdout = os.pipe()
+        stderr, child_stderr = os.pipe()
+        child_fds = [child_stdin, child_stdout, child_stderr]
+        try:
+            self._socket.sendmsg(
+                [data],
+                [
+                    (
+                        socket.SOL_SOCKET,
+                        socket.SCM_RIGHTS,
+                        array.array("i", child_fds),
+                    ),
+                ],
+            )
+        except OSError as error:
+            if error.errno != errno.EMSGSIZE:
+                logging.warning(f"Unable to use the process launcher: {error}")
+            for fd in (stdin, stdout, stderr):
+                os.close(fd)
+            return None
+        finally:
+            # The launcher has its own copies, if it got them.
+            for fd in child_fds:
+                os.close(fd)
+
+        process = LaunchedProcess(
+            self._reactor,
+            protocol,
+            stdin,
+            stdout,
+            stderr,
+        )
+        self._requested[request_id] = process
+        protocol.makeConnection(process)
+        return process
+
+    def fileno(self):
+        return self._socket.fileno()
+
+    def logPrefix(self):  # noqa: N802
+        return "LauncherProcessFactory"
+
+    def doRead(self):  # noqa: N802
+        """Handle the replies of the launcher."""
+        while self._socket is not None:
+            try:
+                reply = self._socket.recv(256)
+            except BlockingIOError:
+                return
+            except OSError as error:
+                logging.warning(f"Unable to read from the launcher: {error}")
+                reply = b""
+            if not reply:
+                self.launcher_ended(None)
+                return
+            self._handle_reply(reply.decode("ascii"))
+
+    def _handle_reply(self, reply):
+        fields = reply.split()
+        if len(fields) == 2 and fields[0] == "failed":
+            # A failure without a request id, like an unknown one.
+            fields.insert(1, "0")
+        try:
+            kind, key, value = fields
+            key, value = int(key), int(value)
+        except ValueError:
+            logging.warning(f"Invalid process launcher reply: {reply!r}")
+            return
+        if kind == "started":
+            process = self._requested.pop(key, None)
+            if process is None:
+                logging.warning(
+                    f"Unknown request in process launcher reply: {reply!r}",
+                )
+                return
+            process.started(value)
+            self._processes[value] = process
+        elif kind == "failed":
+            logging.warning(
+                "The process launcher failed to execute a process: "
+                f"{os.strerror(value)}",
+            )
+            process = self._requested.pop(key, None)
+            if process is None and self._requested:
+                # The launcher couldn't read the request id, the request
+                # is the oldest one since they're answered in order.
+                process = self._requested.pop(next(iter(self._requested)))
+            if process is not None:
+                # As if it exited with an error, like it does when the
+                # reactor fails to execute it.
+                process.exited(1 << 8)
+        elif kind == "exited":
+            process = self._processes.pop(key, None)
+            if process is not None:
+                process.exited(value)
+
+    def connectionLost(self, reason):  # noqa: N802
+        self.stop()
@@ -16,3 +16,6 @@ class Manager(BrokerClient):
         self.reactor = reactor
         self.config = config
         self.store = ManagerStore(self.config.store_filename)
+        # The IReactorProcess provider for the plugins to spawn processes
+        # with, if not the reactor.
+        self.process_factory = None
@@ -87,6 +87,7 @@ class PackageManager(ManagerPlugin):
                 env=environ,
                 errortoo=1,
                 path=None,
+                reactor=self.registry.process_factory,
             )
             result.addCallback(self._got_output, cls)
         else:
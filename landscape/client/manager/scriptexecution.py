@@ -83,11 +83,23 @@ class ScriptRunnerMixin:
     truncation_indicator = "\n**OUTPUT TRUNCATED**"
 
     def __init__(self, process_factory=None):
-        if process_factory is None:
-            from twisted.internet import reactor as process_factory
         self.process_factory = process_factory
         self.IS_SNAP = IS_SNAP
 
+    def get_process_factory(self):
+        """
+        Return the L{IReactorProcess} provider to run the process with: the
+        one given, or the one of the manager, spawning through the process
+        launcher, or else the reactor.
+        """
+        if self.process_factory is not None:
+            return self.process_factory
+        if self.registry.process_factory is not None:
+            return self.registry.process_factory
+        from twisted.internet import reactor
+
+        return reactor
+
     def is_user_allowed(self, user):
         allowed_users = self.registry.config.get_allowed_script_users()
         return allowed_users == ALL_USERS or user in allowed_users
@@ -129,7 +141,7 @@ class ScriptRunnerMixin:
             self.truncation_indicator,
         )
         args = (filename,)
-        self.process_factory.spawnProcess(
+        self.get_process_factory().spawnProcess(
             pp,
             filename,
             args=args,
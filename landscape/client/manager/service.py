@@ -4,7 +4,9 @@ from twisted.python.reflect import namedClass
 
 from landscape.client.amp import ComponentPublisher
 from landscape.client.broker.amp import RemoteBrokerConnector
+from landscape.client.health import ClientHealth
 from landscape.client.manager.config import ManagerConfiguration
+from landscape.client.manager.launcher import LauncherProcessFactory
 from landscape.client.manager.manager import Manager
 from landscape.client.service import LandscapeService
 from landscape.client.service import run_landscape_service
@@ -20,54 +22,68 @@ class ManagerService(LandscapeService):
 
     def __init__(self, config):
         super().__init__(config)
-        self.plugins = self.get_plugins()
+        if config.load_plugins_over:
+            self.plugins = []
+        else:
+            self.plugins = self.get_plugins()
         self.manager = Manager(self.reactor, self.config)
+        from twisted.internet import reactor
+
+        self.process_factory = LauncherProcessFactory(reactor)
         self.publisher = ComponentPublisher(
             self.manager,
             self.reactor,
             self.config,
         )
 
-    def get_plugins(self):
-        """Return instances of all the plugins enabled in the configuration."""
-        plugins = []
-
-        for plugin_name in self.config.plugin_factories:
-            try:
-                plugin = namedClass(
-                    "landscape.client.manager."
-                    f"{plugin_name.lower()}.{plugin_name}",
-                )
-                plugins.append(plugin())
-            except ModuleNotFoundError:
-                logging.warning(
-                    f"Invalid manager plugin specified: '{plugin_name}'"
-                    "See `example.conf` for a full list of monitor plugins.",
-                )
-            except Exception as exc:
-                logging.warning(
-                    f"Unable to load manager plugin '{plugin_name}': {exc}",
-                )
-
-        return plugins
+    def get_plugin(self, plugin_name):
+        """Return an instance of the named plugin, or C{None} on errors."""
+        try:
+            plugin = namedClass(
+                "landscape.client.manager."
+                f"{plugin_name.lower()}.{plugin_name}",
+            )
+            return plugin()
+        except ModuleNotFoundError:
+            logging.warning(
+                f"Invalid manager plugin specified: '{plugin_name}'"
+                "See `example.conf` for a full list of monitor plugins.",
+            )
+        except Exception as exc:
+            logging.warning(
+                f"Unable to load manager plugin '{plugin_name}': {exc}",
+            )
+        return None
 
     def startService(self):  # noqa: N802
         """Start the manager service.
 
-        This method does 3 things, in this order:
+        This method does 4 things, in this order:
 
           - Start listening for connections on the manager socket.
+          - Start the process launcher, if it's installed.
           - Connect to the broker.
           - Add all configured plugins, that will in turn register themselves.
         """
         super().startService()
         self.publisher.start()
+        if self.process_factory.start():
+            self.manager.process_factory = self.process_factory
 
         def start_plugins(broker):
             self.broker = broker
             self.manager.broker = broker
             for plugin in self.plugins:
                 self.manager.add(plugin)
+            if self.config.load_plugins_over:
+                self.load_plugins_lazily(self.manager)
+            if self.config.client_health_interval:
+                self.manager.add(
+                    ClientHealth(
+                        self.service_name,
+                        self.config.client_health_interval,
+                    ),
+                )
             return self.broker.register_client(self.service_name)
 
         self.connector = RemoteBrokerConnector(self.reactor, self.config)
@@ -77,6 +93,8 @@ class ManagerService(LandscapeService):
     def stopService(self):  # noqa: N802
         """Stop the manager and close the connection with the broker."""
         self.connector.disconnect()
+        self.manager.process_factory = None
+        self.process_factory.stop()
         deferred = self.publisher.stop()
         super().stopService()
         return deferred
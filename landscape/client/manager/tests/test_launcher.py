@@ -0,0 +1,269 @@
+import array
+import os
+import socket
+from unittest import mock
+
+from twisted.internet.error import ProcessDone
+from twisted.internet.error import ProcessExitedAlready
+from twisted.internet.error import ProcessTerminated
+from twisted.internet.protocol import ProcessProtocol
+
+from landscape.client.manager.launcher import LauncherProcessFactory
+from landscape.client.manager.launcher import UNKNOWN_EXIT_STATUS
+from landscape.client.tests.helpers import LandscapeTest
+
+
+class StubReactor:
+    """
+    A reactor recording the readers and the spawned processes, keeping a
+    socket to the side of the launcher.
+    """
+
+    def __init__(self):
+        self.readers = []
+        self.spawned = []
+        self.launcher_socket = None
+
+    def addReader(self, reader):  # noqa: N802
+        self.readers.append(reader)
+
+    def removeReader(self, reader):  # noqa: N802
+        if reader in self.readers:
+            self.readers.remove(reader)
+
+    def addWriter(self, writer):  # noqa: N802
+        pass
+
+    def removeWriter(self, writer):  # noqa: N802
+        pass
+
+    def spawnProcess(self, protocol, executable, **kwargs):  # noqa: N802
+        self.spawned.append((protocol, executable, kwargs))
+        child_fds = kwargs.get("childFDs") or {}
+        if 3 in child_fds:
+            self.launcher_socket = socket.socket(fileno=os.dup(child_fds[3]))
+
+
+class RecordingProtocol(ProcessProtocol):
+    def __init__(self):
+        self.data = []
+        self.exited = None
+        self.ended = None
+
+    def childDataReceived(self, fd, data):  # noqa: N802
+        self.data.append((fd, data))
+
+    def processExited(self, reason):  # noqa: N802
+        self.exited = reason
+
+    def processEnded(self, reason):  # noqa: N802
+        self.ended = reason
+
+
+class LauncherProcessFactoryTest(LandscapeTest):
+    def setUp(self):
+        super().setUp()
+        self.reactor = StubReactor()
+        self.factory = LauncherProcessFactory(self.reactor)
+        self.factory.launcher_filename = self.makeFile("")
+        os.chmod(self.factory.launcher_filename, 0o755)
+        self.addCleanup(self.factory.stop)
+
+    def start(self):
+        self.assertTrue(self.factory.start())
+        self.addCleanup(self.reactor.launcher_socket.close)
+        return self.reactor.launcher_socket
+
+    def receive_request(self, launcher_socket):
+        """Return the fields and descriptors of a request."""
+        fds = array.array("i")
+        data, ancdata, flags, address = launcher_socket.recvmsg(
+            65536,
+            socket.CMSG_LEN(3 * fds.itemsize),
+        )
+        for level, kind, cmsg_data in ancdata:
+            fds.frombytes(cmsg_data)
+        for fd in fds:
+            self.addCleanup(os.close, fd)
+        return data.split(b"\0")[:-1], list(fds)
+
+    def reply(self, launcher_socket, reply):
+        launcher_socket.send(reply)
+        self.factory.doRead()
+
+    def end_pipes(self, process):
+        for fd in list(process.pipes):
+            process.childConnectionLost(fd, None)
+
+    def test_start(self):
+        """
+        The launcher is spawned with one end of a socket pair, the other
+        end being read for its replies.
+        """
+        self.start()
+        [(protocol, executable, kwargs)] = self.reactor.spawned
+        self.assertEqual(executable, self.factory.launcher_filename)
+        self.assertEqual(
+            kwargs["args"],
+            [self.factory.launcher_filename, "--socket-fd", "3"],
+        )
+        self.assertEqual(kwargs["env"], {})
+        self.assertEqual(self.reactor.readers, [self.factory])
+
+    def test_start_without_launcher(self):
+        """
+        Without the launcher, processes are spawned by the reactor.
+        """
+        self.factory.launcher_filename = self.makeFile()
+        self.assertFalse(self.factory.start())
+        protocol = RecordingProtocol()
+        self.factory.spawnProcess(protocol, "/bin/true", ["/bin/true"])
+        [(spawned_protocol, executable, kwargs)] = self.reactor.spawned
+        self.assertIs(spawned_protocol, protocol)
+        self.assertEqual(executable, "/bin/true")
+
+    def test_spawn_process(self):
+        """
+        The spawn requests are sent to the launcher along with the standard
+        descriptors of the process, which is ended once the launcher says
+        it exited and its output is read.
+        """
+        launcher_socket = self.start()
+        protocol = RecordingProtocol()
+        process = self.factory.spawnProcess(
+            protocol,
+            "/bin/sh",
+            args=["/bin/sh", "-c", "true"],
+            env={"PATH": b"/bin"},
+            path="/tmp",
+            uid=1000,
+            gid=1001,
+        )
+        self.assertIs(protocol.transport, process)
+        fields, fds = self.receive_request(launcher_socket)
+        self.assertEqual(
+            fields,
+            [
+                b"1",
+                b"1000",
+                b"1001",
+                b"/tmp",
+                b"/bin/sh",
+                b"3",
+                b"/bin/sh",
+                b"-c",
+                b"true",
+                b"1",
+                b"PATH=/bin",
+            ],
+        )
+        self.assertEqual(len(fds), 3)
+
+        self.reply(launcher_socket, b"started 1 1234")
+        self.assertEqual(process.pid, 1234)
+
+        os.write(fds[1], b"output")
+        process.pipes[1].doRead()
+        self.assertEqual(protocol.data, [(1, b"output")])
+
+        self.reply(launcher_socket, b"exited 1234 0")
+        self.assertIsNone(process.pid)
+        self.assertTrue(protocol.exited.check(ProcessDone))
+        self.assertIsNone(protocol.ended)
+        self.end_pipes(process)
+        self.assertTrue(protocol.ended.check(ProcessDone))
+
+    def test_spawn_process_exit_code(self):
+        """A process exiting with an error ends with L{ProcessTerminated}."""
+        launcher_socket = self.start()
+        protocol = RecordingProtocol()
+        process = self.factory.spawnProcess(protocol, "/bin/false", [])
+        self.reply(launcher_socket, b"started 1 1234")
+        self.reply(launcher_socket, f"exited 1234 {3 << 8}".encode())
+        self.end_pipes(process)
+        self.assertTrue(protocol.ended.check(ProcessTerminated))
+        self.assertEqual(protocol.ended.value.exitCode, 3)
+
+    def test_spawn_process_failed(self):
+        """
+        A process the launcher failed to execute ends like one which exited
+        with an error.
+        """
+        launcher_socket = self.start()
+        protocol = RecordingProtocol()
+        process = self.factory.spawnProcess(protocol, "/nonexistent", [])
+        self.reply(launcher_socket, b"failed 1 2")
+        self.end_pipes(process)
+        self.assertTrue(protocol.ended.check(ProcessTerminated))
+        self.assertEqual(protocol.ended.value.exitCode, 1)
+        self.assertIn("No such file or directory", self.logfile.getvalue())
+
+    def test_spawn_process_failed_without_id(self):
+        """
+        A failure without a valid request id, for a request the launcher
+        couldn't read, is the one of the oldest request.
+        """
+        launcher_socket = self.start()
+        first = RecordingProtocol()
+        second = RecordingProtocol()
+        self.factory.spawnProcess(first, "/bin/true", [])
+        self.factory.spawnProcess(second, "/bin/true", [])
+        self.reply(launcher_socket, b"failed 0 22")
+        self.assertEqual(first.exited.value.exitCode, 1)
+        self.assertIsNone(second.exited)
+        self.reply(launcher_socket, b"failed 22")
+        self.assertEqual(second.exited.value.exitCode, 1)
+        self.assertIn("Invalid argument", self.logfile.getvalue())
+
+    def test_spawn_process_started_unknown_id(self):
+        """
+        A start reply for an unknown request is logged and ignored, the
+        pending requests still get theirs.
+        """
+        launcher_socket = self.start()
+        protocol = RecordingProtocol()
+        process = self.factory.spawnProcess(protocol, "/bin/true", [])
+        self.reply(launcher_socket, b"started 2 1234")
+        self.assertIsNone(process.pid)
+        self.assertIn("Unknown request", self.logfile.getvalue())
+        self.reply(launcher_socket, b"started 1 1235")
+        self.assertEqual(process.pid, 1235)
+        self.end_pipes(process)
+
+    def test_spawn_process_with_pty(self):
+        """The requests the launcher can't handle go to the reactor."""
+        self.start()
+        protocol = RecordingProtocol()
+        self.factory.spawnProcess(protocol, "/bin/true", [], usePTY=True)
+        self.assertEqual(len(self.reactor.spawned), 2)
+        self.assertIs(self.reactor.spawned[1][0], protocol)
+
+    def test_signal_process(self):
+        """Signals are sent to the process spawned by the launcher."""
+        launcher_socket = self.start()
+        process = self.factory.spawnProcess(RecordingProtocol(), "/bin/sh")
+        self.assertRaises(ProcessExitedAlready, process.signalProcess, "KILL")
+        self.reply(launcher_socket, b"started 1 1234")
+        with mock.patch("os.kill") as kill_mock:
+            process.signalProcess("KILL")
+        kill_mock.assert_called_once_with(1234, 9)
+        self.end_pipes(process)
+
+    def test_launcher_ended(self):
+        """
+        When the launcher exits, the processes it spawned end with an
+        unknown status, and the next ones are spawned by the reactor.
+        """
+        launcher_socket = self.start()
+        protocol = RecordingProtocol()
+        process = self.factory.spawnProcess(protocol, "/bin/sh")
+        self.reply(launcher_socket, b"started 1 1234")
+        launcher_socket.close()
+        self.factory.doRead()
+        self.assertEqual(protocol.exited.value.status, UNKNOWN_EXIT_STATUS)
+        self.end_pipes(process)
+        self.assertTrue(protocol.ended.check(ProcessTerminated))
+        self.assertNotIn(self.factory, self.reactor.readers)
+
+        self.factory.spawnProcess(RecordingProtocol(), "/bin/true")
+        self.assertEqual(len(self.reactor.spawned), 2)
@@ -768,6 +768,22 @@ class RunScriptTests(LandscapeTest):
 
         return result.addCallback(check)
 
+    def test_manager_process_factory(self):
+        """
+        Without a process factory of its own, the plugin runs the script
+        with the one of the manager, spawning through the process launcher.
+        """
+        factory = StubProcessFactory()
+        self.manager.process_factory = factory
+
+        result = self.plugin.run_script("/bin/sh", "echo hi")
+
+        self.assertEqual(len(factory.spawns), 1)
+        protocol = factory.spawns[0][0]
+        protocol.childDataReceived(1, b"hi\n")
+        protocol.processEnded(Failure(ProcessDone(0)))
+        return result.addCallback(self.assertEqual, "hi\n")
+
     def test_script_removed(self):
         """
         The script is removed after it is finished.
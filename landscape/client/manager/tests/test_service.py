@@ -22,6 +22,8 @@ class ManagerServiceTest(LandscapeTest):
         config.load(["-c", self.config_filename])
 
         self.service = self.FakeManagerService(config)
+        # Don't start the process launcher, even if it's installed.
+        self.service.process_factory.launcher_filename = self.makeFile()
 
     @mock.patch("dbus.SystemBus")
     def test_plugins(self, system_bus_mock):
@@ -1,14 +1,25 @@
 import subprocess
 
-from twisted.python.compat import itervalues
-
 from landscape.client.diff import diff
 from landscape.client.monitor.plugin import DataWatcher
 from landscape.lib.jiffies import detect_jiffies
+from landscape.lib.process import make_process_info
 from landscape.lib.process import ProcessInformation
 
 
 class ActiveProcessInfo(DataWatcher):
+    """Report the processes running on the system.
+
+    The first message replaces all the processes known to the server, the
+    next ones only carry the processes that were added, killed or updated.
+
+    @param cpu_threshold: Updates of a process are only reported if its
+        CPU usage changed by at least this many percentage points, or if
+        anything else changed. By default it's the C{process_cpu_threshold}
+        configuration option.
+    @param vm_size_threshold: Likewise, for the virtual memory size in
+        kilobytes, by default C{process_vm_size_threshold}.
+    """
 
     message_type = "active-process-info"
     scope = "process"
@@ -20,6 +31,8 @@ class ActiveProcessInfo(DataWatcher):
         jiffies=None,
         uptime=None,
         popen=subprocess.Popen,
+        cpu_threshold=None,
+        vm_size_threshold=None,
     ):
         super().__init__()
         self._proc_dir = proc_dir
@@ -28,6 +41,8 @@ class ActiveProcessInfo(DataWatcher):
         self._jiffies_per_sec = jiffies or detect_jiffies()
         self._popen = popen
         self._first_run = True
+        self._cpu_threshold = cpu_threshold
+        self._vm_size_threshold = vm_size_threshold
         self._process_info = ProcessInformation(
             proc_dir=proc_dir,
             jiffies=jiffies,
@@ -37,6 +52,15 @@ class ActiveProcessInfo(DataWatcher):
 
     def register(self, manager):
         super().register(manager)
+        config = self.registry.config
+        if self._cpu_threshold is None:
+            self._cpu_threshold = getattr(config, "process_cpu_threshold", 0)
+        if self._vm_size_threshold is None:
+            self._vm_size_threshold = getattr(
+                config,
+                "process_vm_size_threshold",
+                0,
+            )
         self.call_on_accepted(self.message_type, self.exchange, True)
 
     def _reset(self):
@@ -66,23 +90,57 @@ class ActiveProcessInfo(DataWatcher):
         self.registry.flush()
 
     def _get_processes(self):
-        processes = {}
-        for process_info in self._process_info.get_all_process_info():
-            if process_info["state"] != b"X":
-                processes[process_info["pid"]] = process_info
-        return processes
+        """Return the compact records of the processes which aren't dead."""
+        records = self._process_info.get_process_records()
+        return {
+            process_id: record
+            for process_id, record in records.items()
+            if record[1] != b"X"
+        }
 
     def _detect_process_changes(self):
         changes = {}
         processes = self._get_processes()
         creates, updates, deletes = diff(self._persist_processes, processes)
+        for process_id, record in list(updates.items()):
+            old_record = self._persist_processes[process_id]
+            if not self._is_significant_update(old_record, record):
+                # Keep comparing with what the server knows, so that small
+                # changes still get reported once they add up.
+                del updates[process_id]
+                processes[process_id] = old_record
+        # Only build the reported dicts for the processes that changed.
         if creates:
-            changes["add-processes"] = list(itervalues(creates))
+            changes["add-processes"] = [
+                make_process_info(process_id, record)
+                for process_id, record in creates.items()
+            ]
         if updates:
-            changes["update-processes"] = list(itervalues(updates))
+            changes["update-processes"] = [
+                make_process_info(process_id, record)
+                for process_id, record in updates.items()
+            ]
         if deletes:
             changes["kill-processes"] = list(deletes)
 
         # Update cached values for use on the next run.
         self._previous_processes = processes
         return changes
+
+    def _is_significant_update(self, old_record, new_record):
+        """
+        Whether the change from C{old_record} to C{new_record}, records of
+        L{ProcessInformation.get_process_records}, is worth reporting.
+        """
+        *old_fields, old_vm_size, old_start_time, old_cpu = old_record
+        *new_fields, new_vm_size, new_start_time, new_cpu = new_record
+        if old_fields != new_fields or old_start_time != new_start_time:
+            return True
+        if old_vm_size != new_vm_size:
+            if old_vm_size is None or new_vm_size is None:
+                return True
+            if abs(new_vm_size - old_vm_size) >= self._vm_size_threshold:
+                return True
+        return old_cpu != new_cpu and (
+            abs(new_cpu - old_cpu) >= self._cpu_threshold
+        )
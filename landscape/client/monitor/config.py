@@ -43,6 +43,23 @@ class MonitorConfiguration(Configuration):
             "use. ALL means use all plugins.",
             default="ALL",
         )
+        parser.add_option(
+            "--process-cpu-threshold",
+            metavar="PERCENT",
+            type="float",
+            default=0,
+            help="Only report changes of the CPU usage of a process of at "
+            "least PERCENT points (default: 0, report all changes).",
+        )
+        parser.add_option(
+            "--process-vm-size-threshold",
+            metavar="KB",
+            type="int",
+            default=0,
+            help="Only report changes of the virtual memory size of a "
+            "process of at least KB kilobytes (default: 0, report all "
+            "changes).",
+        )
         return parser
 
     @property
@@ -35,7 +35,7 @@ class CPUUsage(MonitorPlugin):
         super().register(registry)
         self._accumulate = Accumulator(self._persist, registry.step_size)
 
-        self.registry.reactor.call_every(self._interval, self.run)
+        self.registry.sampler.call_every(self._interval, self.run)
 
         self._monitor = CoverageMonitor(
             self._interval,
@@ -92,10 +92,9 @@ class CPUUsage(MonitorPlugin):
         """
         result = None
         try:
-            with open(stat_file, "r") as f:
-                # The first line of the file is the CPU information aggregated
-                # across cores.
-                stat = f.readline()
+            # The first line of the file is the CPU information aggregated
+            # across cores.
+            stat = self.registry.sampler.read(stat_file).split("\n", 1)[0]
         except OSError:
             logging.error(
                 f"Could not open {stat_file} for reading, "
@@ -31,7 +31,7 @@ class LoadAverage(MonitorPlugin):
         super().register(registry)
         self._accumulate = Accumulator(self._persist, registry.step_size)
 
-        self.registry.reactor.call_every(self._interval, self.run)
+        self.registry.sampler.call_every(self._interval, self.run)
 
         self._monitor = CoverageMonitor(
             self._interval,
@@ -30,7 +30,7 @@ class MemoryInfo(MonitorPlugin):
     def register(self, registry):
         super().register(registry)
         self._accumulate = Accumulator(self._persist, self.registry.step_size)
-        self.registry.reactor.call_every(self._interval, self.run)
+        self.registry.sampler.call_every(self._interval, self.run)
         self._monitor = CoverageMonitor(
             self._interval,
             0.8,
@@ -68,7 +68,10 @@ class MemoryInfo(MonitorPlugin):
     def run(self):
         self._monitor.ping()
         new_timestamp = int(self._create_time())
-        memstats = MemoryStats(self._source_filename)
+        memstats = MemoryStats(
+            self._source_filename,
+            data=self.registry.sampler.read(self._source_filename),
+        )
         memory_step_data = self._accumulate(
             new_timestamp,
             memstats.free_memory,
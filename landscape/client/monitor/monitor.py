@@ -2,6 +2,7 @@
 import os
 
 from landscape.client.broker.client import BrokerClient
+from landscape.client.monitor.sampler import Sampler
 
 
 class Monitor(BrokerClient):
@@ -26,7 +27,9 @@ class Monitor(BrokerClient):
             self.persist.load(persist_filename)
         self._plugins = []
         self.step_size = step_size
+        self.sampler = Sampler(reactor)
         self.reactor.call_every(self.config.flush_interval, self.flush)
+        self.reactor.call_on("stop", self.sampler.stop)
 
     def flush(self):
         """Flush data to disk."""
@@ -2,7 +2,7 @@ import codecs
 import os
 import time
 
-from landscape.client.accumulate import Accumulator
+from landscape.client.accumulate import BatchAccumulator
 from landscape.client.monitor.plugin import MonitorPlugin
 from landscape.lib.disk import get_mount_info
 from landscape.lib.disk import is_device_removable
@@ -41,7 +41,11 @@ class MountInfo(MonitorPlugin):
 
     def register(self, registry):
         super().register(registry)
-        self._accumulate = Accumulator(self._persist, self.registry.step_size)
+        self._accumulate = BatchAccumulator(
+            self._persist,
+            self.registry.step_size,
+            "accumulate-free-space",
+        )
         self._monitor = CoverageMonitor(
             self.run_interval,
             0.8,
@@ -112,16 +116,10 @@ class MountInfo(MonitorPlugin):
         self._monitor.ping()
         now = int(self._create_time())
         current_mount_points = set()
+        free_spaces = {}
         for mount_info in self._get_mount_info():
             mount_point = mount_info["mount-point"]
-            free_space = mount_info.pop("free-space")
-
-            key = ("accumulate-free-space", mount_point)
-            step_data = self._accumulate(now, free_space, key)
-            if step_data:
-                timestamp = step_data[0]
-                free_space = int(step_data[1])
-                self._free_space.append((timestamp, mount_point, free_space))
+            free_spaces[mount_point] = mount_info.pop("free-space")
 
             prev_mount_info = self._persist.get(("mount-info", mount_point))
             if not prev_mount_info or prev_mount_info != mount_info:
@@ -130,6 +128,14 @@ class MountInfo(MonitorPlugin):
 
             current_mount_points.add(mount_point)
 
+        all_step_data = self._accumulate(now, free_spaces)
+        for mount_point in free_spaces:
+            step_data = all_step_data.get(mount_point)
+            if step_data:
+                timestamp = step_data[0]
+                free_space = int(step_data[1])
+                self._free_space.append((timestamp, mount_point, free_space))
+
     def _get_mount_info(self):
         """Generator yields local mount points worth recording data for."""
         bound_mount_points = self._get_bound_mount_points()
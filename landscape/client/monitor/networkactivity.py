@@ -4,7 +4,7 @@ with the inbound/outbound traffic per interface per step interval.
 """
 import time
 
-from landscape.client.accumulate import Accumulator
+from landscape.client.accumulate import BatchAccumulator
 from landscape.client.monitor.plugin import MonitorPlugin
 from landscape.lib.network import get_network_traffic
 from landscape.lib.network import is_64
@@ -17,7 +17,8 @@ class NetworkActivity(MonitorPlugin):
 
     message_type = "network-activity"
     persist_name = message_type
-    run_interval = 30
+    # Prevent the Plugin base-class from scheduling looping calls.
+    run_interval = None
     _rollover_maxint = 0
     scope = "network"
 
@@ -27,8 +28,10 @@ class NetworkActivity(MonitorPlugin):
         self,
         network_activity_file="/proc/net/dev",
         create_time=time.time,
+        interval=30,
     ):
         self._source_file = network_activity_file
+        self._interval = interval
         # accumulated values for sending out via message
         self._network_activity = {}
         # our last traffic sample for calculating a traffic delta
@@ -40,7 +43,20 @@ class NetworkActivity(MonitorPlugin):
 
     def register(self, registry):
         super().register(registry)
-        self._accumulate = Accumulator(self._persist, self.registry.step_size)
+        step_size = self.registry.step_size
+        self._accumulate_out = BatchAccumulator(
+            self._persist,
+            step_size,
+            "delta-out",
+            legacy_key=lambda interface: f"delta-out-{interface}",
+        )
+        self._accumulate_in = BatchAccumulator(
+            self._persist,
+            step_size,
+            "delta-in",
+            legacy_key=lambda interface: f"delta-in-{interface}",
+        )
+        self.registry.sampler.call_every(self._interval, self.run)
         self.call_on_accepted("network-activity", self.exchange, True)
 
     def create_message(self):
@@ -121,25 +137,25 @@ class NetworkActivity(MonitorPlugin):
         accumulator, recording step data.
         """
         new_timestamp = int(self._create_time())
-        new_traffic = get_network_traffic(self._source_file)
+        new_traffic = get_network_traffic(
+            self._source_file,
+            data=self.registry.sampler.read(self._source_file),
+        )
+        deltas_out = {}
+        deltas_in = {}
         for interface, delta_out, delta_in in self._traffic_delta(new_traffic):
-            out_step_data = self._accumulate(
-                new_timestamp,
-                delta_out,
-                f"delta-out-{interface}",
-            )
-
-            in_step_data = self._accumulate(
-                new_timestamp,
-                delta_in,
-                f"delta-in-{interface}",
-            )
-
-            # there's only data when we cross a step boundary
-            if not (in_step_data and out_step_data):
+            deltas_out[interface] = delta_out
+            deltas_in[interface] = delta_in
+        out_step_data = self._accumulate_out(new_timestamp, deltas_out)
+        in_step_data = self._accumulate_in(new_timestamp, deltas_in)
+
+        # there's only data when we cross a step boundary
+        for interface in deltas_out:
+            if interface not in in_step_data or interface not in out_step_data:
                 continue
-
+            step_boundary, in_step_value = in_step_data[interface]
+            out_step_value = out_step_data[interface][1]
             steps = self._network_activity.setdefault(interface, [])
             steps.append(
-                (in_step_data[0], int(in_step_data[1]), int(out_step_data[1])),
+                (step_boundary, int(in_step_value), int(out_step_value)),
             )
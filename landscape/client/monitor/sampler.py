@@ -0,0 +1,119 @@
+"""Shared sampling of the system files read by the monitor plugins."""
+import logging
+import os
+
+from landscape.lib.format import format_object
+
+
+class SampledFile:
+    """A file which is read over and over, like the ones in C{/proc}.
+
+    The file is kept open and read again from its start with C{pread},
+    instead of being opened, read and closed each time.
+
+    @param filename: The path of the file.
+    """
+
+    CHUNK_SIZE = 8192
+
+    def __init__(self, filename):
+        self.filename = filename
+        self._fd = None
+
+    def read(self):
+        """Return the current content of the file, decoded as UTF-8.
+
+        If reading the open file fails, like when it went away, it's
+        opened again once.
+
+        @raise OSError: If the file can't be opened or read.
+        """
+        if self._fd is not None:
+            try:
+                return self._read()
+            except OSError:
+                self.close()
+        self._fd = os.open(self.filename, os.O_RDONLY | os.O_CLOEXEC)
+        try:
+            return self._read()
+        except OSError:
+            self.close()
+            raise
+
+    def _read(self):
+        chunks = []
+        offset = 0
+        while True:
+            chunk = os.pread(self._fd, self.CHUNK_SIZE, offset)
+            if not chunk:
+                break
+            chunks.append(chunk)
+            offset += len(chunk)
+        return b"".join(chunks).decode("utf-8", "replace")
+
+    def close(self):
+        if self._fd is not None:
+            os.close(self._fd)
+            self._fd = None
+
+    def __del__(self):
+        self.close()
+
+
+class Sampler:
+    """Run the sampling of the monitor plugins in shared ticks.
+
+    Plugins sampling at the same interval are run one after the other
+    from a single timer, rather than each from their own, and read their
+    files through L{read}, which keeps them open across samples.
+
+    @param reactor: The L{LandscapeReactor} to schedule the ticks with.
+    """
+
+    def __init__(self, reactor):
+        self._reactor = reactor
+        self._callbacks = {}
+        self._calls = {}
+        self._files = {}
+
+    def call_every(self, interval, callback):
+        """Call C{callback} every C{interval} seconds, in the same tick
+        as the other callbacks with this interval."""
+        callbacks = self._callbacks.setdefault(interval, [])
+        callbacks.append(callback)
+        if interval not in self._calls:
+            self._calls[interval] = self._reactor.call_every(
+                interval,
+                self._tick,
+                interval,
+            )
+
+    def _tick(self, interval):
+        for callback in list(self._callbacks[interval]):
+            try:
+                callback()
+            except Exception:
+                # Don't let a plugin stop the others from sampling.
+                logging.exception(
+                    f"Error sampling {format_object(callback)}",
+                )
+
+    def read(self, filename):
+        """Return the current content of C{filename}, see L{SampledFile}.
+
+        @raise OSError: If the file can't be opened or read.
+        """
+        sampled_file = self._files.get(filename)
+        if sampled_file is None:
+            sampled_file = self._files[filename] = SampledFile(filename)
+        return sampled_file.read()
+
+    def stop(self):
+        """Stop the ticks and close the files."""
+        for call in self._calls.values():
+            self._reactor.cancel_call(call)
+        self._calls.clear()
+        self._callbacks.clear()
+        for sampled_file in self._files.values():
+            sampled_file.close()
+        self._files.clear()
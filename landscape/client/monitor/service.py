@@ -6,6 +6,7 @@ from twisted.python.reflect import namedClass
 
 from landscape.client.amp import ComponentPublisher
 from landscape.client.broker.amp import RemoteBrokerConnector
+from landscape.client.health import ClientHealth
 from landscape.client.monitor.config import MonitorConfiguration
 from landscape.client.monitor.monitor import Monitor
 from landscape.client.service import LandscapeService
@@ -26,7 +27,10 @@ class MonitorService(LandscapeService):
             f"{self.service_name}.bpickle",
         )
         super().__init__(config)
-        self.plugins = self.get_plugins()
+        if config.load_plugins_over:
+            self.plugins = []
+        else:
+            self.plugins = self.get_plugins()
         self.monitor = Monitor(
             self.reactor,
             self.config,
@@ -39,27 +43,24 @@ class MonitorService(LandscapeService):
             self.config,
         )
 
-    def get_plugins(self):
-        plugins = []
-
-        for plugin_name in self.config.plugin_factories:
-            try:
-                plugin = namedClass(
-                    "landscape.client.monitor."
-                    f"{plugin_name.lower()}.{plugin_name}",
-                )
-                plugins.append(plugin())
-            except ModuleNotFoundError:
-                logging.warning(
-                    f"Invalid monitor plugin specified: '{plugin_name}'. "
-                    "See `example.conf` for a full list of monitor plugins.",
-                )
-            except Exception as exc:
-                logging.warning(
-                    f"Unable to load monitor plugin '{plugin_name}': {exc}",
-                )
-
-        return plugins
+    def get_plugin(self, plugin_name):
+        """Return an instance of the named plugin, or C{None} on errors."""
+        try:
+            plugin = namedClass(
+                "landscape.client.monitor."
+                f"{plugin_name.lower()}.{plugin_name}",
+            )
+            return plugin()
+        except ModuleNotFoundError:
+            logging.warning(
+                f"Invalid monitor plugin specified: '{plugin_name}'. "
+                "See `example.conf` for a full list of monitor plugins.",
+            )
+        except Exception as exc:
+            logging.warning(
+                f"Unable to load monitor plugin '{plugin_name}': {exc}",
+            )
+        return None
 
     def startService(self):  # noqa: N802
         """Start the monitor."""
@@ -71,6 +72,15 @@ class MonitorService(LandscapeService):
             self.monitor.broker = broker
             for plugin in self.plugins:
                 self.monitor.add(plugin)
+            if self.config.load_plugins_over:
+                self.load_plugins_lazily(self.monitor)
+            if self.config.client_health_interval:
+                self.monitor.add(
+                    ClientHealth(
+                        self.service_name,
+                        self.config.client_health_interval,
+                    ),
+                )
             return self.broker.register_client(self.service_name)
 
         self.connector = RemoteBrokerConnector(self.reactor, self.config)
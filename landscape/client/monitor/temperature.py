@@ -4,6 +4,7 @@ from landscape.client.accumulate import Accumulator
 from landscape.client.monitor.plugin import MonitorPlugin
 from landscape.lib.monitor import CoverageMonitor
 from landscape.lib.sysstats import get_thermal_zones
+from landscape.lib.sysstats import ThermalZone
 
 
 class Temperature(MonitorPlugin):
@@ -26,10 +27,12 @@ class Temperature(MonitorPlugin):
         self._monitor_interval = monitor_interval
         self._create_time = create_time
         self._thermal_zones = []
+        self._temperature_paths = []
         self._temperatures = {}
 
         for thermal_zone in get_thermal_zones(self.thermal_zone_path):
             self._thermal_zones.append(thermal_zone.name)
+            self._temperature_paths.append(thermal_zone.temperature_path)
             self._temperatures[thermal_zone.name] = []
 
     def register(self, registry):
@@ -40,7 +43,7 @@ class Temperature(MonitorPlugin):
                 self.registry.step_size,
             )
 
-            registry.reactor.call_every(self._interval, self.run)
+            registry.sampler.call_every(self._interval, self.run)
 
             self._monitor = CoverageMonitor(
                 self._interval,
@@ -89,7 +92,12 @@ class Temperature(MonitorPlugin):
     def run(self):
         self._monitor.ping()
         now = int(self._create_time())
-        for zone in get_thermal_zones(self.thermal_zone_path):
+        for temperature_path in self._temperature_paths:
+            try:
+                data = self.registry.sampler.read(temperature_path)
+            except OSError:
+                continue
+            zone = ThermalZone(temperature_path, data)
             if zone.temperature_value is not None:
                 key = ("accumulate", zone.name)
                 step_data = self._accumulate(now, zone.temperature_value, key)
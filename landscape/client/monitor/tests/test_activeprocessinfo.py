@@ -1127,3 +1127,98 @@ class PluginManagerIntegrationTest(LandscapeTest):
         }
         processes = message["add-processes"]
         self.assertEqual(processes, [expected_process_0])
+
+    def _create_busy_process(self, cpu_jiffies, vmsize=11676):
+        """Create a process which used C{cpu_jiffies} in each CPU mode."""
+        stat_data = (
+            "1 Process S 1 0 0 0 0 0 0 0 "
+            f"0 0 {cpu_jiffies:d} {cpu_jiffies:d} 0 0 0 0 0 0 3000 0 "
+            "0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0"
+        )
+        if os.path.exists(os.path.join(self.sample_dir, "1")):
+            self.builder.remove_data(1)
+        self.builder.create_data(
+            1,
+            self.builder.RUNNING,
+            uid=0,
+            gid=0,
+            process_name="Process",
+            generate_cmd_line=False,
+            stat_data=stat_data,
+            vmsize=vmsize,
+        )
+
+    def test_cpu_threshold(self):
+        """
+        CPU usage changes below the configured threshold aren't reported,
+        until they add up to more than the threshold.
+        """
+        self.config.process_cpu_threshold = 1.0
+        self._create_busy_process(20)
+        plugin = ActiveProcessInfo(
+            proc_dir=self.sample_dir,
+            uptime=400,
+            jiffies=10,
+            boot_time=0,
+        )
+        self.monitor.add(plugin)
+        plugin.exchange()
+
+        self._create_busy_process(22)
+        plugin.exchange()
+        self.assertEqual(len(self.mstore.get_pending_messages()), 1)
+
+        self._create_busy_process(25)
+        plugin.exchange()
+        messages = self.mstore.get_pending_messages()
+        self.assertEqual(len(messages), 2)
+        [process] = messages[1]["update-processes"]
+        self.assertEqual(process["percent-cpu"], 5.0)
+
+    def test_vm_size_threshold(self):
+        """
+        Virtual memory size changes below the threshold aren't reported,
+        unless something else changed.
+        """
+        self._create_busy_process(20)
+        plugin = ActiveProcessInfo(
+            proc_dir=self.sample_dir,
+            uptime=400,
+            jiffies=10,
+            boot_time=0,
+            vm_size_threshold=1000,
+        )
+        self.monitor.add(plugin)
+        plugin.exchange()
+
+        self._create_busy_process(20, vmsize=12000)
+        plugin.exchange()
+        self.assertEqual(len(self.mstore.get_pending_messages()), 1)
+
+        self._create_busy_process(30, vmsize=12000)
+        plugin.exchange()
+        messages = self.mstore.get_pending_messages()
+        self.assertEqual(len(messages), 2)
+        [process] = messages[1]["update-processes"]
+        self.assertEqual(process["vm-size"], 12000)
+        self.assertEqual(process["percent-cpu"], 6.0)
+
+    def test_no_threshold(self):
+        """By default, any change of a process is reported."""
+        self._create_busy_process(20)
+        plugin = ActiveProcessInfo(
+            proc_dir=self.sample_dir,
+            uptime=400,
+            jiffies=10,
+            boot_time=0,
+        )
+        self.monitor.add(plugin)
+        plugin.exchange()
+
+        self._create_busy_process(21, vmsize=11677)
+        plugin.exchange()
+        messages = self.mstore.get_pending_messages()
+        self.assertEqual(len(messages), 2)
+        [process] = messages[1]["update-processes"]
+        self.assertEqual(process["vm-size"], 11677)
+        self.assertEqual(process["percent-cpu"], 4.2)
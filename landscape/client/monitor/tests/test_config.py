@@ -32,3 +32,22 @@ class MonitorConfigurationTest(LandscapeTest):
         """
         self.config.load(["--flush-interval", "123"])
         self.assertEqual(self.config.flush_interval, 123)
+
+    def test_process_thresholds(self):
+        """
+        The C{--process-cpu-threshold} and C{--process-vm-size-threshold}
+        options set the changes below which process updates aren't
+        reported, by default none.
+        """
+        self.assertEqual(self.config.process_cpu_threshold, 0)
+        self.assertEqual(self.config.process_vm_size_threshold, 0)
+        self.config.load(
+            [
+                "--process-cpu-threshold",
+                "1.5",
+                "--process-vm-size-threshold",
+                "1024",
+            ],
+        )
+        self.assertEqual(self.config.process_cpu_threshold, 1.5)
+        self.assertEqual(self.config.process_vm_size_threshold, 1024)
@@ -0,0 +1,105 @@
+import os
+
+from landscape.client.monitor.sampler import SampledFile
+from landscape.client.monitor.sampler import Sampler
+from landscape.client.tests.helpers import LandscapeTest
+from landscape.lib.testing import FakeReactor
+
+
+class SampledFileTest(LandscapeTest):
+    def test_read(self):
+        """L{SampledFile.read} returns the current content of the file."""
+        filename = self.makeFile("first")
+        sampled_file = SampledFile(filename)
+        self.assertEqual(sampled_file.read(), "first")
+        with open(filename, "w") as fd:
+            fd.write("second, longer")
+        self.assertEqual(sampled_file.read(), "second, longer")
+        sampled_file.close()
+
+    def test_read_keeps_file_open(self):
+        """The file is opened once, and read again from its start."""
+        filename = self.makeFile("content")
+        sampled_file = SampledFile(filename)
+        sampled_file.read()
+        fd = sampled_file._fd
+        self.assertEqual(sampled_file.read(), "content")
+        self.assertEqual(sampled_file._fd, fd)
+        sampled_file.close()
+        self.assertIsNone(sampled_file._fd)
+
+    def test_read_in_chunks(self):
+        """Files bigger than L{SampledFile.CHUNK_SIZE} are read whole."""
+        content = "x" * (SampledFile.CHUNK_SIZE * 2 + 1)
+        sampled_file = SampledFile(self.makeFile(content))
+        self.assertEqual(sampled_file.read(), content)
+        sampled_file.close()
+
+    def test_read_missing_file(self):
+        """An C{OSError} is raised if the file can't be opened."""
+        sampled_file = SampledFile(self.makeFile())
+        self.assertRaises(OSError, sampled_file.read)
+
+    def test_read_reopens_file(self):
+        """If reading the open file fails, it's opened again."""
+        filename = self.makeFile("content")
+        sampled_file = SampledFile(filename)
+        sampled_file.read()
+        os.close(sampled_file._fd)
+        self.assertEqual(sampled_file.read(), "content")
+        sampled_file.close()
+
+
+class SamplerTest(LandscapeTest):
+    def setUp(self):
+        super().setUp()
+        self.reactor = FakeReactor()
+        self.sampler = Sampler(self.reactor)
+
+    def test_call_every(self):
+        """
+        Callbacks with the same interval are run from a single timer, the
+        ones with different intervals from their own.
+        """
+        calls = []
+        self.sampler.call_every(10, lambda: calls.append("a"))
+        self.sampler.call_every(10, lambda: calls.append("b"))
+        self.sampler.call_every(15, lambda: calls.append("c"))
+        self.assertEqual(len(self.reactor._calls), 2)
+        self.reactor.advance(10)
+        self.assertEqual(calls, ["a", "b"])
+        self.reactor.advance(5)
+        self.assertEqual(calls, ["a", "b", "c"])
+        self.reactor.advance(5)
+        self.assertEqual(calls, ["a", "b", "c", "a", "b"])
+
+    def test_call_every_with_error(self):
+        """A failing callback doesn't prevent the others from running."""
+        self.log_helper.ignore_errors("Error sampling")
+        calls = []
+        self.sampler.call_every(10, lambda: 1 / 0)
+        self.sampler.call_every(10, lambda: calls.append("b"))
+        self.reactor.advance(20)
+        self.assertEqual(calls, ["b", "b"])
+        self.assertIn("ZeroDivisionError", self.logfile.getvalue())
+
+    def test_read(self):
+        """
+        L{Sampler.read} reads files through a L{SampledFile}, kept for the
+        following reads.
+        """
+        filename = self.makeFile("content")
+        self.assertEqual(self.sampler.read(filename), "content")
+        sampled_file = self.sampler._files[filename]
+        self.assertEqual(self.sampler.read(filename), "content")
+        self.assertIs(self.sampler._files[filename], sampled_file)
+
+    def test_stop(self):
+        """L{Sampler.stop} cancels the ticks and closes the files."""
+        calls = []
+        self.sampler.call_every(10, lambda: calls.append("a"))
+        self.sampler.read(self.makeFile("content"))
+        self.sampler.stop()
+        self.reactor.advance(10)
+        self.assertEqual(calls, [])
+        self.assertEqual(self.sampler._files, {})
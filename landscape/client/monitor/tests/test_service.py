@@ -73,6 +73,36 @@ class MonitorServiceTest(LandscapeTest):
         self.assertIn("Unable to load", cm.output[0])
         self.assertIn("Mars?", cm.output[0])
 
+    def test_load_plugins_lazily(self):
+        """
+        With C{load_plugins_over}, the plugins aren't loaded on startup, but
+        one after the other over that time, each one added once loaded.
+        """
+        config = MonitorConfiguration()
+        config.load(
+            [
+                "-c",
+                self.config_filename,
+                "--monitor-plugins",
+                "ComputerInfo, LoadAverage",
+                "--load-plugins-over",
+                "10",
+            ],
+        )
+        service = self.service.__class__(config)
+        self.assertEqual(service.plugins, [])
+
+        monitor = Mock()
+        with patch.object(service, "get_plugin") as get_plugin_mock:
+            service.load_plugins_lazily(monitor)
+            service.reactor.advance(0)
+            get_plugin_mock.assert_called_once_with("ComputerInfo")
+            service.reactor.advance(5)
+            get_plugin_mock.assert_called_with("LoadAverage")
+        self.assertEqual(get_plugin_mock.call_count, 2)
+        self.assertEqual(len(service.plugins), 2)
+        self.assertEqual(monitor.add.call_count, 2)
+
     def test_start_service(self):
         """
         The L{MonitorService.startService} method connects to the broker,
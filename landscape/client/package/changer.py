@@ -30,6 +30,7 @@ from landscape.constants import UNKNOWN_PACKAGE_DATA_TIMEOUT
 from landscape.lib import base64
 from landscape.lib.config import get_bindir
 from landscape.lib.fs import create_binary_file
+from landscape.lib.twisted_util import gather_results
 
 
 class UnknownPackageData(Exception):
@@ -39,6 +40,21 @@ class UnknownPackageData(Exception):
 class PackageChangerConfiguration(PackageTaskHandlerConfiguration):
     """Specialized configuration for the Landscape package-changer."""
 
+    def make_parser(self):
+        """
+        Specialize L{Configuration.make_parser}, adding options
+        changer-specific options.
+        """
+        parser = super().make_parser()
+        parser.add_option(
+            "--package-changes-batch-size",
+            type="int",
+            metavar="NUMBER",
+            help="The maximum number of queued change-packages operations "
+            "to perform in a single transaction (default: 1).",
+        )
+        return parser
+
     @property
     def binaries_path(self):
         """The path to the directory we store server-generated packages in."""
@@ -95,6 +111,9 @@ class PackageChanger(PackageTaskHandler):
         else:
             self._landscape_reactor = landscape_reactor
         self.reboot_required_filename = reboot_required_filename
+        # The ids of the tasks which failed as part of a batch, and are
+        # handled on their own.
+        self._unbatched_task_ids = set()
 
     def run(self):
         """
@@ -133,6 +152,9 @@ class PackageChanger(PackageTaskHandler):
         """
         message = task.data
         if message["type"] == "change-packages":
+            batch = self.get_batch(task)
+            if batch:
+                return self.handle_change_packages_batch(task, batch)
             result = maybeDeferred(self.handle_change_packages, message)
             return result.addErrback(self.unknown_package_data_error, task)
         if message["type"] == "change-package-locks":
@@ -363,6 +385,124 @@ class PackageChanger(PackageTaskHandler):
             deferred.addCallback(self._reboot_later)
         return deferred
 
+    def get_batch(self, task):
+        """Return the queued tasks to perform in one transaction with C{task}.
+
+        Batching is enabled by the C{package_changes_batch_size} option.
+        The tasks following C{task} in the queue are merged as long as they
+        don't carry binaries, don't require a reboot and don't undo the
+        changes of the ones before them.
+
+        @return: The tasks to merge, not including C{task} itself, or an
+            empty list if C{task} must be handled on its own.
+        """
+        batch_size = self._config.package_changes_batch_size or 1
+        if (
+            batch_size < 2
+            or task.id in self._unbatched_task_ids
+            or not self._is_batchable(task.data)
+        ):
+            return []
+        marks = {}
+        self._add_marks(marks, task.data)
+        batch = []
+        for next_task in self._store.get_next_tasks(
+            self.queue_name,
+            batch_size,
+        ):
+            if next_task.id == task.id:
+                continue
+            self._decode_task_type(next_task)
+            message = next_task.data
+            if (
+                next_task.id in self._unbatched_task_ids
+                or not self._is_batchable(message)
+                or self._conflicts(marks, message)
+            ):
+                break
+            self._add_marks(marks, message)
+            batch.append(next_task)
+        return batch
+
+    def _is_batchable(self, message):
+        return (
+            message["type"] == "change-packages"
+            and not message.get("binaries")
+            and not message.get("reboot-if-necessary")
+        )
+
+    def _add_marks(self, marks, message):
+        for key in ("install", "remove", "hold", "remove-hold"):
+            marks.setdefault(key, set()).update(message.get(key, ()))
+        if message.get("upgrade-all", False):
+            marks["upgrade-all"] = True
+
+    def _conflicts(self, marks, message):
+        """Whether C{message} reverts some of the changes in C{marks}."""
+        for key, other_key in [
+            ("install", "remove"),
+            ("remove", "install"),
+            ("hold", "remove-hold"),
+            ("remove-hold", "hold"),
+        ]:
+            if marks[other_key].intersection(message.get(key, ())):
+                return True
+        return False
+
+    def handle_change_packages_batch(self, task, batch):
+        """Perform the changes of C{task} and C{batch} in one transaction.
+
+        A C{change-packages-result} is sent for each of the tasks. The
+        merged transaction is resolved with L{POLICY_STRICT}, and if it
+        fails the tasks are handled one by one instead, so that each gets
+        its own result, with the policy it asked for.
+        """
+        tasks = [task] + batch
+        marks = {}
+        for each_task in tasks:
+            self._add_marks(marks, each_task.data)
+
+        self.init_channels()
+        try:
+            self.mark_packages(
+                upgrade=marks.get("upgrade-all", False),
+                install=sorted(marks["install"]),
+                remove=sorted(marks["remove"]),
+                hold=sorted(marks["hold"]),
+                remove_hold=sorted(marks["remove-hold"]),
+            )
+            result = self.change_packages(POLICY_STRICT)
+        except UnknownPackageData:
+            result = None
+
+        if result is None or result.code != SUCCESS_RESULT:
+            logging.info(
+                f"Performing {len(tasks)} batched package changes failed, "
+                "performing them one by one.",
+            )
+            self._unbatched_task_ids.update(
+                each_task.id for each_task in tasks
+            )
+            return self.handle_task(task)
+
+        logging.info(f"Performed {len(tasks)} package changes in one batch.")
+        deferred = gather_results(
+            [
+                self._send_response(None, each_task.data, result)
+                for each_task in tasks
+            ],
+        )
+        return deferred.addCallback(lambda _: self._remove_batch(batch))
+
+    def _remove_batch(self, batch):
+        """
+        Remove the tasks merged into the one being handled, which is
+        removed by L{_handle_next_task} like any other.
+        """
+        for task in batch:
+            task.remove()
+            self._count += 1
+
     def _reboot_later(self, result):
         self._landscape_reactor.call_later(5, self._run_reboot)
 
@@ -3,8 +3,10 @@ try:
 except ImportError:
     import urllib.parse as urlparse
 
+import json
 import locale
 import logging
+import tempfile
 import time
 import os
 import glob
@@ -13,6 +15,7 @@ import re
 
 from twisted.internet.defer import (
     Deferred,
+    maybeDeferred,
     succeed,
     inlineCallbacks,
     returnValue,
@@ -22,13 +25,18 @@ from landscape.lib import bpickle
 from landscape.lib.apt.package.store import (
     UnknownHashIDRequest,
     FakePackageStore,
+    HashIdIndex,
 )
+from landscape.lib.bitmap import IdBitmap
 from landscape.lib.config import get_bindir
 from landscape.lib.sequenceranges import sequence_to_ranges
 from landscape.lib.twisted_util import gather_results, spawn_process
-from landscape.lib.fetch import fetch_async
-from landscape.lib.fs import touch_file, create_binary_file
+from landscape.lib.fetch import fetch_ranges_async
+from landscape.lib.fs import touch_file
+from landscape.lib.monitor import health_stats
 from landscape.lib.os_release import parse_os_release
+from landscape.client.health import get_health_message
+from landscape.client.health import reset_health_stats
 from landscape.client.package.taskhandler import (
     PackageTaskHandlerConfiguration,
     PackageTaskHandler,
@@ -42,6 +50,13 @@ LOCK_RETRY_DELAYS = [0, 20, 40]
 PYTHON_BIN = "/usr/bin/python3"
 RELEASE_UPGRADER_PATTERN = "/tmp/ubuntu-release-upgrader-"
 UID_ROOT = "0"
+APT_UPDATE_STATS_FD = 3
+# The summary apt-get prints at the end of an update, the size being in
+# powers of 1000 of bytes, like "Fetched 1,234 kB in 2s (617 kB/s)".
+APT_FETCHED_PATTERN = re.compile(
+    rb"^Fetched ([\d.,]+) ?([kMGTPEZY]?)B in ",
+    re.MULTILINE,
+)
 
 
 class PackageReporterConfiguration(PackageTaskHandlerConfiguration):
@@ -59,6 +74,20 @@ class PackageReporterConfiguration(PackageTaskHandlerConfiguration):
             action="store_true",
             help="Force running apt-update.",
         )
+        parser.add_option(
+            "--apt-update-max-hosts",
+            type="int",
+            metavar="NUMBER",
+            help="The maximum number of connections to fetch package "
+            "indexes over in parallel, to all the mirrors together.",
+        )
+        parser.add_option(
+            "--apt-update-pipeline-depth",
+            type="int",
+            metavar="NUMBER",
+            help="The maximum number of index requests in flight on the "
+            "connection to each mirror.",
+        )
         parser.add_option(
             "--http-proxy",
             metavar="URL",
@@ -86,6 +115,7 @@ class PackageReporter(PackageTaskHandler):
     sources_list_filename = "/etc/apt/sources.list"
     sources_list_directory = "/etc/apt/sources.list.d"
     _got_task = False
+    _apt_update_stats = None
 
     def run(self):
         self._got_task = False
@@ -94,29 +124,75 @@ class PackageReporter(PackageTaskHandler):
         # Set us up to communicate properly
         result.addCallback(lambda x: self.get_session_id())
 
-        result.addCallback(lambda x: self.run_apt_update())
+        result.addCallback(
+            lambda x: self._run_phase("apt-update", self.run_apt_update),
+        )
 
         # If the appropriate hash=>id db is not there, fetch it
-        result.addCallback(lambda x: self.fetch_hash_id_db())
+        result.addCallback(
+            lambda x: self._run_phase(
+                "fetch-hash-id-db",
+                self.fetch_hash_id_db,
+            ),
+        )
 
         # Attach the hash=>id database if available
         result.addCallback(lambda x: self.use_hash_id_db())
 
         # Now, handle any queued tasks.
-        result.addCallback(lambda x: self.handle_tasks())
+        result.addCallback(
+            lambda x: self._run_phase("handle-tasks", self.handle_tasks),
+        )
 
         # Then, remove any expired hash=>id translation requests.
         result.addCallback(lambda x: self.remove_expired_hash_id_requests())
 
         # After that, check if we have any unknown hashes to request.
-        result.addCallback(lambda x: self.request_unknown_hashes())
+        result.addCallback(
+            lambda x: self._run_phase(
+                "request-unknown-hashes",
+                self.request_unknown_hashes,
+            ),
+        )
 
         # Finally, verify if we have anything new to report to the server.
-        result.addCallback(lambda x: self.detect_changes())
+        result.addCallback(
+            lambda x: self._run_phase("detect-changes", self.detect_changes),
+        )
+
+        # And report how long all of that took, if asked to.
+        result.addCallback(lambda x: self.send_health())
 
         result.callback(None)
         return result
 
+    def _run_phase(self, name, method):
+        """Run a phase of L{run}, recording the time it took."""
+        start = health_stats.time()
+        result = maybeDeferred(method)
+
+        def record_phase_time(result):
+            health_stats.record_since(f"reporter-phase-time:{name}", start)
+            return result
+
+        return result.addBoth(record_phase_time)
+
+    def send_health(self):
+        """
+        Send the health statistics of this run in a C{client-health}
+        message, if C{client_health_interval} is set.
+        """
+        if not self._config.client_health_interval:
+            return succeed(None)
+        return self._broker.call_if_accepted(
+            "client-health",
+            self._send_health_message,
+        )
+
+    def _send_health_message(self):
+        result = self.send_message(get_health_message("package-reporter"))
+        return result.addCallback(reset_health_stats)
+
     def send_message(self, message):
         return self._broker.send_message(message, self._session_id, True)
 
@@ -129,7 +205,9 @@ class PackageReporter(PackageTaskHandler):
         The format of the database filename is <uuid>_<codename>_<arch>,
         and it will be downloaded from the HTTP directory set in
         config.package_hash_id_url, or config.url/hash-id-databases if
-        the former is not set.
+        the former is not set. It's downloaded in ranges, resuming with the
+        missing ones after a failure, and verified against the SHA-256
+        digest in the <filename>.sha256 file next to it, if there's one.
 
         Fetch failures are handled gracefully and logged as appropriate.
         """
@@ -152,8 +230,7 @@ class PackageReporter(PackageTaskHandler):
             # Cast to str as pycurl doesn't like unicode
             url = str(base_url + os.path.basename(hash_id_db_filename))
 
-            def fetch_ok(data):
-                create_binary_file(hash_id_db_filename, data)
+            def fetch_ok(filename):
                 logging.info(f"Downloaded hash=>id database from {url}")
 
             def fetch_error(failure):
@@ -167,8 +244,10 @@ class PackageReporter(PackageTaskHandler):
             else:
                 proxy = self._config.get("http_proxy")
 
-            result = fetch_async(
+            result = fetch_ranges_async(
                 url,
+                hash_id_db_filename,
+                checksum_url=url + ".sha256",
                 cainfo=self._config.get("ssl_public_key"),
                 proxy=proxy,
             )
@@ -309,11 +388,14 @@ class PackageReporter(PackageTaskHandler):
                     self._apt_update,
                     deferred,
                 )
+                started = self._reactor.time() + LOCK_RETRY_DELAYS[retry]
                 out, err, code = yield deferred
                 out = out.decode("utf-8")
                 err = err.decode("utf-8")
 
                 timestamp = self._reactor.time()
+                health_stats.record("apt-update-time", timestamp - started)
+                health_stats.set("apt-update-exit-code", code)
 
                 touch_file(self._config.update_stamp_filename)
                 logging.debug(
@@ -359,6 +441,7 @@ class PackageReporter(PackageTaskHandler):
                     timestamp,
                     code,
                     err,
+                    self._apt_update_stats,
                 )
                 yield returnValue((out, err, code))
         else:
@@ -367,6 +450,28 @@ class PackageReporter(PackageTaskHandler):
             )
             yield returnValue(("", "", 0))
 
+    def _get_apt_update_options(self):
+        """
+        Return the apt options limiting how many connections the indexes
+        are fetched over in parallel, and how many requests are in flight
+        on each of them.
+
+        Indexes are already queued per mirror by apt, which sends
+        conditional requests and prefers by-hash pdiffs when the archive
+        supports them. apt-get doesn't report how long each source took,
+        so only the totals of the update are known.
+        """
+        options = {}
+        if self._config.apt_update_max_hosts:
+            options["Acquire::QueueHost::Limit"] = str(
+                self._config.apt_update_max_hosts,
+            )
+        if self._config.apt_update_pipeline_depth is not None:
+            options["Acquire::http::Pipeline-Depth"] = str(
+                self._config.apt_update_pipeline_depth,
+            )
+        return options
+
     def _apt_update(self, deferred):
         """
         Run apt-update using the passed in deferred, which allows for callers
@@ -378,19 +483,80 @@ class PackageReporter(PackageTaskHandler):
         if self._config.https_proxy:
             env["https_proxy"] = self._config.https_proxy
 
+        args = ["--stats-fd", str(APT_UPDATE_STATS_FD)]
+        for name, value in sorted(self._get_apt_update_options().items()):
+            args.extend(["-o", f"{name}={value}"])
+
+        self._apt_update_stats = None
+        stats_file = tempfile.TemporaryFile()
+        child_fds = {0: "w", 1: "r", 2: "r"}
+        child_fds[APT_UPDATE_STATS_FD] = stats_file.fileno()
+
         try:
-            result = spawn_process(self.apt_update_filename, env=env)
+            result = spawn_process(
+                self.apt_update_filename,
+                args=args,
+                env=env,
+                child_fds=child_fds,
+            )
         except Exception as e:
+            stats_file.close()
             return deferred.callback((b"", str(e).encode(), e.errno))
 
         def callback(args, deferred):
+            with stats_file:
+                stats_file.seek(0)
+                stats = self._parse_apt_update_stats(stats_file.read())
+            fetched_bytes = self._parse_fetched_bytes(args[0])
+            if fetched_bytes is not None:
+                stats = stats or {}
+                stats["fetched-bytes"] = fetched_bytes
+            self._apt_update_stats = stats
             return deferred.callback(args)
 
         return result.addCallback(callback, deferred)
 
-    def send_result(self, timestamp, code, err):
+    def _parse_apt_update_stats(self, data):
+        """
+        Parse the JSON statistics written by apt-update on its statistics
+        descriptor, returning C{None} if there are none.
+        """
+        if not data:
+            return None
+        try:
+            stats = json.loads(data)
+        except ValueError:
+            logging.warning(f"Invalid apt-update statistics: {data!r}")
+            return None
+        return {
+            key: value
+            for key, value in stats.items()
+            if isinstance(value, (int, float))
+        }
+
+    def _parse_fetched_bytes(self, out):
+        """
+        Return the number of bytes apt-get says it fetched in its output,
+        or C{None} if it doesn't say, like when nothing was fetched.
+        """
+        match = APT_FETCHED_PATTERN.search(out)
+        if match is None:
+            return None
+        size, unit = match.groups()
+        try:
+            size = float(size.replace(b",", b""))
+        except ValueError:
+            return None
+        if unit:
+            size *= 1000 ** (b"kMGTPEZY".index(unit) + 1)
+        return round(size)
+
+    def send_result(self, timestamp, code, err, stats=None):
         """
         Report the package reporter result to the server in a message.
+
+        @param stats: Optional timing and resource usage statistics of the
+            apt update, mapping names to numbers.
         """
         message = {
             "type": "package-reporter-result",
@@ -398,6 +564,8 @@ class PackageReporter(PackageTaskHandler):
             "code": code,
             "err": err,
         }
+        if stats:
+            message["stats"] = stats
         return self.send_message(message)
 
     def handle_task(self, task):
@@ -509,6 +677,10 @@ class PackageReporter(PackageTaskHandler):
                     f"Removing cached hash=>id database {hash_id_db_filename}",
                 )
                 os.remove(hash_id_db_filename)
+            if hash_id_db_filename:
+                index_filename = HashIdIndex.get_filename(hash_id_db_filename)
+                if os.path.exists(index_filename):
+                    os.remove(index_filename)
 
         result = self._determine_hash_id_db_filename()
         result.addCallback(_remove_it)
@@ -553,12 +725,12 @@ class PackageReporter(PackageTaskHandler):
         """
         self._facade.ensure_channels_reloaded()
 
-        unknown_hashes = set()
-
-        for package in self._facade.get_packages():
-            hash = self._facade.get_package_hash(package)
-            if self._store.get_hash_id(hash) is None:
-                unknown_hashes.add(self._facade.get_package_hash(package))
+        hashes = [
+            self._facade.get_package_hash(package)
+            for package in self._facade.get_packages()
+        ]
+        hash_ids = self._store.get_hash_ids(hashes)
+        unknown_hashes = {hash for hash in hashes if hash not in hash_ids}
 
         # Discard unknown hashes in existent requests.
         for request in self._store.iter_hash_id_requests():
@@ -682,24 +854,30 @@ class PackageReporter(PackageTaskHandler):
         """
         self._facade.ensure_channels_reloaded()
 
-        old_installed = set(self._store.get_installed())
-        old_available = set(self._store.get_available())
-        old_upgrades = set(self._store.get_available_upgrades())
-        old_locked = set(self._store.get_locked())
-        old_autoremovable = set(self._store.get_autoremovable())
-        old_security = set(self._store.get_security())
-
-        current_installed = set()
-        current_available = set()
-        current_upgrades = set()
-        current_locked = set()
-        current_autoremovable = set()
-        current_security = set()
+        old_installed = self._store.get_package_state("installed")
+        old_available = self._store.get_package_state("available")
+        old_upgrades = self._store.get_package_state("available_upgrade")
+        old_locked = self._store.get_package_state("locked")
+        old_autoremovable = self._store.get_package_state("autoremovable")
+        old_security = self._store.get_package_state("security")
+
+        current_installed = []
+        current_available = []
+        current_upgrades = []
+        current_locked = []
+        current_autoremovable = []
+        current_security = []
         os_release_info = parse_os_release()
         backports_archive = "{}-backports".format(os_release_info["code-name"])
         security_archive = "{}-security".format(os_release_info["code-name"])
 
-        for package in self._facade.get_packages():
+        packages = list(self._facade.get_packages())
+        # Locked packages are among these, so resolve all the ids at once.
+        hash_ids = self._store.get_hash_ids(
+            [self._facade.get_package_hash(package) for package in packages],
+        )
+
+        for package in packages:
             # Don't include package versions from the official backports
             # archive. The backports archive is enabled by default since
             # xenial with a pinning policy of 100. Ideally we would
@@ -720,20 +898,20 @@ class PackageReporter(PackageTaskHandler):
                 # user wants to get updates from it.
                 continue
             hash = self._facade.get_package_hash(package)
-            id = self._store.get_hash_id(hash)
+            id = hash_ids.get(hash)
             if id is not None:
                 if self._facade.is_package_installed(package):
-                    current_installed.add(id)
+                    current_installed.append(id)
                     if self._facade.is_package_available(package):
-                        current_available.add(id)
+                        current_available.append(id)
                     if self._facade.is_package_autoremovable(package):
-                        current_autoremovable.add(id)
+                        current_autoremovable.append(id)
                 else:
-                    current_available.add(id)
+                    current_available.append(id)
 
                 # Are there any packages that this package is an upgrade for?
                 if self._facade.is_package_upgrade(package):
-                    current_upgrades.add(id)
+                    current_upgrades.append(id)
 
                 # Is this package present in the security pocket?
                 security_origins = any(
@@ -742,13 +920,20 @@ class PackageReporter(PackageTaskHandler):
                     if origin.archive == security_archive
                 )
                 if security_origins:
-                    current_security.add(id)
+                    current_security.append(id)
 
         for package in self._facade.get_locked_packages():
             hash = self._facade.get_package_hash(package)
-            id = self._store.get_hash_id(hash)
+            id = hash_ids.get(hash)
             if id is not None:
-                current_locked.add(id)
+                current_locked.append(id)
+
+        current_installed = IdBitmap(current_installed)
+        current_available = IdBitmap(current_available)
+        current_upgrades = IdBitmap(current_upgrades)
+        current_locked = IdBitmap(current_locked)
+        current_autoremovable = IdBitmap(current_autoremovable)
+        current_security = IdBitmap(current_security)
 
         new_installed = current_installed - old_installed
         new_available = current_available - old_available
@@ -767,52 +952,52 @@ class PackageReporter(PackageTaskHandler):
         message = {}
         if new_installed:
             message["installed"] = list(
-                sequence_to_ranges(sorted(new_installed)),
+                sequence_to_ranges(new_installed),
             )
         if new_available:
             message["available"] = list(
-                sequence_to_ranges(sorted(new_available)),
+                sequence_to_ranges(new_available),
             )
         if new_upgrades:
             message["available-upgrades"] = list(
-                sequence_to_ranges(sorted(new_upgrades)),
+                sequence_to_ranges(new_upgrades),
             )
         if new_locked:
-            message["locked"] = list(sequence_to_ranges(sorted(new_locked)))
+            message["locked"] = list(sequence_to_ranges(new_locked))
 
         if new_autoremovable:
             message["autoremovable"] = list(
-                sequence_to_ranges(sorted(new_autoremovable)),
+                sequence_to_ranges(new_autoremovable),
             )
         if not_autoremovable:
             message["not-autoremovable"] = list(
-                sequence_to_ranges(sorted(not_autoremovable)),
+                sequence_to_ranges(not_autoremovable),
             )
 
         if new_security:
             message["security"] = list(
-                sequence_to_ranges(sorted(new_security)),
+                sequence_to_ranges(new_security),
             )
         if not_security:
             message["not-security"] = list(
-                sequence_to_ranges(sorted(not_security)),
+                sequence_to_ranges(not_security),
             )
 
         if not_installed:
             message["not-installed"] = list(
-                sequence_to_ranges(sorted(not_installed)),
+                sequence_to_ranges(not_installed),
             )
         if not_available:
             message["not-available"] = list(
-                sequence_to_ranges(sorted(not_available)),
+                sequence_to_ranges(not_available),
             )
         if not_upgrades:
             message["not-available-upgrades"] = list(
-                sequence_to_ranges(sorted(not_upgrades)),
+                sequence_to_ranges(not_upgrades),
             )
         if not_locked:
             message["not-locked"] = list(
-                sequence_to_ranges(sorted(not_locked)),
+                sequence_to_ranges(not_locked),
             )
 
         if not message:
@@ -838,30 +1023,16 @@ class PackageReporter(PackageTaskHandler):
         )
 
         def update_currently_known(result):
-            if new_installed:
-                self._store.add_installed(new_installed)
-            if not_installed:
-                self._store.remove_installed(not_installed)
-            if new_available:
-                self._store.add_available(new_available)
-            if new_locked:
-                self._store.add_locked(new_locked)
-            if new_autoremovable:
-                self._store.add_autoremovable(new_autoremovable)
-            if not_available:
-                self._store.remove_available(not_available)
-            if new_upgrades:
-                self._store.add_available_upgrades(new_upgrades)
-            if not_upgrades:
-                self._store.remove_available_upgrades(not_upgrades)
-            if not_locked:
-                self._store.remove_locked(not_locked)
-            if not_autoremovable:
-                self._store.remove_autoremovable(not_autoremovable)
-            if new_security:
-                self._store.add_security(new_security)
-            if not_security:
-                self._store.remove_security(not_security)
+            self._store.set_package_states(
+                {
+                    "installed": current_installed,
+                    "available": current_available,
+                    "available_upgrade": current_upgrades,
+                    "locked": current_locked,
+                    "autoremovable": current_autoremovable,
+                    "security": current_security,
+                },
+            )
             # Something has changed wrt the former run, let's update the
             # timestamp and return True.
             stamp_file = self._config.detect_package_changes_stamp
@@ -41,6 +41,11 @@ class PackageTaskHandlerConfiguration(Configuration):
         """Get the path to the directory holding the stock hash-id stores."""
         return os.path.join(self.package_directory, "hash-id")
 
+    @property
+    def hash_cache_filename(self):
+        """Get the path to the file caching the package hashes."""
+        return os.path.join(self.package_directory, "hash-cache")
+
     @property
     def update_stamp_filename(self):
         """Get the path to the update-stamp file."""
@@ -307,8 +312,10 @@ def run_task_handler(cls, args, reactor=None):
     # Delay importing of the facades so that we don't
     # import Apt unless we need to.
     from landscape.lib.apt.package.facade import AptFacade
+    from landscape.lib.apt.package.hashing import HashCache
 
     package_facade = AptFacade()
+    package_facade.hash_cache = HashCache(config.hash_cache_filename)
 
     def finish():
         connector.disconnect()
@@ -684,6 +684,162 @@ class AptPackageChangerTest(LandscapeTest):
 
         return result.addCallback(got_result)
 
+    def test_batched_operations(self):
+        """
+        With a C{package_changes_batch_size}, queued operations are
+        performed in a single transaction, and each gets its result.
+        """
+        self.config.package_changes_batch_size = 5
+        installed_hash = self.set_pkg1_installed()
+        self.store.set_hash_ids({installed_hash: 1, HASH2: 2, HASH3: 3})
+        self.store.add_task(
+            "changer",
+            {"type": "change-packages", "install": [2], "operation-id": 123},
+        )
+        self.store.add_task(
+            "changer",
+            {"type": "change-packages", "install": [3], "operation-id": 124},
+        )
+        calls = []
+
+        def return_good_result(facade):
+            calls.append(
+                sorted(
+                    version.package.name
+                    for version in facade._version_installs
+                ),
+            )
+            return "Yeah, I did whatever you've asked for!"
+
+        self.replace_perform_changes(return_good_result)
+
+        result = self.changer.handle_tasks()
+
+        def got_result(result):
+            self.assertEqual(calls, [["name2", "name3"]])
+            self.assertMessages(
+                self.get_pending_messages(),
+                [
+                    {
+                        "operation-id": operation_id,
+                        "result-code": SUCCESS_RESULT,
+                        "result-text": "Yeah, I did whatever you've "
+                        "asked for!",
+                        "type": "change-packages-result",
+                    }
+                    for operation_id in (123, 124)
+                ],
+            )
+            self.assertIsNone(self.store.get_next_task("changer"))
+            self.assertEqual(self.changer.handled_tasks_count, 2)
+
+        return result.addCallback(got_result)
+
+    def test_batched_operations_failing(self):
+        """
+        If the batched transaction fails, the operations are performed one
+        by one, to get their own results.
+        """
+        self.config.package_changes_batch_size = 5
+        installed_hash = self.set_pkg1_installed()
+        self.store.set_hash_ids({installed_hash: 1, HASH2: 2, HASH3: 3})
+        self.store.add_task(
+            "changer",
+            {"type": "change-packages", "install": [2], "operation-id": 123},
+        )
+        self.store.add_task(
+            "changer",
+            {"type": "change-packages", "install": [3], "operation-id": 124},
+        )
+        calls = []
+
+        def perform_changes(facade):
+            calls.append(len(facade._version_installs))
+            if len(facade._version_installs) > 1:
+                raise TransactionError("Batch failed")
+            return "Done"
+
+        self.replace_perform_changes(perform_changes)
+
+        result = self.changer.handle_tasks()
+
+        def got_result(result):
+            self.assertEqual(calls, [2, 1, 1])
+            messages = self.get_pending_messages()
+            self.assertEqual(
+                [message["operation-id"] for message in messages],
+                [123, 124],
+            )
+            self.assertEqual(
+                [message["result-code"] for message in messages],
+                [SUCCESS_RESULT, SUCCESS_RESULT],
+            )
+            self.assertIsNone(self.store.get_next_task("changer"))
+
+        return result.addCallback(got_result)
+
+    def test_get_batch(self):
+        """
+        The operations following a task in the queue are batched with it,
+        up to the first one which can't be.
+        """
+        self.config.package_changes_batch_size = 5
+        task = self.store.add_task(
+            "changer",
+            {"type": "change-packages", "install": [1], "operation-id": 1},
+        )
+        other_task = self.store.add_task(
+            "changer",
+            {
+                "type": "change-packages",
+                "upgrade-all": True,
+                "operation-id": 2,
+            },
+        )
+        self.store.add_task(
+            "changer",
+            {"type": "change-packages", "remove": [1], "operation-id": 3},
+        )
+        self.store.add_task(
+            "changer",
+            {"type": "change-packages", "install": [2], "operation-id": 4},
+        )
+        self.assertEqual(
+            [each.id for each in self.changer.get_batch(task)],
+            [other_task.id],
+        )
+
+    def test_get_batch_not_batchable(self):
+        """
+        Operations with binaries or a reboot aren't batched, nor is
+        anything by default.
+        """
+        task = self.store.add_task(
+            "changer",
+            {"type": "change-packages", "install": [1], "operation-id": 1},
+        )
+        self.store.add_task(
+            "changer",
+            {
+                "type": "change-packages",
+                "install": [2],
+                "reboot-if-necessary": True,
+                "operation-id": 2,
+            },
+        )
+        self.store.add_task(
+            "changer",
+            {
+                "type": "change-packages",
+                "install": [3],
+                "binaries": [(HASH2, 3, PKGDEB2)],
+                "operation-id": 3,
+            },
+        )
+        self.assertEqual(self.changer.get_batch(task), [])
+        self.config.package_changes_batch_size = 5
+        self.assertEqual(self.changer.get_batch(task), [])
+
     def test_successful_operation_with_binaries(self):
         """
         Simulate a successful operation involving server-generated binary
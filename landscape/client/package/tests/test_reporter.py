@@ -36,8 +36,10 @@ from landscape.lib.apt.package.testing import HASH3
 from landscape.lib.apt.package.testing import PKGNAME1
 from landscape.lib.apt.package.testing import SimpleRepositoryHelper
 from landscape.lib.fetch import FetchError
+from landscape.lib.fs import create_binary_file
 from landscape.lib.fs import create_text_file
 from landscape.lib.fs import touch_file
+from landscape.lib.monitor import health_stats
 from landscape.lib.os_release import get_os_filename
 from landscape.lib.os_release import parse_os_release
 from landscape.lib.testing import EnvironSaverHelper
@@ -59,6 +61,16 @@ UBUNTU_CODENAME=codename
 """
 
 
+def fake_fetch_ranges_async(url, filename, **kwargs):
+    """Pretend to download the C{url} to C{filename}."""
+
+    def download(filename):
+        create_binary_file(filename, b"hash-ids")
+        return filename
+
+    return succeed(filename).addCallback(download)
+
+
 class PackageReporterConfigurationTest(LandscapeTest):
     def test_force_apt_update_option(self):
         """
@@ -383,11 +395,11 @@ class PackageReporterAptTest(LandscapeTest):
         return deferred.addCallback(got_result)
 
     @mock.patch(
-        "landscape.client.package.reporter.fetch_async",
-        return_value=succeed(b"hash-ids"),
+        "landscape.client.package.reporter.fetch_ranges_async",
+        side_effect=fake_fetch_ranges_async,
     )
     @mock.patch("logging.info", return_value=None)
-    def test_fetch_hash_id_db(self, logging_mock, mock_fetch_async):
+    def test_fetch_hash_id_db(self, logging_mock, mock_fetch):
         # Assume package_hash_id_url is set
         self.config.data_path = self.makeDir()
         self.config.package_hash_id_url = "http://fake.url/path/"
@@ -423,19 +435,26 @@ class PackageReporterAptTest(LandscapeTest):
         logging_mock.assert_called_once_with(
             f"Downloaded hash=>id database from {hash_id_db_url}",
         )
-        mock_fetch_async.assert_called_once_with(
+        mock_fetch.assert_called_once_with(
             hash_id_db_url,
+            os.path.join(
+                self.config.data_path,
+                "package",
+                "hash-id",
+                "uuid_codename_arch",
+            ),
+            checksum_url=hash_id_db_url + ".sha256",
             cainfo=None,
             proxy=None,
         )
         return result
 
     @mock.patch(
-        "landscape.client.package.reporter.fetch_async",
-        return_value=succeed(b"hash-ids"),
+        "landscape.client.package.reporter.fetch_ranges_async",
+        side_effect=fake_fetch_ranges_async,
     )
     @mock.patch("logging.info", return_value=None)
-    def test_fetch_hash_id_db_with_proxy(self, logging_mock, mock_fetch_async):
+    def test_fetch_hash_id_db_with_proxy(self, logging_mock, mock_fetch):
         """fetching hash-id-db uses proxy settings"""
         # Assume package_hash_id_url is set
         self.config.data_path = self.makeDir()
@@ -455,15 +474,22 @@ class PackageReporterAptTest(LandscapeTest):
         self.config.https_proxy = "http://helloproxy:8000"
 
         result = self.reporter.fetch_hash_id_db()
-        mock_fetch_async.assert_called_once_with(
+        mock_fetch.assert_called_once_with(
             hash_id_db_url,
+            os.path.join(
+                self.config.data_path,
+                "package",
+                "hash-id",
+                "uuid_codename_arch",
+            ),
+            checksum_url=hash_id_db_url + ".sha256",
             cainfo=None,
             proxy="http://helloproxy:8000",
         )
         return result
 
-    @mock.patch("landscape.client.package.reporter.fetch_async")
-    def test_fetch_hash_id_db_does_not_download_twice(self, mock_fetch_async):
+    @mock.patch("landscape.client.package.reporter.fetch_ranges_async")
+    def test_fetch_hash_id_db_does_not_download_twice(self, mock_fetch):
         # Let's say that the hash=>id database is already there
         self.config.package_hash_id_url = "http://fake.url/path/"
         self.config.data_path = self.makeDir()
@@ -486,7 +512,7 @@ class PackageReporterAptTest(LandscapeTest):
 
         def callback(ignored):
             # Check that fetch_async hasn't been called
-            mock_fetch_async.assert_not_called()
+            mock_fetch.assert_not_called()
 
             # The hash=>id database is still there
             self.assertEqual(open(hash_id_db_filename).read(), "test")
@@ -546,10 +572,10 @@ class PackageReporterAptTest(LandscapeTest):
         return result
 
     @mock.patch(
-        "landscape.client.package.reporter.fetch_async",
-        return_value=succeed(b"hash-ids"),
+        "landscape.client.package.reporter.fetch_ranges_async",
+        side_effect=fake_fetch_ranges_async,
     )
-    def test_fetch_hash_id_db_with_default_url(self, mock_fetch_async):
+    def test_fetch_hash_id_db_with_default_url(self, mock_fetch):
         # Let's say package_hash_id_url is not set but url is
         self.config.data_path = self.makeDir()
         self.config.package_hash_id_url = None
@@ -580,22 +606,29 @@ class PackageReporterAptTest(LandscapeTest):
             self.assertEqual(open(hash_id_db_filename).read(), "hash-ids")
 
         result.addCallback(callback)
-        mock_fetch_async.assert_called_once_with(
+        mock_fetch.assert_called_once_with(
             hash_id_db_url,
+            os.path.join(
+                self.config.data_path,
+                "package",
+                "hash-id",
+                "uuid_codename_arch",
+            ),
+            checksum_url=hash_id_db_url + ".sha256",
             cainfo=None,
             proxy=None,
         )
         return result
 
     @mock.patch(
-        "landscape.client.package.reporter.fetch_async",
+        "landscape.client.package.reporter.fetch_ranges_async",
         return_value=fail(FetchError("fetch error")),
     )
     @mock.patch("logging.warning", return_value=None)
     def test_fetch_hash_id_db_with_download_error(
         self,
         logging_mock,
-        mock_fetch_async,
+        mock_fetch,
     ):
         # Assume package_hash_id_url is set
         self.config.data_path = self.makeDir()
@@ -627,8 +660,15 @@ class PackageReporterAptTest(LandscapeTest):
         logging_mock.assert_called_once_with(
             "Couldn't download hash=>id database: fetch error",
         )
-        mock_fetch_async.assert_called_once_with(
+        mock_fetch.assert_called_once_with(
             hash_id_db_url,
+            os.path.join(
+                self.config.data_path,
+                "package",
+                "hash-id",
+                "uuid_codename_arch",
+            ),
+            checksum_url=hash_id_db_url + ".sha256",
             cainfo=None,
             proxy=None,
         )
@@ -666,10 +706,10 @@ class PackageReporterAptTest(LandscapeTest):
         return result
 
     @mock.patch(
-        "landscape.client.package.reporter.fetch_async",
-        return_value=succeed(b"hash-ids"),
+        "landscape.client.package.reporter.fetch_ranges_async",
+        side_effect=fake_fetch_ranges_async,
     )
-    def test_fetch_hash_id_db_with_custom_certificate(self, mock_fetch_async):
+    def test_fetch_hash_id_db_with_custom_certificate(self, mock_fetch):
         """
         The L{PackageReporter.fetch_hash_id_db} method takes into account the
         possible custom SSL certificate specified in the client configuration.
@@ -691,8 +731,15 @@ class PackageReporterAptTest(LandscapeTest):
 
         # Now go!
         result = self.reporter.fetch_hash_id_db()
-        mock_fetch_async.assert_called_once_with(
+        mock_fetch.assert_called_once_with(
             hash_id_db_url,
+            os.path.join(
+                self.config.data_path,
+                "package",
+                "hash-id",
+                "uuid_codename_arch",
+            ),
+            checksum_url=hash_id_db_url + ".sha256",
             cainfo=self.config.ssl_public_key,
             proxy=None,
         )
@@ -1436,6 +1483,63 @@ class PackageReporterAptTest(LandscapeTest):
         self.assertTrue(self.reporter.request_unknown_hashes.called)
         self.assertTrue(self.reporter.detect_changes.called)
 
+    def test_run_health_stats(self):
+        """
+        The time taken by the phases of the run is recorded, and sent in a
+        C{client-health} message when C{client_health_interval} is set.
+        """
+        health_stats.reset()
+        message_store = self.broker_service.message_store
+        message_store.set_accepted_types(["client-health"])
+        self.config.client_health_interval = 3600
+        for name in (
+            "run_apt_update",
+            "fetch_hash_id_db",
+            "use_hash_id_db",
+            "handle_tasks",
+            "remove_expired_hash_id_requests",
+            "request_unknown_hashes",
+            "detect_changes",
+        ):
+            setattr(self.reporter, name, mock.Mock(return_value=succeed(None)))
+
+        def got_result(result):
+            [message] = message_store.get_pending_messages()
+            self.assertEqual(message["type"], "client-health")
+            self.assertEqual(message["component"], "package-reporter")
+            self.assertEqual(
+                sorted(message["histograms"]),
+                [
+                    "reporter-phase-time:apt-update",
+                    "reporter-phase-time:detect-changes",
+                    "reporter-phase-time:fetch-hash-id-db",
+                    "reporter-phase-time:handle-tasks",
+                    "reporter-phase-time:request-unknown-hashes",
+                ],
+            )
+            self.assertEqual(health_stats.get_summary()["histograms"], {})
+
+        return self.reporter.run().addCallback(got_result)
+
+    def test_send_health_not_accepted(self):
+        """
+        The health statistics aren't reset if the server doesn't accept
+        C{client-health} messages, so they're not lost.
+        """
+        health_stats.reset()
+        health_stats.record("apt-update-time", 3)
+        self.config.client_health_interval = 3600
+
+        def got_result(result):
+            message_store = self.broker_service.message_store
+            self.assertEqual(message_store.get_pending_messages(), [])
+            self.assertIn(
+                "apt-update-time",
+                health_stats.get_summary()["histograms"],
+            )
+
+        return self.reporter.send_health().addCallback(got_result)
+
     def test_main(self):
         mocktarget = "landscape.client.package.reporter.run_task_handler"
         with mock.patch(mocktarget) as m:
@@ -1610,6 +1714,32 @@ class PackageReporterAptTest(LandscapeTest):
         reactor.callWhenRunning(do_test)
         return deferred
 
+    def test_run_apt_update_health_stats(self):
+        """
+        The time taken by apt-update and its exit code are recorded in the
+        health statistics.
+        """
+        health_stats.reset()
+        self.makeFile("", path=self.config.update_stamp_filename)
+        self.config.load(["--force-apt-update"])
+        self._make_fake_apt_update(code=2)
+        warning_patcher = mock.patch.object(reporter.logging, "warning")
+        warning_patcher.start()
+        self.addCleanup(warning_patcher.stop)
+
+        def callback(args):
+            summary = health_stats.get_summary()
+            self.assertEqual(summary["values"]["apt-update-exit-code"], 2)
+            self.assertEqual(
+                summary["histograms"]["apt-update-time"]["count"],
+                1,
+            )
+
+        result = self.reporter.run_apt_update()
+        result.addCallback(callback)
+        self.reactor.advance(0)
+        return result
+
     def test_run_apt_update_with_force_apt_update(self):
         """
         L{PackageReporter.run_apt_update} forces an apt-update run if the
@@ -2088,6 +2218,131 @@ class PackageReporterAptTest(LandscapeTest):
         reactor.callWhenRunning(do_test)
         return deferred
 
+    @mock.patch(
+        "landscape.client.package.reporter.spawn_process",
+        return_value=succeed((b"", b"", 0)),
+    )
+    def test_run_apt_update_passes_fetch_limits(self, mock_spawn_process):
+        """
+        The concurrency limits from the configuration are passed to the
+        apt-update wrapper as apt options.
+        """
+        self.config.apt_update_max_hosts = 4
+        self.config.apt_update_pipeline_depth = 0
+        self.reporter.sources_list_filename = "/I/Dont/Exist"
+
+        update_result = self.reporter.run_apt_update()
+        self.reactor.advance(0)
+        self.successResultOf(update_result)
+
+        mock_spawn_process.assert_called_once_with(
+            self.reporter.apt_update_filename,
+            args=[
+                "--stats-fd",
+                "3",
+                "-o",
+                "Acquire::QueueHost::Limit=4",
+                "-o",
+                "Acquire::http::Pipeline-Depth=0",
+            ],
+            env={},
+            child_fds=mock.ANY,
+        )
+
+    def test_run_apt_update_report_stats(self):
+        """
+        The statistics apt-update writes on its statistics descriptor are
+        included in the package-reporter-result message.
+        """
+        message_store = self.broker_service.message_store
+        message_store.set_accepted_types(["package-reporter-result"])
+        self.reporter.apt_update_filename = self.makeFile(
+            "#!/bin/sh\n"
+            "test \"$1\" = --stats-fd || exit 1\n"
+            "echo '{\"setup-time\": 0.5, \"update-max-rss\": 1024}' >&$2\n",
+        )
+        os.chmod(self.reporter.apt_update_filename, 0o755)
+        deferred = Deferred()
+
+        def do_test():
+            result = self.reporter.run_apt_update()
+
+            def callback(ignore):
+                self.assertMessages(
+                    message_store.get_pending_messages(),
+                    [
+                        {
+                            "type": "package-reporter-result",
+                            "report-timestamp": 0.0,
+                            "code": 0,
+                            "err": "",
+                            "stats": {
+                                "setup-time": 0.5,
+                                "update-max-rss": 1024,
+                            },
+                        },
+                    ],
+                )
+
+            result.addCallback(callback)
+            self.reactor.advance(0)
+            result.chainDeferred(deferred)
+
+        reactor.callWhenRunning(do_test)
+        return deferred
+
+    def test_run_apt_update_report_fetched_bytes(self):
+        """
+        The number of bytes apt-get says it fetched is included in the
+        statistics of the package-reporter-result message.
+        """
+        message_store = self.broker_service.message_store
+        message_store.set_accepted_types(["package-reporter-result"])
+        self.reporter.apt_update_filename = self.makeFile(
+            "#!/bin/sh\n"
+            "echo 'Get:1 http://archive.ubuntu.com/ubuntu jammy InRelease'\n"
+            "echo 'Fetched 1,234 kB in 2s (617 kB/s)'\n",
+        )
+        os.chmod(self.reporter.apt_update_filename, 0o755)
+        deferred = Deferred()
+
+        def do_test():
+            result = self.reporter.run_apt_update()
+
+            def callback(ignore):
+                [message] = message_store.get_pending_messages()
+                self.assertEqual(message["stats"], {"fetched-bytes": 1234000})
+
+            result.addCallback(callback)
+            self.reactor.advance(0)
+            result.chainDeferred(deferred)
+
+        reactor.callWhenRunning(do_test)
+        return deferred
+
+    def test_parse_fetched_bytes(self):
+        """
+        The size apt-get prints in its summary is converted to bytes, and
+        is C{None} if there's no summary.
+        """
+        parse = self.reporter._parse_fetched_bytes
+        self.assertEqual(parse(b"Fetched 0 B in 0s (0 B/s)\n"), 0)
+        self.assertEqual(
+            parse(b"Fetched 23.4 MB in 3s (7,890 kB/s)"),
+            23400000,
+        )
+        self.assertIsNone(parse(b"All packages are up to date.\n"))
+
+    def test_parse_apt_update_stats_invalid(self):
+        """
+        Invalid apt-update statistics are logged and ignored.
+        """
+        with mock.patch.object(reporter.logging, "warning") as warning_mock:
+            self.assertIsNone(self.reporter._parse_apt_update_stats(b"{"))
+        warning_mock.assert_called_once_with(
+            "Invalid apt-update statistics: b'{'",
+        )
+
     @mock.patch(
         "landscape.client.package.reporter.spawn_process",
         return_value=succeed((b"", b"", 0)),
@@ -2107,7 +2362,9 @@ class PackageReporterAptTest(LandscapeTest):
 
         mock_spawn_process.assert_called_once_with(
             self.reporter.apt_update_filename,
+            args=["--stats-fd", "3"],
             env={"http_proxy": "http://proxy_server:8080"},
+            child_fds=mock.ANY,
         )
 
     @mock.patch(
@@ -2129,7 +2386,9 @@ class PackageReporterAptTest(LandscapeTest):
 
         mock_spawn_process.assert_called_once_with(
             self.reporter.apt_update_filename,
+            args=["--stats-fd", "3"],
             env={"https_proxy": "http://proxy_server:8443"},
+            child_fds=mock.ANY,
         )
 
     def test_run_apt_update_error_on_cache_file(self):
@@ -40,6 +40,17 @@ class PackageTaskHandlerConfigurationTest(LandscapeTest):
             "/var/lib/landscape/client/package/update-stamp",
         )
 
+    def test_hash_cache_filename(self):
+        """
+        L{PackageReporterConfiguration.hash_cache_filename} points to the
+        package hash cache, next to the package store.
+        """
+        config = PackageTaskHandlerConfiguration()
+        self.assertEqual(
+            config.hash_cache_filename,
+            "/var/lib/landscape/client/package/hash-cache",
+        )
+
 
 class PackageTaskHandlerTest(LandscapeTest):
     helpers = [AptFacadeHelper, EnvironSaverHelper, BrokerServiceHelper]
@@ -394,6 +405,10 @@ class PackageTaskHandlerTest(LandscapeTest):
             # Verify the arguments passed to the reporter constructor.
             self.assertEqual(type(store), PackageStore)
             self.assertEqual(type(facade), AptFacade)
+            self.assertEqual(
+                facade.hash_cache._filename,
+                os.path.join(self.data_path, "package", "hash-cache"),
+            )
             self.assertEqual(type(broker), LazyRemoteBroker)
             self.assertEqual(type(config), PackageTaskHandlerConfiguration)
             self.assertIn("mock-reactor", repr(reactor))
@@ -1,4 +1,5 @@
 import logging
+import os
 import signal
 
 from twisted.application.app import startApplication
@@ -7,9 +8,11 @@ from twisted.application.service import Service
 
 from landscape.client.deployment import get_versioned_persist
 from landscape.client.deployment import init_logging
+from landscape.client.health import StatsFactory
 from landscape.client.reactor import LandscapeReactor
 from landscape.lib.logging import LoggingAttributeError
 from landscape.lib.logging import rotate_logs
+from landscape.lib.monitor import PhaseTimer
 
 
 class LandscapeService(Service):
@@ -28,10 +31,13 @@ class LandscapeService(Service):
 
     reactor_factory = LandscapeReactor
     persist_filename = None
+    stats_port = None
 
     def __init__(self, config):
         self.config = config
         self.reactor = self.reactor_factory()
+        if self.config is not None and self.config.timer_slack:
+            self.reactor.set_timer_slack(self.config.timer_slack)
         if self.persist_filename:
             self.persist = get_versioned_persist(self)
         if not (self.config is not None and self.config.ignore_sigusr1):
@@ -42,8 +48,59 @@ class LandscapeService(Service):
                 lambda signal, frame: reactor.callFromThread(rotate_logs),
             )
 
+    def get_plugin(self, plugin_name):
+        """Return an instance of the plugin, or C{None} if it can't be loaded.
+
+        It must be provided by the sub-classes having plugins.
+        """
+        raise NotImplementedError()
+
+    def get_plugins(self):
+        """Return instances of all the plugins enabled in the configuration."""
+        plugins = []
+        for plugin_name in self.config.plugin_factories:
+            plugin = self.get_plugin(plugin_name)
+            if plugin is not None:
+                plugins.append(plugin)
+        return plugins
+
+    def load_plugins_lazily(self, client):
+        """Load the plugins one after the other, over C{load_plugins_over}.
+
+        Instead of importing all the plugin modules when the service gets
+        created, each one is imported when its turn comes and the plugin is
+        added to C{client}, which schedules its first run from there.
+
+        @param client: The L{BrokerClient} to add the plugins to.
+        """
+        plugin_names = list(self.config.plugin_factories)
+        if not plugin_names:
+            return
+        delay = float(self.config.load_plugins_over) / len(plugin_names)
+        for i, plugin_name in enumerate(plugin_names):
+            self.reactor.call_later(
+                delay * i,
+                self._add_plugin,
+                client,
+                plugin_name,
+            )
+
+    def _add_plugin(self, client, plugin_name):
+        plugin = self.get_plugin(plugin_name)
+        if plugin is not None:
+            self.plugins.append(plugin)
+            client.add(plugin)
+
     def startService(self):  # noqa: N802
         Service.startService(self)
+        if self.config.stats_socket:
+            self.stats_port = self.reactor.listen_unix(
+                os.path.join(
+                    self.config.sockets_path,
+                    f"{self.service_name}.stats",
+                ),
+                StatsFactory(self.service_name),
+            )
         logging.info(
             f"{self.service_name.capitalize()} started with "
             f"config {self.config.get_config_filename()}",
@@ -78,8 +135,10 @@ def run_landscape_service(configuration_class, service_class, args):
     #     startLoggingWithObserver, PythonLoggingObserver)
     # startLoggingWithObserver(PythonLoggingObserver().emit, setStdout=False)
 
+    startup = PhaseTimer(f"{service_class.service_name.capitalize()} startup")
     configuration = configuration_class()
     configuration.load(args)
+    startup.phase("configuration")
     try:
         init_logging(configuration, service_class.service_name)
     except LoggingAttributeError:
@@ -87,6 +146,7 @@ def run_landscape_service(configuration_class, service_class, args):
     application = Application(f"landscape-{service_class.service_name}")
     service = service_class(configuration)
     service.setServiceParent(application)
+    startup.phase("initialization")
 
     if configuration.clones > 0:
         # Increase the timeout of AMP's MethodCalls
@@ -128,5 +188,7 @@ def run_landscape_service(configuration_class, service_class, args):
     startApplication(application, False)
     if configuration.ignore_sigint:
         signal.signal(signal.SIGINT, signal.SIG_IGN)
+    startup.phase("start")
+    startup.log()
 
     service.reactor.run()
@@ -1,5 +1,6 @@
 from landscape.client.accumulate import accumulate
 from landscape.client.accumulate import Accumulator
+from landscape.client.accumulate import BatchAccumulator
 from landscape.client.tests.helpers import LandscapeTest
 from landscape.lib.persist import Persist
 
@@ -158,3 +159,84 @@ class AccumulatorTest(LandscapeTest):
         step_data = accumulate(0, 14, "key")
         self.assertEqual(step_data, None)
         self.assertEqual(persist.get("key"), (0, 0))
+
+
+class BatchAccumulatorTest(LandscapeTest):
+    """Tests for the BatchAccumulator plugin helper class."""
+
+    def test_accumulate(self):
+        """
+        Step data is returned for the series crossing a step boundary, and
+        the state of all series is persisted as columns under one key.
+        """
+        persist = Persist()
+        accumulate = BatchAccumulator(persist, 5, "key")
+
+        step_data = accumulate(2, {"a": 4, "b": 3})
+        self.assertEqual(step_data, {})
+        self.assertEqual(persist.get("key"), (("a", "b"), (2, 2), (8, 6)))
+        step_data = accumulate(7, {"a": 4, "b": 3})
+        self.assertEqual(step_data, {"a": (5, 4), "b": (5, 3)})
+        self.assertEqual(persist.get("key"), (("a", "b"), (7, 7), (8, 6)))
+
+    def test_accumulate_without_values(self):
+        """Nothing is returned nor persisted when there are no values."""
+        persist = Persist()
+        accumulate = BatchAccumulator(persist, 5, "key")
+        self.assertEqual(accumulate(5, {}), {})
+        self.assertEqual(persist.get("key"), None)
+
+    def test_accumulate_keeps_missing_series(self):
+        """
+        A series missing from a sample keeps its state, and is accumulated
+        from it when it's sampled again, like with an L{Accumulator}.
+        """
+        persist = Persist()
+        accumulate = BatchAccumulator(persist, 5, "key")
+        accumulator = Accumulator(Persist(), 5)
+
+        samples = [
+            (2, {"a": 4, "b": 3}),
+            (4, {"a": 2}),
+            (13, {"a": 1, "b": 6}),
+        ]
+        for timestamp, values in samples:
+            expected = {}
+            for name, value in values.items():
+                step_data = accumulator(timestamp, value, name)
+                if step_data is not None:
+                    expected[name] = step_data
+            self.assertEqual(accumulate(timestamp, values), expected)
+        self.assertEqual(persist.get("key"), (("a", "b"), (13, 13), (3, 18)))
+
+    def test_accumulate_from_accumulator_state(self):
+        """
+        The state an L{Accumulator} left under C{(key, name)} keys is
+        accumulated from, and replaced.
+        """
+        persist = Persist()
+        persist.set(("key", "a"), (7, 8))
+        accumulate = BatchAccumulator(persist, 5, "key")
+
+        step_data = accumulate(13, {"a": 3})
+        self.assertEqual(step_data, {"a": (10, float((2 * 4) + (3 * 3)) / 5)})
+        self.assertEqual(persist.get("key"), (("a",), (13,), (9,)))
+
+    def test_accumulate_from_legacy_key(self):
+        """
+        The state an L{Accumulator} left under the C{legacy_key} of a
+        series is accumulated from, and removed.
+        """
+        persist = Persist()
+        persist.set("key-a", (7, 8))
+        accumulate = BatchAccumulator(
+            persist,
+            5,
+            "key",
+            legacy_key=lambda name: f"key-{name}",
+        )
+
+        step_data = accumulate(13, {"a": 3})
+        self.assertEqual(step_data, {"a": (10, float((2 * 4) + (3 * 3)) / 5)})
+        self.assertEqual(persist.get("key"), (("a",), (13,), (9,)))
+        self.assertFalse(persist.has("key-a"))
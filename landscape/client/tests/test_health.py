@@ -0,0 +1,134 @@
+import json
+from unittest import mock
+
+from twisted.internet.defer import fail
+
+from landscape.client.health import ClientHealth
+from landscape.client.health import get_health_message
+from landscape.client.health import reset_health_stats
+from landscape.client.health import StatsFactory
+from landscape.client.tests.helpers import LandscapeTest
+from landscape.client.tests.helpers import MonitorHelper
+from landscape.lib.monitor import health_stats
+from landscape.lib.monitor import HealthStats
+from landscape.lib.testing import FakeReactor
+
+
+class FakeTransport:
+    def __init__(self):
+        self.data = b""
+        self.connected = True
+
+    def write(self, data):
+        self.data += data
+
+    def loseConnection(self):  # noqa: N802
+        self.connected = False
+
+
+class GetHealthMessageTest(LandscapeTest):
+    def test_get_health_message(self):
+        """
+        The message has the statistics recorded since the last one, which
+        aren't reset until it's sent.
+        """
+        reactor = FakeReactor()
+        stats = HealthStats(create_time=reactor.time)
+        stats.record("exchange-time", 3)
+        reactor.advance(60)
+        message = get_health_message("broker", stats)
+        self.assertEqual(message["type"], "client-health")
+        self.assertEqual(message["component"], "broker")
+        self.assertEqual(message["period"], 60)
+        self.assertEqual(message["histograms"]["exchange-time"]["count"], 1)
+        self.assertIn("exchange-time", stats.get_summary()["histograms"])
+
+    def test_reset_health_stats(self):
+        """
+        L{reset_health_stats} resets the statistics, passing its argument
+        through.
+        """
+        stats = HealthStats()
+        stats.record("exchange-time", 3)
+        self.assertEqual(reset_health_stats(123, stats), 123)
+        self.assertEqual(stats.get_summary()["histograms"], {})
+
+
+class ClientHealthTest(LandscapeTest):
+
+    helpers = [MonitorHelper]
+
+    def setUp(self):
+        super().setUp()
+        health_stats.reset()
+
+    def test_run(self):
+        """The plugin sends the health statistics of its process."""
+        self.mstore.set_accepted_types(["client-health"])
+        self.monitor.add(ClientHealth("monitor", 3600))
+        health_stats.record("store-add-time", 0.25)
+        self.reactor.advance(3600)
+        [message] = self.mstore.get_pending_messages()
+        self.assertEqual(message["component"], "monitor")
+        self.assertEqual(
+            message["histograms"]["store-add-time"]["buckets"],
+            [(0.5, 1)],
+        )
+        self.assertNotIn(
+            "store-add-time",
+            health_stats.get_summary()["histograms"],
+        )
+
+    def test_run_send_failed(self):
+        """
+        The statistics aren't reset if the message can't be sent, the next
+        one has them.
+        """
+        self.mstore.set_accepted_types(["client-health"])
+        plugin = ClientHealth("monitor", 3600)
+        self.monitor.add(plugin)
+        health_stats.record("store-add-time", 0.25)
+        with mock.patch.object(
+            self.remote,
+            "send_message",
+            return_value=fail(RuntimeError("Broken")),
+        ):
+            self.failureResultOf(plugin.send_message())
+        self.assertIn(
+            "store-add-time",
+            health_stats.get_summary()["histograms"],
+        )
+
+    def test_run_not_accepted(self):
+        """No message is sent if the server doesn't accept them."""
+        self.monitor.add(ClientHealth("monitor", 3600))
+        self.reactor.advance(3600)
+        self.assertEqual(self.mstore.get_pending_messages(), [])
+
+
+class StatsFactoryTest(LandscapeTest):
+    def test_connection(self):
+        """
+        The statistics are written as a line of JSON to the connecting
+        clients, without being reset.
+        """
+        reactor = FakeReactor()
+        stats = HealthStats(create_time=reactor.time)
+        stats.record("exchange-payload-bytes", 1000)
+        stats.set("apt-update-exit-code", 0)
+        protocol = StatsFactory("broker", stats).buildProtocol(None)
+        transport = FakeTransport()
+        protocol.makeConnection(transport)
+        self.assertFalse(transport.connected)
+        self.assertTrue(transport.data.endswith(b"\n"))
+        summary = json.loads(transport.data)
+        self.assertEqual(summary["component"], "broker")
+        self.assertEqual(summary["values"], {"apt-update-exit-code": 0})
+        self.assertEqual(
+            summary["histograms"]["exchange-payload-bytes"]["buckets"],
+            [[1024.0, 1]],
+        )
+        self.assertIn(
+            "exchange-payload-bytes",
+            stats.get_summary()["histograms"],
+        )
@@ -1,10 +1,13 @@
 import logging
+import os
 import signal
+from unittest import mock
 
 from twisted.internet import reactor
 from twisted.internet.task import deferLater
 
 from landscape.client.deployment import Configuration
+from landscape.client.health import StatsFactory
 from landscape.client.service import LandscapeService
 from landscape.client.tests.helpers import LandscapeTest
 from landscape.lib.testing import FakeReactor
@@ -51,6 +54,35 @@ class LandscapeServiceTest(LandscapeTest):
         service = TestService(self.config)
         self.assertFalse(hasattr(service, "persist"))
 
+    def test_timer_slack(self):
+        """The timers of the reactor are coalesced with C{timer_slack}."""
+        self.config.timer_slack = 10
+
+        class SlackService(TestService):
+            reactor_factory = mock.Mock
+
+        service = SlackService(self.config)
+        service.reactor.set_timer_slack.assert_called_once_with(10)
+
+    def test_stats_socket(self):
+        """
+        With C{stats_socket}, the health statistics of the service are
+        served on a C{<service>.stats} socket.
+        """
+        self.config.stats_socket = True
+
+        class StatsService(TestService):
+            reactor_factory = FakeReactor
+
+        service = StatsService(self.config)
+        service.startService()
+        self.addCleanup(service.stopService)
+        factory = service.reactor._socket_paths[
+            os.path.join(self.config.sockets_path, "monitor.stats")
+        ]
+        self.assertIsInstance(factory, StatsFactory)
+        self.assertEqual(factory.component, "monitor")
+
     def test_usr1_rotates_logs(self):
         """
         SIGUSR1 should cause logs to be reopened.
@@ -683,6 +683,26 @@ class DaemonTest(DaemonTestBase):
 
         return daemon.stop()
 
+    def test_start_process_with_config_snapshot(self):
+        """The daemon is given the configuration snapshot, if any."""
+        output_filename = self.makeFile("NOT RUN")
+        self._write_script(f'#!/bin/sh\necho "RUN $@" > {output_filename}')
+
+        waiter = FileChangeWaiter(output_filename)
+
+        self.daemon.config_snapshot = "/some/config.snapshot"
+        self.daemon.start()
+
+        waiter.wait()
+
+        self.assertEqual(
+            open(output_filename).read(),
+            "RUN --ignore-sigint --quiet "
+            "--config-snapshot /some/config.snapshot\n",
+        )
+
+        return self.daemon.stop()
+
     def test_kill_process_with_sigterm(self):
         """The stop() method sends SIGTERM to the subprocess."""
         output_filename = self.makeFile("NOT RUN")
@@ -72,6 +72,8 @@ class Daemon:
         trying to connect to the watched daemon.
     @cvar factor: The factor by which the delay between subsequent connection
         attempts will increase.
+    @ivar config_snapshot: Optionally, the configuration snapshot the daemon
+        is started with, see L{BaseConfiguration.write_config_snapshot}.
 
     @param connector: The L{ComponentConnector} of the daemon.
     @param reactor: The reactor used to spawn the process and schedule timed
@@ -84,6 +86,7 @@ class Daemon:
     max_retries = 3
     factor = 1.1
     options = None
+    config_snapshot = None
 
     BIN_DIR = None
 
@@ -154,6 +157,8 @@ class Daemon:
             args.append("--quiet")
         if self._config:
             args.extend(["-c", self._config])
+        if self.config_snapshot:
+            args.extend(["--config-snapshot", self.config_snapshot])
         if self.options is not None:
             args.extend(self.options)
         env = encode_values(self._env)
@@ -592,6 +597,15 @@ class WatchDogService(Service):
                     log_dir=self._config.log_dir + suffix,
                 )
 
+        # Parse the configuration once for all the daemons.
+        snapshot_filename = os.path.join(
+            self._config.data_path,
+            "config.snapshot",
+        )
+        if self._config.write_config_snapshot(snapshot_filename):
+            for daemon in self.watchdog.daemons:
+                daemon.config_snapshot = snapshot_filename
+
         result = succeed(None)
         result.addCallback(lambda _: self.watchdog.check_running())
 
@@ -0,0 +1,638 @@
+/*
+
+ Copyright (c) 2024 Canonical, Ltd.
+
+ Accelerated, wire-compatible implementation of landscape.lib.bpickle.
+
+ Objects are dumped into a single growable buffer, and loaded by walking
+ the input buffer directly instead of slicing it.
+
+*/
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <string.h>
+
+typedef struct {
+  char *data;
+  Py_ssize_t size;
+  Py_ssize_t allocated;
+} Buffer;
+
+static int buffer_reserve(Buffer *buffer, Py_ssize_t extra)
+{
+  if (buffer->size + extra <= buffer->allocated)
+    return 0;
+  Py_ssize_t allocated = buffer->allocated * 2;
+  if (allocated < buffer->size + extra)
+    allocated = buffer->size + extra;
+  char *data = PyMem_Realloc(buffer->data, allocated);
+  if (!data) {
+    PyErr_NoMemory();
+    return -1;
+  }
+  buffer->data = data;
+  buffer->allocated = allocated;
+  return 0;
+}
+
+static int buffer_write(Buffer *buffer, const char *data, Py_ssize_t size)
+{
+  if (buffer_reserve(buffer, size) == -1)
+    return -1;
+  memcpy(buffer->data + buffer->size, data, size);
+  buffer->size += size;
+  return 0;
+}
+
+static int buffer_write_char(Buffer *buffer, char c)
+{
+  if (buffer_reserve(buffer, 1) == -1)
+    return -1;
+  buffer->data[buffer->size++] = c;
+  return 0;
+}
+
+// Write a type character, a length and a colon, like "s12:".
+static int buffer_write_length(Buffer *buffer, char type, Py_ssize_t length)
+{
+  char header[32];
+  int size = snprintf(header, sizeof(header), "%c%zd:", type, length);
+  return buffer_write(buffer, header, size);
+}
+
+static int dump(Buffer *buffer, PyObject *obj);
+
+static int dump_int(Buffer *buffer, PyObject *obj)
+{
+  int overflow;
+  long long value = PyLong_AsLongLongAndOverflow(obj, &overflow);
+  if (value == -1 && PyErr_Occurred())
+    return -1;
+  if (!overflow) {
+    char text[32];
+    int size = snprintf(text, sizeof(text), "i%lld;", value);
+    return buffer_write(buffer, text, size);
+  }
+  PyObject *text = PyObject_Str(obj);
+  if (!text)
+    return -1;
+  Py_ssize_t size;
+  const char *data = PyUnicode_AsUTF8AndSize(text, &size);
+  int result = -1;
+  if (data && buffer_write_char(buffer, 'i') == 0 &&
+      buffer_write(buffer, data, size) == 0)
+    result = buffer_write_char(buffer, ';');
+  Py_DECREF(text);
+  return result;
+}
+
+static int dump_float(Buffer *buffer, PyObject *obj)
+{
+  // Same as repr(), so that the output matches f"f{obj!r};".
+  char *text = PyOS_double_to_string(PyFloat_AS_DOUBLE(obj), 'r', 0,
+                                     Py_DTSF_ADD_DOT_0, NULL);
+  if (!text)
+    return -1;
+  int result = -1;
+  if (buffer_write_char(buffer, 'f') == 0 &&
+      buffer_write(buffer, text, strlen(text)) == 0)
+    result = buffer_write_char(buffer, ';');
+  PyMem_Free(text);
+  return result;
+}
+
+static int dump_sequence(Buffer *buffer, char type, PyObject *obj)
+{
+  if (buffer_write_char(buffer, type) == -1)
+    return -1;
+  Py_ssize_t i;
+  for (i = 0; i < PySequence_Fast_GET_SIZE(obj); i++) {
+    PyObject *item = PySequence_Fast_GET_ITEM(obj, i);
+    Py_INCREF(item);
+    int result = dump(buffer, item);
+    Py_DECREF(item);
+    if (result == -1)
+      return -1;
+  }
+  return buffer_write_char(buffer, ';');
+}
+
+static int dump_dict(Buffer *buffer, PyObject *obj)
+{
+  PyObject *keys = PyDict_Keys(obj);
+  if (!keys)
+    return -1;
+  int result = -1;
+  if (PyList_Sort(keys) == -1 || buffer_write_char(buffer, 'd') == -1)
+    goto done;
+  Py_ssize_t i;
+  for (i = 0; i < PyList_GET_SIZE(keys); i++) {
+    PyObject *key = PyList_GET_ITEM(keys, i);
+    PyObject *value = PyDict_GetItemWithError(obj, key);
+    if (!value) {
+      if (!PyErr_Occurred())
+        PyErr_SetObject(PyExc_KeyError, key);
+      goto done;
+    }
+    Py_INCREF(value);
+    int dumped = dump(buffer, key) == 0 && dump(buffer, value) == 0;
+    Py_DECREF(value);
+    if (!dumped)
+      goto done;
+  }
+  result = buffer_write_char(buffer, ';');
+done:
+  Py_DECREF(keys);
+  return result;
+}
+
+static int dump(Buffer *buffer, PyObject *obj)
+{
+  PyTypeObject *type = Py_TYPE(obj);
+  Py_ssize_t size;
+  const char *data;
+  int result;
+
+  // Only exact types are supported, as with the pure Python dumps_table.
+  if (type == &PyBool_Type)
+    return buffer_write(buffer, obj == Py_True ? "b1" : "b0", 2);
+  if (type == &PyLong_Type)
+    return dump_int(buffer, obj);
+  if (type == &PyFloat_Type)
+    return dump_float(buffer, obj);
+  if (type == &PyBytes_Type) {
+    size = PyBytes_GET_SIZE(obj);
+    if (buffer_write_length(buffer, 's', size) == -1)
+      return -1;
+    return buffer_write(buffer, PyBytes_AS_STRING(obj), size);
+  }
+  if (type == &PyUnicode_Type) {
+    data = PyUnicode_AsUTF8AndSize(obj, &size);
+    if (!data || buffer_write_length(buffer, 'u', size) == -1)
+      return -1;
+    return buffer_write(buffer, data, size);
+  }
+  if (obj == Py_None)
+    return buffer_write_char(buffer, 'n');
+  if (type != &PyList_Type && type != &PyTuple_Type && type != &PyDict_Type) {
+    PyErr_Format(PyExc_ValueError, "Unsupported type: %R", (PyObject *)type);
+    return -1;
+  }
+
+  if (Py_EnterRecursiveCall(" while dumping a bpickle"))
+    return -1;
+  if (type == &PyDict_Type)
+    result = dump_dict(buffer, obj);
+  else
+    result = dump_sequence(buffer, type == &PyList_Type ? 'l' : 't', obj);
+  Py_LeaveRecursiveCall();
+  return result;
+}
+
+static PyObject *bpickle_dumps(PyObject *self, PyObject *obj)
+{
+  Buffer buffer = {NULL, 0, 0};
+  PyObject *result = NULL;
+  if (buffer_reserve(&buffer, 256) == 0 && dump(&buffer, obj) == 0)
+    result = PyBytes_FromStringAndSize(buffer.data, buffer.size);
+  PyMem_Free(buffer.data);
+  return result;
+}
+
+typedef struct {
+  const char *data;
+  Py_ssize_t size;
+  Py_ssize_t pos;
+  int as_is;
+} Reader;
+
+static PyObject *corrupted(void)
+{
+  PyErr_SetString(PyExc_ValueError, "Corrupted data");
+  return NULL;
+}
+
+// Return the position of the next terminator character, raising the same
+// error as bytes.index() if there's none.
+static Py_ssize_t find(Reader *reader, char terminator)
+{
+  const char *found = memchr(reader->data + reader->pos, terminator,
+                             reader->size - reader->pos);
+  if (!found) {
+    PyErr_SetString(PyExc_ValueError, "subsection not found");
+    return -1;
+  }
+  return found - reader->data;
+}
+
+// Convert data[start:end] like int() or float() would, so that the
+// accepted literals are the same as the pure Python implementation.
+static PyObject *convert(Reader *reader, Py_ssize_t start, Py_ssize_t end,
+                         PyObject *(*converter)(PyObject *))
+{
+  PyObject *text = PyBytes_FromStringAndSize(reader->data + start,
+                                             end - start);
+  if (!text)
+    return NULL;
+  PyObject *result = converter(text);
+  Py_DECREF(text);
+  return result;
+}
+
+static PyObject *load_int(Reader *reader)
+{
+  Py_ssize_t start = reader->pos + 1;
+  Py_ssize_t end = find(reader, ';');
+  if (end == -1)
+    return NULL;
+  reader->pos = end + 1;
+
+  // Fast path for plain decimal literals that fit in a long long.
+  const char *digits = reader->data + start;
+  Py_ssize_t length = end - start;
+  int negative = length > 0 && digits[0] == '-';
+  if (length - negative > 0 && length - negative <= 18) {
+    long long value = 0;
+    Py_ssize_t i;
+    for (i = negative; i < length; i++) {
+      if (digits[i] < '0' || digits[i] > '9')
+        break;
+      value = value * 10 + (digits[i] - '0');
+    }
+    if (i == length)
+      return PyLong_FromLongLong(negative ? -value : value);
+  }
+  return convert(reader, start, end, PyNumber_Long);
+}
+
+static PyObject *load_float(Reader *reader)
+{
+  Py_ssize_t start = reader->pos + 1;
+  Py_ssize_t end = find(reader, ';');
+  if (end == -1)
+    return NULL;
+  reader->pos = end + 1;
+  return convert(reader, start, end, PyNumber_Float);
+}
+
+// Read the length prefix of a bytes or unicode value, leaving the reader
+// at the start of the data.
+static Py_ssize_t load_length(Reader *reader, const char *kind)
+{
+  Py_ssize_t start = reader->pos + 1;
+  Py_ssize_t end = find(reader, ':');
+  if (end == -1)
+    return -1;
+  PyObject *length_object = convert(reader, start, end, PyNumber_Long);
+  if (!length_object)
+    return -1;
+  Py_ssize_t length = PyLong_AsSsize_t(length_object);
+  Py_DECREF(length_object);
+  if (length == -1 && PyErr_Occurred())
+    return -1;
+  if (length < 0) {
+    PyErr_Format(PyExc_ValueError, "Negative %s length: %zd", kind, length);
+    return -1;
+  }
+  reader->pos = end + 1;
+  if (length > reader->size - reader->pos) {
+    corrupted();
+    return -1;
+  }
+  return length;
+}
+
+static PyObject *unknown_type(char type)
+{
+  PyObject *text = PyBytes_FromStringAndSize(&type, 1);
+  if (text) {
+    PyErr_Format(PyExc_ValueError, "Unknown type character: %R", text);
+    Py_DECREF(text);
+  }
+  return NULL;
+}
+
+static PyObject *load(Reader *reader);
+
+static PyObject *load_sequence(Reader *reader)
+{
+  reader->pos++;
+  PyObject *list = PyList_New(0);
+  if (!list)
+    return NULL;
+  while (1) {
+    if (reader->pos >= reader->size) {
+      Py_DECREF(list);
+      return corrupted();
+    }
+    if (reader->data[reader->pos] == ';')
+      break;
+    PyObject *item = load(reader);
+    if (!item || PyList_Append(list, item) == -1) {
+      Py_XDECREF(item);
+      Py_DECREF(list);
+      return NULL;
+    }
+    Py_DECREF(item);
+  }
+  reader->pos++;
+  return list;
+}
+
+static PyObject *load_dict(Reader *reader)
+{
+  reader->pos++;
+  PyObject *dict = PyDict_New();
+  if (!dict)
+    return NULL;
+  while (1) {
+    if (reader->pos >= reader->size) {
+      Py_DECREF(dict);
+      return corrupted();
+    }
+    if (reader->data[reader->pos] == ';')
+      break;
+    PyObject *key = load(reader);
+    if (!key) {
+      Py_DECREF(dict);
+      return NULL;
+    }
+    if (!reader->as_is && PyBytes_CheckExact(key)) {
+      // Although the wire format of dictionary keys is ASCII bytes, the
+      // code actually expects them to be strings.
+      PyObject *text = PyUnicode_DecodeASCII(PyBytes_AS_STRING(key),
+                                             PyBytes_GET_SIZE(key), NULL);
+      Py_DECREF(key);
+      if (!text) {
+        Py_DECREF(dict);
+        return NULL;
+      }
+      key = text;
+    }
+    if (reader->pos >= reader->size) {
+      Py_DECREF(key);
+      Py_DECREF(dict);
+      return corrupted();
+    }
+    PyObject *value = load(reader);
+    if (!value || PyDict_SetItem(dict, key, value) == -1) {
+      Py_DECREF(key);
+      Py_XDECREF(value);
+      Py_DECREF(dict);
+      return NULL;
+    }
+    Py_DECREF(key);
+    Py_DECREF(value);
+  }
+  reader->pos++;
+  return dict;
+}
+
+static PyObject *load(Reader *reader)
+{
+  Py_ssize_t length;
+  PyObject *result, *tmp;
+  char type = reader->data[reader->pos];
+
+  switch (type) {
+  case 'b':
+    if (reader->pos + 1 >= reader->size)
+      return corrupted();
+    type = reader->data[reader->pos + 1];
+    if (type < '0' || type > '9') {
+      /* Let int() raise the same error as the Python version. */
+      tmp = PyBytes_FromStringAndSize(reader->data + reader->pos + 1, 1);
+      if (tmp == NULL)
+        return NULL;
+      result = PyNumber_Long(tmp);
+      Py_DECREF(tmp);
+      if (result == NULL)
+        return NULL;
+      Py_DECREF(result);
+      return corrupted();
+    }
+    reader->pos += 2;
+    return PyBool_FromLong(type != '0');
+  case 'i':
+    return load_int(reader);
+  case 'f':
+    return load_float(reader);
+  case 's':
+    length = load_length(reader, "bytestring");
+    if (length == -1)
+      return NULL;
+    result = PyBytes_FromStringAndSize(reader->data + reader->pos, length);
+    reader->pos += length;
+    return result;
+  case 'u':
+    length = load_length(reader, "unicode");
+    if (length == -1)
+      return NULL;
+    result = PyUnicode_DecodeUTF8(reader->data + reader->pos, length, NULL);
+    reader->pos += length;
+    return result;
+  case 'n':
+    reader->pos++;
+    Py_RETURN_NONE;
+  case 'l':
+  case 't':
+  case 'd':
+    if (Py_EnterRecursiveCall(" while loading a bpickle"))
+      return NULL;
+    if (type == 'd') {
+      result = load_dict(reader);
+    } else {
+      result = load_sequence(reader);
+      if (result && type == 't') {
+        PyObject *tuple = PyList_AsTuple(result);
+        Py_DECREF(result);
+        result = tuple;
+      }
+    }
+    Py_LeaveRecursiveCall();
+    return result;
+  default:
+    return unknown_type(type);
+  }
+}
+
+static int skip(Reader *reader);
+
+static int skip_items(Reader *reader, int pairs)
+{
+  reader->pos++;
+  while (1) {
+    if (reader->pos >= reader->size) {
+      corrupted();
+      return -1;
+    }
+    if (reader->data[reader->pos] == ';')
+      break;
+    if (skip(reader) == -1)
+      return -1;
+    if (pairs) {
+      if (reader->pos >= reader->size) {
+        corrupted();
+        return -1;
+      }
+      if (skip(reader) == -1)
+        return -1;
+    }
+  }
+  reader->pos++;
+  return 0;
+}
+
+// Move the reader past the value at its position, without building it.
+// Only the framing of the value is checked, not the numbers and text in
+// it, unlike load().
+static int skip(Reader *reader)
+{
+  Py_ssize_t end;
+  int result;
+  char type = reader->data[reader->pos];
+
+  switch (type) {
+  case 'b':
+    if (reader->pos + 1 >= reader->size) {
+      corrupted();
+      return -1;
+    }
+    reader->pos += 2;
+    return 0;
+  case 'i':
+  case 'f':
+    end = find(reader, ';');
+    if (end == -1)
+      return -1;
+    reader->pos = end + 1;
+    return 0;
+  case 's':
+  case 'u':
+    end = load_length(reader, type == 's' ? "bytestring" : "unicode");
+    if (end == -1)
+      return -1;
+    reader->pos += end;
+    return 0;
+  case 'n':
+    reader->pos++;
+    return 0;
+  case 'l':
+  case 't':
+  case 'd':
+    if (Py_EnterRecursiveCall(" while loading a bpickle"))
+      return -1;
+    result = skip_items(reader, type == 'd');
+    Py_LeaveRecursiveCall();
+    return result;
+  default:
+    unknown_type(type);
+    return -1;
+  }
+}
+
+// Load the values of the given keys of a dict, skipping the other ones.
+static PyObject *load_fields(Reader *reader, PyObject *fields)
+{
+  if (reader->data[0] != 'd') {
+    PyErr_SetString(PyExc_ValueError, "Not a dictionary");
+    return NULL;
+  }
+  reader->pos++;
+  PyObject *dict = PyDict_New();
+  if (!dict)
+    return NULL;
+  while (1) {
+    if (reader->pos >= reader->size) {
+      Py_DECREF(dict);
+      return corrupted();
+    }
+    if (reader->data[reader->pos] == ';')
+      break;
+    PyObject *key = load(reader);
+    if (!key) {
+      Py_DECREF(dict);
+      return NULL;
+    }
+    if (reader->pos >= reader->size) {
+      Py_DECREF(key);
+      Py_DECREF(dict);
+      return corrupted();
+    }
+    int wanted = PySequence_Contains(fields, key);
+    if (wanted == 1) {
+      PyObject *value = load(reader);
+      if (!value || PyDict_SetItem(dict, key, value) == -1)
+        wanted = -1;
+      Py_XDECREF(value);
+    } else if (wanted == 0 && skip(reader) == -1) {
+      wanted = -1;
+    }
+    Py_DECREF(key);
+    if (wanted == -1) {
+      Py_DECREF(dict);
+      return NULL;
+    }
+  }
+  return dict;
+}
+
+static PyObject *bpickle_loads(PyObject *self, PyObject *args,
+                               PyObject *kwargs)
+{
+  static char *keywords[] = {"byte_string", "as_is", NULL};
+  Py_buffer view;
+  int as_is = 0;
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "y*|p:loads", keywords,
+                                   &view, &as_is))
+    return NULL;
+  if (view.len == 0) {
+    PyBuffer_Release(&view);
+    PyErr_SetString(PyExc_ValueError, "Can't load empty string");
+    return NULL;
+  }
+  Reader reader = {view.buf, view.len, 0, as_is};
+  PyObject *result = load(&reader);
+  PyBuffer_Release(&view);
+  return result;
+}
+
+static PyObject *bpickle_loads_fields(PyObject *self, PyObject *args)
+{
+  Py_buffer view;
+  PyObject *fields;
+  if (!PyArg_ParseTuple(args, "y*O:loads_fields", &view, &fields))
+    return NULL;
+  if (view.len == 0) {
+    PyBuffer_Release(&view);
+    PyErr_SetString(PyExc_ValueError, "Can't load empty string");
+    return NULL;
+  }
+  Reader reader = {view.buf, view.len, 0, 1};
+  PyObject *result = load_fields(&reader, fields);
+  PyBuffer_Release(&view);
+  return result;
+}
+
+static PyMethodDef bpickle_methods[] = {
+  {"dumps", bpickle_dumps, METH_O, "Serialize an object to bytes."},
+  {"loads", (PyCFunction)(void (*)(void))bpickle_loads,
+   METH_VARARGS | METH_KEYWORDS, "Load a serialized byte string."},
+  {"loads_fields", bpickle_loads_fields, METH_VARARGS,
+   "Load some of the keys of a serialized dict."},
+  {NULL, NULL, 0, NULL}
+};
+
+static struct PyModuleDef bpickle_module = {
+  PyModuleDef_HEAD_INIT,
+  "_bpickle",
+  "Accelerated implementation of landscape.lib.bpickle.",
+  -1,
+  bpickle_methods
+};
+
+PyMODINIT_FUNC PyInit__bpickle(void)
+{
+  return PyModule_Create(&bpickle_module);
+}
@@ -0,0 +1,362 @@
+/*
+
+ Copyright (c) 2024 Canonical, Ltd.
+
+ Accelerated /proc scanner for landscape.lib.process.
+
+ The process directories are listed with getdents64 and their files are
+ opened relative to them with openat, all read into a single buffer, and
+ only the fields ProcessInformation reports are parsed out of them.
+
+*/
+
+#define _GNU_SOURCE
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// The parts of the read buffer the files of a process are read into.
+#define CMDLINE_SIZE 4096
+#define STATUS_SIZE 8192
+#define STAT_SIZE 4096
+#define READ_BUFFER_SIZE (CMDLINE_SIZE + STATUS_SIZE + STAT_SIZE)
+#define DIRENT_BUFFER_SIZE 32768
+
+struct linux_dirent64 {
+  unsigned long long d_ino;
+  long long d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+};
+
+typedef struct {
+  long pid;
+  const char *name;
+  Py_ssize_t name_size;
+  const char *status_name;
+  Py_ssize_t status_name_size;
+  char state;
+  long long uid;
+  long long gid;
+  long long vm_size;
+  int has_vm_size;
+  long long utime;
+  long long stime;
+  long long start_time;
+} Process;
+
+// Read the file at path, relative to dirfd, into buffer, NUL-terminated.
+static Py_ssize_t read_file(int dirfd, const char *path, char *buffer,
+                            Py_ssize_t size)
+{
+  int fd = openat(dirfd, path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+    return -1;
+  Py_ssize_t total = 0;
+  while (total < size - 1) {
+    ssize_t count = read(fd, buffer + total, size - 1 - total);
+    if (count == -1) {
+      if (errno == EINTR)
+        continue;
+      close(fd);
+      return -1;
+    }
+    if (count == 0)
+      break;
+    total += count;
+  }
+  close(fd);
+  buffer[total] = '\0';
+  return total;
+}
+
+static int is_space(char c)
+{
+  // The ASCII characters str.strip() removes.
+  return c == ' ' || (c >= '\t' && c <= '\r') ||
+         (c >= '\x1c' && c <= '\x1f');
+}
+
+static void strip(const char **start, Py_ssize_t *size)
+{
+  while (*size > 0 && is_space(**start)) {
+    (*start)++;
+    (*size)--;
+  }
+  while (*size > 0 && is_space((*start)[*size - 1]))
+    (*size)--;
+}
+
+static int parse_integer(const char *start, long long *value)
+{
+  char *end;
+  while (is_space(*start))
+    start++;
+  errno = 0;
+  *value = strtoll(start, &end, 10);
+  return (end == start || errno) ? -1 : 0;
+}
+
+// Take the basename of the first argument of the command line.
+static void parse_cmdline(Process *process, const char *data,
+                          Py_ssize_t size)
+{
+  Py_ssize_t end = 0;
+  while (end < size && data[end] != '\0' && data[end] != '\n')
+    end++;
+  const char *start = data;
+  for (Py_ssize_t i = 0; i < end; i++)
+    if (data[i] == '/')
+      start = data + i + 1;
+  Py_ssize_t name_size = end - (start - data);
+  strip(&start, &name_size);
+  process->name = start;
+  process->name_size = name_size;
+}
+
+static int parse_status(Process *process, char *data)
+{
+  int found = 0;
+  char *line = data;
+  while (*line) {
+    char *next = strchr(line, '\n');
+    if (next)
+      *next++ = '\0';
+    else
+      next = line + strlen(line);
+    char *value = strchr(line, ':');
+    if (value) {
+      *value++ = '\0';
+      if (strcmp(line, "Name") == 0) {
+        Py_ssize_t size = strlen(value);
+        const char *start = value;
+        strip(&start, &size);
+        process->status_name = start;
+        process->status_name_size = size;
+        found |= 1;
+      } else if (strcmp(line, "State") == 0) {
+        Py_ssize_t size = strlen(value);
+        const char *start = value;
+        strip(&start, &size);
+        if (size == 0)
+          return -1;
+        // Older kernels used T for both stopped and tracing stop.
+        if (size == 16 && memcmp(start, "T (tracing stop)", 16) == 0)
+          process->state = 't';
+        else
+          process->state = start[0];
+        found |= 2;
+      } else if (strcmp(line, "Uid") == 0) {
+        if (parse_integer(value, &process->uid) == -1)
+          return -1;
+        found |= 4;
+      } else if (strcmp(line, "Gid") == 0) {
+        if (parse_integer(value, &process->gid) == -1)
+          return -1;
+        found |= 8;
+      } else if (strcmp(line, "VmSize") == 0) {
+        if (parse_integer(value, &process->vm_size) == -1)
+          return -1;
+        process->has_vm_size = 1;
+        break;
+      }
+    }
+    line = next;
+  }
+  return found == 15 ? 0 : -1;
+}
+
+static int parse_stat(Process *process, char *data)
+{
+  // The command name may hold spaces, it is followed by field 3.
+  int field = 0;
+  char *start = strrchr(data, ')');
+  if (start) {
+    start++;
+    field = 2;
+  } else {
+    start = data;
+  }
+  int found = 0;
+  char *saveptr;
+  char *token = strtok_r(start, " \t\n", &saveptr);
+  while (token && found != 3) {
+    long long *value = NULL;
+    if (field == 13)
+      value = &process->utime;
+    else if (field == 14)
+      value = &process->stime;
+    else if (field == 21)
+      value = &process->start_time;
+    if (value) {
+      if (parse_integer(token, value) == -1)
+        return -1;
+      found++;
+    }
+    field++;
+    token = strtok_r(NULL, " \t\n", &saveptr);
+  }
+  return found == 3 ? 0 : -1;
+}
+
+static PyObject *decode_name(Process *process)
+{
+  const char *name = process->name;
+  Py_ssize_t name_size = process->name_size;
+  if (name_size == 0) {
+    name = process->status_name;
+    name_size = process->status_name_size;
+  }
+  return PyUnicode_DecodeUTF8(name, name_size, "replace");
+}
+
+// Read the process in directory name, relative to dirfd, in a tuple or
+// None if it went away or its files can't be parsed.
+static PyObject *scan_process(int dirfd, const char *name, long pid,
+                              char *buffer)
+{
+  int fd = openat(dirfd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd == -1)
+    Py_RETURN_NONE;
+  Process process = {0};
+  process.pid = pid;
+  // The names point into the buffer, so each file gets its own part.
+  char *cmdline = buffer;
+  char *status = cmdline + CMDLINE_SIZE;
+  char *stat = status + STATUS_SIZE;
+  Py_ssize_t size = read_file(fd, "cmdline", cmdline, CMDLINE_SIZE);
+  if (size == -1)
+    goto gone;
+  parse_cmdline(&process, cmdline, size);
+  if (read_file(fd, "status", status, STATUS_SIZE) == -1 ||
+      parse_status(&process, status) == -1)
+    goto gone;
+  if (read_file(fd, "stat", stat, STAT_SIZE) == -1 ||
+      parse_stat(&process, stat) == -1)
+    goto gone;
+  close(fd);
+
+  PyObject *process_name = decode_name(&process);
+  if (!process_name)
+    return NULL;
+  PyObject *vm_size;
+  if (process.has_vm_size) {
+    vm_size = PyLong_FromLongLong(process.vm_size);
+    if (!vm_size) {
+      Py_DECREF(process_name);
+      return NULL;
+    }
+  } else {
+    vm_size = Py_None;
+    Py_INCREF(vm_size);
+  }
+  return Py_BuildValue("(lNy#LLNLLL)", process.pid, process_name,
+                       &process.state, (Py_ssize_t)1, process.uid,
+                       process.gid, vm_size, process.utime, process.stime,
+                       process.start_time);
+
+gone:
+  close(fd);
+  Py_RETURN_NONE;
+}
+
+static int parse_pid(const char *name, long *pid)
+{
+  if (*name == '\0')
+    return -1;
+  long value = 0;
+  for (const char *c = name; *c; c++) {
+    if (*c < '0' || *c > '9' || value > (LONG_MAX - 9) / 10)
+      return -1;
+    value = value * 10 + (*c - '0');
+  }
+  *pid = value;
+  return 0;
+}
+
+static PyObject *procscan_scan(PyObject *self, PyObject *args)
+{
+  PyObject *path;
+  if (!PyArg_ParseTuple(args, "O&:scan", PyUnicode_FSConverter, &path))
+    return NULL;
+  int dirfd = open(PyBytes_AS_STRING(path),
+                   O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dirfd == -1) {
+    PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, path);
+    Py_DECREF(path);
+    return NULL;
+  }
+  Py_DECREF(path);
+
+  PyObject *result = PyList_New(0);
+  char *dirents = PyMem_Malloc(DIRENT_BUFFER_SIZE);
+  char *buffer = PyMem_Malloc(READ_BUFFER_SIZE);
+  if (!result || !dirents || !buffer) {
+    if (result)
+      PyErr_NoMemory();
+    goto error;
+  }
+  for (;;) {
+    long count = syscall(SYS_getdents64, dirfd, dirents, DIRENT_BUFFER_SIZE);
+    if (count == -1) {
+      PyErr_SetFromErrno(PyExc_OSError);
+      goto error;
+    }
+    if (count == 0)
+      break;
+    for (long offset = 0; offset < count;) {
+      struct linux_dirent64 *entry =
+        (struct linux_dirent64 *)(dirents + offset);
+      offset += entry->d_reclen;
+      long pid;
+      if (parse_pid(entry->d_name, &pid) == -1)
+        continue;
+      PyObject *process = scan_process(dirfd, entry->d_name, pid, buffer);
+      if (!process)
+        goto error;
+      if (process != Py_None && PyList_Append(result, process) == -1) {
+        Py_DECREF(process);
+        goto error;
+      }
+      Py_DECREF(process);
+    }
+  }
+  close(dirfd);
+  PyMem_Free(dirents);
+  PyMem_Free(buffer);
+  return result;
+
+error:
+  close(dirfd);
+  PyMem_Free(dirents);
+  PyMem_Free(buffer);
+  Py_XDECREF(result);
+  return NULL;
+}
+
+static PyMethodDef procscan_methods[] = {
+  {"scan", procscan_scan, METH_VARARGS,
+   "Return the (pid, name, state, uid, gid, vm_size, utime, stime, "
+   "start_time) tuples of the processes in a /proc directory."},
+  {NULL, NULL, 0, NULL}
+};
+
+static struct PyModuleDef procscan_module = {
+  PyModuleDef_HEAD_INIT,
+  "_procscan",
+  "Accelerated /proc scanner for landscape.lib.process.",
+  -1,
+  procscan_methods
+};
+
+PyMODINIT_FUNC PyInit__procscan(void)
+{
+  return PyModule_Create(&procscan_module);
+}
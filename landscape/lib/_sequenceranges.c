@@ -0,0 +1,340 @@
+/*
+
+ Copyright (c) 2024 Canonical, Ltd.
+
+ Accelerated implementation of landscape.lib.sequenceranges.
+
+ Sequences and ranges lists are read into arrays of (start, stop)
+ intervals, which are merged in a single pass and written back as ranges
+ lists, without going through the items one Python object at a time.
+
+*/
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+typedef struct {
+  long long start;
+  long long stop;
+} Interval;
+
+typedef struct {
+  Interval *data;
+  Py_ssize_t size;
+  Py_ssize_t allocated;
+} Intervals;
+
+static int intervals_append(Intervals *intervals, long long start,
+                            long long stop)
+{
+  if (intervals->size == intervals->allocated) {
+    Py_ssize_t allocated = intervals->allocated * 2;
+    if (allocated == 0)
+      allocated = 64;
+    Interval *data = PyMem_Realloc(intervals->data,
+                                   allocated * sizeof(Interval));
+    if (!data) {
+      PyErr_NoMemory();
+      return -1;
+    }
+    intervals->data = data;
+    intervals->allocated = allocated;
+  }
+  intervals->data[intervals->size].start = start;
+  intervals->data[intervals->size].stop = stop;
+  intervals->size++;
+  return 0;
+}
+
+// Append the interval, merging it with the last one if they touch.
+static int intervals_extend(Intervals *intervals, long long start,
+                            long long stop)
+{
+  if (intervals->size > 0) {
+    Interval *last = &intervals->data[intervals->size - 1];
+    if (start <= last->stop + 1) {
+      if (stop > last->stop)
+        last->stop = stop;
+      return 0;
+    }
+  }
+  return intervals_append(intervals, start, stop);
+}
+
+// Convert an item to a C integer. Items which aren't ints, or are too big
+// for the interval arithmetic, raise a TypeError or an OverflowError so
+// that the caller can fall back to the Python implementation.
+static int as_long_long(PyObject *item, long long *value)
+{
+  if (!PyLong_Check(item)) {
+    PyErr_SetString(PyExc_TypeError, "ranges items must be ints");
+    return -1;
+  }
+  int overflow;
+  *value = PyLong_AsLongLongAndOverflow(item, &overflow);
+  if (*value == -1 && PyErr_Occurred())
+    return -1;
+  if (overflow || *value == LLONG_MAX || *value == LLONG_MIN) {
+    PyErr_SetString(PyExc_OverflowError, "ranges item out of bounds");
+    return -1;
+  }
+  return 0;
+}
+
+static int compare_intervals(const void *a, const void *b)
+{
+  const Interval *first = a, *second = b;
+  if (first->start != second->start)
+    return first->start < second->start ? -1 : 1;
+  if (first->stop != second->stop)
+    return first->stop < second->stop ? -1 : 1;
+  return 0;
+}
+
+// Sort the intervals and merge the touching ones, in place.
+static void intervals_normalize(Intervals *intervals)
+{
+  qsort(intervals->data, intervals->size, sizeof(Interval),
+        compare_intervals);
+  Py_ssize_t size = 0;
+  for (Py_ssize_t i = 0; i < intervals->size; i++) {
+    Interval *next = &intervals->data[i];
+    if (size > 0 && next->start <= intervals->data[size - 1].stop + 1) {
+      if (next->stop > intervals->data[size - 1].stop)
+        intervals->data[size - 1].stop = next->stop;
+    } else {
+      intervals->data[size++] = *next;
+    }
+  }
+  intervals->size = size;
+}
+
+// Read a ranges list of ints and (start, stop) tuples into sorted
+// intervals, merging the touching ones. Ranges lists are normally sorted
+// already, unsorted ones are sorted like the Python implementation does.
+static int read_ranges(PyObject *ranges, Intervals *intervals)
+{
+  int sorted = 1;
+  PyObject *fast = PySequence_Fast(ranges, "ranges must be a sequence");
+  if (!fast)
+    return -1;
+  Py_ssize_t size = PySequence_Fast_GET_SIZE(fast);
+  PyObject **items = PySequence_Fast_ITEMS(fast);
+  for (Py_ssize_t i = 0; i < size; i++) {
+    long long start, stop;
+    if (PyTuple_Check(items[i])) {
+      if (PyTuple_GET_SIZE(items[i]) != 2) {
+        PyErr_SetString(PyExc_TypeError, "ranges must be (start, stop)");
+        goto error;
+      }
+      if (as_long_long(PyTuple_GET_ITEM(items[i], 0), &start) == -1 ||
+          as_long_long(PyTuple_GET_ITEM(items[i], 1), &stop) == -1)
+        goto error;
+      if (start > stop) {
+        PyErr_Format(PyExc_ValueError, "Range error %lld > %lld", start,
+                     stop);
+        goto error;
+      }
+    } else {
+      if (as_long_long(items[i], &start) == -1)
+        goto error;
+      stop = start;
+    }
+    // Once unsorted, the intervals are only merged after being sorted.
+    if (intervals->size > 0 &&
+        start < intervals->data[intervals->size - 1].start)
+      sorted = 0;
+    int appended = sorted ? intervals_extend(intervals, start, stop)
+                          : intervals_append(intervals, start, stop);
+    if (appended == -1)
+      goto error;
+  }
+  if (!sorted)
+    intervals_normalize(intervals);
+  Py_DECREF(fast);
+  return 0;
+
+error:
+  Py_DECREF(fast);
+  return -1;
+}
+
+static int append_item(PyObject *list, long long value)
+{
+  PyObject *item = PyLong_FromLongLong(value);
+  if (!item)
+    return -1;
+  int result = PyList_Append(list, item);
+  Py_DECREF(item);
+  return result;
+}
+
+// Write intervals as a ranges list: runs of 3 or more items become a
+// (start, stop) tuple, shorter ones are listed item by item.
+static PyObject *write_ranges(Intervals *intervals)
+{
+  PyObject *result = PyList_New(0);
+  if (!result)
+    return NULL;
+  for (Py_ssize_t i = 0; i < intervals->size; i++) {
+    long long start = intervals->data[i].start;
+    long long stop = intervals->data[i].stop;
+    if (stop - start < 2) {
+      for (long long value = start; value <= stop; value++)
+        if (append_item(result, value) == -1)
+          goto error;
+    } else {
+      PyObject *range = Py_BuildValue("(LL)", start, stop);
+      if (!range)
+        goto error;
+      int appended = PyList_Append(result, range);
+      Py_DECREF(range);
+      if (appended == -1)
+        goto error;
+    }
+  }
+  return result;
+
+error:
+  Py_DECREF(result);
+  return NULL;
+}
+
+static PyObject *sequenceranges_sequence_to_ranges(PyObject *self,
+                                                   PyObject *args)
+{
+  PyObject *sequence, *error_class;
+  if (!PyArg_ParseTuple(args, "OO:sequence_to_ranges", &sequence,
+                        &error_class))
+    return NULL;
+  PyObject *fast = PySequence_Fast(sequence, "sequence must be iterable");
+  if (!fast)
+    return NULL;
+  Py_ssize_t size = PySequence_Fast_GET_SIZE(fast);
+  PyObject **items = PySequence_Fast_ITEMS(fast);
+  Intervals intervals = {NULL, 0, 0};
+  PyObject *result = NULL;
+  for (Py_ssize_t i = 0; i < size; i++) {
+    long long value;
+    if (as_long_long(items[i], &value) == -1)
+      goto done;
+    if (intervals.size > 0) {
+      Interval *last = &intervals.data[intervals.size - 1];
+      if (value <= last->stop) {
+        if (value < last->stop)
+          PyErr_Format(error_class, "Sequence is unordered (%R < %lld)",
+                       items[i], last->stop);
+        else
+          PyErr_Format(error_class, "Found duplicated item (%R)", items[i]);
+        goto done;
+      }
+      if (value == last->stop + 1) {
+        last->stop = value;
+        continue;
+      }
+    }
+    if (intervals_append(&intervals, value, value) == -1)
+      goto done;
+  }
+  result = write_ranges(&intervals);
+
+done:
+  Py_DECREF(fast);
+  PyMem_Free(intervals.data);
+  return result;
+}
+
+static PyObject *sequenceranges_union_ranges(PyObject *self, PyObject *args)
+{
+  PyObject *ranges, *other;
+  if (!PyArg_ParseTuple(args, "OO:union_ranges", &ranges, &other))
+    return NULL;
+  Intervals first = {NULL, 0, 0}, second = {NULL, 0, 0};
+  Intervals merged = {NULL, 0, 0};
+  PyObject *result = NULL;
+  if (read_ranges(ranges, &first) == -1 || read_ranges(other, &second) == -1)
+    goto done;
+  Py_ssize_t i = 0, j = 0;
+  while (i < first.size || j < second.size) {
+    Interval *next;
+    if (j == second.size ||
+        (i < first.size && first.data[i].start <= second.data[j].start))
+      next = &first.data[i++];
+    else
+      next = &second.data[j++];
+    if (intervals_extend(&merged, next->start, next->stop) == -1)
+      goto done;
+  }
+  result = write_ranges(&merged);
+
+done:
+  PyMem_Free(first.data);
+  PyMem_Free(second.data);
+  PyMem_Free(merged.data);
+  return result;
+}
+
+static PyObject *sequenceranges_difference_ranges(PyObject *self,
+                                                  PyObject *args)
+{
+  PyObject *ranges, *other;
+  if (!PyArg_ParseTuple(args, "OO:difference_ranges", &ranges, &other))
+    return NULL;
+  Intervals first = {NULL, 0, 0}, second = {NULL, 0, 0};
+  Intervals remaining = {NULL, 0, 0};
+  PyObject *result = NULL;
+  if (read_ranges(ranges, &first) == -1 || read_ranges(other, &second) == -1)
+    goto done;
+  Py_ssize_t j = 0;
+  for (Py_ssize_t i = 0; i < first.size; i++) {
+    long long start = first.data[i].start;
+    long long stop = first.data[i].stop;
+    // Skip the removed intervals ending before this one, they can't
+    // overlap the following ones either.
+    while (j < second.size && second.data[j].stop < start)
+      j++;
+    for (Py_ssize_t k = j; k < second.size && start <= stop; k++) {
+      if (second.data[k].start > stop)
+        break;
+      if (second.data[k].start > start &&
+          intervals_append(&remaining, start, second.data[k].start - 1) == -1)
+        goto done;
+      if (second.data[k].stop + 1 > start)
+        start = second.data[k].stop + 1;
+    }
+    if (start <= stop && intervals_append(&remaining, start, stop) == -1)
+      goto done;
+  }
+  result = write_ranges(&remaining);
+
+done:
+  PyMem_Free(first.data);
+  PyMem_Free(second.data);
+  PyMem_Free(remaining.data);
+  return result;
+}
+
+static PyMethodDef sequenceranges_methods[] = {
+  {"sequence_to_ranges", sequenceranges_sequence_to_ranges, METH_VARARGS,
+   "Return the ranges list of an ordered sequence of ints, raising the "
+   "given exception class if it's unordered or has duplicates."},
+  {"union_ranges", sequenceranges_union_ranges, METH_VARARGS,
+   "Return the ranges list of the items in either of two ranges lists."},
+  {"difference_ranges", sequenceranges_difference_ranges, METH_VARARGS,
+   "Return the ranges list of the items in the first ranges list but not "
+   "in the second."},
+  {NULL, NULL, 0, NULL}
+};
+
+static struct PyModuleDef sequenceranges_module = {
+  PyModuleDef_HEAD_INIT,
+  "_sequenceranges",
+  "Accelerated implementation of landscape.lib.sequenceranges.",
+  -1,
+  sequenceranges_methods
+};
+
+PyMODINIT_FUNC PyInit__sequenceranges(void)
+{
+  return PyModule_Create(&sequenceranges_module);
+}
@@ -38,26 +38,38 @@ Note that when invoking a method via the remote proxy, the parameters
 are required to be serializable with bpickle, so they can be sent over
 the wire.
 
+Parameters too big for a single AMP value are written to a memfd which is
+passed to the peer over the Unix socket, and mapped by it, if both the
+transport and the peer support it. Otherwise they are split in chunks sent
+ahead of the method call, a few of them at a time.
+
 See also::
 
     http://twistedmatrix.com/documents/current/core/howto/amp.html
 
 for more details about the Twisted AMP protocol.
 """
+import fcntl
+import mmap
+import os
+from collections import deque
 from uuid import uuid4
 
 from twisted.internet.defer import Deferred
 from twisted.internet.defer import maybeDeferred
 from twisted.internet.defer import succeed
+from twisted.internet.interfaces import IUNIXTransport
 from twisted.internet.protocol import ReconnectingClientFactory
 from twisted.internet.protocol import ServerFactory
 from twisted.protocols.amp import AMP
 from twisted.protocols.amp import Argument
 from twisted.protocols.amp import Command
 from twisted.protocols.amp import CommandLocator
+from twisted.protocols.amp import Descriptor
 from twisted.protocols.amp import Integer
 from twisted.protocols.amp import MAX_VALUE_LENGTH
 from twisted.protocols.amp import String
+from twisted.protocols.amp import UnhandledCommand
 from twisted.python.compat import xrange
 from twisted.python.failure import Failure
 
@@ -136,6 +148,31 @@ class MethodCallChunk(Command):
     errors = {MethodCallError: b"METHOD_CALL_ERROR"}
 
 
+class MethodCallDescriptor(Command):
+    """Call a method with arguments passed in a file descriptor.
+
+    This is used in place of L{MethodCallChunk}s and L{MethodCall} when the
+    arguments are bigger than 64k and the transport is a Unix socket, able
+    to pass file descriptors.
+
+    The command arguments have the same semantics as the L{MethodCall} ones,
+    except for:
+
+    - C{descriptor}: A sealed memfd holding the BPickled C{(args, kwargs)}
+      binary tuple. The receiver maps it rather than reading it.
+    """
+
+    arguments = [
+        (b"sequence", Integer()),
+        (b"method", String()),
+        (b"descriptor", Descriptor()),
+    ]
+
+    response = [(b"result", MethodCallArgument())]
+
+    errors = {MethodCallError: b"METHOD_CALL_ERROR"}
+
+
 class MethodCallReceiver(CommandLocator):
     """Expose methods of a local object over AMP.
 
@@ -175,7 +212,41 @@ class MethodCallReceiver(CommandLocator):
 
         # Pass the the arguments as-is without reinterpreting strings.
         args, kwargs = bpickle.loads(arguments, as_is=True)
+        return self._call_method(method, args, kwargs)
+
+    @MethodCallDescriptor.responder
+    def receive_method_call_descriptor(self, sequence, method, descriptor):
+        """Call an object's method with the arguments in a file descriptor.
 
+        @param sequence: The integer that uniquely identifies the call.
+        @param method: The name of the object's method to call.
+        @param descriptor: A file descriptor holding the bpickle'd binary
+            tuple of (args, kwargs), closed once they're loaded. It must be
+            a memfd sealed against shrinking and writing, so that the peer
+            can't change its content, or truncate it, under the mapping.
+        """
+        required_seals = fcntl.F_SEAL_SHRINK | fcntl.F_SEAL_WRITE
+        try:
+            try:
+                seals = fcntl.fcntl(descriptor, fcntl.F_GET_SEALS)
+                size = os.fstat(descriptor).st_size
+            except OSError as error:
+                raise MethodCallError(f"Invalid arguments descriptor: {error}")
+            if seals & required_seals != required_seals:
+                raise MethodCallError("Arguments descriptor isn't sealed")
+            if size == 0:
+                raise MethodCallError("Arguments descriptor is empty")
+            with mmap.mmap(descriptor, size, prot=mmap.PROT_READ) as data:
+                args, kwargs = bpickle.loads(data, as_is=True)
+        finally:
+            os.close(descriptor)
+        return self._call_method(method, args, kwargs)
+
+    def _call_method(self, method, args, kwargs):
+        """Call the given C{method} of the object, if it's exposed.
+
+        @return: A deferred firing with the L{MethodCall} response.
+        """
         # We encoded the method name in `send_method_call` and have to decode
         # it here again.
         method = method.decode("utf-8")
@@ -228,10 +299,17 @@ class MethodCallSender:
     timeout = 60
 
     _chunk_size = MAX_VALUE_LENGTH
+    # How many L{MethodCallChunk}s are sent ahead of their responses.
+    _chunk_window = 8
 
     def __init__(self, protocol, clock):
         self._protocol = protocol
         self._clock = clock
+        # Whether big arguments can be passed in a file descriptor, this is
+        # turned off if the peer doesn't know about L{MethodCallDescriptor}.
+        self._send_descriptors = hasattr(os, "memfd_create") and (
+            IUNIXTransport.providedBy(protocol.transport)
+        )
 
     def _call_remote_with_timeout(self, command, **kwargs):
         """Send an L{AMP} command that will errback in case of a timeout.
@@ -240,6 +318,14 @@ class MethodCallSender:
             the peer responds within C{self.timeout} seconds, or that errbacks
             with a L{MethodCallError} otherwise.
         """
+        return self._add_timeout(self._protocol.callRemote(command, **kwargs))
+
+    def _add_timeout(self, result):
+        """
+        Return a deferred firing with the outcome of the C{result} of an
+        L{AMP} command, or with a L{MethodCallError} after C{self.timeout}
+        seconds.
+        """
         deferred = Deferred()
 
         def handle_response(response):
@@ -255,8 +341,6 @@ class MethodCallSender:
             deferred.errback(MethodCallError("timeout"))
 
         call = self._clock.callLater(self.timeout, handle_timeout)
-
-        result = self._protocol.callRemote(command, **kwargs)
         result.addBoth(handle_response)
         return deferred
 
@@ -279,41 +363,112 @@ class MethodCallSender:
         # As we send the method name to remote, we need bytes.
         method = method.encode("utf-8")
 
+        if len(arguments) > self._chunk_size and self._send_descriptors:
+            result = self._send_descriptor(sequence, method, arguments)
+        else:
+            result = self._send_chunks(sequence, method, arguments)
+        result.addCallback(lambda response: response["result"])
+        return result
+
+    def _send_descriptor(self, sequence, method, arguments):
+        """Send a L{MethodCallDescriptor} with the arguments in a memfd.
+
+        If the peer doesn't handle L{MethodCallDescriptor}, the arguments
+        are sent in chunks instead, and so are the ones of later calls.
+        """
+        descriptor = os.memfd_create(
+            "landscape-amp",
+            os.MFD_CLOEXEC | os.MFD_ALLOW_SEALING,
+        )
+        try:
+            with open(descriptor, "wb", closefd=False) as memfd:
+                memfd.write(arguments)
+            # Seal the memfd, so the receiver can map it safely.
+            fcntl.fcntl(
+                descriptor,
+                fcntl.F_ADD_SEALS,
+                fcntl.F_SEAL_SHRINK
+                | fcntl.F_SEAL_GROW
+                | fcntl.F_SEAL_WRITE
+                | fcntl.F_SEAL_SEAL,
+            )
+            sent = self._protocol.callRemote(
+                MethodCallDescriptor,
+                sequence=sequence,
+                method=method,
+                descriptor=descriptor,
+            )
+        except Exception:
+            os.close(descriptor)
+            raise
+
+        def close_descriptor(response):
+            # The transport passes the descriptor when it writes the command,
+            # so it can only be closed once the peer answered, even if the
+            # call timed out in the meantime.
+            os.close(descriptor)
+            return response
+
+        def handle_unknown_command(failure):
+            failure.trap(UnhandledCommand)
+            self._send_descriptors = False
+            return self._send_chunks(sequence, method, arguments)
+
+        sent.addBoth(close_descriptor)
+        result = self._add_timeout(sent)
+        result.addErrback(handle_unknown_command)
+        return result
+
+    def _send_chunks(self, sequence, method, arguments):
+        """Send a L{MethodCall}, preceded by L{MethodCallChunk}s if needed.
+
+        Up to C{_chunk_window} chunks are sent without waiting for their
+        responses, and the L{MethodCall} with the last chunk once all of
+        them have been received.
+        """
         # Split the given arguments in one or more chunks
-        chunks = [
+        chunks = deque(
             arguments[i : i + self._chunk_size]
             for i in xrange(0, len(arguments), self._chunk_size)
-        ]
+        )
+        last_chunk = chunks.pop()
 
         result = Deferred()
-        if len(chunks) > 1:
-            # If we have N chunks, send the first N-1 as MethodCallChunk's
-            for chunk in chunks[:-1]:
-
-                def create_send_chunk(sequence, chunk):
-                    def send_chunk(x):
-                        return self._protocol.callRemote(
-                            MethodCallChunk,
-                            sequence=sequence,
-                            chunk=chunk,
-                        )
-
-                    return send_chunk
-
-                result.addCallback(create_send_chunk(sequence, chunk))
+        in_flight = 0
+
+        def send_chunks():
+            nonlocal in_flight
+            while chunks and in_flight < self._chunk_window:
+                in_flight += 1
+                chunk_result = self._protocol.callRemote(
+                    MethodCallChunk,
+                    sequence=sequence,
+                    chunk=chunks.popleft(),
+                )
+                chunk_result.addCallbacks(chunk_sent, chunk_failed)
+            if not chunks and not in_flight and not result.called:
+                result.callback(None)
+
+        def chunk_sent(response):
+            nonlocal in_flight
+            in_flight -= 1
+            send_chunks()
+
+        def chunk_failed(failure):
+            chunks.clear()
+            if not result.called:
+                result.errback(failure)
 
         def send_last_chunk(ignored):
-            chunk = chunks[-1]
             return self._call_remote_with_timeout(
                 MethodCall,
                 sequence=sequence,
                 method=method,
-                arguments=chunk,
+                arguments=last_chunk,
             )
 
         result.addCallback(send_last_chunk)
-        result.addCallback(lambda response: response["result"])
-        result.callback(None)
+        send_chunks()
         return result
 
 
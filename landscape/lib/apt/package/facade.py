@@ -15,7 +15,9 @@ from apt.progress.text import AcquireProgress
 from aptsources.sourceslist import SourcesList
 from twisted.python.compat import itervalues
 
+from .hashing import compute_hashes
 from .skeleton import build_skeleton_apt
+from .skeleton import get_skeleton_hash
 from landscape.lib.compat import StringIO
 from landscape.lib.fs import append_text_file
 from landscape.lib.fs import create_text_file
@@ -125,10 +127,17 @@ class AptFacade:
     @ivar refetch_package_index: Whether to refetch the package indexes
         when reloading the channels, or reuse the existing local
         database.
+    @ivar hash_workers: The number of processes hashing packages when
+        reloading the channels, by default one per available CPU.
+    @ivar hash_cache: An optional L{HashCache} keeping the package hashes
+        across reloads and runs.
     """
 
     max_dpkg_retries = 12  # number of dpkg retries before we give up
     dpkg_retry_sleep = 5
+    hash_workers = None
+    hash_cache = None
+    hash_check_count = 20  # hashes checked against the package skeletons
     _dpkg_status = "/var/lib/dpkg/status"
 
     def __init__(self, root=None):
@@ -261,21 +270,97 @@ class AptFacade:
 
         self._pkg2hash.clear()
         self._hash2pkg.clear()
-        for package in self._cache:
-            if not self._is_main_architecture(package):
-                continue
-            for version in package.versions:
-                skeleton_hash = self.get_package_skeleton(
-                    version,
-                    with_info=False,
-                ).get_hash()
-                # Use a tuple including the package, since the Version
-                # objects of two different packages can have the same
-                # hash.
-                self._pkg2hash[(package, version)] = skeleton_hash
-                self._hash2pkg[skeleton_hash] = version
+        versions = [
+            version
+            for package in self._cache
+            if self._is_main_architecture(package)
+            for version in package.versions
+        ]
+        for version, skeleton_hash in zip(
+            versions,
+            self._get_package_hashes(versions),
+        ):
+            # Use a tuple including the package, since the Version
+            # objects of two different packages can have the same
+            # hash.
+            self._pkg2hash[(version.package, version)] = skeleton_hash
+            self._hash2pkg[skeleton_hash] = version
         self._channels_loaded = True
 
+    def _get_package_hashes(self, versions):
+        """Return the hashes of C{versions}, in the same order.
+
+        If there is a C{hash_cache}, only the versions read from files
+        that changed since it was saved get hashed.
+        """
+        if self.hash_cache is None:
+            return self._compute_package_hashes(versions)
+        self.hash_cache.load()
+        keys = [self._get_hash_cache_key(version) for version in versions]
+        hashes = [self.hash_cache.get(key) for key in keys]
+        missing = [
+            index
+            for index, package_hash in enumerate(hashes)
+            if package_hash is None
+        ]
+        if missing:
+            missing_hashes = self._compute_package_hashes(
+                [versions[index] for index in missing],
+            )
+            for index, skeleton_hash in zip(missing, missing_hashes):
+                hashes[index] = skeleton_hash
+                self.hash_cache.set(keys[index], skeleton_hash)
+        try:
+            self.hash_cache.save()
+        except OSError as error:
+            logging.warning(f"Couldn't save the package hash cache: {error}")
+        return hashes
+
+    def _get_hash_cache_key(self, version):
+        """Return the L{HashCache} key of C{version}."""
+        candidate = version._cand
+        files = {
+            package_file.filename
+            for package_file, _ in candidate.file_list
+            if package_file.filename
+        }
+        return (
+            version.package.name,
+            candidate.ver_str,
+            candidate.arch,
+            tuple(sorted(files)),
+        )
+
+    def _compute_package_hashes(self, versions):
+        """Compute the hashes of C{versions}, in the same order.
+
+        The hashes are computed by L{get_skeleton_hash} in
+        C{hash_workers} processes. A sample of them is checked against
+        the skeletons' hashes, and if any differs all the hashes are
+        computed again from the skeletons, which are authoritative.
+        """
+        hashes = compute_hashes(versions, get_skeleton_hash, self.hash_workers)
+        step = max(1, len(versions) // self.hash_check_count)
+        for index in range(0, len(versions), step):
+            skeleton = self.get_package_skeleton(
+                versions[index],
+                with_info=False,
+            )
+            if skeleton.get_hash() != hashes[index]:
+                logging.warning(
+                    f"Fast hash of {versions[index].package.name} "
+                    f"{versions[index].version} differs from its skeleton "
+                    "hash, hashing all packages from their skeletons.",
+                )
+                return [
+                    self.get_package_skeleton(
+                        version,
+                        with_info=False,
+                    ).get_hash()
+                    for version in versions
+                ]
+        return hashes
+
     def ensure_channels_reloaded(self):
         """Reload the channels if they haven't been reloaded yet."""
         if self._channels_loaded:
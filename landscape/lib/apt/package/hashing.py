@@ -0,0 +1,201 @@
+"""Compute package hashes in parallel, in forked worker processes."""
+import logging
+import os
+import tempfile
+
+from landscape.lib import bpickle
+from landscape.lib.fs import create_binary_file
+from landscape.lib.fs import read_binary_file
+from landscape.lib.hashlib import sha1
+
+
+HASH_SIZE = sha1().digest_size
+
+# Below this many items per worker, forking costs more than it saves.
+MIN_ITEMS_PER_WORKER = 2000
+
+
+def get_default_workers():
+    """Return the number of CPUs this process is allowed to run on."""
+    try:
+        return len(os.sched_getaffinity(0))
+    except AttributeError:
+        return os.cpu_count() or 1
+
+
+def compute_hashes(items, hash_function, workers=None):
+    """Return the list of C{hash_function(item)} for every item.
+
+    The items are split in contiguous chunks, each hashed by a forked
+    child that writes the digests to a temporary file, so that the
+    children share the parent's memory (and its apt cache) for free.
+    If a child fails, its chunk is hashed again in this process.
+
+    @param items: A sequence of items to hash.
+    @param hash_function: A callable returning a C{HASH_SIZE} bytes digest.
+    @param workers: The number of processes to use, by default one per
+        available CPU.
+    """
+    if workers is None:
+        workers = get_default_workers()
+    workers = min(workers, len(items) // MIN_ITEMS_PER_WORKER)
+    if workers <= 1:
+        return [hash_function(item) for item in items]
+
+    chunk_size = -(-len(items) // workers)
+    children = []
+    for start in range(0, len(items), chunk_size):
+        chunk = items[start : start + chunk_size]
+        output = tempfile.TemporaryFile()
+        pid = os.fork()
+        if pid == 0:  # pragma: no cover
+            status = 1
+            try:
+                output.write(b"".join(hash_function(item) for item in chunk))
+                output.flush()
+                status = 0
+            finally:
+                os._exit(status)
+        children.append((pid, chunk, output))
+
+    hashes = []
+    for pid, chunk, output in children:
+        _, status = os.waitpid(pid, 0)
+        with output:
+            output.seek(0)
+            data = output.read()
+        if status != 0 or len(data) != len(chunk) * HASH_SIZE:
+            logging.warning(
+                f"Package hashing worker {pid:d} failed, hashing its "
+                f"{len(chunk):d} packages again.",
+            )
+            hashes.extend(hash_function(item) for item in chunk)
+            continue
+        hashes.extend(
+            data[offset : offset + HASH_SIZE]
+            for offset in range(0, len(data), HASH_SIZE)
+        )
+    return hashes
+
+
+class HashCache:
+    """An on-disk cache of package hashes, across runs.
+
+    The hash of a version only depends on its stanzas in the files it
+    was read from, the apt lists and the dpkg status file, so it can be
+    reused as long as none of these files changed. Files are compared
+    by inode, size and modification time.
+
+    @param filename: The file where the cache is persisted to.
+    """
+
+    def __init__(self, filename):
+        self._filename = filename
+        self._saved_fingerprints = {}
+        self._fingerprints = {}
+        self._hashes = {}
+        self._new_hashes = {}
+        # Whether hashes were set since the cache was loaded.
+        self._dirty = False
+
+    def load(self):
+        """Load the cache, forgetting what was added since the last save."""
+        self._saved_fingerprints = {}
+        self._fingerprints = {}
+        self._hashes = {}
+        self._new_hashes = {}
+        self._dirty = False
+        if not os.path.exists(self._filename):
+            return
+        try:
+            data = bpickle.loads(read_binary_file(self._filename))
+            paths = []
+            for path, inode, size, mtime in data["files"]:
+                paths.append(path)
+                self._saved_fingerprints[path] = (inode, size, mtime)
+            for name, version, arch, indexes, package_hash in data["hashes"]:
+                files = tuple(paths[index] for index in indexes)
+                self._hashes[(name, version, arch, files)] = package_hash
+        except Exception:
+            logging.warning(
+                f"Ignoring invalid package hash cache {self._filename}.",
+            )
+            self._saved_fingerprints = {}
+            self._hashes = {}
+
+    def get(self, key):
+        """Return the cached hash for C{key}, or C{None}.
+
+        @param key: A C{(name, version, architecture, files)} tuple, with
+            the sorted paths of the files the version was read from.
+        """
+        if not self._can_cache(key):
+            return None
+        package_hash = self._hashes.get(key)
+        if package_hash is None:
+            return None
+        for path in key[3]:
+            if self._fingerprints[path] != self._saved_fingerprints.get(path):
+                return None
+        self._new_hashes[key] = package_hash
+        return package_hash
+
+    def set(self, key, package_hash):
+        """Cache the hash for C{key}, as passed to L{get}."""
+        if self._can_cache(key):
+            self._new_hashes[key] = package_hash
+            self._dirty = True
+
+    def save(self):
+        """Save the hashes looked up or set since the cache was loaded.
+
+        Nothing is written if they're the ones that were loaded, which is
+        the case when none of the files changed and no version is gone.
+        """
+        if not self._dirty and len(self._new_hashes) == len(self._hashes):
+            return
+        indexes = {}
+        files = []
+        hashes = []
+        for (name, version, arch, paths), package_hash in (
+            self._new_hashes.items()
+        ):
+            path_indexes = []
+            for path in paths:
+                if path not in indexes:
+                    indexes[path] = len(files)
+                    files.append([path, *self._fingerprints[path]])
+                path_indexes.append(indexes[path])
+            hashes.append([name, version, arch, path_indexes, package_hash])
+        temporary = self._filename + ".new"
+        create_binary_file(
+            temporary,
+            bpickle.dumps({"files": files, "hashes": hashes}),
+        )
+        os.rename(temporary, self._filename)
+        self._dirty = False
+
+    def _can_cache(self, key):
+        """Whether all the files of C{key} exist, and can be fingerprinted.
+
+        The fingerprints are taken once, before any hash is computed, so
+        that a file changing afterwards invalidates the hashes from it.
+        """
+        files = key[3]
+        if not files:
+            return False
+        for path in files:
+            if path not in self._fingerprints:
+                try:
+                    stat = os.stat(path)
+                except OSError:
+                    self._fingerprints[path] = None
+                else:
+                    self._fingerprints[path] = (
+                        stat.st_ino,
+                        stat.st_size,
+                        stat.st_mtime_ns,
+                    )
+            if self._fingerprints[path] is None:
+                return False
+        return True
@@ -205,3 +205,59 @@ def build_skeleton_apt(version, with_info=False, with_unicode=False):
             if not isinstance(skeleton.description, unicode):
                 skeleton.description = skeleton.description.decode("utf-8")
     return skeleton
+
+
+# The dependency types that contribute to a package hash, with the
+# relation types build_skeleton_apt uses for them.
+_HASHED_DEPENDENCIES = (
+    ("PreDepends", DEB_REQUIRES, DEB_OR_REQUIRES),
+    ("Depends", DEB_REQUIRES, DEB_OR_REQUIRES),
+    ("Conflicts", DEB_CONFLICTS, None),
+    ("Breaks", DEB_CONFLICTS, None),
+)
+
+
+def get_skeleton_hash(version):
+    """Return the hash of C{build_skeleton_apt(version)}, but faster.
+
+    The relations are read straight from the underlying C{apt_pkg}
+    version, without building C{apt.package.Dependency} wrappers or a
+    L{PackageSkeleton}, which is what dominates the time spent hashing
+    a whole cache.
+
+    @param version: An instance of C{apt.package.Version}
+    """
+    name, version_string = version.package.name, version.version
+    candidate = version._cand
+    relations = {
+        (DEB_PROVIDES, provide[0]) for provide in candidate.provides_list
+    }
+    relations.add((DEB_NAME_PROVIDES, f"{name} = {version_string}"))
+    relations.add((DEB_UPGRADES, f"{name} < {version_string}"))
+    depends_list = candidate.depends_list
+    for dependency_type, relation_type, or_relation_type in (
+        _HASHED_DEPENDENCIES
+    ):
+        for or_group in depends_list.get(dependency_type, ()):
+            value_strings = []
+            for dependency in or_group:
+                if dependency.comp_type:
+                    value_strings.append(
+                        f"{dependency.target_pkg.name} "
+                        f"{dependency.comp_type} {dependency.target_ver}",
+                    )
+                else:
+                    value_strings.append(dependency.target_pkg.name)
+            relations.add(
+                (
+                    or_relation_type
+                    if len(value_strings) > 1
+                    else relation_type,
+                    " | ".join(value_strings),
+                ),
+            )
+
+    digest = sha1(f"[{DEB_PACKAGE:d} {name} {version_string}]".encode("ascii"))
+    for pair in sorted(relations):
+        digest.update(f"[{pair[0]:d} {pair[1]}]".encode("ascii"))
+    return digest.digest()
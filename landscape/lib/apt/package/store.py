@@ -1,5 +1,11 @@
 """Provide access to the persistent data used by L{PackageTaskHandler}s."""
+import logging
+import mmap
+import os
+import struct
+import sys
 import time
+from array import array
 
 try:
     import sqlite3
@@ -9,9 +15,24 @@ except ImportError:
 from twisted.python.compat import iteritems, long
 
 from landscape.lib import bpickle
+from landscape.lib.bitmap import IdBitmap
 from landscape.lib.store import with_cursor
 
 
+# SQLite versions before 3.32 accept at most 999 parameters per query.
+MAX_QUERY_PARAMETERS = 999
+
+# The package states kept by a PackageStore, as sets of package ids.
+PACKAGE_STATES = (
+    "available",
+    "available_upgrade",
+    "autoremovable",
+    "installed",
+    "locked",
+    "security",
+)
+
+
 class UnknownHashIDRequest(Exception):
     """Raised for unknown hash id requests."""
 
@@ -65,10 +86,29 @@ class HashIdStore:
         return None
 
     @with_cursor
-    def get_hash_ids(self, cursor):
-        """Return a C{dict} holding all the available hash=>id mappings."""
-        cursor.execute("SELECT hash, id FROM hash")
-        return {bytes(row[0]): row[1] for row in cursor.fetchall()}
+    def get_hash_ids(self, cursor, hashes=None):
+        """Return a C{dict} holding the available hash=>id mappings.
+
+        @param hashes: If given, an iterable of C{bytes} hashes to look up,
+            otherwise all the mappings are returned.
+        """
+        if hashes is None:
+            cursor.execute("SELECT hash, id FROM hash")
+            return {bytes(row[0]): row[1] for row in cursor.fetchall()}
+        hashes = [sqlite3.Binary(hash) for hash in hashes]
+        hash_ids = {}
+        for start in range(0, len(hashes), MAX_QUERY_PARAMETERS):
+            chunk = hashes[start : start + MAX_QUERY_PARAMETERS]
+            cursor.execute(
+                "SELECT hash, id FROM hash WHERE hash IN ({})".format(
+                    ",".join("?" * len(chunk)),
+                ),
+                chunk,
+            )
+            hash_ids.update(
+                (bytes(row[0]), row[1]) for row in cursor.fetchall()
+            )
+        return hash_ids
 
     @with_cursor
     def get_id_hash(self, cursor, id):
@@ -99,6 +139,222 @@ class HashIdStore:
             raise InvalidHashIdDb(self._filename)
 
 
+class HashIdIndex:
+    """A read-only, memory-mapped index of a hash=>id database.
+
+    The index is a file next to the database. After a header, it has a
+    fan-out table with the position of the first hash starting with each
+    two bytes value, then the hashes sorted, padded to the longest one
+    and followed by their length and their id, then the ids sorted, with
+    the position of their hash. Looking up a hash only reads the few
+    records of its fan-out bucket, with no per-row query overhead.
+
+    The header records the size and modification time of the database,
+    so that an index of a previous database isn't used.
+
+    @param filename: The file of the index.
+    """
+
+    _header = struct.Struct("<4sBBxxQQq")
+    _magic = b"LHID"
+    _version = 1
+    _buckets = 1 << 16
+    _id = struct.Struct("<q")
+    _id_position = struct.Struct("<qQ")
+
+    def __init__(self, filename):
+        self._filename = filename
+        with open(filename, "rb") as index_file:
+            try:
+                self._map = mmap.mmap(
+                    index_file.fileno(),
+                    0,
+                    access=mmap.ACCESS_READ,
+                )
+            except ValueError:  # An empty file
+                raise InvalidHashIdDb(filename)
+        try:
+            (
+                magic,
+                version,
+                self._width,
+                self._count,
+                self.db_size,
+                self.db_mtime,
+            ) = self._header.unpack_from(self._map)
+        except struct.error:
+            raise InvalidHashIdDb(filename)
+        self._key_size = self._width + 1
+        self._record_size = self._key_size + self._id.size
+        self._records_offset = self._header.size + (self._buckets + 1) * 4
+        self._ids_offset = (
+            self._records_offset + self._count * self._record_size
+        )
+        size = self._ids_offset + self._count * self._id_position.size
+        if (
+            magic != self._magic
+            or version != self._version
+            or self._width < 1
+            or len(self._map) != size
+        ):
+            raise InvalidHashIdDb(filename)
+        self._fan_out = array("I")
+        self._fan_out.frombytes(
+            self._map[self._header.size : self._records_offset],
+        )
+        if sys.byteorder == "big":  # pragma: no cover
+            self._fan_out.byteswap()
+
+    @staticmethod
+    def get_filename(db_filename):
+        """Return the filename of the index of C{db_filename}."""
+        return db_filename + ".index"
+
+    @classmethod
+    def load(cls, db_filename):
+        """Return the index of C{db_filename}, building it if needed.
+
+        @return: A L{HashIdIndex}, or C{None} if it can't be built, for
+            instance because a hash is too long for this format.
+        """
+        filename = cls.get_filename(db_filename)
+        try:
+            stat = os.stat(db_filename)
+            try:
+                index = cls(filename)
+            except (OSError, InvalidHashIdDb):
+                pass
+            else:
+                if (index.db_size, index.db_mtime) == (
+                    stat.st_size,
+                    stat.st_mtime_ns,
+                ):
+                    return index
+                index.close()
+            if not cls.build(db_filename, filename, stat):
+                return None
+            return cls(filename)
+        except (OSError, InvalidHashIdDb, sqlite3.DatabaseError) as error:
+            logging.warning(
+                f"Couldn't index hash=>id database {db_filename}: {error}",
+            )
+            return None
+
+    @classmethod
+    def build(cls, db_filename, filename, stat):
+        """Write the index of C{db_filename} to C{filename}.
+
+        @param stat: The C{os.stat} result of C{db_filename}.
+        @return: C{False} if the hashes are too long to be indexed.
+        """
+        db = sqlite3.connect(db_filename)
+        try:
+            # SQLite sorts blobs as the index does if they're all of the
+            # same length, which is the case of package hashes.
+            rows = db.execute(
+                "SELECT hash, id FROM hash ORDER BY hash",
+            ).fetchall()
+        finally:
+            db.close()
+        lengths = {len(row[0]) for row in rows}
+        width = max(lengths, default=1)
+        if width > 255:
+            return False
+        records = [
+            (cls._make_key(bytes(hash), width), id) for hash, id in rows
+        ]
+        if len(lengths) > 1:
+            records.sort()
+        fan_out = array("I", bytes(4 * (cls._buckets + 1)))
+        for key, _ in records:
+            fan_out[(key[0] << 8 | key[1]) + 1] += 1
+        for bucket in range(cls._buckets):
+            fan_out[bucket + 1] += fan_out[bucket]
+        if sys.byteorder == "big":  # pragma: no cover
+            fan_out.byteswap()
+        ids = [id for _, id in records]
+        pack_id = cls._id.pack
+        pack_id_position = cls._id_position.pack
+        temporary = filename + ".new"
+        with open(temporary, "wb") as index_file:
+            index_file.write(
+                cls._header.pack(
+                    cls._magic,
+                    cls._version,
+                    width,
+                    len(records),
+                    stat.st_size,
+                    stat.st_mtime_ns,
+                ),
+            )
+            index_file.write(fan_out.tobytes())
+            index_file.write(
+                b"".join(key + pack_id(id) for key, id in records),
+            )
+            positions = sorted(range(len(ids)), key=ids.__getitem__)
+            index_file.write(
+                b"".join(
+                    pack_id_position(ids[position], position)
+                    for position in positions
+                ),
+            )
+        os.rename(temporary, filename)
+        return True
+
+    @staticmethod
+    def _make_key(hash, width):
+        return hash.ljust(width, b"\0") + bytes((len(hash),))
+
+    def close(self):
+        self._map.close()
+
+    def get_hash_id(self, hash):
+        """Return the id associated to C{hash}, or C{None} if not available."""
+        if len(hash) > self._width:
+            return None
+        key = self._make_key(hash, self._width)
+        bucket = key[0] << 8 | key[1]
+        record_size = self._record_size
+        start = self._records_offset + self._fan_out[bucket] * record_size
+        end = self._records_offset + self._fan_out[bucket + 1] * record_size
+        records = self._map[start:end]
+        position = records.find(key)
+        # Only matches at the start of a record count.
+        while position != -1 and position % record_size:
+            position = records.find(key, position + 1)
+        if position == -1:
+            return None
+        return self._id.unpack_from(records, position + self._key_size)[0]
+
+    def get_hash_ids(self, hashes):
+        """Return a C{dict} of hash=>id mappings for C{hashes}."""
+        hash_ids = {}
+        for hash in hashes:
+            id = self.get_hash_id(hash)
+            if id is not None:
+                hash_ids[hash] = id
+        return hash_ids
+
+    def get_id_hash(self, id):
+        """Return the hash associated to C{id}, or C{None} if not available."""
+        low, high = 0, self._count
+        while low < high:
+            middle = (low + high) // 2
+            middle_id, position = self._id_position.unpack_from(
+                self._map,
+                self._ids_offset + middle * self._id_position.size,
+            )
+            if middle_id == id:
+                offset = self._records_offset + position * self._record_size
+                length = self._map[offset + self._width]
+                return self._map[offset : offset + length]
+            if middle_id < id:
+                low = middle + 1
+            else:
+                high = middle
+        return None
+
+
 class PackageStore(HashIdStore):
     """Persist data about system packages and L{PackageTaskHandler}'s tasks.
 
@@ -142,6 +398,8 @@ class PackageStore(HashIdStore):
             # propagate the error
             raise e
 
+        # Query a memory-mapped index of the database if we can.
+        hash_id_store = HashIdIndex.load(filename) or hash_id_store
         self._hash_id_stores.append(hash_id_store)
 
     def has_hash_id_db(self):
@@ -166,6 +424,29 @@ class PackageStore(HashIdStore):
         # Fall back to the locally-populated db
         return HashIdStore.get_hash_id(self, hash)
 
+    def get_hash_ids(self, hashes=None):
+        """Return a C{dict} holding the available hash=>id mappings.
+
+        With C{hashes}, this method composes the L{HashIdStore.get_hash_ids}
+        methods of all the attached lookaside databases, falling back to the
+        main one, looking up all the hashes in a single pass over each.
+        Without, it returns all the mappings of the main database.
+        """
+        if hashes is None:
+            return HashIdStore.get_hash_ids(self)
+        missing = set(hashes)
+        hash_ids = {}
+        for store in self._hash_id_stores:
+            if not missing:
+                break
+            for hash, id in iteritems(store.get_hash_ids(missing)):
+                if id:
+                    hash_ids[hash] = id
+                    missing.discard(hash)
+        if missing:
+            hash_ids.update(HashIdStore.get_hash_ids(self, missing))
+        return hash_ids
+
     def get_id_hash(self, id):
         """Return the hash associated to C{id}, or C{None} if not available.
 
@@ -179,124 +460,148 @@ class PackageStore(HashIdStore):
                 return hash
         return HashIdStore.get_id_hash(self, id)
 
+    @with_cursor
+    def get_package_state(self, cursor, state):
+        """Return the L{IdBitmap} of the package ids in C{state}.
+
+        @param state: One of L{PACKAGE_STATES}.
+        """
+        return self._get_package_state(cursor, state)
+
+    @with_cursor
+    def set_package_states(self, cursor, states):
+        """Replace the package ids of several states, in one transaction.
+
+        @param states: A C{dict} mapping states, from L{PACKAGE_STATES},
+            to the L{IdBitmap} of their package ids.
+        """
+        for state, ids in iteritems(states):
+            self._set_package_state(cursor, state, ids)
+
+    def _get_package_state(self, cursor, state):
+        assert state in PACKAGE_STATES
+        cursor.execute("SELECT ids FROM package_state WHERE name=?", (state,))
+        row = cursor.fetchone()
+        if row is None:
+            return IdBitmap()
+        return IdBitmap.from_bytes(bytes(row[0]))
+
+    def _set_package_state(self, cursor, state, ids):
+        assert state in PACKAGE_STATES
+        if not ids:
+            cursor.execute("DELETE FROM package_state WHERE name=?", (state,))
+            return
+        cursor.execute(
+            "REPLACE INTO package_state VALUES (?, ?)",
+            (state, sqlite3.Binary(ids.to_bytes())),
+        )
+
+    def _add_to_package_state(self, cursor, state, ids):
+        ids = self._get_package_state(cursor, state) | IdBitmap(ids)
+        self._set_package_state(cursor, state, ids)
+
+    def _remove_from_package_state(self, cursor, state, ids):
+        ids = self._get_package_state(cursor, state) - IdBitmap(ids)
+        self._set_package_state(cursor, state, ids)
+
     @with_cursor
     def add_available(self, cursor, ids):
-        for id in ids:
-            cursor.execute("REPLACE INTO available VALUES (?)", (id,))
+        self._add_to_package_state(cursor, "available", ids)
 
     @with_cursor
     def remove_available(self, cursor, ids):
-        id_list = ",".join(str(int(id)) for id in ids)
-        cursor.execute(f"DELETE FROM available WHERE id IN ({id_list})")
+        self._remove_from_package_state(cursor, "available", ids)
 
     @with_cursor
     def clear_available(self, cursor):
-        cursor.execute("DELETE FROM available")
+        self._set_package_state(cursor, "available", IdBitmap())
 
     @with_cursor
     def get_available(self, cursor):
-        cursor.execute("SELECT id FROM available")
-        return [row[0] for row in cursor.fetchall()]
+        return list(self._get_package_state(cursor, "available"))
 
     @with_cursor
     def add_available_upgrades(self, cursor, ids):
-        for id in ids:
-            cursor.execute("REPLACE INTO available_upgrade VALUES (?)", (id,))
+        self._add_to_package_state(cursor, "available_upgrade", ids)
 
     @with_cursor
     def remove_available_upgrades(self, cursor, ids):
-        id_list = ",".join(str(int(id)) for id in ids)
-        cursor.execute(
-            f"DELETE FROM available_upgrade WHERE id IN ({id_list})",
-        )
+        self._remove_from_package_state(cursor, "available_upgrade", ids)
 
     @with_cursor
     def clear_available_upgrades(self, cursor):
-        cursor.execute("DELETE FROM available_upgrade")
+        self._set_package_state(cursor, "available_upgrade", IdBitmap())
 
     @with_cursor
     def get_available_upgrades(self, cursor):
-        cursor.execute("SELECT id FROM available_upgrade")
-        return [row[0] for row in cursor.fetchall()]
+        return list(self._get_package_state(cursor, "available_upgrade"))
 
     @with_cursor
     def add_autoremovable(self, cursor, ids):
-        for id in ids:
-            cursor.execute("REPLACE INTO autoremovable VALUES (?)", (id,))
+        self._add_to_package_state(cursor, "autoremovable", ids)
 
     @with_cursor
     def remove_autoremovable(self, cursor, ids):
-        id_list = ",".join(str(int(id)) for id in ids)
-        cursor.execute(f"DELETE FROM autoremovable WHERE id IN ({id_list})")
+        self._remove_from_package_state(cursor, "autoremovable", ids)
 
     @with_cursor
     def clear_autoremovable(self, cursor):
-        cursor.execute("DELETE FROM autoremovable")
+        self._set_package_state(cursor, "autoremovable", IdBitmap())
 
     @with_cursor
     def get_autoremovable(self, cursor):
-        cursor.execute("SELECT id FROM autoremovable")
-        return [row[0] for row in cursor.fetchall()]
+        return list(self._get_package_state(cursor, "autoremovable"))
 
     @with_cursor
     def add_security(self, cursor, ids):
-        for id in ids:
-            cursor.execute("REPLACE INTO security VALUES (?)", (id,))
+        self._add_to_package_state(cursor, "security", ids)
 
     @with_cursor
     def remove_security(self, cursor, ids):
-        id_list = ",".join(str(int(id)) for id in ids)
-        cursor.execute(f"DELETE FROM security WHERE id IN ({id_list})")
+        self._remove_from_package_state(cursor, "security", ids)
 
     @with_cursor
     def clear_security(self, cursor):
-        cursor.execute("DELETE FROM security")
+        self._set_package_state(cursor, "security", IdBitmap())
 
     @with_cursor
     def get_security(self, cursor):
-        cursor.execute("SELECT id FROM security")
-        return [row[0] for row in cursor.fetchall()]
+        return list(self._get_package_state(cursor, "security"))
 
     @with_cursor
     def add_installed(self, cursor, ids):
-        for id in ids:
-            cursor.execute("REPLACE INTO installed VALUES (?)", (id,))
+        self._add_to_package_state(cursor, "installed", ids)
 
     @with_cursor
     def remove_installed(self, cursor, ids):
-        id_list = ",".join(str(int(id)) for id in ids)
-        cursor.execute(f"DELETE FROM installed WHERE id IN ({id_list})")
+        self._remove_from_package_state(cursor, "installed", ids)
 
     @with_cursor
     def clear_installed(self, cursor):
-        cursor.execute("DELETE FROM installed")
+        self._set_package_state(cursor, "installed", IdBitmap())
 
     @with_cursor
     def get_installed(self, cursor):
-        cursor.execute("SELECT id FROM installed")
-        return [row[0] for row in cursor.fetchall()]
+        return list(self._get_package_state(cursor, "installed"))
 
     @with_cursor
     def get_locked(self, cursor):
         """Get the package ids of all locked packages."""
-        cursor.execute("SELECT id FROM locked")
-        return [row[0] for row in cursor.fetchall()]
+        return list(self._get_package_state(cursor, "locked"))
 
     @with_cursor
     def add_locked(self, cursor, ids):
         """Add the given package ids to the list of locked packages."""
-        for id in ids:
-            cursor.execute("REPLACE INTO locked VALUES (?)", (id,))
+        self._add_to_package_state(cursor, "locked", ids)
 
     @with_cursor
     def remove_locked(self, cursor, ids):
-        id_list = ",".join(str(int(id)) for id in ids)
-        cursor.execute(f"DELETE FROM locked WHERE id IN ({id_list})")
+        self._remove_from_package_state(cursor, "locked", ids)
 
     @with_cursor
     def clear_locked(self, cursor):
         """Remove all the package ids in the locked table."""
-        cursor.execute("DELETE FROM locked")
+        self._set_package_state(cursor, "locked", IdBitmap())
 
     @with_cursor
     def add_hash_id_request(self, cursor, hashes):
@@ -348,6 +653,19 @@ class PackageStore(HashIdStore):
             return PackageTask(self._db, row[0], row[1], row[2], row[3])
         return None
 
+    @with_cursor
+    def get_next_tasks(self, cursor, queue, limit):
+        """Return up to C{limit} tasks of the queue, oldest first."""
+        cursor.execute(
+            "SELECT id, queue, timestamp, data FROM task "
+            "WHERE queue=? ORDER BY timestamp LIMIT ?",
+            (queue, limit),
+        )
+        return [
+            PackageTask(self._db, row[0], row[1], row[2], row[3])
+            for row in cursor.fetchall()
+        ]
+
     @with_cursor
     def clear_tasks(self, cursor, except_tasks=()):
         cursor.execute(
@@ -493,16 +811,6 @@ def ensure_package_schema(db):
     #       try block.
     cursor = db.cursor()
     try:
-        cursor.execute("CREATE TABLE security" " (id INTEGER PRIMARY KEY)")
-        cursor.execute(
-            "CREATE TABLE autoremovable" " (id INTEGER PRIMARY KEY)",
-        )
-        cursor.execute("CREATE TABLE locked" " (id INTEGER PRIMARY KEY)")
-        cursor.execute("CREATE TABLE available" " (id INTEGER PRIMARY KEY)")
-        cursor.execute(
-            "CREATE TABLE available_upgrade" " (id INTEGER PRIMARY KEY)",
-        )
-        cursor.execute("CREATE TABLE installed" " (id INTEGER PRIMARY KEY)")
         cursor.execute(
             "CREATE TABLE hash_id_request"
             " (id INTEGER PRIMARY KEY, timestamp TIMESTAMP,"
@@ -519,6 +827,44 @@ def ensure_package_schema(db):
     else:
         cursor.close()
         db.commit()
+    ensure_package_state_schema(db)
+
+
+def ensure_package_state_schema(db):
+    """Create the table holding the package states of a L{PackageStore}.
+
+    Each state is a single row, with the serialized L{IdBitmap} of its
+    package ids. The ids of databases created by older clients, with a
+    table of ids per state, are moved there.
+
+    @param db: A connection to a SQLite database.
+    """
+    cursor = db.cursor()
+    try:
+        cursor.execute(
+            "CREATE TABLE package_state (name TEXT PRIMARY KEY, ids BLOB)",
+        )
+        for state in PACKAGE_STATES:
+            cursor.execute(
+                "SELECT name FROM sqlite_master WHERE type='table' AND name=?",
+                (state,),
+            )
+            if cursor.fetchone() is None:
+                continue
+            cursor.execute(f"SELECT id FROM {state}")
+            ids = IdBitmap(row[0] for row in cursor.fetchall())
+            if ids:
+                cursor.execute(
+                    "INSERT INTO package_state VALUES (?, ?)",
+                    (state, sqlite3.Binary(ids.to_bytes())),
+                )
+            cursor.execute(f"DROP TABLE {state}")
+    except sqlite3.OperationalError:
+        cursor.close()
+        db.rollback()
+    else:
+        cursor.close()
+        db.commit()
 
 
 def ensure_fake_package_schema(db):
@@ -21,6 +21,8 @@ from landscape.lib.apt.package.facade import ChannelError
 from landscape.lib.apt.package.facade import DependencyError
 from landscape.lib.apt.package.facade import LandscapeInstallProgress
 from landscape.lib.apt.package.facade import TransactionError
+from landscape.lib.apt.package.hashing import HashCache
+from landscape.lib.apt.package.skeleton import build_skeleton_apt
 from landscape.lib.apt.package.testing import AptFacadeHelper
 from landscape.lib.apt.package.testing import create_deb
 from landscape.lib.apt.package.testing import create_simple_repository
@@ -29,10 +31,18 @@ from landscape.lib.apt.package.testing import HASH2
 from landscape.lib.apt.package.testing import HASH3
 from landscape.lib.apt.package.testing import PKGDEB1
 from landscape.lib.apt.package.testing import PKGDEB_MINIMAL
+from landscape.lib.apt.package.testing import PKGDEB_MULTIPLE_RELATIONS
+from landscape.lib.apt.package.testing import PKGDEB_OR_RELATIONS
+from landscape.lib.apt.package.testing import PKGDEB_SIMPLE_RELATIONS
+from landscape.lib.apt.package.testing import PKGDEB_VERSION_RELATIONS
 from landscape.lib.apt.package.testing import PKGNAME1
 from landscape.lib.apt.package.testing import PKGNAME2
 from landscape.lib.apt.package.testing import PKGNAME3
 from landscape.lib.apt.package.testing import PKGNAME_MINIMAL
+from landscape.lib.apt.package.testing import PKGNAME_MULTIPLE_RELATIONS
+from landscape.lib.apt.package.testing import PKGNAME_OR_RELATIONS
+from landscape.lib.apt.package.testing import PKGNAME_SIMPLE_RELATIONS
+from landscape.lib.apt.package.testing import PKGNAME_VERSION_RELATIONS
 from landscape.lib.fs import create_text_file
 from landscape.lib.fs import read_text_file
 
@@ -1001,6 +1011,104 @@ class AptFacadeTest(
         hashes = self.facade.get_package_hashes()
         self.assertEqual(sorted(hashes), sorted([HASH1, HASH2, HASH3]))
 
+    def test_get_package_hashes_in_workers(self):
+        """
+        The hashes are the same when they're computed in several worker
+        processes.
+        """
+        deb_dir = self.makeDir()
+        create_simple_repository(deb_dir)
+        self.facade.add_channel_deb_dir(deb_dir)
+        self.facade.hash_workers = 2
+        with mock.patch(
+            "landscape.lib.apt.package.hashing.MIN_ITEMS_PER_WORKER",
+            1,
+        ):
+            self.facade.reload_channels()
+        hashes = self.facade.get_package_hashes()
+        self.assertEqual(sorted(hashes), sorted([HASH1, HASH2, HASH3]))
+
+    def test_get_package_hashes_cached(self):
+        """
+        With a C{hash_cache}, the hashes are computed again only for the
+        packages whose list files changed since the last reload.
+        """
+        deb_dir = self.makeDir()
+        create_simple_repository(deb_dir)
+        self.facade.add_channel_deb_dir(deb_dir)
+        self.facade.hash_cache = HashCache(self.makeFile())
+        self.facade.reload_channels()
+        # Fetching the indexes again would write new list files.
+        self.facade.refetch_package_index = False
+        with mock.patch(
+            "landscape.lib.apt.package.facade.get_skeleton_hash",
+        ) as get_skeleton_hash:
+            self.facade.reload_channels()
+        get_skeleton_hash.assert_not_called()
+        hashes = self.facade.get_package_hashes()
+        self.assertEqual(sorted(hashes), sorted([HASH1, HASH2, HASH3]))
+
+    def test_get_package_hashes_match_skeletons(self):
+        """
+        The hash of every package, as computed in worker processes, is the
+        one of its skeleton as built by C{build_skeleton_apt}, whatever its
+        relations.
+        """
+        deb_dir = self.makeDir()
+        create_simple_repository(deb_dir)
+        for name, data in [
+            (PKGNAME_MINIMAL, PKGDEB_MINIMAL),
+            (PKGNAME_SIMPLE_RELATIONS, PKGDEB_SIMPLE_RELATIONS),
+            (PKGNAME_VERSION_RELATIONS, PKGDEB_VERSION_RELATIONS),
+            (PKGNAME_MULTIPLE_RELATIONS, PKGDEB_MULTIPLE_RELATIONS),
+            (PKGNAME_OR_RELATIONS, PKGDEB_OR_RELATIONS),
+        ]:
+            create_deb(deb_dir, name, data)
+        self._add_system_package(
+            "installed",
+            control_fields={
+                "Depends": "name1 (>= 1.0), libc6 | libc7",
+                "Provides": "virtual",
+                "Conflicts": "name2",
+            },
+        )
+        self.facade.add_channel_deb_dir(deb_dir)
+        self.facade.hash_workers = 2
+        with mock.patch(
+            "landscape.lib.apt.package.hashing.MIN_ITEMS_PER_WORKER",
+            1,
+        ), mock.patch("logging.warning") as warning:
+            self.facade.reload_channels()
+        warning.assert_not_called()
+        versions = list(self.facade.get_packages())
+        self.assertEqual(9, len(versions))
+        self.assertEqual(
+            sorted(
+                build_skeleton_apt(version).get_hash() for version in versions
+            ),
+            sorted(self.facade.get_package_hashes()),
+        )
+
+    def test_get_package_hashes_mismatch(self):
+        """
+        If the fast hashes don't match the skeletons' hashes, a warning
+        is logged and the hashes of the skeletons are used.
+        """
+        deb_dir = self.makeDir()
+        create_simple_repository(deb_dir)
+        self.facade.add_channel_deb_dir(deb_dir)
+        with mock.patch(
+            "landscape.lib.apt.package.facade.get_skeleton_hash",
+            return_value=b"x" * 20,
+        ), mock.patch("logging.warning") as warning:
+            self.facade.reload_channels()
+        hashes = self.facade.get_package_hashes()
+        self.assertEqual(sorted(hashes), sorted([HASH1, HASH2, HASH3]))
+        self.assertIn(
+            "differs from its skeleton hash",
+            warning.call_args[0][0],
+        )
+
     def test_get_package_by_hash(self):
         """
         C{get_package_by_hash} returns the package that has the given hash.
@@ -0,0 +1,206 @@
+import os
+import shutil
+import tempfile
+import unittest
+from unittest import mock
+
+from landscape.lib.apt.package import hashing
+from landscape.lib.apt.package.hashing import compute_hashes
+from landscape.lib.apt.package.hashing import HashCache
+from landscape.lib.fs import create_text_file
+from landscape.lib.hashlib import sha1
+
+
+def hash_item(item):
+    return sha1(str(item).encode("ascii")).digest()
+
+
+class ComputeHashesTest(unittest.TestCase):
+    def setUp(self):
+        super().setUp()
+        patcher = mock.patch.object(hashing, "MIN_ITEMS_PER_WORKER", 10)
+        patcher.start()
+        self.addCleanup(patcher.stop)
+        self.items = list(range(95))
+        self.expected = [hash_item(item) for item in self.items]
+
+    def test_single_worker(self):
+        """
+        With a single worker the hashes are computed in this process.
+        """
+        with mock.patch("os.fork") as fork:
+            hashes = compute_hashes(self.items, hash_item, workers=1)
+        self.assertEqual(self.expected, hashes)
+        fork.assert_not_called()
+
+    def test_few_items(self):
+        """
+        No worker is forked unless each has enough items to hash.
+        """
+        with mock.patch("os.fork") as fork:
+            hashes = compute_hashes(self.items[:15], hash_item, workers=4)
+        self.assertEqual(self.expected[:15], hashes)
+        fork.assert_not_called()
+
+    def test_workers(self):
+        """
+        The hashes computed by the workers are returned in the order of
+        the items.
+        """
+        hashes = compute_hashes(self.items, hash_item, workers=4)
+        self.assertEqual(self.expected, hashes)
+
+    def test_failed_worker(self):
+        """
+        If a worker fails, its items are hashed again in this process.
+        """
+        parent = os.getpid()
+
+        def hash_or_fail(item):
+            if item == 50 and os.getpid() != parent:
+                raise RuntimeError("boom")
+            return hash_item(item)
+
+        with mock.patch("logging.warning") as warning:
+            hashes = compute_hashes(self.items, hash_or_fail, workers=4)
+        self.assertEqual(self.expected, hashes)
+        self.assertEqual(1, warning.call_count)
+        self.assertIn("hashing its 24 packages again", warning.call_args[0][0])
+
+
+class HashCacheTest(unittest.TestCase):
+    def setUp(self):
+        super().setUp()
+        self.directory = tempfile.mkdtemp()
+        self.addCleanup(shutil.rmtree, self.directory)
+        self.filename = os.path.join(self.directory, "hash-cache")
+        self.list_file = os.path.join(self.directory, "Packages")
+        self.status_file = os.path.join(self.directory, "status")
+        for path in (self.list_file, self.status_file):
+            create_text_file(path, "Package: name1\n")
+        self.key1 = ("name1", "1.0", "amd64", (self.list_file,))
+        self.key2 = (
+            "name2",
+            "2.0",
+            "all",
+            (self.list_file, self.status_file),
+        )
+
+    def create_cache(self):
+        cache = HashCache(self.filename)
+        cache.load()
+        return cache
+
+    def test_empty(self):
+        """
+        Nothing is cached if the cache file doesn't exist yet.
+        """
+        cache = self.create_cache()
+        self.assertIsNone(cache.get(self.key1))
+
+    def test_save_and_load(self):
+        """
+        Hashes set and saved are available once the cache is loaded again.
+        """
+        cache = self.create_cache()
+        cache.set(self.key1, b"hash1")
+        cache.set(self.key2, b"hash2")
+        cache.save()
+        cache = self.create_cache()
+        self.assertEqual(b"hash1", cache.get(self.key1))
+        self.assertEqual(b"hash2", cache.get(self.key2))
+
+    def test_changed_file(self):
+        """
+        The hashes of versions read from a file that changed since the
+        cache was saved aren't returned.
+        """
+        cache = self.create_cache()
+        cache.set(self.key1, b"hash1")
+        cache.set(self.key2, b"hash2")
+        cache.save()
+        create_text_file(self.status_file, "Package: name1\nStatus: ok\n")
+        cache = self.create_cache()
+        self.assertEqual(b"hash1", cache.get(self.key1))
+        self.assertIsNone(cache.get(self.key2))
+
+    def test_missing_file(self):
+        """
+        Nothing is cached for versions read from a file that doesn't
+        exist, or from no file at all.
+        """
+        cache = self.create_cache()
+        os.unlink(self.list_file)
+        cache.set(self.key1, b"hash1")
+        cache.set(("name3", "3.0", "all", ()), b"hash3")
+        cache.save()
+        create_text_file(self.list_file, "Package: name1\n")
+        cache = self.create_cache()
+        self.assertIsNone(cache.get(self.key1))
+        self.assertIsNone(cache.get(("name3", "3.0", "all", ())))
+
+    def test_save_drops_unused(self):
+        """
+        Only the hashes looked up or set since loading are saved, so that
+        versions gone from the channels are forgotten.
+        """
+        cache = self.create_cache()
+        cache.set(self.key1, b"hash1")
+        cache.set(self.key2, b"hash2")
+        cache.save()
+        cache = self.create_cache()
+        cache.get(self.key2)
+        cache.save()
+        cache = self.create_cache()
+        self.assertIsNone(cache.get(self.key1))
+        self.assertEqual(b"hash2", cache.get(self.key2))
+
+    def test_save_unchanged(self):
+        """
+        The cache file isn't written again if all its hashes were looked
+        up and none was set.
+        """
+        cache = self.create_cache()
+        cache.set(self.key1, b"hash1")
+        cache.set(self.key2, b"hash2")
+        cache.save()
+        inode = os.stat(self.filename).st_ino
+        cache = self.create_cache()
+        cache.get(self.key1)
+        cache.get(self.key2)
+        cache.save()
+        self.assertEqual(inode, os.stat(self.filename).st_ino)
+
+    def test_save_changed(self):
+        """
+        The cache file is written again if a hash was set, or one of its
+        hashes wasn't looked up.
+        """
+        cache = self.create_cache()
+        cache.set(self.key1, b"hash1")
+        cache.save()
+        inode = os.stat(self.filename).st_ino
+        cache = self.create_cache()
+        cache.get(self.key1)
+        cache.set(self.key2, b"hash2")
+        cache.save()
+        self.assertNotEqual(inode, os.stat(self.filename).st_ino)
+
+        inode = os.stat(self.filename).st_ino
+        cache = self.create_cache()
+        cache.get(self.key2)
+        cache.save()
+        self.assertNotEqual(inode, os.stat(self.filename).st_ino)
+        self.assertIsNone(self.create_cache().get(self.key1))
+
+    def test_invalid_file(self):
+        """
+        An invalid cache file is ignored, with a warning.
+        """
+        create_text_file(self.filename, "garbage")
+        with mock.patch("logging.warning") as warning:
+            cache = self.create_cache()
+        self.assertIsNone(cache.get(self.key1))
+        warning.assert_called_once_with(
+            f"Ignoring invalid package hash cache {self.filename}.",
+        )
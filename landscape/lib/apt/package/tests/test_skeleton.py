@@ -12,6 +12,7 @@ from landscape.lib.apt.package.skeleton import DEB_PACKAGE
 from landscape.lib.apt.package.skeleton import DEB_PROVIDES
 from landscape.lib.apt.package.skeleton import DEB_REQUIRES
 from landscape.lib.apt.package.skeleton import DEB_UPGRADES
+from landscape.lib.apt.package.skeleton import get_skeleton_hash
 from landscape.lib.apt.package.skeleton import PackageSkeleton
 from landscape.lib.apt.package.testing import AptFacadeHelper
 from landscape.lib.apt.package.testing import create_deb
@@ -338,6 +339,27 @@ class SkeletonAptTest(BaseTestCase):
         self.assertEqual(relations, skeleton.relations)
         self.assertEqual(HASH_OR_RELATIONS, skeleton.get_hash())
 
+    def test_get_skeleton_hash(self):
+        """
+        C{get_skeleton_hash} returns the hash of the skeleton that
+        build_skeleton_apt builds for a package, whatever relations it
+        has.
+        """
+        for name, expected_hash in [
+            ("name1", HASH1),
+            ("minimal", HASH_MINIMAL),
+            ("simple-relations", HASH_SIMPLE_RELATIONS),
+            ("version-relations", HASH_VERSION_RELATIONS),
+            ("multiple-relations", HASH_MULTIPLE_RELATIONS),
+            ("or-relations", HASH_OR_RELATIONS),
+        ]:
+            pkg = self.get_package(name)
+            self.assertEqual(expected_hash, get_skeleton_hash(pkg), name)
+            self.assertEqual(
+                build_skeleton_apt(pkg).get_hash(),
+                get_skeleton_hash(pkg),
+            )
+
 
 class SkeletonTest(BaseTestCase):
     def test_skeleton_set_hash(self):
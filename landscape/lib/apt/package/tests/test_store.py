@@ -1,3 +1,4 @@
+import os
 import sqlite3
 import threading
 import time
@@ -5,10 +6,12 @@ import unittest
 from unittest import mock
 
 from landscape.lib import testing
+from landscape.lib.apt.package.store import HashIdIndex
 from landscape.lib.apt.package.store import HashIdStore
 from landscape.lib.apt.package.store import InvalidHashIdDb
 from landscape.lib.apt.package.store import PackageStore
 from landscape.lib.apt.package.store import UnknownHashIDRequest
+from landscape.lib.bitmap import IdBitmap
 
 
 class BaseTestCase(testing.FSTestCase, unittest.TestCase):
@@ -129,6 +132,89 @@ class HashIdStoreTest(BaseTestCase):
         self.assertRaises(InvalidHashIdDb, store.check_sanity)
 
 
+class HashIdIndexTest(BaseTestCase):
+    def setUp(self):
+        super().setUp()
+        self.db_filename = self.makeFile()
+        self.addCleanup(self._remove_index)
+        self.hash_ids = {
+            b"hash1": 10,
+            b"hash2": 5,
+            b"ha\x00sh1": 7,
+            b"h": 3,
+            b"\xff" * 20: 1,
+        }
+        HashIdStore(self.db_filename).set_hash_ids(self.hash_ids)
+
+    def _remove_index(self):
+        filename = HashIdIndex.get_filename(self.db_filename)
+        if os.path.exists(filename):
+            os.remove(filename)
+
+    def test_get_hash_id(self):
+        index = HashIdIndex.load(self.db_filename)
+        for hash, id in self.hash_ids.items():
+            self.assertEqual(id, index.get_hash_id(hash))
+        self.assertIsNone(index.get_hash_id(b"hash"))
+        self.assertIsNone(index.get_hash_id(b"hash3"))
+        self.assertIsNone(index.get_hash_id(b"x" * 30))
+
+    def test_get_hash_ids(self):
+        index = HashIdIndex.load(self.db_filename)
+        hashes = list(self.hash_ids) + [b"", b"hash0", b"zzz", b"hash1\0"]
+        self.assertEqual(self.hash_ids, index.get_hash_ids(hashes))
+
+    def test_get_id_hash(self):
+        index = HashIdIndex.load(self.db_filename)
+        for hash, id in self.hash_ids.items():
+            self.assertEqual(hash, index.get_id_hash(id))
+        self.assertIsNone(index.get_id_hash(4))
+        self.assertIsNone(index.get_id_hash(11))
+
+    def test_empty(self):
+        db_filename = self.makeFile()
+        HashIdStore(db_filename).check_sanity()
+        index = HashIdIndex.load(db_filename)
+        os.remove(HashIdIndex.get_filename(db_filename))
+        self.assertEqual({}, index.get_hash_ids([b"hash1"]))
+        self.assertIsNone(index.get_id_hash(1))
+
+    def test_reuse(self):
+        """
+        An index is only built once for a given database.
+        """
+        HashIdIndex.load(self.db_filename)
+        with mock.patch.object(HashIdIndex, "build") as build:
+            index = HashIdIndex.load(self.db_filename)
+        build.assert_not_called()
+        self.assertEqual(10, index.get_hash_id(b"hash1"))
+
+    def test_rebuild_for_new_database(self):
+        """
+        The index is built again if the database changed since.
+        """
+        HashIdIndex.load(self.db_filename)
+        HashIdStore(self.db_filename).set_hash_ids({b"hash3": 11})
+        stat = os.stat(self.db_filename)
+        os.utime(
+            self.db_filename,
+            ns=(stat.st_atime_ns, stat.st_mtime_ns + 1000000000),
+        )
+        index = HashIdIndex.load(self.db_filename)
+        self.assertEqual(11, index.get_hash_id(b"hash3"))
+
+    def test_invalid_index(self):
+        """
+        An invalid index is built again.
+        """
+        filename = HashIdIndex.get_filename(self.db_filename)
+        with open(filename, "wb") as index_file:
+            index_file.write(b"junk")
+        self.assertRaises(InvalidHashIdDb, HashIdIndex, filename)
+        index = HashIdIndex.load(self.db_filename)
+        self.assertEqual(10, index.get_hash_id(b"hash1"))
+
+
 class PackageStoreTest(BaseTestCase):
     def setUp(self):
         super().setUp()
@@ -227,6 +313,72 @@ class PackageStoreTest(BaseTestCase):
         self.assertEqual(self.store1.get_id_hash(456), b"hash2")
         self.assertEqual(self.store1.get_id_hash(789), b"hash3")
 
+    def test_get_hash_ids_using_hash_id_dbs(self):
+        """
+        L{PackageStore.get_hash_ids} looks up several hashes at once, with
+        the same priorities as L{PackageStore.get_hash_id}.
+        """
+        self.store1.set_hash_ids({b"hash1": 1, b"hash4": 6})
+        self.store1.add_hash_id_db(
+            self.hash_id_db_factory({b"hash1": 2, b"hash2": 3}),
+        )
+        self.store1.add_hash_id_db(
+            self.hash_id_db_factory({b"hash2": 4, b"ha\x00sh1": 5}),
+        )
+        self.assertEqual(
+            {b"hash1": 2, b"hash2": 3, b"ha\x00sh1": 5, b"hash4": 6},
+            self.store1.get_hash_ids(
+                [b"hash1", b"hash2", b"ha\x00sh1", b"hash4", b"hash5"],
+            ),
+        )
+        # Without hashes, all the mappings of the main database are
+        # returned.
+        self.assertEqual(
+            {b"hash1": 1, b"hash4": 6},
+            self.store1.get_hash_ids(),
+        )
+
+    def test_get_hash_ids_many(self):
+        """
+        L{HashIdStore.get_hash_ids} looks up more hashes than SQLite
+        accepts parameters in a single query.
+        """
+        hash_ids = {f"hash{i:d}".encode("ascii"): i for i in range(2500)}
+        self.store1.set_hash_ids(hash_ids)
+        self.assertEqual(
+            hash_ids,
+            self.store1.get_hash_ids(list(hash_ids) + [b"unknown"]),
+        )
+
+    def test_add_hash_id_db_builds_index(self):
+        """
+        Attaching a hash=>id database builds a L{HashIdIndex} next to it,
+        which is used for the look-ups.
+        """
+        filename = self.hash_id_db_factory({b"hash1": 2})
+        self.store1.add_hash_id_db(filename)
+        self.assertTrue(os.path.exists(HashIdIndex.get_filename(filename)))
+        self.assertIsInstance(self.store1._hash_id_stores[0], HashIdIndex)
+        self.assertEqual(2, self.store1.get_hash_id(b"hash1"))
+
+    def test_add_hash_id_db_without_index(self):
+        """
+        If the index can't be built, the hash=>id database is queried
+        directly.
+        """
+        filename = self.hash_id_db_factory({b"hash1": 2})
+        with mock.patch.object(
+            HashIdIndex,
+            "build",
+            side_effect=OSError("No space left"),
+        ), mock.patch("logging.warning") as warning:
+            self.store1.add_hash_id_db(filename)
+        warning.assert_called_once_with(
+            f"Couldn't index hash=>id database {filename}: No space left",
+        )
+        self.assertIsInstance(self.store1._hash_id_stores[0], HashIdStore)
+        self.assertEqual(2, self.store1.get_hash_id(b"hash1"))
+
     def test_add_and_get_available_packages(self):
         self.store1.add_available([1, 2])
         self.assertEqual(self.store2.get_available(), [1, 2])
@@ -363,21 +515,50 @@ class PackageStoreTest(BaseTestCase):
             " (id INTEGER PRIMARY KEY, queue TEXT,"
             " timestamp TIMESTAMP, data BLOB)",
         )
+        cursor.execute("INSERT INTO installed VALUES (3)")
+        cursor.execute("INSERT INTO installed VALUES (70000)")
+        cursor.execute("INSERT INTO available VALUES (5)")
         cursor.close()
         database.commit()
         database.close()
 
         store = PackageStore(filename)
-        store.get_locked()
+        self.assertEqual([], store.get_locked())
+        self.assertEqual([], store.get_autoremovable())
+        self.assertEqual([3, 70000], store.get_installed())
+        self.assertEqual([5], store.get_available())
 
         database = sqlite3.connect(filename)
         cursor = database.cursor()
-        cursor.execute("pragma table_info(locked)")
+        cursor.execute("pragma table_info(package_state)")
         result = cursor.fetchall()
         self.assertTrue(len(result) > 0)
-        cursor.execute("pragma table_info(autoremovable)")
+        # The ids were moved out of the old, per state, tables.
+        cursor.execute("pragma table_info(installed)")
         result = cursor.fetchall()
-        self.assertTrue(len(result) > 0)
+        self.assertEqual([], result)
+        database.close()
+
+    def test_get_and_set_package_states(self):
+        """
+        L{PackageStore.set_package_states} replaces the ids of several
+        package states at once, which L{PackageStore.get_package_state}
+        returns as an L{IdBitmap}.
+        """
+        self.store1.add_installed([1, 2])
+        self.store1.add_available([3])
+        self.store1.set_package_states(
+            {
+                "installed": IdBitmap([2, 4]),
+                "available": IdBitmap(),
+            },
+        )
+        self.assertEqual(
+            IdBitmap([2, 4]),
+            self.store2.get_package_state("installed"),
+        )
+        self.assertEqual([2, 4], self.store2.get_installed())
+        self.assertEqual([], self.store2.get_available())
 
     def test_add_and_get_locked(self):
         """
@@ -515,6 +696,18 @@ class PackageStoreTest(BaseTestCase):
         task = self.store2.get_next_task("reporter")
         self.assertEqual(task, None)
 
+    def test_get_next_tasks(self):
+        task1 = self.store1.add_task("reporter", [1])
+        self.store1.add_task("changer", [2])
+        task3 = self.store1.add_task("reporter", [3])
+        self.store1.add_task("reporter", [4])
+
+        tasks = self.store2.get_next_tasks("reporter", 2)
+        self.assertEqual([task.id for task in tasks], [task1.id, task3.id])
+        self.assertEqual([task.data for task in tasks], [[1], [3]])
+
+        self.assertEqual(self.store2.get_next_tasks("other", 2), [])
+
     def test_get_task_timestamp(self):
         with mock.patch("time.time", return_value=123):
             self.store1.add_task("reporter", [1])
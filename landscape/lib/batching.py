@@ -0,0 +1,95 @@
+from collections import deque
+
+
+class AdaptiveBatch:
+    """
+    Keeps track of how many messages, and bytes, to send in a batch, after
+    the throughput and round trip time measured on the past batches.
+
+    A batch is meant to take about C{target_duration} seconds to transfer,
+    round trip included. The byte budget is what the link is estimated to
+    carry in that time, and the message count is what fits in the budget
+    with the average message size seen so far, but never fewer than
+    C{max_messages} nor more than C{max_scale} times that.
+    """
+
+    def __init__(
+        self,
+        max_messages,
+        initial_bytes=1024 * 1024,
+        min_bytes=64 * 1024,
+        max_bytes=16 * 1024 * 1024,
+        target_duration=30,
+        max_scale=10,
+    ):
+        self._base_messages = max_messages
+        self._min_bytes = min_bytes
+        self._max_bytes = max_bytes
+        self._target_duration = target_duration
+        self._max_scale = max_scale
+        self._throughput = None  # Bytes per second
+        self._message_size = None  # Average bytes per message
+        # Successive batch durations, the shortest is taken as the RTT.
+        self._durations = deque(maxlen=10)
+
+        self.max_messages = max_messages
+        self.max_bytes = initial_bytes
+
+    def get_round_trip_time(self):
+        """Return the estimated round trip time, or C{None} if unknown."""
+        if not self._durations:
+            return None
+        return min(self._durations)
+
+    def record(self, size, messages, duration):
+        """
+        Record that a batch of C{messages} messages, adding up to C{size}
+        bytes, was transferred in C{duration} seconds, and update the
+        C{max_messages} and C{max_bytes} of the next batch.
+        """
+        # Clocks have a finite resolution, and a zero duration would be an
+        # infinite throughput.
+        duration = max(duration, 0.001)
+        self._durations.append(duration)
+        if not messages:
+            return
+        self._throughput = self._average(self._throughput, size / duration)
+        self._message_size = self._average(self._message_size, size / messages)
+
+        # Leave room for the round trip, but for at least half of the time
+        # when the link is really slow to answer.
+        transfer_time = max(
+            self._target_duration - self.get_round_trip_time(),
+            self._target_duration / 2,
+        )
+        self.max_bytes = self._clamp(
+            int(self._throughput * transfer_time),
+            self._min_bytes,
+            self._max_bytes,
+        )
+        self.max_messages = self._clamp(
+            int(self.max_bytes / max(self._message_size, 1)),
+            self._base_messages,
+            self._base_messages * self._max_scale,
+        )
+
+    def record_failure(self):
+        """
+        Record that a batch failed to be transferred, halving the budget of
+        the next batch in case it was too big for the link.
+        """
+        if self._throughput is not None:
+            self._throughput /= 2
+        self.max_bytes = max(self.max_bytes // 2, self._min_bytes)
+        self.max_messages = max(self.max_messages // 2, self._base_messages)
+
+    @staticmethod
+    def _average(average, value, weight=0.5):
+        """Return the moving average of the values, C{value} being the last."""
+        if average is None:
+            return value
+        return average + weight * (value - average)
+
+    @staticmethod
+    def _clamp(value, low, high):
+        return min(max(value, low), high)
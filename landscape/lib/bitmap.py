@@ -0,0 +1,187 @@
+"""Compact sets of integer ids, like package ids."""
+import re
+import struct
+import sys
+from array import array
+
+
+CONTAINER_BITS = 16
+CONTAINER_SIZE = 1 << CONTAINER_BITS
+CONTAINER_BYTES = CONTAINER_SIZE // 8
+
+# Containers with fewer ids than this are serialized as sorted arrays of
+# their low bits, which is smaller than their bitmap.
+ARRAY_MAX = CONTAINER_BYTES // 2
+
+ARRAY, BITMAP = 0, 1
+
+_header = struct.Struct("<IBI")
+_nonzero = re.compile(rb"[^\x00]")
+_byte_bits = [
+    tuple(bit for bit in range(8) if byte >> bit & 1) for byte in range(256)
+]
+
+
+try:
+    _bit_count = int.bit_count
+except AttributeError:  # Python < 3.10
+
+    def _bit_count(bits):
+        return bin(bits).count("1")
+
+
+class IdBitmap:
+    """An immutable set of non-negative integer ids.
+
+    As in a roaring bitmap, the ids are split in containers by their
+    high bits, so that a sparse set stays small. Each container is a
+    Python int used as a bitmap, so that set operations between two
+    bitmaps work a machine word at a time rather than an id at a time.
+
+    Iterating a bitmap yields its ids in ascending order.
+
+    @param ids: An iterable of ids.
+    """
+
+    __slots__ = ("_containers",)
+
+    def __init__(self, ids=()):
+        groups = {}
+        for id in ids:
+            if id < 0:
+                raise ValueError(f"Invalid id {id!r}")
+            high = id >> CONTAINER_BITS
+            bits = groups.get(high)
+            if bits is None:
+                bits = groups[high] = bytearray(CONTAINER_BYTES)
+            low = id & (CONTAINER_SIZE - 1)
+            bits[low >> 3] |= 1 << (low & 7)
+        self._containers = {
+            high: int.from_bytes(bits, "little")
+            for high, bits in sorted(groups.items())
+        }
+
+    @classmethod
+    def _from_containers(cls, containers):
+        bitmap = cls.__new__(cls)
+        bitmap._containers = {
+            high: bits for high, bits in sorted(containers.items()) if bits
+        }
+        return bitmap
+
+    @classmethod
+    def from_bytes(cls, data):
+        """Return the bitmap serialized by L{to_bytes}.
+
+        @raise ValueError: If C{data} isn't a valid serialized bitmap.
+        """
+        containers = {}
+        offset = 0
+        try:
+            while offset < len(data):
+                high, kind, count = _header.unpack_from(data, offset)
+                offset += _header.size
+                if kind == BITMAP:
+                    end = offset + CONTAINER_BYTES
+                    bits = int.from_bytes(data[offset:end], "little")
+                elif kind == ARRAY:
+                    end = offset + count * 2
+                    lows = array("H")
+                    lows.frombytes(data[offset:end])
+                    if len(lows) != count:
+                        raise ValueError("Truncated id array")
+                    if sys.byteorder == "big":  # pragma: no cover
+                        lows.byteswap()
+                    bits = bytearray(CONTAINER_BYTES)
+                    for low in lows:
+                        bits[low >> 3] |= 1 << (low & 7)
+                    bits = int.from_bytes(bits, "little")
+                else:
+                    raise ValueError(f"Unknown container kind {kind!r}")
+                if end > len(data):
+                    raise ValueError("Truncated container")
+                containers[high] = bits
+                offset = end
+        except struct.error as error:
+            raise ValueError(str(error))
+        return cls._from_containers(containers)
+
+    def to_bytes(self):
+        """Serialize the bitmap, for L{from_bytes}."""
+        chunks = []
+        for high, bits in self._containers.items():
+            count = _bit_count(bits)
+            if count < ARRAY_MAX:
+                lows = array("H", self._iter_bits(bits))
+                if sys.byteorder == "big":  # pragma: no cover
+                    lows.byteswap()
+                chunks.append(_header.pack(high, ARRAY, count))
+                chunks.append(lows.tobytes())
+            else:
+                chunks.append(_header.pack(high, BITMAP, count))
+                chunks.append(bits.to_bytes(CONTAINER_BYTES, "little"))
+        return b"".join(chunks)
+
+    @staticmethod
+    def _iter_bits(bits):
+        """Yield the positions of the bits set in C{bits}, ascending."""
+        # Let the regular expression skip the empty bytes in C.
+        data = bits.to_bytes(CONTAINER_BYTES, "little")
+        for match in _nonzero.finditer(data):
+            offset = match.start()
+            for bit in _byte_bits[data[offset]]:
+                yield offset * 8 + bit
+
+    def __iter__(self):
+        for high, bits in self._containers.items():
+            base = high << CONTAINER_BITS
+            for low in self._iter_bits(bits):
+                yield base + low
+
+    def __len__(self):
+        return sum(_bit_count(bits) for bits in self._containers.values())
+
+    def __bool__(self):
+        return bool(self._containers)
+
+    def __contains__(self, id):
+        bits = self._containers.get(id >> CONTAINER_BITS, 0)
+        return bool(bits >> (id & (CONTAINER_SIZE - 1)) & 1)
+
+    def __eq__(self, other):
+        if not isinstance(other, IdBitmap):
+            return NotImplemented
+        return self._containers == other._containers
+
+    def __ne__(self, other):
+        if not isinstance(other, IdBitmap):
+            return NotImplemented
+        return self._containers != other._containers
+
+    __hash__ = None
+
+    def __or__(self, other):
+        containers = dict(self._containers)
+        for high, bits in other._containers.items():
+            containers[high] = containers.get(high, 0) | bits
+        return self._from_containers(containers)
+
+    def __and__(self, other):
+        return self._from_containers(
+            {
+                high: bits & other._containers[high]
+                for high, bits in self._containers.items()
+                if high in other._containers
+            },
+        )
+
+    def __sub__(self, other):
+        return self._from_containers(
+            {
+                high: bits & ~other._containers.get(high, 0)
+                for high, bits in self._containers.items()
+            },
+        )
+
+    def __repr__(self):
+        return f"IdBitmap({list(self)!r})"
@@ -48,12 +48,15 @@ def dumps(obj, _dt=dumps_table):
 def loads(byte_string, _lt=loads_table, as_is=False):
     """Load a serialized byte_string.
 
-    @param byte_string: the serialized data
+    @param byte_string: the serialized data, bytes or any object
+        supporting the buffer protocol, like an C{mmap}
     @param _lt: the conversion map
     @param as_is: don't reinterpret dict keys as str
     """
     if not byte_string:
         raise ValueError("Can't load empty string")
+    if not isinstance(byte_string, bytes):
+        byte_string = bytes(byte_string)
     try:
         # To avoid python3 turning byte_string[0] into an int,
         # we slice the bytestring instead.
@@ -229,3 +232,193 @@ else:
             str: dumps_unicode,
         },
     )
+
+
+class Serialized(bytes):
+    """Bytes holding an object that was already encoded with L{dumps}.
+
+    L{dumps_iter} copies these into its output verbatim, instead of
+    encoding them again as a byte string.
+    """
+
+
+def dumps_iter(obj):
+    """Serialize C{obj} as a sequence of byte chunks.
+
+    Joining the chunks gives the same result as L{dumps}, except that any
+    L{Serialized} value found in a dict, list or tuple is yielded as-is.
+    This is meant for payloads that are mostly made of serialized objects,
+    such as a batch of stored messages, which then never need to be decoded
+    or joined in memory.
+    """
+    if isinstance(obj, Serialized):
+        yield obj
+    elif type(obj) is dict:
+        yield b"d"
+        for key in sorted(obj):
+            yield dumps(key)
+            yield from dumps_iter(obj[key])
+        yield b";"
+    elif type(obj) is list or type(obj) is tuple:
+        yield b"l" if type(obj) is list else b"t"
+        for value in obj:
+            yield from dumps_iter(value)
+        yield b";"
+    else:
+        yield dumps(obj)
+
+
+def loads_fields(byte_string, fields):
+    """Load only the given keys of the serialized dict in C{byte_string}.
+
+    This gives the same as C{loads(byte_string, as_is=True)} restricted to
+    C{fields}, except that the accelerated version skips the other values
+    without building them, only checking how they're framed.
+
+    @return: A dict with the C{fields} that were found.
+    """
+    obj = py_loads(byte_string, as_is=True)
+    if type(obj) is not dict:
+        raise ValueError("Not a dictionary")
+    return {key: value for key, value in obj.items() if key in fields}
+
+
+class Decoder:
+    """Incrementally decode a serialized object fed in chunks.
+
+    Bytes are dropped as soon as the values they hold are decoded, so only
+    the decoded object and the last, partial, token are kept in memory.
+    Errors are kept until L{close} is called, which makes L{feed} safe to
+    use as a callback that must not raise, like a pycurl write function.
+
+    @param as_is: don't reinterpret dict keys as str
+    @ivar received: the number of bytes fed so far.
+    @ivar pending: the bytes that weren't decoded.
+    """
+
+    _missing = object()
+
+    def __init__(self, as_is=False):
+        self.as_is = as_is
+        self.received = 0
+        self.pending = bytearray()
+        self._stack = []
+        self._result = self._error = None
+        self._done = False
+
+    def feed(self, data):
+        """Decode as much as possible of C{data}."""
+        self.received += len(data)
+        if self._done:
+            # Trailing data is ignored, like L{loads} does, unless it's
+            # needed to tell what went wrong.
+            if self._error is not None:
+                self.pending += data
+            return
+        self.pending += data
+        try:
+            pos = self._decode(self.pending)
+        except Exception as e:
+            # Malformed data raises ValueError mostly, but also TypeError
+            # for an unhashable key for example.
+            self._error = e
+            self._done = True
+        else:
+            del self.pending[:pos]
+
+    def close(self):
+        """Return the decoded object.
+
+        @raises ValueError: if the data is corrupted or incomplete, or the
+            error decoding it raised.
+        """
+        if self._error is not None:
+            raise self._error
+        if not self._done:
+            if not self.received:
+                raise ValueError("Can't load empty string")
+            raise ValueError("Corrupted data")
+        return self._result
+
+    def _decode(self, buffer):
+        """Decode the complete values in C{buffer}, return where we stopped."""
+        pos = 0
+        size = len(buffer)
+        stack = self._stack
+        while pos < size:
+            start = pos
+            kind = buffer[pos]
+            if kind in b"ltd":
+                value = {} if kind == ord("d") else []
+                stack.append([kind, value, self._missing])
+                pos += 1
+                continue
+            if kind == ord(";") and stack:
+                kind, value, key = stack.pop()
+                if key is not self._missing:
+                    raise ValueError("Corrupted data")
+                if kind == ord("t"):
+                    value = tuple(value)
+                pos += 1
+            elif kind == ord("n"):
+                value = None
+                pos += 1
+            elif kind == ord("b"):
+                if pos + 2 > size:
+                    return start
+                value = bool(int(buffer[pos + 1 : pos + 2]))
+                pos += 2
+            elif kind == ord("i") or kind == ord("f"):
+                end = buffer.find(b";", pos)
+                if end == -1:
+                    return start
+                convert = int if kind == ord("i") else float
+                value = convert(buffer[pos + 1 : end])
+                pos = end + 1
+            elif kind == ord("s") or kind == ord("u"):
+                colon = buffer.find(b":", pos)
+                if colon == -1:
+                    return start
+                length = int(buffer[pos + 1 : colon])
+                if length < 0:
+                    raise ValueError(f"Negative length: {length}")
+                end = colon + 1 + length
+                if end > size:
+                    return start
+                value = bytes(buffer[colon + 1 : end])
+                if kind == ord("u"):
+                    value = value.decode("utf-8")
+                pos = end
+            else:
+                raise ValueError(f"Unknown type character: {chr(kind)!r}")
+            if not stack:
+                self._result = value
+                self._done = True
+                return pos
+            container = stack[-1]
+            if container[0] != ord("d"):
+                container[1].append(value)
+            elif container[2] is self._missing:
+                if not self.as_is and isinstance(value, bytes):
+                    value = value.decode("ascii")
+                container[2] = value
+            else:
+                container[1][container[2]] = value
+                container[2] = self._missing
+        return pos
+
+
+# Keep the pure Python implementation around, and use the compiled
+# accelerator when it's available. Both are wire-compatible.
+py_dumps = dumps
+py_loads = loads
+py_loads_fields = loads_fields
+
+try:
+    from landscape.lib._bpickle import (  # noqa: F401,F811
+        dumps,
+        loads,
+        loads_fields,
+    )
+except ImportError:
+    pass
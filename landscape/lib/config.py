@@ -1,7 +1,10 @@
+import json
 import os.path
 import sys
+import tempfile
 from logging import getLogger
 from optparse import OptionParser
+from optparse import SUPPRESS_HELP
 
 from configobj import ConfigObj
 from configobj import ConfigObjError
@@ -213,12 +216,91 @@ class BaseConfiguration:
         then the old data will take precedence.
         """
         self._config_filename = filename
-        config_obj = self._get_config_object()
+        config_obj = None
+        if self.config_snapshot:
+            config_obj = self._read_config_snapshot(filename)
+        if config_obj is None:
+            config_obj = self._get_config_object()
         try:
             self._config_file_options = config_obj[self.config_section]
         except KeyError:
             pass
 
+    def write_config_snapshot(self, snapshot_filename):
+        """Write the parsed configuration file to a snapshot.
+
+        The processes loading the same configuration file can be given the
+        snapshot with C{--config-snapshot}, and read it instead of parsing
+        the file again, as long as it's unchanged. The snapshot has the
+        owner and mode of the configuration file, which may hold secrets.
+
+        @return: Whether the snapshot was written.
+        """
+        filename = self.get_config_filename()
+        try:
+            stat = os.stat(filename)
+            config_obj = self._get_config_object()
+            snapshot = {
+                "filename": os.path.abspath(filename),
+                "stat": [stat.st_ino, stat.st_size, stat.st_mtime_ns],
+                "sections": config_obj.dict(),
+            }
+            # The snapshot directory may belong to a less privileged user
+            # than the watchdog, so the temporary file is created without
+            # following links, and only changed through its descriptor.
+            fd, temp_filename = tempfile.mkstemp(
+                prefix=os.path.basename(snapshot_filename) + ".",
+                dir=os.path.dirname(os.path.abspath(snapshot_filename)),
+            )
+            try:
+                with os.fdopen(fd, "w") as snapshot_file:
+                    json.dump(snapshot, snapshot_file)
+                    snapshot_file.flush()
+                    if os.getuid() == 0:
+                        os.fchown(fd, stat.st_uid, stat.st_gid)
+                    os.fchmod(fd, stat.st_mode & 0o777)
+                os.rename(temp_filename, snapshot_filename)
+            except BaseException:
+                os.unlink(temp_filename)
+                raise
+        except (OSError, TypeError, ValueError) as error:
+            getLogger().warning(
+                f"Unable to write configuration snapshot: {error}",
+            )
+            return False
+        return True
+
+    def _read_config_snapshot(self, filename):
+        """Return the sections of the configuration snapshot.
+
+        The snapshot is only trusted if it has the owner of the file, so
+        that the users who can write to its directory can't forge one.
+
+        @return: The sections of C{filename} as they were parsed when the
+            snapshot got written, or C{None} if the snapshot can't be read
+            or the file changed since.
+        """
+        try:
+            with open(self.config_snapshot) as snapshot_file:
+                snapshot_stat = os.fstat(snapshot_file.fileno())
+                snapshot = json.load(snapshot_file)
+            stat = os.stat(filename)
+        except (OSError, ValueError):
+            return None
+        if snapshot_stat.st_uid != stat.st_uid:
+            return None
+        if not isinstance(snapshot, dict) or snapshot.get("filename") != (
+            os.path.abspath(filename)
+        ):
+            return None
+        if snapshot.get("stat") != [
+            stat.st_ino,
+            stat.st_size,
+            stat.st_mtime_ns,
+        ]:
+            return None
+        return snapshot.get("sections")
+
     def _get_config_object(self, alternative_config=None):
         """Create a L{ConfigObj} consistent with our preferences.
 
@@ -279,7 +361,10 @@ class BaseConfiguration:
         all_options.update(self._set_options)
         section = config_obj[self.config_section]
         for name, value in all_options.items():
-            if name != "config" and name not in self.unsaved_options:
+            if (
+                name not in ("config", "config_snapshot")
+                and name not in self.unsaved_options
+            ):
                 if (
                     value == self._command_line_defaults.get(name)
                     and name not in self._config_file_options
@@ -307,6 +392,11 @@ class BaseConfiguration:
         """
         parser = OptionParser(version=self.version)
         cli.add_cli_options(parser, cfgfile, datadir)
+        parser.add_option(
+            "--config-snapshot",
+            metavar="FILE",
+            help=SUPPRESS_HELP,
+        )
         return parser
 
     def get_config_filename(self):
@@ -1,13 +1,60 @@
+import hashlib
 import io
+import logging
 import os
+import shutil
+import string
 import sys
+import threading
 from optparse import OptionParser
 
 from twisted.internet.defer import DeferredList
+from twisted.internet.defer import succeed
 from twisted.internet.threads import deferToThread
 from twisted.python.compat import iteritems
 from twisted.python.compat import networkString
 
+from landscape.lib.fs import create_binary_file
+
+
+class ChunksReader:
+    """A file-like reader for a list of byte chunks.
+
+    It's used to stream a POST body made of several chunks to pycurl,
+    without having to join them in memory first. It can be rewound, for
+    curl to send the body again.
+    """
+
+    def __init__(self, chunks):
+        self._chunks = chunks
+        self.seek(0)
+
+    def seek(self, offset):
+        """Move to the given offset from the start of the chunks."""
+        self._index = 0
+        self._offset = offset
+        while (
+            self._index < len(self._chunks)
+            and self._offset >= len(self._chunks[self._index])
+        ):
+            self._offset -= len(self._chunks[self._index])
+            self._index += 1
+
+    def read(self, size=-1):
+        parts = []
+        while size != 0 and self._index < len(self._chunks):
+            chunk = self._chunks[self._index]
+            end = len(chunk)
+            if size > 0:
+                end = min(end, self._offset + size)
+                size -= end - self._offset
+            parts.append(chunk[self._offset : end])
+            self._offset = end
+            if self._offset == len(chunk):
+                self._index += 1
+                self._offset = 0
+        return b"".join(parts)
+
 
 class FetchError(Exception):
     pass
@@ -25,6 +72,19 @@ class HTTPCodeError(FetchError):
         return f"<HTTPCodeError http_code={self.http_code:d}>"
 
 
+class ChecksumError(FetchError):
+    def __init__(self, url, expected, actual):
+        self.url = url
+        self.expected = expected
+        self.actual = actual
+
+    def __str__(self):
+        return (
+            f"Checksum mismatch for {self.url}: expected {self.expected}, "
+            f"got {self.actual}"
+        )
+
+
 class PyCurlError(FetchError):
     def __init__(self, error_code, message):
         self.error_code = error_code
@@ -41,6 +101,57 @@ class PyCurlError(FetchError):
         return self._message
 
 
+class CurlHandle:
+    """A curl handle reused by the successive requests to a server.
+
+    A curl handle keeps its connections alive and its TLS sessions after
+    a request, so reusing it spares the following requests new TCP and
+    TLS handshakes. Requests made while the handle is in use by another
+    thread get a handle of their own.
+
+    @param http2: If true, negotiate HTTP/2 with HTTPS servers, when curl
+        supports it.
+    """
+
+    def __init__(self, http2=False):
+        self._http2 = http2
+        self._curl = None
+        self._lock = threading.Lock()
+
+    def acquire(self):
+        """Return the curl handle, with its options reset, for a request.
+
+        It must be given back with L{release} once the request is done.
+        """
+        import pycurl
+
+        if not self._lock.acquire(False):
+            curl = pycurl.Curl()
+        elif self._curl is None:
+            curl = self._curl = pycurl.Curl()
+        else:
+            # Resetting the options keeps the connections and sessions.
+            curl = self._curl
+            curl.reset()
+        if self._http2 and hasattr(pycurl, "CURL_HTTP_VERSION_2TLS"):
+            curl.setopt(pycurl.HTTP_VERSION, pycurl.CURL_HTTP_VERSION_2TLS)
+        return curl
+
+    def release(self, curl):
+        """Give back a curl handle returned by L{acquire}."""
+        if curl is self._curl:
+            self._lock.release()
+        else:
+            curl.close()
+
+    def close(self):
+        """Close the curl handle, and its connections."""
+        with self._lock:
+            if self._curl is not None:
+                self._curl.close()
+                self._curl = None
+
+
 def fetch(
     url,
     post=False,
@@ -54,12 +165,18 @@ def fetch(
     follow=True,
     user_agent=None,
     proxy=None,
+    write=None,
+    handle=None,
+    byte_range=None,
+    header=None,
 ):
     """Retrieve a URL and return the content.
 
     @param url: The url to be fetched.
     @param post: If true, the POST method will be used (defaults to GET).
-    @param data: Data to be sent to the server as the POST content.
+    @param data: Data to be sent to the server as the POST content, either
+        a string or an iterable of byte chunks, which are sent without
+        being joined.
     @param headers: Dictionary of header => value entries to be used on the
         request.
     @param curl: A pycurl.Curl instance to use. If not provided, one will be
@@ -71,13 +188,63 @@ def fetch(
     @param follow: If True, follow HTTP redirects (default True).
     @param user_agent: The user-agent to set in the request.
     @param proxy: The proxy url to use for the request.
+    @param write: A function called with the content as it's received. If
+        provided, the content isn't kept and an empty string is returned,
+        the body of an error response is still kept for L{HTTPCodeError}.
+    @param handle: A L{CurlHandle} to make the request with, instead of
+        C{curl}, so that it reuses the connection of earlier requests.
+    @param byte_range: A C{(start, end)} tuple with the offsets of the first
+        and last bytes to retrieve. The server can answer with the whole
+        content, if it doesn't support ranges.
+    @param header: A function called with each line of the response
+        headers, status lines included, as bytes.
     """
     import pycurl
 
-    if not isinstance(data, bytes):
-        data = data.encode("utf-8")
-    output = io.BytesIO(data)
+    if handle is not None:
+        curl = handle.acquire()
+        try:
+            return fetch(
+                url,
+                post=post,
+                data=data,
+                headers=headers,
+                cainfo=cainfo,
+                curl=curl,
+                connect_timeout=connect_timeout,
+                total_timeout=total_timeout,
+                insecure=insecure,
+                follow=follow,
+                user_agent=user_agent,
+                proxy=proxy,
+                write=write,
+                byte_range=byte_range,
+                header=header,
+            )
+        finally:
+            handle.release(curl)
+
+    if isinstance(data, (bytes, str)):
+        if not isinstance(data, bytes):
+            data = data.encode("utf-8")
+        output = io.BytesIO(data)
+        size = len(data)
+    else:
+        data = list(data)
+        output = ChunksReader(data)
+        size = sum(len(chunk) for chunk in data)
     input = io.BytesIO()
+    if write is None:
+        write = input.write
+    else:
+        write_content = write
+
+        def write(data):
+            # Only a successful response is content, an error one is kept to
+            # be raised with.
+            if curl.getinfo(pycurl.HTTP_CODE) // 100 == 2:
+                return write_content(data)
+            return input.write(data)
 
     if curl is None:
         curl = pycurl.Curl()
@@ -89,9 +256,19 @@ def fetch(
     if post:
         curl.setopt(pycurl.POST, True)
 
-        if data:
-            curl.setopt(pycurl.POSTFIELDSIZE, len(data))
+        if size:
+
+            def seek(offset, origin):
+                # Curl rewinds the body to send it again, like when a kept
+                # alive connection turns out to be closed by the server.
+                if origin != os.SEEK_SET:
+                    return pycurl.SEEKFUNC_CANTSEEK
+                output.seek(offset)
+                return pycurl.SEEKFUNC_OK
+
+            curl.setopt(pycurl.POSTFIELDSIZE, size)
             curl.setopt(pycurl.READFUNCTION, output.read)
+            curl.setopt(pycurl.SEEKFUNCTION, seek)
 
     if cainfo and url.startswith("https:"):
         curl.setopt(pycurl.CAINFO, networkString(cainfo))
@@ -114,12 +291,18 @@ def fetch(
     if proxy is not None:
         curl.setopt(pycurl.PROXY, networkString(proxy))
 
+    if byte_range is not None:
+        start, end = byte_range
+        curl.setopt(pycurl.RANGE, networkString(f"{start:d}-{end:d}"))
+
     curl.setopt(pycurl.MAXREDIRS, 5)
     curl.setopt(pycurl.CONNECTTIMEOUT, connect_timeout)
     curl.setopt(pycurl.LOW_SPEED_LIMIT, 1)
     curl.setopt(pycurl.LOW_SPEED_TIME, total_timeout)
     curl.setopt(pycurl.NOSIGNAL, 1)
-    curl.setopt(pycurl.WRITEFUNCTION, input.write)
+    curl.setopt(pycurl.WRITEFUNCTION, write)
+    if header is not None:
+        curl.setopt(pycurl.HEADERFUNCTION, header)
     curl.setopt(pycurl.DNS_CACHE_TIMEOUT, 0)
     curl.setopt(pycurl.ENCODING, b"gzip,deflate")
 
@@ -131,7 +314,12 @@ def fetch(
     body = input.getvalue()
 
     http_code = curl.getinfo(pycurl.HTTP_CODE)
-    if http_code != 200:
+    if byte_range is not None:
+        # A 200 means the whole content was sent instead of the range, which
+        # only starts where the range does if it's at the beginning.
+        if http_code != 206 and (http_code != 200 or byte_range[0] > 0):
+            raise HTTPCodeError(http_code, body)
+    elif http_code != 200:
         raise HTTPCodeError(http_code, body)
 
     return body
@@ -168,6 +356,321 @@ def fetch_many_async(urls, callback=None, errback=None, **kwargs):
     return DeferredList(results, fireOnOneErrback=True, consumeErrors=True)
 
 
+def _get_validator(response):
+    """
+    Return the validator of a response, for an C{If-Range} header: its
+    strong C{ETag}, or else its C{Last-Modified} date.
+    """
+    etag = response.get("etag")
+    if etag and not etag.startswith("W/"):
+        return etag
+    return response.get("last-modified")
+
+
+class RangeDownload:
+    """Download a URL to a file in ranges, several of them in parallel.
+
+    The ranges are kept in a C{<filename>.parts} directory until all of
+    them are there, so an interrupted download resumes with the missing
+    ones. The first range is fetched alone, and if the server answers it
+    with the whole content, because it doesn't support ranges, that is all
+    there is to fetch.
+
+    The validator of the content, its C{ETag} or C{Last-Modified} date, is
+    kept with the ranges and sent in an C{If-Range} header, so that ranges
+    of another version of the content are never joined: the server sends
+    the whole new content instead, which replaces the ranges, and if it
+    answers with another validator anyway the download fails and starts
+    over. Ranges without a validator aren't resumed.
+
+    @param url: The URL to download.
+    @param filename: The file to save the content to, once it's complete.
+    @param part_size: The size of the ranges.
+    @param parts: How many ranges are fetched at the same time.
+    @param checksum_url: Optionally, the URL of the SHA-256 digest of the
+        content, in hexadecimal. If it can't be fetched or doesn't hold a
+        digest, the content isn't verified, if it doesn't match the
+        download starts over.
+    @param kwargs: The options passed to L{fetch_async}.
+    """
+
+    def __init__(
+        self,
+        url,
+        filename,
+        part_size=4 * 1024 * 1024,
+        parts=4,
+        checksum_url=None,
+        **kwargs,
+    ):
+        self._url = url
+        self._filename = filename
+        self._part_size = part_size
+        self._parts = parts
+        self._checksum_url = checksum_url
+        self._kwargs = kwargs
+        self._directory = filename + ".parts"
+        self._validator_path = os.path.join(self._directory, "validator")
+        self._checksum = None
+        self._validator = None
+        # The sizes of the ranges fetched, by index.
+        self._sizes = {}
+        # Whether the first range holds the whole content.
+        self._whole = False
+        # Whether the content changed, the responses still coming are
+        # then ignored.
+        self._changed = False
+
+    def run(self):
+        """Start the download.
+
+        @return: A C{Deferred} firing with the file name, once the file is
+            complete, or failing with the first error.
+        """
+        result = succeed(None)
+        result.addCallback(lambda _: self._load_parts())
+        if self._checksum_url is not None:
+            result.addCallback(lambda _: self._fetch_checksum())
+        result.addCallback(lambda _: self._fetch_first_part())
+        result.addCallback(self._fetch_parts)
+        result.addErrback(self._unwrap_first_error)
+        result.addErrback(self._discard_on_error)
+        return result
+
+    def _load_parts(self):
+        """Pick up the ranges fetched by an earlier download."""
+        if os.path.exists(self._validator_path):
+            with open(self._validator_path) as fd:
+                self._validator = fd.read()
+        elif os.path.isdir(self._directory):
+            # They can't be told apart from ranges of another version.
+            shutil.rmtree(self._directory)
+        if not os.path.isdir(self._directory):
+            os.makedirs(self._directory)
+        for name in os.listdir(self._directory):
+            if name.isdigit():
+                path = os.path.join(self._directory, name)
+                self._sizes[int(name)] = os.path.getsize(path)
+
+    def _fetch_first_part(self):
+        if 0 not in self._sizes:
+            return self._fetch_part(0)
+
+    def _fetch_checksum(self):
+        def got_checksum(data):
+            # Also accept the "<digest>  <filename>" format of sha256sum.
+            words = data.split()
+            checksum = words[0].decode("ascii", "replace") if words else ""
+            if len(checksum) == 64 and all(
+                char in string.hexdigits for char in checksum
+            ):
+                self._checksum = checksum.lower()
+            else:
+                logging.warning(
+                    f"Not verifying {self._url}, {self._checksum_url} "
+                    "doesn't hold a SHA-256 digest.",
+                )
+
+        def no_checksum(failure):
+            # The checksum is optional, whatever stops us from getting it.
+            if failure.check(HTTPCodeError) and failure.value.http_code == 404:
+                return
+            logging.warning(
+                f"Not verifying {self._url}, fetching "
+                f"{self._checksum_url} failed: {failure.value}",
+            )
+
+        result = fetch_async(self._checksum_url, **self._kwargs)
+        result.addCallbacks(got_checksum, no_checksum)
+        return result
+
+    def _get_last_part(self):
+        """Return the index of the last range, or C{None} if not known yet.
+
+        The last range is the first one shorter than C{part_size}, or the
+        first one if the server sent the whole content instead.
+        """
+        if self._whole or self._sizes.get(0, 0) > self._part_size:
+            return 0
+        last = [
+            index
+            for index, size in self._sizes.items()
+            if size < self._part_size
+        ]
+        if last:
+            return min(last)
+        return None
+
+    def _fetch_parts(self, ignored=None):
+        """Fetch the C{parts} next missing ranges, or assemble the file."""
+        last = self._get_last_part()
+        indexes = []
+        index = 0
+        while len(indexes) < self._parts and (last is None or index <= last):
+            if index not in self._sizes:
+                indexes.append(index)
+            index += 1
+        if not indexes:
+            return self._assemble(last)
+        result = DeferredList(
+            [self._fetch_part(index) for index in indexes],
+            fireOnOneErrback=True,
+            consumeErrors=True,
+        )
+        result.addCallback(self._fetch_parts)
+        return result
+
+    def _fetch_part(self, index):
+        start = index * self._part_size
+        byte_range = (start, start + self._part_size - 1)
+        response = {}
+
+        def header(line):
+            line = line.decode("latin-1").strip()
+            if line.startswith("HTTP/"):
+                # The headers of another response, like after a redirect.
+                response.clear()
+                response[":status"] = line.split()[1:2]
+            else:
+                name, separator, value = line.partition(":")
+                if separator:
+                    response[name.strip().lower()] = value.strip()
+
+        def got_part(data):
+            if self._changed:
+                return
+            if response.get(":status") == ["200"]:
+                # The whole content, rather than the first range.
+                self._save_whole(data, response)
+                return
+            self._check_validator(response)
+            self._save_part(index, data)
+
+        def not_a_range(failure):
+            failure.trap(HTTPCodeError)
+            http_code = failure.value.http_code
+            if self._changed:
+                return
+            if http_code == 416:
+                # Range Not Satisfiable, the content ends before this range.
+                self._sizes[index] = 0
+            elif http_code == 200:
+                # The server sent the whole content, because it doesn't
+                # support ranges or the content changed.
+                self._save_whole(failure.value.body, response)
+            else:
+                return failure
+
+        kwargs = dict(self._kwargs)
+        if self._validator is not None:
+            kwargs["headers"] = dict(
+                kwargs.get("headers", {}),
+                **{"If-Range": self._validator},
+            )
+        result = fetch_async(
+            self._url,
+            byte_range=byte_range,
+            header=header,
+            **kwargs,
+        )
+        result.addCallbacks(got_part, not_a_range)
+        return result
+
+    def _check_validator(self, response):
+        """Keep the validator of the first range, check the next ones'."""
+        validator = _get_validator(response)
+        if validator is None or validator == self._validator:
+            return
+        if self._validator is None:
+            self._set_validator(validator)
+            return
+        self._changed = True
+        self._discard_parts()
+        raise FetchError(f"{self._url} changed during the download")
+
+    def _set_validator(self, validator):
+        create_binary_file(
+            self._validator_path + ".tmp",
+            validator.encode("latin-1"),
+        )
+        os.rename(self._validator_path + ".tmp", self._validator_path)
+        self._validator = validator
+
+    def _save_whole(self, data, response):
+        """Replace the ranges with the whole content."""
+        self._discard_parts()
+        validator = _get_validator(response)
+        if validator is not None:
+            self._set_validator(validator)
+        self._whole = True
+        self._save_part(0, data)
+
+    def _discard_parts(self):
+        shutil.rmtree(self._directory, ignore_errors=True)
+        os.makedirs(self._directory)
+        self._sizes.clear()
+        self._validator = None
+
+    def _save_part(self, index, data):
+        path = os.path.join(self._directory, str(index))
+        # Write under a temporary name, so that a range file is always
+        # complete when resuming.
+        create_binary_file(path + ".tmp", data)
+        os.rename(path + ".tmp", path)
+        self._sizes[index] = len(data)
+
+    def _assemble(self, last):
+        """Join the ranges into the file, verifying its checksum."""
+        digest = hashlib.sha256()
+        partial = self._filename + ".partial"
+        with open(partial, "wb") as fd:
+            for index in range(last + 1):
+                path = os.path.join(self._directory, str(index))
+                if not self._sizes[index]:
+                    continue
+                with open(path, "rb") as part:
+                    data = part.read()
+                digest.update(data)
+                fd.write(data)
+        actual = digest.hexdigest()
+        if self._checksum is not None and actual != self._checksum:
+            # Start over next time, some range may come from another
+            # version of the content.
+            os.unlink(partial)
+            shutil.rmtree(self._directory)
+            raise ChecksumError(self._url, self._checksum, actual)
+        os.rename(partial, self._filename)
+        shutil.rmtree(self._directory)
+        return self._filename
+
+    @staticmethod
+    def _unwrap_first_error(failure):
+        if hasattr(failure.value, "subFailure"):
+            return failure.value.subFailure
+        return failure
+
+    def _discard_on_error(self, failure):
+        """
+        Discard the ranges if the server said the content isn't there,
+        they're kept to resume after the other errors.
+        """
+        if (
+            failure.check(HTTPCodeError)
+            and 400 <= failure.value.http_code < 500
+            and failure.value.http_code not in (408, 429)
+        ):
+            shutil.rmtree(self._directory, ignore_errors=True)
+        return failure
+
+
+def fetch_ranges_async(url, filename, **kwargs):
+    """Download a URL to a file in ranges, see L{RangeDownload}.
+
+    @return: A C{Deferred} firing with the file name once it's complete.
+    """
+    return RangeDownload(url, filename, **kwargs).run()
+
+
 def url_to_filename(url, directory=None):
     """Return the last component of the given C{url}.
 
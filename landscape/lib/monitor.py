@@ -1,5 +1,8 @@
 import logging
+import math
+import threading
 import time
+from contextlib import contextmanager
 
 from landscape.lib.format import format_delta
 from landscape.lib.format import format_percent
@@ -29,6 +32,40 @@ class Timer:
         self._last_time = self._create_time()
 
 
+class PhaseTimer(Timer):
+    """
+    A phase timer keeps track of the time taken by the successive phases
+    of an activity, like the startup of a process, each phase starting
+    when the previous one ended.
+    """
+
+    def __init__(self, event_name, create_time=None):
+        super().__init__(create_time=create_time)
+        self.event_name = event_name
+        self.phases = []
+
+    def phase(self, name):
+        """Record that the C{name} phase ended."""
+        self.phases.append((name, self.since_reset()))
+        self.reset()
+
+    def log(self):
+        """
+        Log the time taken by each phase, and the CPU time used by the
+        process since it started, which includes its imports.
+        """
+        logging.info(
+            "%s took %s (%s), using %s of CPU time.",
+            self.event_name,
+            format_delta(self.since_start()),
+            ", ".join(
+                f"{name} {format_delta(duration)}"
+                for name, duration in self.phases
+            ),
+            format_delta(time.process_time()),
+        )
+
+
 class Monitor(Timer):
     """
     A monitor tracks the number of pings it received during it's
@@ -64,6 +101,126 @@ class Monitor(Timer):
         self.reset()
 
 
+class Histogram(Monitor):
+    """
+    A histogram tracks the distribution of the values it records since
+    the last reset, like durations or sizes, counting them in buckets of
+    increasing powers of two.
+    """
+
+    def __init__(self, event_name, create_time=None):
+        super().__init__(event_name, create_time=create_time)
+        self._reset_values()
+
+    def _reset_values(self):
+        self.sum = 0
+        self.min = None
+        self.max = None
+        self._buckets = {}
+
+    def record(self, value):
+        self.ping()
+        self.sum += value
+        if self.min is None or value < self.min:
+            self.min = value
+        if self.max is None or value > self.max:
+            self.max = value
+        # The bucket of a value is the lowest power of two above it, and
+        # the 0 bucket is the one of the values which aren't positive.
+        if value > 0:
+            bucket = 2.0 ** math.frexp(value)[1]
+        else:
+            bucket = 0.0
+        self._buckets[bucket] = self._buckets.get(bucket, 0) + 1
+
+    def reset(self):
+        super().reset()
+        self._reset_values()
+
+    def get_summary(self):
+        """
+        Return the count, sum, minimum and maximum of the values, and the
+        list of C{(bucket, count)} tuples of the buckets they fell in.
+        """
+        return {
+            "count": self.count,
+            "sum": self.sum,
+            "min": self.min,
+            "max": self.max,
+            "buckets": sorted(self._buckets.items()),
+        }
+
+
+class HealthStats(Timer):
+    """
+    Health statistics keep a L{Histogram} for each of the durations and
+    sizes measured on the hot paths of a process, and the last value of
+    the others, like exit codes, so that they can be reported from time to
+    time. They're safe to record from the threads of the process.
+    """
+
+    def __init__(self, create_time=None):
+        super().__init__(create_time=create_time)
+        self.histograms = {}
+        self.values = {}
+        self._lock = threading.Lock()
+
+    def record(self, name, value):
+        """Record a C{value} in the C{name} histogram."""
+        with self._lock:
+            histogram = self.histograms.get(name)
+            if histogram is None:
+                histogram = self.histograms[name] = Histogram(
+                    name,
+                    create_time=self._create_time,
+                )
+            histogram.record(value)
+
+    def record_since(self, name, start):
+        """Record the time elapsed since C{start}, as returned by L{time}."""
+        self.record(name, self.time() - start)
+
+    @contextmanager
+    def timed(self, name):
+        """Record the time taken by a C{with} block in a histogram."""
+        start = self.time()
+        try:
+            yield
+        finally:
+            self.record_since(name, start)
+
+    def set(self, name, value):
+        """Set the last C{value} of C{name}, which is kept across resets."""
+        with self._lock:
+            self.values[name] = value
+
+    def get_summary(self):
+        """
+        Return the number of seconds since the last reset, the summaries of
+        the histograms which recorded values since then, and the values.
+        """
+        with self._lock:
+            return {
+                "period": self.since_reset(),
+                "histograms": {
+                    name: histogram.get_summary()
+                    for name, histogram in self.histograms.items()
+                    if histogram.count
+                },
+                "values": dict(self.values),
+            }
+
+    def reset(self):
+        with self._lock:
+            super().reset()
+            for histogram in self.histograms.values():
+                histogram.reset()
+
+
+# The health statistics of the running process.
+health_stats = HealthStats(create_time=time.monotonic)
+
+
 class BurstMonitor(Monitor):
     """
     A burst monitor tracks the volume pings it receives.  It goes into
@@ -232,13 +232,17 @@ def get_active_device_info(
     )
 
 
-def get_network_traffic(source_file="/proc/net/dev"):
+def get_network_traffic(source_file="/proc/net/dev", data=None):
     """
     Retrieves an array of information regarding the network activity per
     network interface.
+
+    @param data: The content of C{source_file}, if it was already read.
     """
-    with open(source_file, "r") as netdev:
-        lines = netdev.readlines()
+    if data is None:
+        with open(source_file, "r") as netdev:
+            data = netdev.read()
+    lines = data.splitlines()
 
     # Parse out the column headers as keys.
     _, receive_columns, transmit_columns = lines[1].split("|")
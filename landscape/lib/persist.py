@@ -21,7 +21,9 @@
 import copy
 import os
 import re
+import struct
 import sys
+from functools import lru_cache
 
 from twisted.python.compat import StringType  # Py2: basestring, Py3: str
 
@@ -30,6 +32,7 @@ __all__ = [
     "Persist",
     "PickleBackend",
     "BPickleBackend",
+    "JournalBackend",
     "path_string_to_tuple",
     "path_tuple_to_string",
     "RootedPersist",
@@ -85,6 +88,10 @@ class Persist:
         self._readonly = False
         self._modified = False
         self._config = self
+        # The paths of the hard map changed since it was last loaded
+        # from, or saved to, _synced_filepath.
+        self._dirty = set()
+        self._synced_filepath = None
         self.filename = filename
         if filename is not None and os.path.exists(filename):
             self.load(filename)
@@ -135,6 +142,8 @@ class Persist:
             return False
 
         filepath = os.path.expanduser(filepath)
+        self._dirty.clear()
+        self._synced_filepath = None
         if not os.path.isfile(filepath):
             if load_old():
                 return
@@ -148,6 +157,7 @@ class Persist:
             if load_old():
                 return
             raise PersistError(f"Broken configuration file at {filepath}")
+        self._synced_filepath = filepath
 
     def save(self, filepath=None):
         """Save the persist to the given C{filepath}.
@@ -157,28 +167,77 @@ class Persist:
 
         If the destination file already exists, it will be renamed
         to C{<filepath>.old}.
+
+        If the backend supports it, like L{JournalBackend}, and C{filepath}
+        is where the persist was last loaded from or saved to, only the
+        changes since then are appended to it, until the backend asks for
+        the whole persist to be saved again.
         """
         if filepath is None:
             if self.filename is None:
                 raise PersistError("Need a filename!")
             filepath = self.filename
         filepath = os.path.expanduser(filepath)
-        if os.path.isfile(filepath):
-            os.rename(filepath, filepath + ".old")
-        dirname = os.path.dirname(filepath)
-        if dirname and not os.path.isdir(dirname):
-            os.makedirs(dirname)
-        self._backend.save(filepath, self._hardmap)
+        if not self._save_changes(filepath):
+            if os.path.isfile(filepath):
+                self._backend.rename(filepath, filepath + ".old")
+            dirname = os.path.dirname(filepath)
+            if dirname and not os.path.isdir(dirname):
+                os.makedirs(dirname)
+            self._backend.save(filepath, self._hardmap)
+        self._dirty.clear()
+        self._synced_filepath = filepath
+
+    def _save_changes(self, filepath):
+        """Append the changes since the last sync, if possible.
+
+        @return: Whether the changes were saved.
+        """
+        append = getattr(self._backend, "append", None)
+        if (
+            append is None
+            or filepath != self._synced_filepath
+            or not os.path.isfile(filepath)
+            or self._backend.needs_compaction(filepath)
+        ):
+            return False
+        changes = []
+        try:
+            for path in sorted(self._dirty, key=len):
+                # A path changed along with its parent is saved with it.
+                if not any(path[:i] in self._dirty for i in range(len(path))):
+                    value = self._traverse(self._hardmap, path, NOTHING)
+                    changes.append((path, value))
+        except PersistError:
+            return False
+        if changes:
+            append(filepath, changes)
+        return True
+
+    def _mark_dirty(self, path):
+        """Record that the hard map changed at C{path}.
+
+        Lists are saved as a whole, so a path into a list marks the list.
+        """
+        for index, elem in enumerate(path):
+            if type(elem) is int:
+                path = path[:index]
+                break
+        if path:
+            self._dirty.add(path)
+        else:
+            self._synced_filepath = None
 
     def _traverse(self, obj, path, default=NOTHING, setvalue=NOTHING):
         if setvalue is not NOTHING:
             setvalue = self._backend.copy(setvalue)
         queue = list(path)
+        queue.reverse()
         marker = NOTHING
         newobj = obj
         while queue:
             obj = newobj
-            elem = queue.pop(0)
+            elem = queue.pop()
             newobj = self._backend.get(obj, elem)
             if newobj is NotImplemented:
                 if queue:
@@ -198,7 +257,7 @@ class Persist:
             else:
                 while True:
                     if len(queue) > 0:
-                        if type(queue[0]) is int:
+                        if type(queue[-1]) is int:
                             newvalue = []
                         else:
                             newvalue = {}
@@ -213,7 +272,7 @@ class Persist:
                     if not queue:
                         break
                     obj = newobj
-                    elem = queue.pop(0)
+                    elem = queue.pop()
         return newobj
 
     def _getvalue(self, path, soft=False, hard=False, weak=False):
@@ -272,6 +331,7 @@ class Persist:
         else:
             self.assert_writable()
             self._modified = True
+            self._mark_dirty(path)
             map = self._hardmap
         self._traverse(map, path, setvalue=value)
 
@@ -286,6 +346,7 @@ class Persist:
         else:
             self.assert_writable()
             self._modified = True
+            self._mark_dirty(path)
             map = self._hardmap
         if unique:
             current = self._traverse(map, path)
@@ -305,6 +366,7 @@ class Persist:
         else:
             self.assert_writable()
             self._modified = True
+            self._mark_dirty(path)
             map = self._hardmap
         marker = NOTHING
         while path:
@@ -437,6 +499,7 @@ class RootedPersist:
 _splitpath = re.compile(r"(\[-?\d+\])|(?<!\\)\.").split
 
 
+@lru_cache(maxsize=1024)
 def path_string_to_tuple(path):
     """Convert a L{Persist} path string to a path tuple.
 
@@ -520,6 +583,10 @@ class Backend:
     def save(self, filepath, map):
         raise NotImplementedError
 
+    def rename(self, filepath, newpath):
+        """Rename the files of a saved map."""
+        os.rename(filepath, newpath)
+
     def get(self, obj, elem, _marker=NOTHING):
         """Lookup a child in the given node object."""
         if type(obj) is dict:
@@ -627,6 +694,15 @@ class PickleBackend(Backend):
 
 
 class BPickleBackend(Backend):
+    """Save maps with L{bpickle}.
+
+    A map saved with L{JournalBackend} may have a journal of changes next
+    to it, which is replayed when loading it, and merged into the map when
+    saving it.
+    """
+
+    _length = struct.Struct("<I")
+
     def __init__(self):
         from landscape.lib import bpickle
 
@@ -635,13 +711,113 @@ class BPickleBackend(Backend):
     def new(self):
         return {}
 
+    def get_journal_filename(self, filepath):
+        return filepath + ".journal"
+
     def load(self, filepath):
         with open(filepath, "rb") as fd:
-            return self._bpickle.loads(fd.read())
+            map = self._bpickle.loads(fd.read())
+        try:
+            with open(self.get_journal_filename(filepath), "rb") as fd:
+                data = fd.read()
+        except FileNotFoundError:
+            return map
+        offset = 0
+        while offset + self._length.size <= len(data):
+            (length,) = self._length.unpack_from(data, offset)
+            offset += self._length.size
+            try:
+                change = self._bpickle.loads(data[offset : offset + length])
+            except ValueError:
+                break  # A partly written record, the save was interrupted.
+            offset += length
+            if len(change) == 2:
+                self._replay_set(map, change[0], change[1])
+            else:
+                self._replay_remove(map, change[0])
+        return map
+
+    def _replay_set(self, map, path, value):
+        for elem in path[:-1]:
+            map = map.setdefault(elem, {})
+        map[path[-1]] = value
+
+    def _replay_remove(self, map, path):
+        # Persist.remove drops the parents left empty as well.
+        parents = []
+        for elem in path[:-1]:
+            parents.append(map)
+            map = map.get(elem)
+            if type(map) is not dict:
+                return
+        map.pop(path[-1], None)
+        for parent, elem in zip(reversed(parents), reversed(path[:-1])):
+            if parent[elem]:
+                break
+            del parent[elem]
 
     def save(self, filepath, map):
         with open(filepath, "wb") as fd:
             fd.write(self._bpickle.dumps(map))
+        journal_filename = self.get_journal_filename(filepath)
+        if os.path.exists(journal_filename):
+            os.unlink(journal_filename)
+
+    def rename(self, filepath, newpath):
+        super().rename(filepath, newpath)
+        journal_filename = self.get_journal_filename(filepath)
+        new_journal_filename = self.get_journal_filename(newpath)
+        if os.path.exists(journal_filename):
+            os.rename(journal_filename, new_journal_filename)
+        elif os.path.exists(new_journal_filename):
+            os.unlink(new_journal_filename)
+
+
+class JournalBackend(BPickleBackend):
+    """A L{BPickleBackend} which can save just the changes to a map.
+
+    The changes are appended to a journal next to the saved map, with a
+    record for each changed path holding its new value, or nothing if
+    it was removed. L{Persist.save} saves the whole map again, which
+    empties the journal, once the journal grows bigger than the map.
+
+    @param min_journal_size: The journal size, in bytes, below which
+        the map is never saved again as a whole.
+    """
+
+    def __init__(self, min_journal_size=65536):
+        super().__init__()
+        self._min_journal_size = min_journal_size
+
+    def append(self, filepath, changes):
+        """Append C{changes} to the journal of the map saved at C{filepath}.
+
+        @param changes: A list of C{(path, value)} tuples, where C{value}
+            is L{NOTHING} for removed paths.
+        """
+        chunks = []
+        for path, value in changes:
+            if value is NOTHING:
+                data = self._bpickle.dumps([list(path)])
+            else:
+                data = self._bpickle.dumps([list(path), value])
+            chunks.append(self._length.pack(len(data)))
+            chunks.append(data)
+        with open(self.get_journal_filename(filepath), "ab") as fd:
+            fd.write(b"".join(chunks))
+
+    def needs_compaction(self, filepath):
+        """Whether the map at C{filepath} should be saved as a whole."""
+        try:
+            journal_size = os.path.getsize(
+                self.get_journal_filename(filepath),
+            )
+        except OSError:
+            return False
+        return journal_size > max(
+            self._min_journal_size,
+            os.path.getsize(filepath),
+        )
 
 
 # vim:ts=4:sw=4:et
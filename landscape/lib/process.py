@@ -7,6 +7,11 @@ from landscape.lib import sysstats
 from landscape.lib.jiffies import detect_jiffies
 from landscape.lib.timestamp import to_timestamp
 
+try:
+    from landscape.lib._procscan import scan as _scan_proc_dir
+except ImportError:
+    _scan_proc_dir = None
+
 
 class ProcessInformation:
     """
@@ -44,6 +49,126 @@ class ProcessInformation:
             if process_info:
                 yield process_info
 
+    def get_process_records(self):
+        """Get compact records of all the processes on the system.
+
+        This reads the same information as L{get_all_process_info}, with
+        the native scanner when it's built, but doesn't build a dict for
+        each process, so that callers can only do so for the processes
+        that changed. See L{make_process_info}.
+
+        @return: A dict mapping process ids to C{(name, state, uid, gid,
+            vm_size, start_time, percent_cpu)} tuples, with a C{None}
+            C{vm_size} for kernel threads.
+        """
+        if _scan_proc_dir is not None:
+            processes = _scan_proc_dir(self._proc_dir)
+        else:
+            processes = []
+            for filename in os.listdir(self._proc_dir):
+                try:
+                    process_id = int(filename)
+                except ValueError:
+                    continue
+                process = self._read_process(process_id)
+                if process is not None:
+                    processes.append(process)
+        if not processes:
+            return {}
+        if self._boot_time is None:
+            logging.warning(
+                "Skipping %d processes without boot time.",
+                len(processes),
+            )
+            return {}
+
+        uptime = self._uptime or sysstats.get_uptime()
+        jiffies = self._jiffies_per_sec
+        boot_timestamp = to_timestamp(self._boot_time)
+        records = {}
+        for (
+            process_id,
+            name,
+            state,
+            uid,
+            gid,
+            vm_size,
+            utime,
+            stime,
+            start_time,
+        ) in processes:
+            records[process_id] = (
+                name,
+                state,
+                uid,
+                gid,
+                vm_size,
+                boot_timestamp + start_time // jiffies,
+                calculate_pcpu(utime, stime, uptime, start_time, jiffies),
+            )
+        return records
+
+    def _read_process(self, process_id):
+        """
+        Read the entry in L{get_process_records} of the process with
+        C{process_id}, as a C{(process_id, name, state, uid, gid, vm_size,
+        utime, stime, start_time)} tuple, or C{None} if it went away.
+        """
+        process_dir = os.path.join(self._proc_dir, str(process_id))
+        try:
+            with open(os.path.join(process_dir, "cmdline"), "rb") as file:
+                cmd_line = file.read().split(b"\0", 1)[0].split(b"\n", 1)[0]
+            with open(os.path.join(process_dir, "status"), "rb") as file:
+                status = file.read()
+            with open(os.path.join(process_dir, "stat"), "rb") as file:
+                stat = file.read()
+        except OSError:
+            return None
+
+        name = os.path.basename(cmd_line).decode("utf-8", "replace").strip()
+        fields = {}
+        for line in status.split(b"\n"):
+            key, _, value = line.partition(b":")
+            fields[key] = value
+            if key == b"VmSize":
+                break
+        try:
+            if not name:
+                name = fields[b"Name"].decode("utf-8", "replace").strip()
+            state = fields[b"State"].strip()
+            if state == b"T (tracing stop)":
+                state = b"t"
+            state = state[:1]
+            uid = int(fields[b"Uid"].split()[0])
+            gid = int(fields[b"Gid"].split()[0])
+            vm_size = fields.get(b"VmSize")
+            if vm_size is not None:
+                vm_size = int(vm_size.split()[0])
+            # The command name in stat may hold spaces, skip past it.
+            end = stat.rfind(b")")
+            if end == -1:
+                parts = stat.split()
+            else:
+                parts = [b"", b""] + stat[end + 1 :].split()
+            utime = int(parts[13])
+            stime = int(parts[14])
+            start_time = int(parts[21])
+        except (KeyError, IndexError, ValueError):
+            return None
+        if not state:
+            return None
+        return (
+            process_id,
+            name,
+            state,
+            uid,
+            gid,
+            vm_size,
+            utime,
+            stime,
+            start_time,
+        )
+
     def get_process_info(self, process_id):
         """
         Parse the /proc/<pid>/cmdline and /proc/<pid>/status files for
@@ -107,7 +232,13 @@ class ProcessInformation:
                 #         children have been scheduled in user mode.
                 # cstime: The number of jiffies that this process's waited-for
                 #         children have been scheduled in kernel mode.
-                parts = file.read().split()
+                stat = file.read()
+                # The command name may hold spaces, skip past it.
+                end = stat.rfind(")")
+                if end == -1:
+                    parts = stat.split()
+                else:
+                    parts = ["", ""] + stat[end + 1 :].split()
                 start_time = int(parts[21])
                 utime = int(parts[13])
                 stime = int(parts[14])
@@ -149,6 +280,26 @@ class ProcessInformation:
         return process_info
 
 
+def make_process_info(process_id, record):
+    """
+    Return the dict L{ProcessInformation.get_process_info} would return,
+    for a record from L{ProcessInformation.get_process_records}.
+    """
+    name, state, uid, gid, vm_size, start_time, percent_cpu = record
+    process_info = {
+        "pid": process_id,
+        "name": name,
+        "state": state,
+        "uid": uid,
+        "gid": gid,
+        "start-time": start_time,
+        "percent-cpu": percent_cpu,
+    }
+    if vm_size is not None:
+        process_info["vm-size"] = vm_size
+    return process_info
+
+
 def calculate_pcpu(utime, stime, uptime, start_time, hertz):
     """
     Implement ps' algorithm to calculate the percentage cpu utilisation for a
@@ -2,11 +2,14 @@
 Extend the regular Twisted reactor with event-handling features.
 """
 import logging
+import math
 import time
 
+from twisted.internet.defer import Deferred
 from twisted.internet.threads import deferToThread
 
 from landscape.lib.format import format_object
+from landscape.lib.log import log_failure
 
 
 class InvalidID(Exception):
@@ -130,6 +133,150 @@ class ReactorID:
         self._timeout = timeout
 
 
+class CoalescedCall:
+    """A call scheduled by a L{TimerCoalescer}.
+
+    @ivar due: The time the call is next due at, before coalescing.
+    @ivar interval: The number of seconds between the runs of a repeated
+        call, or C{None} if it's run once.
+    """
+
+    def __init__(self, coalescer, due, interval, f, args, kwargs):
+        self.due = due
+        self.interval = interval
+        self._coalescer = coalescer
+        self._f = f
+        self._args = args
+        self._kwargs = kwargs
+        self._active = True
+        self._window = None
+
+    def active(self):
+        return self._active
+
+    def cancel(self):
+        self._coalescer.cancel(self)
+
+
+class TimerCoalescer:
+    """Run the timers due in the same slack window from a single wakeup.
+
+    Each call is delayed to the end of the C{slack} seconds window it's due
+    in, so the timers of the different plugins due around the same time
+    run one after the other as a batch, and an idle process wakes up once
+    per window at most, instead of once per timer.
+
+    @param call_later: The C{callLater} of the underlying reactor.
+    @param time: The function returning the current time.
+    @param slack: The length of the windows, in seconds.
+    """
+
+    def __init__(self, call_later, time, slack):
+        self._call_later = call_later
+        self._time = time
+        self.slack = slack
+        # Map the end of the windows to their timer and their calls.
+        self._windows = {}
+
+    def call_later(self, seconds, f, *args, **kwargs):
+        """Call C{f} once, after at least C{seconds} seconds."""
+        call = CoalescedCall(
+            self,
+            self._time() + seconds,
+            None,
+            f,
+            args,
+            kwargs,
+        )
+        self._schedule(call)
+        return call
+
+    def call_every(self, seconds, f, *args, **kwargs):
+        """Call C{f} repeatedly, every C{seconds} seconds.
+
+        Like a L{LoopingCall}, the call is stopped if C{f} raises an error,
+        and isn't run again before the deferred it returns, if any, fired.
+        """
+        call = CoalescedCall(
+            self,
+            self._time() + seconds,
+            seconds,
+            f,
+            args,
+            kwargs,
+        )
+        self._schedule(call)
+        return call
+
+    def cancel(self, call):
+        """Cancel a call, the timer of its window too if it was the last."""
+        call._active = False
+        window = self._windows.get(call._window)
+        if window is None:
+            return
+        timer, calls = window
+        if call in calls:
+            calls.remove(call)
+        if not calls:
+            del self._windows[call._window]
+            if timer.active():
+                timer.cancel()
+
+    def _schedule(self, call):
+        end = math.ceil(call.due / self.slack) * self.slack
+        window = self._windows.get(end)
+        if window is None:
+            delay = max(end - self._time(), 0)
+            timer = self._call_later(delay, self._run, end)
+            window = self._windows[end] = (timer, [])
+        window[1].append(call)
+        call._window = end
+
+    def _run(self, end):
+        timer, calls = self._windows.pop(end)
+        for call in calls:
+            if not call._active:
+                # Cancelled by a call run before it.
+                continue
+            call._window = None
+            if call.interval is None:
+                call._active = False
+            try:
+                result = call._f(*call._args, **call._kwargs)
+            except Exception:
+                logging.exception(f"Error running {format_object(call._f)}")
+                call._active = False
+                continue
+            if call.interval is None:
+                continue
+            if isinstance(result, Deferred):
+                result.addCallbacks(
+                    self._reschedule,
+                    self._stop,
+                    callbackArgs=(call,),
+                    errbackArgs=(call,),
+                )
+            else:
+                self._reschedule(None, call)
+
+    def _stop(self, failure, call):
+        """Stop a repeated call whose deferred failed, like a raising one."""
+        log_failure(failure, f"Error running {format_object(call._f)}")
+        self.cancel(call)
+
+    def _reschedule(self, result, call):
+        if call._active and call._window is None:
+            # Skip the runs that were missed, like a LoopingCall does.
+            now = self._time()
+            call.due += call.interval
+            if call.due <= now:
+                call.due += (
+                    math.floor((now - call.due) / call.interval) + 1
+                ) * call.interval
+            self._schedule(call)
+        return result
+
+
 class EventHandlingReactor(EventHandlingReactorMixin):
     """Wrap and add functionalities to the Twisted reactor.
 
@@ -144,6 +291,7 @@ class EventHandlingReactor(EventHandlingReactorMixin):
 
         self._LoopingCall = LoopingCall
         self._reactor = reactor
+        self._coalescer = None
         self._cleanup()
         self.callFromThread = reactor.callFromThread
         super().__init__()
@@ -155,25 +303,51 @@ class EventHandlingReactor(EventHandlingReactorMixin):
         """
         return time.time()
 
+    def set_timer_slack(self, slack):
+        """Coalesce the timers due within C{slack} seconds of each other.
+
+        Once set, the delayed and repeated calls of C{slack} seconds or
+        more are run by a L{TimerCoalescer}. Shorter ones, like retries,
+        timeouts and frequent repeated calls, are still scheduled on their
+        own, so that they aren't delayed longer than they last.
+
+        @param slack: The slack window, in seconds, or C{0} to schedule
+            every timer on its own again.
+        """
+        if slack:
+            self._coalescer = TimerCoalescer(
+                self._reactor.callLater,
+                self._reactor.seconds,
+                slack,
+            )
+        else:
+            self._coalescer = None
+
     def call_later(self, *args, **kwargs):
         """Call a function later.
 
-        Simply call C{callLater(*args, **kwargs)} and return its result.
+        Simply call C{callLater(*args, **kwargs)} and return its result,
+        unless the call is coalesced, see L{set_timer_slack}.
 
         @see: L{twisted.internet.interfaces.IReactorTime.callLater}.
 
         """
+        if self._coalescer is not None and args[0] >= self._coalescer.slack:
+            return self._coalescer.call_later(*args, **kwargs)
         return self._reactor.callLater(*args, **kwargs)
 
     def call_every(self, seconds, f, *args, **kwargs):
         """Call a function repeatedly.
 
         Create a new L{twisted.internet.task.LoopingCall} object and
-        start it.
+        start it, unless the call is coalesced, see L{set_timer_slack}.
 
-        @return: the created C{LoopingCall} object.
+        @return: the created C{LoopingCall} object, or L{CoalescedCall}.
         """
+        if self._coalescer is not None and seconds >= self._coalescer.slack:
+            return self._coalescer.call_every(seconds, f, *args, **kwargs)
         lc = self._LoopingCall(f, *args, **kwargs)
+        lc.clock = self._reactor
         lc.start(seconds, now=False)
         return lc
 
@@ -182,7 +356,8 @@ class EventHandlingReactor(EventHandlingReactorMixin):
 
         @param id: The function call or handler to remove. It can be an
             L{EventID}, a L{LoopingCall} or a C{IDelayedCall}, as returned
-            by L{call_on}, L{call_every} and L{call_later} respectively.
+            by L{call_on}, L{call_every} and L{call_later} respectively, or
+            a L{CoalescedCall}.
         """
         if isinstance(id, EventID):
             return EventHandlingReactorMixin.cancel_call(self, id)
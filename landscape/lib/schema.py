@@ -1,5 +1,8 @@
-"""A schema system. Yes. Another one!"""
-from twisted.python.compat import iteritems
+"""A schema system. Yes. Another one!
+
+Schemas may declare the C{types} of the values they can coerce, so that
+L{Any} only tries the ones which can coerce a value of a given type.
+"""
 from twisted.python.compat import long
 from twisted.python.compat import unicode
 
@@ -13,6 +16,8 @@ class InvalidError(Exception):
 class Constant:
     """Something that must be equal to a constant value."""
 
+    types = None
+
     def __init__(self, value):
         self.value = value
 
@@ -36,13 +41,31 @@ class Any:
 
     def __init__(self, *schemas):
         self.schemas = schemas
+        all_types = [getattr(schema, "types", None) for schema in schemas]
+        if None in all_types:
+            self.types = None
+        else:
+            self.types = tuple(t for types in all_types for t in types)
+        # The schemas which can coerce a value, by its type.
+        self._candidates = {}
+
+    def _get_candidates(self, value_type):
+        candidates = self._candidates.get(value_type)
+        if candidates is None:
+            candidates = self._candidates[value_type] = [
+                schema
+                for schema in self.schemas
+                if getattr(schema, "types", None) is None
+                or issubclass(value_type, schema.types)
+            ]
+        return candidates
 
     def coerce(self, value):
         """
         The result of the first schema which doesn't raise
         L{InvalidError} from its C{coerce} method will be returned.
         """
-        for schema in self.schemas:
+        for schema in self._get_candidates(type(value)):
             try:
                 return schema.coerce(value)
             except InvalidError:
@@ -55,6 +78,8 @@ class Any:
 class Bool:
     """Something that must be a C{bool}."""
 
+    types = (bool,)
+
     def coerce(self, value):
         if not isinstance(value, bool):
             raise InvalidError(f"{value!r} is not a bool")
@@ -64,6 +89,8 @@ class Bool:
 class Int:
     """Something that must be an C{int} or C{long}."""
 
+    types = (int,)
+
     def coerce(self, value):
         if not isinstance(value, (int, long)):
             raise InvalidError(f"{value!r} isn't an int or long")
@@ -73,6 +100,8 @@ class Int:
 class Float:
     """Something that must be an C{int}, C{long}, or C{float}."""
 
+    types = (int, float)
+
     def coerce(self, value):
         if not isinstance(value, (int, long, float)):
             raise InvalidError(f"{value!r} isn't a float")
@@ -86,6 +115,8 @@ class Bytes:
     encoded.
     """
 
+    types = (bytes, str)
+
     def coerce(self, value):
         if isinstance(value, bytes):
             return value
@@ -104,10 +135,14 @@ class Unicode:
     @param encoding: The encoding to automatically decode C{str}s with.
     """
 
+    types = (bytes, str)
+
     def __init__(self, encoding="utf-8"):
         self.encoding = encoding
 
     def coerce(self, value):
+        if type(value) is str:
+            return value
         if isinstance(value, bytes):
             try:
                 value = value.decode(self.encoding)
@@ -126,21 +161,27 @@ class List:
     @param schema: The schema that all values of the list must match.
     """
 
+    types = (list,)
+
     def __init__(self, schema):
         self.schema = schema
 
     def coerce(self, value):
         if not isinstance(value, list):
             raise InvalidError(f"{value!r} is not a list")
-        new_list = list(value)
-        for i, subvalue in enumerate(value):
+        coerce = self.schema.coerce
+        try:
+            return [coerce(subvalue) for subvalue in value]
+        except InvalidError:
+            pass
+        # Coerce again one value at a time, to tell which one is invalid.
+        for subvalue in value:
             try:
-                new_list[i] = self.schema.coerce(subvalue)
+                coerce(subvalue)
             except InvalidError as e:
                 raise InvalidError(
                     f"{subvalue!r} could not coerce with {self.schema}: {e}",
                 )
-        return new_list
 
 
 class Tuple:
@@ -150,6 +191,8 @@ class Tuple:
         each value in the tuple respectively.
     """
 
+    types = (tuple,)
+
     def __init__(self, *schema):
         self.schema = schema
 
@@ -161,10 +204,10 @@ class Tuple:
                 f"Need {len(self.schema)} items, "
                 f"got {len(value)} in {value!r}",
             )
-        new_value = []
-        for schema, value in zip(self.schema, value):
-            new_value.append(schema.coerce(value))
-        return tuple(new_value)
+        return tuple(
+            schema.coerce(subvalue)
+            for schema, subvalue in zip(self.schema, value)
+        )
 
 
 class KeyDict:
@@ -177,40 +220,42 @@ class KeyDict:
         keys must match.
     """
 
+    types = (dict,)
+
     def __init__(self, schema, optional=None, strict=True):
         if optional is None:
             optional = []
         self.optional = set(optional)
         self.schema = schema
         self._strict = strict
+        self._required = frozenset(schema) - self.optional
 
     def coerce(self, value):
         new_dict = {}
         if not isinstance(value, dict):
             raise InvalidError(f"{value!r} is not a dict.")
 
-        for k, v in iteritems(value):
-            unknown_key = k not in self.schema
+        schema = self.schema
+        for k, v in value.items():
+            key_schema = schema.get(k)
 
-            if unknown_key and self._strict:
+            if key_schema is None and self._strict:
                 raise InvalidError(
-                    f"{k!r} is not a valid key as per {self.schema!r}",
+                    f"{k!r} is not a valid key as per {schema!r}",
                 )
-            elif unknown_key:
+            elif key_schema is None:
                 # We are in non-strict mode, so we ignore unknown keys.
                 continue
 
             try:
-                new_dict[k] = self.schema[k].coerce(v)
+                new_dict[k] = key_schema.coerce(v)
             except InvalidError as e:
                 raise InvalidError(
                     f"Value of {k!r} key of dict {value!r} could not coerce "
-                    f"with {self.schema[k]}: {e}",
+                    f"with {key_schema}: {e}",
                 )
-        new_keys = set(new_dict.keys())
-        required_keys = set(self.schema.keys()) - self.optional
-        missing = required_keys - new_keys
-        if missing:
+        if not self._required <= new_dict.keys():
+            missing = set(self._required - new_dict.keys())
             raise InvalidError(f"Missing keys {missing}")
         return new_dict
 
@@ -222,6 +267,8 @@ class Dict:
     @param value_schema: The schema that values must match.
     """
 
+    types = (dict,)
+
     def __init__(self, key_schema, value_schema):
         self.key_schema = key_schema
         self.value_schema = value_schema
@@ -229,7 +276,6 @@ class Dict:
     def coerce(self, value):
         if not isinstance(value, dict):
             raise InvalidError(f"{value!r} is not a dict.")
-        new_dict = {}
-        for k, v in value.items():
-            new_dict[self.key_schema.coerce(k)] = self.value_schema.coerce(v)
-        return new_dict
+        coerce_key = self.key_schema.coerce
+        coerce_value = self.value_schema.coerce
+        return {coerce_key(k): coerce_value(v) for k, v in value.items()}
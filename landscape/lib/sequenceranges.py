@@ -1,5 +1,10 @@
 from twisted.python.compat import xrange
 
+try:
+    from landscape.lib import _sequenceranges
+except ImportError:
+    _sequenceranges = None
+
 
 class SequenceError(Exception):
     """Raised when the sequence isn't proper for translation to ranges."""
@@ -60,9 +65,34 @@ class SequenceRanges:
     def remove(self, item):
         remove_from_ranges(self._ranges, item)
 
+    def __or__(self, other):
+        """Return the L{SequenceRanges} of the items in either."""
+        return self.from_ranges(union_ranges(self._ranges, other._ranges))
+
+    def __sub__(self, other):
+        """Return the L{SequenceRanges} of the items not in C{other}."""
+        return self.from_ranges(
+            difference_ranges(self._ranges, other._ranges),
+        )
+
 
 def sequence_to_ranges(sequence):
     """Iterate over range items that compose the given sequence."""
+    if _sequenceranges is None:
+        yield from py_sequence_to_ranges(sequence)
+        return
+    if not isinstance(sequence, (list, tuple)):
+        sequence = list(sequence)
+    try:
+        ranges = _sequenceranges.sequence_to_ranges(sequence, SequenceError)
+    except (TypeError, OverflowError):
+        # Items which aren't ints, or too big ones.
+        ranges = py_sequence_to_ranges(sequence)
+    yield from ranges
+
+
+def py_sequence_to_ranges(sequence):
+    """The pure Python implementation of L{sequence_to_ranges}."""
 
     iterator = iter(sequence)
     try:
@@ -198,3 +228,101 @@ def remove_from_ranges(ranges, item):
                     ranges[index:index] = ((range_start, item - 1),)
         elif item == test:
             del ranges[index]
+
+
+def _iter_intervals(ranges):
+    """Iterate over the C{(start, stop)} intervals of a ranges list."""
+    for item in ranges:
+        if isinstance(item, tuple):
+            yield item
+        else:
+            yield item, item
+
+
+def _merged_intervals(ranges):
+    """
+    Return the sorted intervals of a ranges list, merging touching ones,
+    so that unsorted ranges lists are handled too.
+    """
+    merged = []
+    for start, stop in sorted(_iter_intervals(ranges)):
+        if merged and start <= merged[-1][1] + 1:
+            merged[-1] = (merged[-1][0], max(merged[-1][1], stop))
+        else:
+            merged.append((start, stop))
+    return merged
+
+
+def _intervals_to_ranges(intervals):
+    """Return the ranges list of sorted intervals, merging touching ones."""
+    ranges = []
+    start = stop = None
+    for next_start, next_stop in intervals:
+        if stop is not None and next_start <= stop + 1:
+            stop = max(stop, next_stop)
+            continue
+        if stop is not None:
+            _append_interval(ranges, start, stop)
+        start, stop = next_start, next_stop
+    if stop is not None:
+        _append_interval(ranges, start, stop)
+    return ranges
+
+
+def _append_interval(ranges, start, stop):
+    if stop - start < 2:
+        ranges.extend(range(start, stop + 1))
+    else:
+        ranges.append((start, stop))
+
+
+def py_union_ranges(ranges, other):
+    """The pure Python implementation of L{union_ranges}."""
+    intervals = sorted(
+        list(_iter_intervals(ranges)) + list(_iter_intervals(other)),
+    )
+    return _intervals_to_ranges(intervals)
+
+
+def py_difference_ranges(ranges, other):
+    """The pure Python implementation of L{difference_ranges}."""
+    removed = _merged_intervals(other)
+    remaining = []
+    index = 0
+    for start, stop in _merged_intervals(ranges):
+        # Skip the removed intervals ending before this one, they can't
+        # overlap the following ones either.
+        while index < len(removed) and removed[index][1] < start:
+            index += 1
+        for removed_start, removed_stop in removed[index:]:
+            if removed_start > stop or start > stop:
+                break
+            if removed_start > start:
+                remaining.append((start, removed_start - 1))
+            start = max(start, removed_stop + 1)
+        if start <= stop:
+            remaining.append((start, stop))
+    return _intervals_to_ranges(remaining)
+
+
+def union_ranges(ranges, other):
+    """Return the ranges list of the items in either of the ranges lists."""
+    if _sequenceranges is not None:
+        try:
+            return _sequenceranges.union_ranges(ranges, other)
+        except (TypeError, OverflowError):
+            pass
+    return py_union_ranges(ranges, other)
+
+
+def difference_ranges(ranges, other):
+    """
+    Return the ranges list of the items in C{ranges} which aren't in
+    C{other}.
+    """
+    if _sequenceranges is not None:
+        try:
+            return _sequenceranges.difference_ranges(ranges, other)
+        except (TypeError, OverflowError):
+            pass
+    return py_difference_ranges(ranges, other)
@@ -15,9 +15,18 @@ class CommandError(Exception):
 
 
 class MemoryStats:
-    def __init__(self, filename="/proc/meminfo"):
+    """
+    @param filename: The file to read the memory statistics from.
+    @param data: The content of C{filename}, if it was already read.
+    """
+
+    def __init__(self, filename="/proc/meminfo", data=None):
+        if data is None:
+            with open(filename) as fd:
+                data = fd.read()
+        lines = data.splitlines()
         data = {}
-        for line in open(filename):
+        for line in lines:
             if ":" in line:
                 key, value = line.split(":", 1)
                 if key in [
@@ -107,32 +116,39 @@ def get_thermal_zones(thermal_zone_path=None):
 
 
 class ThermalZone:
+    """
+    @param temperature_path: The file to read the temperature from.
+    @param data: The content of C{temperature_path}, if it was already read.
+    """
 
     temperature = None
     temperature_value = None
     temperature_unit = None
 
-    def __init__(self, temperature_path):
+    def __init__(self, temperature_path, data=None):
+        self.temperature_path = temperature_path
         self.path = os.path.dirname(temperature_path)
         self.name = os.path.basename(self.path)
         try:
-            with open(temperature_path) as f:
-                if os.path.basename(temperature_path) == "temperature":
-                    for line in f:
-                        if line.startswith("temperature:"):
-                            self.temperature = line[12:].strip()
-                            value, unit = self.temperature.split()
-                            self.temperature_value = int(value)
-                            self.temperature_unit = unit
-                            break
-                else:
-                    line = f.readline()
-                    self.temperature_value = int(line.strip()) / 1000.0
-                    self.temperature_unit = "C"
-                    self.temperature = "{:.1f} {}".format(
-                        self.temperature_value,
-                        self.temperature_unit,
-                    )
+            if data is None:
+                with open(temperature_path) as f:
+                    data = f.read()
+            if os.path.basename(temperature_path) == "temperature":
+                for line in data.splitlines():
+                    if line.startswith("temperature:"):
+                        self.temperature = line[12:].strip()
+                        value, unit = self.temperature.split()
+                        self.temperature_value = int(value)
+                        self.temperature_unit = unit
+                        break
+            else:
+                line = data.split("\n", 1)[0]
+                self.temperature_value = int(line.strip()) / 1000.0
+                self.temperature_unit = "C"
+                self.temperature = "{:.1f} {}".format(
+                    self.temperature_value,
+                    self.temperature_unit,
+                )
         except (ValueError, OSError):
             pass
 
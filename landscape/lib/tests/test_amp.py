@@ -1,17 +1,25 @@
+import fcntl
+import os
 import unittest
+from unittest import mock
 
 from twisted.internet import reactor
 from twisted.internet.defer import Deferred
 from twisted.internet.defer import inlineCallbacks
 from twisted.internet.error import ConnectError
 from twisted.internet.error import ConnectionDone
+from twisted.internet.interfaces import IUNIXTransport
 from twisted.internet.task import Clock
+from twisted.protocols.amp import AMP
 from twisted.python.failure import Failure
+from zope.interface import implementer
 
+from landscape.lib import bpickle
 from landscape.lib import testing
 from landscape.lib.amp import MethodCallClientFactory
 from landscape.lib.amp import MethodCallClientProtocol
 from landscape.lib.amp import MethodCallError
+from landscape.lib.amp import MethodCallReceiver
 from landscape.lib.amp import MethodCallSender
 from landscape.lib.amp import MethodCallServerFactory
 from landscape.lib.amp import MethodCallServerProtocol
@@ -38,16 +46,30 @@ class FakeTransport:
         pass
 
 
+@implementer(IUNIXTransport)
+class FakeUNIXTransport(FakeTransport):
+    """Also accumulate file descriptors, like a Unix socket passes them."""
+
+    def __init__(self, connection):
+        super().__init__(connection)
+        self.descriptors = []
+
+    def sendFileDescriptor(self, descriptor):  # noqa: N802
+        # The peer gets its own copy of the descriptor, as with SCM_RIGHTS.
+        self.descriptors.append(os.dup(descriptor))
+
+
 class FakeConnection:
     """Simulate a connection between a client and a server protocol."""
 
-    def __init__(self, client, server):
+    def __init__(self, client, server, transport=FakeTransport):
         self.client = client
         self.server = server
+        self.transport = transport
 
     def make(self):
-        self.server.makeConnection(FakeTransport(self))
-        self.client.makeConnection(FakeTransport(self))
+        self.server.makeConnection(self.transport(self))
+        self.client.makeConnection(self.transport(self))
 
     def lose(self, connector, reason):
         self.server.connectionLost(reason)
@@ -60,12 +82,20 @@ class FakeConnection:
         """
         while True:
             if self.client.transport and self.client.transport.stream:
+                self._pass_descriptors(self.client, self.server)
                 self.server.dataReceived(self.client.transport.stream.pop(0))
             elif self.server.transport and self.server.transport.stream:
+                self._pass_descriptors(self.server, self.client)
                 self.client.dataReceived(self.server.transport.stream.pop(0))
             else:
                 break
 
+    def _pass_descriptors(self, sender, receiver):
+        """Pass file descriptors ahead of the data they were sent with."""
+        descriptors = getattr(sender.transport, "descriptors", [])
+        while descriptors:
+            receiver.fileDescriptorReceived(descriptors.pop(0))
+
 
 class FakeConnector:
     """Make L{FakeConnection}s using the given server and client factories."""
@@ -314,6 +344,23 @@ class MethodCallTest(BaseTestCase):
         self.assertEqual(80000, self.successResultOf(deferred1))
         self.assertEqual(90000, self.successResultOf(deferred2))
 
+    def test_with_long_argument_chunk_window(self):
+        """
+        Up to C{_chunk_window} L{MethodCallChunk}s are sent ahead of their
+        responses, the rest as the responses come.
+        """
+        self.object.method = lambda word: len(word)
+        self.sender._chunk_size = 10
+        self.sender._chunk_window = 4
+        deferred = self.sender.send_method_call(
+            method="method",
+            args=["!" * 100],
+            kwargs={},
+        )
+        self.assertEqual(4, len(self.connection.client.transport.stream))
+        self.connection.flush()
+        self.assertEqual(100, self.successResultOf(deferred))
+
     def test_with_exception(self):
         """
         If the target object method raises an exception, the remote call fails
@@ -424,6 +471,163 @@ class MethodCallTest(BaseTestCase):
         failure.trap(MethodCallError)
 
 
+class ChunksOnlyReceiver(MethodCallReceiver):
+    """A receiver not handling L{MethodCallDescriptor}, like older ones."""
+
+    def locateResponder(self, name):  # noqa: N802
+        if name == b"MethodCallDescriptor":
+            return None
+        return super().locateResponder(name)
+
+
+class MethodCallDescriptorTest(BaseTestCase):
+    def setUp(self):
+        super().setUp()
+        self.methods = ["method"]
+        self.object = DummyObject()
+        self.object.method = lambda word: len(word)
+        self.clock = Clock()
+
+    def connect(self, server):
+        client = MethodCallClientProtocol()
+        self.connection = FakeConnection(client, server, FakeUNIXTransport)
+        self.connection.make()
+        self.sender = MethodCallSender(client, self.clock)
+
+    def test_with_long_argument(self):
+        """
+        Arguments bigger than the maximum AMP value size are passed in a
+        file descriptor over Unix sockets, rather than in chunks.
+        """
+        server = MethodCallServerProtocol(self.object, self.methods)
+        self.connect(server)
+        deferred = self.sender.send_method_call(
+            method="method",
+            args=["!" * 200000],
+            kwargs={},
+        )
+        transport = self.connection.client.transport
+        self.assertEqual(1, len(transport.descriptors))
+        self.assertEqual(1, len(transport.stream))
+        self.connection.flush()
+        self.assertEqual(200000, self.successResultOf(deferred))
+        self.assertEqual({}, server.locator._pending_chunks)
+
+    def test_with_long_argument_timeout(self):
+        """
+        If the call times out, the file descriptor with the arguments is
+        only closed once the peer answers.
+        """
+        descriptors = []
+        create = os.memfd_create
+
+        def memfd_create(*args):
+            descriptors.append(create(*args))
+            return descriptors[-1]
+
+        self.object.deferred = Deferred()
+        self.object.method = lambda word: self.object.deferred
+        self.connect(MethodCallServerProtocol(self.object, self.methods))
+        with mock.patch("os.memfd_create", side_effect=memfd_create):
+            deferred = self.sender.send_method_call(
+                method="method",
+                args=["!" * 200000],
+                kwargs={},
+            )
+        [descriptor] = descriptors
+        self.connection.flush()
+        self.clock.advance(60)
+        self.failureResultOf(deferred).trap(MethodCallError)
+        os.fstat(descriptor)
+
+        self.object.deferred.callback("late")
+        self.connection.flush()
+        self.assertRaises(OSError, os.fstat, descriptor)
+
+    def make_descriptor(self, data, seals=0):
+        descriptor = os.memfd_create("test", os.MFD_ALLOW_SEALING)
+        os.write(descriptor, data)
+        if seals:
+            fcntl.fcntl(descriptor, fcntl.F_ADD_SEALS, seals)
+        return descriptor
+
+    def receive_descriptor(self, descriptor):
+        """
+        Pass the descriptor to the receiver, returning the error it raises.
+        """
+        receiver = MethodCallReceiver(self.object, self.methods)
+        with self.assertRaises(MethodCallError) as context:
+            receiver.receive_method_call_descriptor(
+                sequence=1,
+                method=b"method",
+                descriptor=descriptor,
+            )
+        self.assertRaises(OSError, os.fstat, descriptor)
+        return context.exception
+
+    def test_receive_unsealed_descriptor(self):
+        """
+        A descriptor which can still be written to or truncated is rejected,
+        and closed.
+        """
+        arguments = bpickle.dumps((("word",), {}))
+        for seals in (0, fcntl.F_SEAL_WRITE, fcntl.F_SEAL_SHRINK):
+            descriptor = self.make_descriptor(arguments, seals)
+            error = self.receive_descriptor(descriptor)
+            self.assertIn("isn't sealed", str(error))
+
+    def test_receive_empty_descriptor(self):
+        """An empty descriptor is rejected, rather than mapped."""
+        descriptor = self.make_descriptor(
+            b"",
+            fcntl.F_SEAL_SHRINK | fcntl.F_SEAL_WRITE,
+        )
+        error = self.receive_descriptor(descriptor)
+        self.assertIn("empty", str(error))
+
+    def test_receive_descriptor_not_memfd(self):
+        """A descriptor which can't be sealed, like a pipe, is rejected."""
+        read_end, write_end = os.pipe()
+        self.addCleanup(os.close, write_end)
+        error = self.receive_descriptor(read_end)
+        self.assertIn("Invalid arguments descriptor", str(error))
+
+    def test_with_short_argument(self):
+        """Arguments fitting in an AMP value are sent as they are."""
+        self.connect(MethodCallServerProtocol(self.object, self.methods))
+        deferred = self.sender.send_method_call(
+            method="method",
+            args=["!" * 100],
+            kwargs={},
+        )
+        self.assertEqual([], self.connection.client.transport.descriptors)
+        self.connection.flush()
+        self.assertEqual(100, self.successResultOf(deferred))
+
+    def test_with_chunks_only_receiver(self):
+        """
+        If the peer doesn't handle L{MethodCallDescriptor}, the arguments
+        are sent in chunks, from then on.
+        """
+        receiver = ChunksOnlyReceiver(self.object, self.methods)
+        self.connect(AMP(locator=receiver))
+        deferred = self.sender.send_method_call(
+            method="method",
+            args=["!" * 200000],
+            kwargs={},
+        )
+        self.connection.flush()
+        self.assertEqual(200000, self.successResultOf(deferred))
+        deferred = self.sender.send_method_call(
+            method="method",
+            args=["*" * 100000],
+            kwargs={},
+        )
+        self.assertEqual([], self.connection.client.transport.descriptors)
+        self.connection.flush()
+        self.assertEqual(100000, self.successResultOf(deferred))
+
+
 class RemoteObjectTest(BaseTestCase):
     def setUp(self):
         super().setUp()
@@ -0,0 +1,82 @@
+import unittest
+
+from landscape.lib.batching import AdaptiveBatch
+
+
+class AdaptiveBatchTest(unittest.TestCase):
+    def test_initial_batch(self):
+        """Before any batch is recorded, the initial limits are used."""
+        batch = AdaptiveBatch(100, initial_bytes=1000)
+        self.assertEqual(100, batch.max_messages)
+        self.assertEqual(1000, batch.max_bytes)
+        self.assertIsNone(batch.get_round_trip_time())
+
+    def test_record(self):
+        """
+        The byte budget is what the link carries in the target duration,
+        less the round trip time, and the message count what fits in it.
+        """
+        batch = AdaptiveBatch(
+            10,
+            min_bytes=1,
+            max_bytes=10**9,
+            target_duration=30,
+            max_scale=1000,
+        )
+        batch.record(size=1000, messages=1, duration=10)
+        self.assertEqual(10, batch.get_round_trip_time())
+        self.assertEqual(100 * 20, batch.max_bytes)
+        # Fewer messages than the base count are never allowed.
+        self.assertEqual(10, batch.max_messages)
+        batch.record(size=100000, messages=1000, duration=1)
+        self.assertEqual(1, batch.get_round_trip_time())
+        # The averages are half way between the old and new values.
+        throughput = (100 + 100000) / 2
+        message_size = (1000 + 100) / 2
+        self.assertEqual(int(throughput * 29), batch.max_bytes)
+        self.assertEqual(
+            int(int(throughput * 29) / message_size),
+            batch.max_messages,
+        )
+
+    def test_record_slow_round_trip(self):
+        """
+        At least half of the target duration is left for the transfer, when
+        the round trip takes longer.
+        """
+        batch = AdaptiveBatch(1, min_bytes=1, target_duration=30)
+        batch.record(size=4000, messages=1, duration=40)
+        self.assertEqual(100 * 15, batch.max_bytes)
+
+    def test_record_without_messages(self):
+        """Batches without messages are only used for the round trip time."""
+        batch = AdaptiveBatch(100, initial_bytes=1000)
+        batch.record(size=0, messages=0, duration=0.5)
+        self.assertEqual(0.5, batch.get_round_trip_time())
+        self.assertEqual(100, batch.max_messages)
+        self.assertEqual(1000, batch.max_bytes)
+
+    def test_record_limits(self):
+        """The budget stays within its limits, however fast the link is."""
+        batch = AdaptiveBatch(100, min_bytes=10, max_bytes=1000, max_scale=5)
+        batch.record(size=10**9, messages=10, duration=0)
+        self.assertEqual(1000, batch.max_bytes)
+        self.assertEqual(100, batch.max_messages)
+        batch = AdaptiveBatch(100, min_bytes=10, max_bytes=10**9, max_scale=5)
+        batch.record(size=10**9, messages=10**9, duration=0)
+        self.assertEqual(10**9, batch.max_bytes)
+        self.assertEqual(500, batch.max_messages)
+        batch = AdaptiveBatch(100, min_bytes=10, max_bytes=1000)
+        batch.record(size=1, messages=1, duration=1000)
+        self.assertEqual(10, batch.max_bytes)
+
+    def test_record_failure(self):
+        """A failure halves the budget of the next batch, down to its min."""
+        batch = AdaptiveBatch(10, initial_bytes=1000, min_bytes=300)
+        batch.max_messages = 40
+        batch.record_failure()
+        self.assertEqual(500, batch.max_bytes)
+        self.assertEqual(20, batch.max_messages)
+        batch.record_failure()
+        self.assertEqual(300, batch.max_bytes)
+        self.assertEqual(10, batch.max_messages)
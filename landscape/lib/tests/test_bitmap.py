@@ -0,0 +1,77 @@
+import unittest
+
+from landscape.lib.bitmap import IdBitmap
+
+
+class IdBitmapTest(unittest.TestCase):
+    def test_empty(self):
+        bitmap = IdBitmap()
+        self.assertFalse(bitmap)
+        self.assertEqual(0, len(bitmap))
+        self.assertEqual([], list(bitmap))
+
+    def test_iter_sorted(self):
+        """Iterating a bitmap yields its ids once each, in order."""
+        ids = [70000, 3, 1 << 40, 65535, 65536, 3, 0]
+        bitmap = IdBitmap(ids)
+        self.assertEqual(sorted(set(ids)), list(bitmap))
+        self.assertEqual(6, len(bitmap))
+
+    def test_contains(self):
+        bitmap = IdBitmap([1, 70000])
+        self.assertIn(1, bitmap)
+        self.assertIn(70000, bitmap)
+        self.assertNotIn(2, bitmap)
+        self.assertNotIn(1 + 65536, bitmap)
+
+    def test_negative_id(self):
+        self.assertRaises(ValueError, IdBitmap, [1, -1])
+
+    def test_equal(self):
+        self.assertEqual(IdBitmap([1, 2]), IdBitmap([2, 1]))
+        self.assertNotEqual(IdBitmap([1, 2]), IdBitmap([1, 70000]))
+        self.assertNotEqual(IdBitmap([1]), [1])
+
+    def test_operations(self):
+        """
+        Set difference, union and intersection work across containers,
+        and drop the containers left empty.
+        """
+        first = IdBitmap([1, 2, 70000, 200000])
+        second = IdBitmap([2, 3, 200000])
+        self.assertEqual([1, 70000], list(first - second))
+        self.assertEqual([3], list(second - first))
+        self.assertEqual([1, 2, 3, 70000, 200000], list(first | second))
+        self.assertEqual([2, 200000], list(first & second))
+        self.assertEqual(IdBitmap(), IdBitmap([70000]) - IdBitmap([70000]))
+        self.assertFalse(IdBitmap([70000]) & IdBitmap([1]))
+
+    def test_to_bytes_sparse(self):
+        """Sparse containers are serialized as arrays of their ids."""
+        bitmap = IdBitmap([1, 5, 1 << 33])
+        data = bitmap.to_bytes()
+        self.assertEqual(2 * 9 + 3 * 2, len(data))
+        self.assertEqual(bitmap, IdBitmap.from_bytes(data))
+
+    def test_to_bytes_dense(self):
+        """Dense containers are serialized as bitmaps."""
+        bitmap = IdBitmap(range(10, 60000))
+        data = bitmap.to_bytes()
+        self.assertEqual(9 + 8192, len(data))
+        self.assertEqual(bitmap, IdBitmap.from_bytes(data))
+        self.assertEqual(list(range(10, 60000)), list(bitmap))
+
+    def test_from_bytes_empty(self):
+        self.assertEqual(IdBitmap(), IdBitmap.from_bytes(b""))
+
+    def test_from_bytes_invalid(self):
+        data = IdBitmap([1, 2, 3]).to_bytes()
+        self.assertRaises(ValueError, IdBitmap.from_bytes, data[:-1])
+        self.assertRaises(ValueError, IdBitmap.from_bytes, data[:5])
+        self.assertRaises(
+            ValueError,
+            IdBitmap.from_bytes,
+            data[:4] + b"\x07" + data[5:],
+        )
+        dense = IdBitmap(range(5000)).to_bytes()
+        self.assertRaises(ValueError, IdBitmap.from_bytes, dense[:-1])
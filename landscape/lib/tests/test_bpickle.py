@@ -3,54 +3,64 @@ import unittest
 from landscape.lib import bpickle
 
 
+try:
+    from landscape.lib import _bpickle
+except ImportError:
+    _bpickle = None
+
+
 class BPickleTest(unittest.TestCase):
+
+    dumps = staticmethod(bpickle.py_dumps)
+    loads = staticmethod(bpickle.py_loads)
+
     def test_int(self):
-        self.assertEqual(bpickle.loads(bpickle.dumps(1)), 1)
+        self.assertEqual(self.loads(self.dumps(1)), 1)
 
     def test_float(self):
-        self.assertAlmostEqual(bpickle.loads(bpickle.dumps(2.3)), 2.3)
+        self.assertAlmostEqual(self.loads(self.dumps(2.3)), 2.3)
 
     def test_float_scientific_notation(self):
         number = 0.00005
         self.assertTrue("e" in repr(number))
-        self.assertAlmostEqual(bpickle.loads(bpickle.dumps(number)), number)
+        self.assertAlmostEqual(self.loads(self.dumps(number)), number)
 
     def test_bytes(self):
-        self.assertEqual(bpickle.loads(bpickle.dumps(b"foo")), b"foo")
+        self.assertEqual(self.loads(self.dumps(b"foo")), b"foo")
 
     def test_bytes_negative_length(self):
-        self.assertRaises(ValueError, bpickle.loads, b"ds-4:tests5:thing;")
+        self.assertRaises(ValueError, self.loads, b"ds-4:tests5:thing;")
 
     def test_string(self):
-        self.assertEqual(bpickle.loads(bpickle.dumps("foo")), "foo")
+        self.assertEqual(self.loads(self.dumps("foo")), "foo")
 
     def test_string_negative_length(self):
-        self.assertRaises(ValueError, bpickle.loads, b"du-4:testu5:thing;")
+        self.assertRaises(ValueError, self.loads, b"du-4:testu5:thing;")
 
     def test_list(self):
         self.assertEqual(
-            bpickle.loads(bpickle.dumps([1, 2, "hello", 3.0])),
+            self.loads(self.dumps([1, 2, "hello", 3.0])),
             [1, 2, "hello", 3.0],
         )
 
     def test_tuple(self):
-        data = bpickle.dumps((1, [], 2, "hello", 3.0))
-        self.assertEqual(bpickle.loads(data), (1, [], 2, "hello", 3.0))
+        data = self.dumps((1, [], 2, "hello", 3.0))
+        self.assertEqual(self.loads(data), (1, [], 2, "hello", 3.0))
 
     def test_none(self):
-        self.assertEqual(bpickle.loads(bpickle.dumps(None)), None)
+        self.assertEqual(self.loads(self.dumps(None)), None)
 
     def test_unicode(self):
-        self.assertEqual(bpickle.loads(bpickle.dumps("\xc0")), "\xc0")
+        self.assertEqual(self.loads(self.dumps("\xc0")), "\xc0")
 
     def test_bool(self):
-        self.assertEqual(bpickle.loads(bpickle.dumps(True)), True)
+        self.assertEqual(self.loads(self.dumps(True)), True)
 
     def test_dict(self):
-        dumped_tostr = bpickle.dumps({True: "hello"})
-        self.assertEqual(bpickle.loads(dumped_tostr), {True: "hello"})
-        dumped_tobool = bpickle.dumps({True: False})
-        self.assertEqual(bpickle.loads(dumped_tobool), {True: False})
+        dumped_tostr = self.dumps({True: "hello"})
+        self.assertEqual(self.loads(dumped_tostr), {True: "hello"})
+        dumped_tobool = self.dumps({True: False})
+        self.assertEqual(self.loads(dumped_tobool), {True: False})
 
     def test_dict_bytes_keys(self):
         """Check loading dict bytes keys without reinterpreting."""
@@ -58,10 +68,217 @@ class BPickleTest(unittest.TestCase):
         # forwarded to the server without changing schema, keys shouldn't be
         # decoded in this case.
         initial_data = {b"hello": True}
-        data = bpickle.dumps(initial_data)
-        result = bpickle.loads(data, as_is=True)
+        data = self.dumps(initial_data)
+        result = self.loads(data, as_is=True)
         self.assertEqual(initial_data, result)
 
     def test_long(self):
         long = 99999999999999999999999999999
-        self.assertEqual(bpickle.loads(bpickle.dumps(long)), long)
+        self.assertEqual(self.loads(self.dumps(long)), long)
+
+    def test_unsupported_type(self):
+        self.assertRaises(ValueError, self.dumps, {1, 2})
+
+    def test_unsupported_subclass(self):
+        class Subclass(dict):
+            pass
+
+        self.assertRaises(ValueError, self.dumps, Subclass())
+
+    def test_unknown_type_character(self):
+        self.assertRaises(ValueError, self.loads, b"lx;")
+
+    def test_buffer(self):
+        """Any object supporting the buffer protocol can be loaded."""
+        data = self.dumps({"a": [1, b"b"]})
+        self.assertEqual(self.loads(memoryview(data)), {"a": [1, b"b"]})
+        self.assertEqual(self.loads(bytearray(data)), {"a": [1, b"b"]})
+
+    def test_nested(self):
+        data = {"a": [(1, b"x"), {"b": None}], "c": "\u20ac", "d": -2.5}
+        self.assertEqual(self.loads(self.dumps(data)), data)
+
+
+@unittest.skipIf(_bpickle is None, "_bpickle accelerator not built")
+class AcceleratedBPickleTest(BPickleTest):
+
+    dumps = staticmethod(bpickle.dumps)
+    loads = staticmethod(bpickle.loads)
+
+    def test_accelerator_is_used(self):
+        self.assertIs(_bpickle.dumps, bpickle.dumps)
+        self.assertIs(_bpickle.loads, bpickle.loads)
+
+    def test_wire_compatible(self):
+        """
+        The accelerator produces the same bytes as the pure Python
+        implementation, and loads them back the same way.
+        """
+        data = {
+            "type": "packages",
+            "installed": [(1, 10), 12, 99999999999999999999],
+            "float": 0.00005,
+            "flags": [True, False, None],
+            "bytes": b"\x00\xff",
+            "unicode": "\xc0",
+            "tuple": (1, ()),
+            "nested": {b"key": {"key": []}},
+        }
+        dumped = bpickle.py_dumps(data)
+        self.assertEqual(dumped, self.dumps(data))
+        self.assertEqual(bpickle.py_loads(dumped), self.loads(dumped))
+        self.assertEqual(
+            bpickle.py_loads(dumped, as_is=True),
+            self.loads(dumped, as_is=True),
+        )
+
+    def test_truncated(self):
+        self.assertRaises(ValueError, self.loads, b"s10:abc")
+        self.assertRaises(ValueError, self.loads, b"li1;")
+
+
+class LoadsFieldsTest(unittest.TestCase):
+
+    loads_fields = staticmethod(bpickle.py_loads_fields)
+
+    def test_loads_fields(self):
+        """Only the given keys are loaded, as they are."""
+        data = bpickle.dumps(
+            {
+                "api": b"3.2",
+                "data": [1, {"a": (2.5, None, True)}, "\u20ac"],
+                "type": "test",
+            },
+        )
+        self.assertEqual(
+            self.loads_fields(data, ("api", "type", "missing")),
+            {"api": b"3.2", "type": "test"},
+        )
+
+    def test_bytes_keys(self):
+        """Keys aren't reinterpreted, like with C{as_is}."""
+        data = bpickle.dumps({b"type": b"test"})
+        self.assertEqual(self.loads_fields(data, ("type",)), {})
+        self.assertEqual(
+            self.loads_fields(data, (b"type",)),
+            {b"type": b"test"},
+        )
+
+    def test_not_a_dict(self):
+        self.assertRaises(ValueError, self.loads_fields, b"li1;;", ("a",))
+        self.assertRaises(ValueError, self.loads_fields, b"", ("a",))
+
+    def test_truncated(self):
+        data = bpickle.dumps({"data": [1, b"value"], "type": "test"})
+        for end in range(1, len(data)):
+            self.assertRaises(
+                ValueError,
+                self.loads_fields,
+                data[:end],
+                ("type",),
+            )
+
+    def test_unknown_type(self):
+        self.assertRaises(
+            ValueError,
+            self.loads_fields,
+            b"du4:datalx;u4:typeu4:test;",
+            ("type",),
+        )
+
+
+@unittest.skipIf(_bpickle is None, "_bpickle accelerator not built")
+class AcceleratedLoadsFieldsTest(LoadsFieldsTest):
+
+    loads_fields = staticmethod(bpickle.loads_fields)
+
+    def test_accelerator_is_used(self):
+        self.assertIs(_bpickle.loads_fields, bpickle.loads_fields)
+
+
+class DumpsIterTest(unittest.TestCase):
+    def test_same_as_dumps(self):
+        data = {"a": [(1, b"x"), {"b": None}], "c": "\u20ac", "d": -2.5}
+        self.assertEqual(
+            b"".join(bpickle.dumps_iter(data)),
+            bpickle.dumps(data),
+        )
+
+    def test_serialized(self):
+        """L{bpickle.Serialized} values are copied verbatim."""
+        message = bpickle.Serialized(bpickle.dumps({"type": "test"}))
+        chunks = list(bpickle.dumps_iter({"messages": [message]}))
+        self.assertTrue(any(chunk is message for chunk in chunks))
+        self.assertEqual(
+            bpickle.loads(b"".join(chunks)),
+            {"messages": [{"type": "test"}]},
+        )
+
+    def test_unsupported_type(self):
+        self.assertRaises(ValueError, list, bpickle.dumps_iter([{1, 2}]))
+
+
+class DecoderTest(unittest.TestCase):
+    def decode(self, data, size=1, as_is=False):
+        decoder = bpickle.Decoder(as_is=as_is)
+        for i in range(0, len(data), size):
+            decoder.feed(data[i : i + size])
+        return decoder.close()
+
+    def test_decode(self):
+        """
+        The decoder gives the same result as L{bpickle.loads}, however the
+        data is split.
+        """
+        data = bpickle.dumps(
+            {
+                "a": [(1, b"x:;"), {"b": None}, True, ()],
+                "c": "\u20ac",
+                "d": -2.5,
+                "e": 99999999999999999999,
+            },
+        )
+        for size in (1, 2, 3, 7, len(data)):
+            self.assertEqual(self.decode(data, size), bpickle.loads(data))
+
+    def test_decode_as_is(self):
+        data = bpickle.dumps({b"hello": True})
+        self.assertEqual(self.decode(data, as_is=True), {b"hello": True})
+        self.assertEqual(self.decode(data), {"hello": True})
+
+    def test_received(self):
+        decoder = bpickle.Decoder()
+        decoder.feed(b"l")
+        decoder.feed(b"i1;;")
+        self.assertEqual(decoder.received, 5)
+        self.assertEqual(decoder.close(), [1])
+
+    def test_pending(self):
+        """Bytes are only kept until the values they hold are decoded."""
+        decoder = bpickle.Decoder()
+        decoder.feed(b"li1;s5:ab")
+        self.assertEqual(decoder.pending, b"s5:ab")
+        decoder.feed(b"cde;")
+        self.assertEqual(decoder.pending, b"")
+        self.assertEqual(decoder.close(), [1, b"abcde"])
+
+    def test_empty(self):
+        self.assertRaises(ValueError, bpickle.Decoder().close)
+
+    def test_truncated(self):
+        self.assertRaises(ValueError, self.decode, b"s10:abc")
+        self.assertRaises(ValueError, self.decode, b"li1;")
+
+    def test_corrupted(self):
+        """Errors are raised by L{bpickle.Decoder.close}, not by feed."""
+        decoder = bpickle.Decoder()
+        decoder.feed(b"<html>")
+        decoder.feed(b"</html>")
+        self.assertRaises(ValueError, decoder.close)
+        self.assertEqual(decoder.pending, b"<html></html>")
+
+    def test_unhashable_key(self):
+        """Any error decoding the data is raised by L{Decoder.close}."""
+        decoder = bpickle.Decoder()
+        decoder.feed(b"dli1;;i2;;")
+        self.assertRaises(TypeError, decoder.close)
@@ -688,6 +688,108 @@ class BaseConfigurationTest(ConfigTestCase, HelperTestCase, unittest.TestCase):
             "[my-config]\n# Comment 1\nwhatever = eggs\n#Comment 2\n",
         )
 
+    # config snapshot
+
+    def test_write_config_snapshot(self):
+        """
+        The configuration loaded with a snapshot of the configuration file
+        reads its options from the snapshot, without parsing the file.
+        """
+        self.write_config_file(whatever="spam")
+        self.config.load([])
+        snapshot_filename = self.makeFile()
+        self.assertTrue(self.config.write_config_snapshot(snapshot_filename))
+
+        config = self.config_class()
+        with mock.patch.object(config, "_get_config_object") as parse_mock:
+            config.load(["--config-snapshot", snapshot_filename])
+        parse_mock.assert_not_called()
+        self.assertEqual(config.whatever, "spam")
+
+    def test_config_snapshot_mode(self):
+        """The snapshot has the mode of the configuration file."""
+        self.write_config_file(whatever="spam")
+        os.chmod(self.config_filename, 0o640)
+        self.config.load([])
+        snapshot_filename = self.makeFile()
+        self.config.write_config_snapshot(snapshot_filename)
+        self.assertEqual(os.stat(snapshot_filename).st_mode & 0o777, 0o640)
+
+    def test_config_snapshot_doesnt_follow_links(self):
+        """
+        Links planted next to the snapshot aren't followed, they're
+        replaced by the snapshot.
+        """
+        self.write_config_file(whatever="spam")
+        self.config.load([])
+        target_filename = self.makeFile("target")
+        snapshot_filename = self.makeFile()
+        os.symlink(target_filename, snapshot_filename + ".new")
+        os.symlink(target_filename, snapshot_filename)
+        self.assertTrue(self.config.write_config_snapshot(snapshot_filename))
+        self.assertEqual(read_text_file(target_filename), "target")
+        self.assertFalse(os.path.islink(snapshot_filename))
+        self.assertEqual(
+            os.readlink(snapshot_filename + ".new"),
+            target_filename,
+        )
+
+    def test_config_snapshot_other_owner(self):
+        """
+        A snapshot which doesn't have the owner of the configuration file
+        is ignored, and the file is parsed.
+        """
+        self.write_config_file(whatever="spam")
+        self.config.load([])
+        snapshot_filename = self.makeFile()
+        self.config.write_config_snapshot(snapshot_filename)
+        # Change the file without changing its size or time, so that only
+        # the owner of the snapshot tells it apart.
+        config_stat = os.stat(self.config_filename)
+        create_text_file(
+            self.config_filename,
+            read_text_file(self.config_filename).replace("spam", "eggs"),
+        )
+        os.utime(
+            self.config_filename,
+            ns=(config_stat.st_atime_ns, config_stat.st_mtime_ns),
+        )
+
+        config = self.config_class()
+        real_fstat = os.fstat
+        with mock.patch("os.fstat") as fstat_mock:
+            fstat_mock.side_effect = lambda fd: os.stat_result(
+                real_fstat(fd)[:4] + (os.getuid() + 1,) + real_fstat(fd)[5:],
+            )
+            config.load(["--config-snapshot", snapshot_filename])
+        self.assertEqual(config.whatever, "eggs")
+
+    def test_config_snapshot_changed_file(self):
+        """The configuration file is parsed again if it changed."""
+        self.write_config_file(whatever="spam")
+        self.config.load([])
+        snapshot_filename = self.makeFile()
+        self.config.write_config_snapshot(snapshot_filename)
+        create_text_file(self.config_filename, "[my-config]\nwhatever = ham")
+
+        config = self.config_class()
+        config.load(["--config-snapshot", snapshot_filename])
+        self.assertEqual(config.whatever, "ham")
+
+    def test_config_snapshot_missing(self):
+        """The configuration file is parsed without a snapshot to read."""
+        self.write_config_file(whatever="spam")
+        self.config.load(["--config-snapshot", self.makeFile()])
+        self.assertEqual(self.config.whatever, "spam")
+
+    def test_dont_write_config_snapshot_option(self):
+        """The snapshot option isn't written to the configuration file."""
+        self.write_config_file()
+        self.config.load(["--config-snapshot", self.makeFile()])
+        self.config.write()
+        data = read_text_file(self.config_filename)
+        self.assertConfigEqual(data, "[my-config]")
+
 
 class GetBindirTest(unittest.TestCase):
 
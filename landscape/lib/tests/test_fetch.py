@@ -1,16 +1,27 @@
+import hashlib
 import os
 import unittest
+from http.server import BaseHTTPRequestHandler
+from http.server import ThreadingHTTPServer
 from threading import local
+from threading import Thread
+from unittest import mock
 
 import pycurl
+from twisted.internet.defer import fail
 from twisted.internet.defer import FirstError
+from twisted.internet.defer import succeed
 from twisted.python.compat import unicode
 
 from landscape.lib import testing
+from landscape.lib.fetch import ChecksumError
+from landscape.lib.fetch import CurlHandle
 from landscape.lib.fetch import fetch
 from landscape.lib.fetch import fetch_async
 from landscape.lib.fetch import fetch_many_async
+from landscape.lib.fetch import fetch_ranges_async
 from landscape.lib.fetch import fetch_to_files
+from landscape.lib.fetch import FetchError
 from landscape.lib.fetch import HTTPCodeError
 from landscape.lib.fetch import PyCurlError
 from landscape.lib.fetch import url_to_filename
@@ -47,6 +58,21 @@ class CurlStub:
         self.performed = True
 
 
+class ReusableCurlStub(CurlStub):
+    def __init__(self, *args, **kwargs):
+        super().__init__(*args, **kwargs)
+        self.resets = 0
+        self.closed = False
+
+    def reset(self):
+        self.options = {}
+        self.performed = False
+        self.resets += 1
+
+    def close(self):
+        self.closed = True
+
+
 class CurlManyStub:
     def __init__(self, url_results):
         self.curls = {}
@@ -94,6 +120,55 @@ class Any:
         return True
 
 
+class FakeRangeServer:
+    """Answer L{fetch_async} calls with ranges of the given content."""
+
+    def __init__(self, content, ranges=True, checksum=None, etag=None):
+        self.content = content
+        self.ranges = ranges
+        self.checksum = checksum
+        self.etag = etag
+        self.calls = []
+        self.if_ranges = []
+
+    def fetch_async(
+        self,
+        url,
+        byte_range=None,
+        header=None,
+        headers=None,
+        **kwargs,
+    ):
+        self.calls.append((url, byte_range))
+        if url.endswith(".sha256"):
+            if self.checksum is None:
+                return fail(HTTPCodeError(404, b""))
+            if isinstance(self.checksum, Exception):
+                return fail(self.checksum)
+            return succeed(self.checksum)
+        if_range = (headers or {}).get("If-Range")
+        self.if_ranges.append(if_range)
+        if not self.ranges or (if_range and if_range != self.etag):
+            self._send_headers(header, 200)
+            if byte_range[0] > 0:
+                return fail(HTTPCodeError(200, self.content))
+            return succeed(self.content)
+        start, end = byte_range
+        if start >= len(self.content):
+            self._send_headers(header, 416)
+            return fail(HTTPCodeError(416, b""))
+        self._send_headers(header, 206)
+        return succeed(self.content[start : end + 1])
+
+    def _send_headers(self, header, http_code):
+        if header is None:
+            return
+        header(f"HTTP/1.1 {http_code} Whatever\r\n".encode("ascii"))
+        if self.etag is not None:
+            header(f"ETag: {self.etag}\r\n".encode("ascii"))
+        header(b"\r\n")
+
+
 class FetchTest(
     testing.FSTestCase,
     testing.TwistedTestCase,
@@ -159,11 +234,96 @@ class FetchTest(
                 pycurl.POST: True,
                 pycurl.POSTFIELDSIZE: 4,
                 pycurl.READFUNCTION: Any(),
+                pycurl.SEEKFUNCTION: Any(),
                 pycurl.DNS_CACHE_TIMEOUT: 0,
                 pycurl.ENCODING: b"gzip,deflate",
             },
         )
 
+    def test_post_data_chunks(self):
+        """
+        The POST content can be a sequence of chunks, they're streamed to
+        curl without being joined first.
+        """
+        curl = CurlStub(b"result")
+        result = fetch(
+            "http://example.com",
+            post=True,
+            data=[b"da", b"", b"ta"],
+            curl=curl,
+        )
+        self.assertEqual(result, b"result")
+        self.assertEqual(curl.options[pycurl.POSTFIELDSIZE], 4)
+        read = curl.options[pycurl.READFUNCTION]
+        self.assertEqual(read(3), b"dat")
+        self.assertEqual(read(3), b"a")
+        self.assertEqual(read(3), b"")
+
+    def test_post_data_rewind(self):
+        """
+        Curl can rewind the POST content to the start, or to any offset
+        from it, to send it again.
+        """
+        curl = CurlStub(b"result")
+        fetch(
+            "http://example.com",
+            post=True,
+            data=[b"da", b"ta"],
+            curl=curl,
+        )
+        read = curl.options[pycurl.READFUNCTION]
+        seek = curl.options[pycurl.SEEKFUNCTION]
+        self.assertEqual(read(3), b"dat")
+        self.assertEqual(seek(0, os.SEEK_SET), pycurl.SEEKFUNC_OK)
+        self.assertEqual(read(10), b"data")
+        self.assertEqual(seek(3, os.SEEK_SET), pycurl.SEEKFUNC_OK)
+        self.assertEqual(read(10), b"a")
+        self.assertEqual(seek(0, os.SEEK_CUR), pycurl.SEEKFUNC_CANTSEEK)
+
+    def test_post_data_iterator(self):
+        """
+        The chunks of the POST content can come from any iterable, they're
+        taken from it once.
+        """
+
+        def chunks():
+            yield from (b"da", b"", b"ta")
+
+        curl = CurlStub(b"result")
+        fetch("http://example.com", post=True, data=chunks(), curl=curl)
+        self.assertEqual(curl.options[pycurl.POSTFIELDSIZE], 4)
+        read = curl.options[pycurl.READFUNCTION]
+        self.assertEqual(read(1), b"d")
+        self.assertEqual(read(3), b"ata")
+        self.assertEqual(read(3), b"")
+
+    def test_write(self):
+        """
+        If a write function is passed, it gets the content instead of it
+        being returned.
+        """
+        chunks = []
+        curl = CurlStub(b"result")
+        result = fetch("http://example.com", curl=curl, write=chunks.append)
+        self.assertEqual(result, b"")
+        self.assertEqual(chunks, [b"result"])
+
+    def test_write_error(self):
+        """
+        The body of an error response isn't passed to the write function,
+        it's kept for the L{HTTPCodeError}.
+        """
+        chunks = []
+        curl = CurlStub(b"result", infos={pycurl.HTTP_CODE: 500})
+        try:
+            fetch("http://example.com", curl=curl, write=chunks.append)
+        except HTTPCodeError as error:
+            self.assertEqual(error.http_code, 500)
+            self.assertEqual(error.body, b"result")
+        else:
+            self.fail("HTTPCodeError not raised")
+        self.assertEqual(chunks, [])
+
     def test_cainfo(self):
         curl = CurlStub(b"result")
         result = fetch("https://example.com", cainfo="cainfo", curl=curl)
@@ -262,6 +422,32 @@ class FetchTest(
         else:
             self.fail("HTTPCodeError not raised")
 
+    def test_byte_range(self):
+        """
+        With a C{byte_range}, only that range is requested, and the server
+        answers with a 206 code.
+        """
+        curl = CurlStub(b"result", {pycurl.HTTP_CODE: 206})
+        result = fetch("http://example.com", curl=curl, byte_range=(10, 19))
+        self.assertEqual(result, b"result")
+        self.assertEqual(curl.options[pycurl.RANGE], b"10-19")
+
+    def test_byte_range_whole_content(self):
+        """
+        If the server sends the whole content rather than a range starting
+        past the beginning, an L{HTTPCodeError} is raised.
+        """
+        curl = CurlStub(b"result", {pycurl.HTTP_CODE: 200})
+        self.assertEqual(
+            fetch("http://example.com", curl=curl, byte_range=(0, 9)),
+            b"result",
+        )
+        curl = CurlStub(b"result", {pycurl.HTTP_CODE: 200})
+        with self.assertRaises(HTTPCodeError) as context:
+            fetch("http://example.com", curl=curl, byte_range=(10, 19))
+        self.assertEqual(context.exception.http_code, 200)
+        self.assertEqual(context.exception.body, b"result")
+
     def test_http_error_str(self):
         self.assertEqual(
             str(HTTPCodeError(501, "")),
@@ -380,6 +566,65 @@ class FetchTest(
             },
         )
 
+    def test_fetch_with_handle(self):
+        """
+        If a L{CurlHandle} is given, the request is made with its curl
+        handle, which is reset and reused by the following requests.
+        """
+        curls = []
+
+        def pycurl_curl():
+            curl = ReusableCurlStub(b"result")
+            curls.append(curl)
+            return curl
+
+        self.addCleanup(setattr, pycurl, "Curl", pycurl.Curl)
+        pycurl.Curl = pycurl_curl
+        handle = CurlHandle()
+        self.assertEqual(fetch("http://example.com", handle=handle), b"result")
+        self.assertEqual(fetch("http://example.com", handle=handle), b"result")
+        [curl] = curls
+        self.assertEqual(curl.resets, 1)
+        self.assertFalse(curl.closed)
+        handle.close()
+        self.assertTrue(curl.closed)
+
+    def test_curl_handle_in_use(self):
+        """
+        While the curl handle of a L{CurlHandle} is in use, requests get a
+        new one, closed once they're done.
+        """
+        curls = []
+
+        def pycurl_curl():
+            curl = ReusableCurlStub(b"result")
+            curls.append(curl)
+            return curl
+
+        self.addCleanup(setattr, pycurl, "Curl", pycurl.Curl)
+        pycurl.Curl = pycurl_curl
+        handle = CurlHandle()
+        curl = handle.acquire()
+        other_curl = handle.acquire()
+        self.assertIsNot(curl, other_curl)
+        handle.release(other_curl)
+        self.assertTrue(other_curl.closed)
+        handle.release(curl)
+        self.assertFalse(curl.closed)
+        self.assertIs(handle.acquire(), curl)
+
+    def test_curl_handle_http2(self):
+        """A L{CurlHandle} can negotiate HTTP/2 with HTTPS servers."""
+        if not hasattr(pycurl, "CURL_HTTP_VERSION_2TLS"):
+            self.skipTest("HTTP/2 isn't supported by this pycurl.")
+        self.addCleanup(setattr, pycurl, "Curl", pycurl.Curl)
+        pycurl.Curl = ReusableCurlStub
+        curl = CurlHandle(http2=True).acquire()
+        self.assertEqual(
+            curl.options[pycurl.HTTP_VERSION],
+            pycurl.CURL_HTTP_VERSION_2TLS,
+        )
+
     def test_async_fetch(self):
         curl = CurlStub(b"result")
         d = fetch_async("http://example.com/", curl=curl)
@@ -584,3 +829,420 @@ class FetchTest(
 
         result.addErrback(check_error)
         return result
+
+
+class ClosingRequestHandler(BaseHTTPRequestHandler):
+    """
+    Echo the POST content back, on kept alive connections, except for the
+    second request which gets its connection closed without an answer.
+    """
+
+    protocol_version = "HTTP/1.1"
+
+    def do_POST(self):  # noqa: N802
+        content = self.rfile.read(int(self.headers["Content-Length"]))
+        self.server.requests += 1
+        if self.server.requests == 2:
+            self.close_connection = True
+            return
+        self.send_response(200)
+        self.send_header("Content-Length", str(len(content)))
+        self.end_headers()
+        self.wfile.write(content)
+
+    def log_message(self, format, *args):
+        pass
+
+
+class FetchServerTest(unittest.TestCase):
+    def setUp(self):
+        super().setUp()
+        server = ThreadingHTTPServer(("127.0.0.1", 0), ClosingRequestHandler)
+        server.requests = 0
+        thread = Thread(target=server.serve_forever)
+        thread.start()
+        self.addCleanup(thread.join)
+        self.addCleanup(server.server_close)
+        self.addCleanup(server.shutdown)
+        self.server = server
+        self.url = f"http://127.0.0.1:{server.server_port:d}/"
+
+    def test_post_on_closed_connection(self):
+        """
+        When the server closed the connection kept alive by a L{CurlHandle}
+        the POST content is rewound and sent again on a new connection.
+        """
+        handle = CurlHandle()
+        self.addCleanup(handle.close)
+        result = fetch(self.url, post=True, data=[b"first"], handle=handle)
+        self.assertEqual(result, b"first")
+        result = fetch(
+            self.url,
+            post=True,
+            data=[b"sec", b"ond"],
+            handle=handle,
+        )
+        self.assertEqual(result, b"second")
+        self.assertEqual(self.server.requests, 3)
+
+
+class FetchRangesTest(
+    testing.FSTestCase,
+    testing.TwistedTestCase,
+    unittest.TestCase,
+):
+    def setUp(self):
+        super().setUp()
+        self.filename = os.path.join(self.makeDir(), "file")
+        self.url = "http://example.com/file"
+
+    def fetch_ranges(self, server, **kwargs):
+        patcher = mock.patch(
+            "landscape.lib.fetch.fetch_async",
+            side_effect=server.fetch_async,
+        )
+        patcher.start()
+        self.addCleanup(patcher.stop)
+        return fetch_ranges_async(self.url, self.filename, **kwargs)
+
+    def test_fetch_ranges(self):
+        """
+        L{fetch_ranges_async} fetches the first range alone, and then the
+        next ones C{parts} at a time, until they go past the end of the
+        content.
+        """
+        server = FakeRangeServer(b"0123456789")
+        result = self.fetch_ranges(server, part_size=4, parts=2)
+        self.assertEqual(self.filename, self.successResultOf(result))
+        self.assertEqual(
+            [
+                (self.url, (0, 3)),
+                (self.url, (4, 7)),
+                (self.url, (8, 11)),
+            ],
+            server.calls,
+        )
+        with open(self.filename, "rb") as fd:
+            self.assertEqual(b"0123456789", fd.read())
+        self.assertFalse(os.path.exists(self.filename + ".parts"))
+
+    def test_fetch_ranges_multiple_of_part_size(self):
+        """
+        If the content ends with a range, the server answers the following
+        ones with a 416 code.
+        """
+        server = FakeRangeServer(b"01234567")
+        result = self.fetch_ranges(server, part_size=4, parts=2)
+        self.successResultOf(result)
+        self.assertEqual(
+            [
+                (self.url, (0, 3)),
+                (self.url, (4, 7)),
+                (self.url, (8, 11)),
+            ],
+            server.calls,
+        )
+        with open(self.filename, "rb") as fd:
+            self.assertEqual(b"01234567", fd.read())
+
+    def make_parts(self, parts, validator=None):
+        """Make the ranges of an earlier download."""
+        directory = self.filename + ".parts"
+        os.mkdir(directory)
+        for index, data in enumerate(parts):
+            with open(os.path.join(directory, str(index)), "wb") as fd:
+                fd.write(data)
+        if validator is not None:
+            with open(os.path.join(directory, "validator"), "w") as fd:
+                fd.write(validator)
+
+    def test_fetch_ranges_resume(self):
+        """
+        The ranges fetched by an earlier download aren't fetched again, the
+        next ones are fetched if the content still has the same validator.
+        """
+        self.make_parts([b"0123"], validator='"v1"')
+        server = FakeRangeServer(b"0123456789", etag='"v1"')
+        result = self.fetch_ranges(server, part_size=4, parts=4)
+        self.successResultOf(result)
+        self.assertEqual(
+            [
+                (self.url, (4, 7)),
+                (self.url, (8, 11)),
+                (self.url, (12, 15)),
+                (self.url, (16, 19)),
+            ],
+            server.calls,
+        )
+        self.assertEqual(['"v1"'] * 4, server.if_ranges)
+        with open(self.filename, "rb") as fd:
+            self.assertEqual(b"0123456789", fd.read())
+
+    def test_fetch_ranges_resume_without_validator(self):
+        """
+        The ranges of an earlier download without a validator are fetched
+        again, they could be of another version of the content.
+        """
+        self.make_parts([b"abcd"])
+        server = FakeRangeServer(b"0123456789")
+        result = self.fetch_ranges(server, part_size=4, parts=2)
+        self.successResultOf(result)
+        self.assertEqual((self.url, (0, 3)), server.calls[0])
+        with open(self.filename, "rb") as fd:
+            self.assertEqual(b"0123456789", fd.read())
+
+    def test_fetch_ranges_resume_changed(self):
+        """
+        If the content changed since an earlier download, the server sends
+        the new content whole in response to the C{If-Range} header, and it
+        replaces the ranges.
+        """
+        self.make_parts([b"abcd"], validator='"v1"')
+        server = FakeRangeServer(b"0123456789", etag='"v2"')
+        result = self.fetch_ranges(server, part_size=4, parts=2)
+        self.successResultOf(result)
+        self.assertEqual(
+            [(self.url, (4, 7)), (self.url, (8, 11))],
+            server.calls,
+        )
+        self.assertEqual('"v1"', server.if_ranges[0])
+        with open(self.filename, "rb") as fd:
+            self.assertEqual(b"0123456789", fd.read())
+
+    def test_fetch_ranges_whole_first_part_replaces_ranges(self):
+        """
+        If the server sends the whole content for the first range, it
+        replaces the ranges of an earlier download, even when it's exactly
+        one range long.
+        """
+        self.make_parts([b"", b"4567"], validator='"v1"')
+        os.unlink(os.path.join(self.filename + ".parts", "0"))
+        server = FakeRangeServer(b"0123", etag='"v2"')
+        result = self.fetch_ranges(server, part_size=4, parts=2)
+        self.successResultOf(result)
+        self.assertEqual([(self.url, (0, 3))], server.calls)
+        with open(self.filename, "rb") as fd:
+            self.assertEqual(b"0123", fd.read())
+
+    def test_fetch_ranges_stores_validator(self):
+        """
+        The validator of the first range is stored with the ranges, and
+        sent in an C{If-Range} header with the next ones.
+        """
+        server = FakeRangeServer(b"0123456789", etag='"v1"')
+        fetch_async = server.fetch_async
+
+        def failing_fetch_async(url, byte_range=None, **kwargs):
+            if byte_range == (8, 11):
+                return fail(HTTPCodeError(503, b""))
+            return fetch_async(url, byte_range=byte_range, **kwargs)
+
+        server.fetch_async = failing_fetch_async
+        result = self.fetch_ranges(server, part_size=4, parts=2)
+        self.failureResultOf(result)
+        self.assertEqual([None, '"v1"'], server.if_ranges)
+        directory = self.filename + ".parts"
+        with open(os.path.join(directory, "validator")) as fd:
+            self.assertEqual('"v1"', fd.read())
+
+    def test_fetch_ranges_last_modified(self):
+        """
+        Without a strong C{ETag}, the C{Last-Modified} date of the content
+        is its validator.
+        """
+        date = "Wed, 14 Oct 2026 10:00:00 GMT"
+        server = FakeRangeServer(b"0123456789")
+        fetch_async = server.fetch_async
+
+        def dated_fetch_async(url, header=None, **kwargs):
+            def dated_header(line):
+                if line == b"\r\n":
+                    header(b'ETag: W/"v1"\r\n')
+                    header(f"Last-Modified: {date}\r\n".encode("ascii"))
+                header(line)
+
+            return fetch_async(url, header=dated_header, **kwargs)
+
+        server.fetch_async = dated_fetch_async
+        result = self.fetch_ranges(server, part_size=4, parts=2)
+        self.successResultOf(result)
+        self.assertEqual([None, date, date], server.if_ranges)
+
+    def test_fetch_ranges_changed_during_download(self):
+        """
+        If a range comes with another validator, despite the C{If-Range}
+        header, the download fails and the ranges are discarded.
+        """
+        server = FakeRangeServer(b"0123456789", etag='"v1"')
+        fetch_async = server.fetch_async
+
+        def changing_fetch_async(url, byte_range=None, **kwargs):
+            if byte_range != (0, 3):
+                # A server ignoring If-Range.
+                server.etag = '"v2"'
+                kwargs.pop("headers", None)
+            return fetch_async(url, byte_range=byte_range, **kwargs)
+
+        server.fetch_async = changing_fetch_async
+        result = self.fetch_ranges(server, part_size=4, parts=2)
+        failure = self.failureResultOf(result)
+        failure.trap(FetchError)
+        self.assertFalse(os.path.exists(self.filename))
+        self.assertEqual([], os.listdir(self.filename + ".parts"))
+
+    def test_fetch_ranges_not_found(self):
+        """
+        If the server says the content isn't there, the download fails and
+        the ranges are discarded.
+        """
+        self.make_parts([b"0123"], validator='"v1"')
+        server = FakeRangeServer(b"0123456789", etag='"v1"')
+        fetch_async = server.fetch_async
+
+        def missing_fetch_async(url, byte_range=None, **kwargs):
+            if byte_range == (8, 11):
+                return fail(HTTPCodeError(404, b""))
+            return fetch_async(url, byte_range=byte_range, **kwargs)
+
+        server.fetch_async = missing_fetch_async
+        result = self.fetch_ranges(server, part_size=4, parts=2)
+        failure = self.failureResultOf(result)
+        failure.trap(HTTPCodeError)
+        self.assertEqual(404, failure.value.http_code)
+        self.assertFalse(os.path.exists(self.filename))
+        self.assertFalse(os.path.exists(self.filename + ".parts"))
+
+    def test_fetch_ranges_error(self):
+        """
+        If a range can't be fetched, the download fails with its error, and
+        the ranges fetched are kept.
+        """
+        server = FakeRangeServer(b"0123456789")
+        fetch_async = server.fetch_async
+
+        def failing_fetch_async(url, byte_range=None, **kwargs):
+            if byte_range == (8, 11):
+                return fail(HTTPCodeError(503, b""))
+            return fetch_async(url, byte_range=byte_range, **kwargs)
+
+        server.fetch_async = failing_fetch_async
+        result = self.fetch_ranges(server, part_size=4, parts=2)
+        failure = self.failureResultOf(result)
+        failure.trap(HTTPCodeError)
+        self.assertEqual(503, failure.value.http_code)
+        self.assertFalse(os.path.exists(self.filename))
+        self.assertEqual(
+            ["0", "1"],
+            sorted(os.listdir(self.filename + ".parts")),
+        )
+
+    def test_fetch_ranges_not_supported(self):
+        """
+        If the server sends the whole content, rather than the first range,
+        that's all there is to fetch.
+        """
+        server = FakeRangeServer(b"0123456789", ranges=False)
+        result = self.fetch_ranges(server, part_size=4)
+        self.successResultOf(result)
+        self.assertEqual([(self.url, (0, 3))], server.calls)
+        with open(self.filename, "rb") as fd:
+            self.assertEqual(b"0123456789", fd.read())
+
+    def test_fetch_ranges_not_supported_one_part(self):
+        """
+        If the server sends the whole content rather than the first range,
+        that's all there is to fetch, even if it's one range long.
+        """
+        server = FakeRangeServer(b"0123", ranges=False)
+        result = self.fetch_ranges(server, part_size=4, parts=1)
+        self.successResultOf(result)
+        self.assertEqual([(self.url, (0, 3))], server.calls)
+        with open(self.filename, "rb") as fd:
+            self.assertEqual(b"0123", fd.read())
+
+    def test_fetch_ranges_with_checksum(self):
+        """The content is verified against the digest at C{checksum_url}."""
+        checksum = hashlib.sha256(b"0123456789").hexdigest().encode("ascii")
+        server = FakeRangeServer(b"0123456789", checksum=checksum + b"  file")
+        result = self.fetch_ranges(
+            server,
+            part_size=4,
+            checksum_url=self.url + ".sha256",
+        )
+        self.successResultOf(result)
+        self.assertEqual((self.url + ".sha256", None), server.calls[0])
+        with open(self.filename, "rb") as fd:
+            self.assertEqual(b"0123456789", fd.read())
+
+    def test_fetch_ranges_without_checksum(self):
+        """
+        If there's no digest at C{checksum_url}, the content isn't
+        verified.
+        """
+        server = FakeRangeServer(b"0123456789")
+        result = self.fetch_ranges(
+            server,
+            part_size=4,
+            checksum_url=self.url + ".sha256",
+        )
+        self.successResultOf(result)
+        self.assertTrue(os.path.exists(self.filename))
+
+    def test_fetch_ranges_checksum_error(self):
+        """
+        If fetching the digest at C{checksum_url} fails, the content isn't
+        verified.
+        """
+        server = FakeRangeServer(
+            b"0123456789",
+            checksum=PyCurlError(60, "SSL certificate problem"),
+        )
+        with mock.patch("logging.warning") as warning_mock:
+            result = self.fetch_ranges(
+                server,
+                part_size=4,
+                checksum_url=self.url + ".sha256",
+            )
+            self.successResultOf(result)
+        self.assertTrue(os.path.exists(self.filename))
+        warning_mock.assert_called_once()
+
+    def test_fetch_ranges_invalid_checksum(self):
+        """
+        If there's something else than a SHA-256 digest at C{checksum_url},
+        the content isn't verified.
+        """
+        for checksum in (b"<html>Not found</html>", b"", b"f" * 63 + b"g"):
+            server = FakeRangeServer(b"0123456789", checksum=checksum)
+            with mock.patch("logging.warning") as warning_mock:
+                result = self.fetch_ranges(
+                    server,
+                    part_size=4,
+                    checksum_url=self.url + ".sha256",
+                )
+                self.successResultOf(result)
+            with open(self.filename, "rb") as fd:
+                self.assertEqual(b"0123456789", fd.read())
+            warning_mock.assert_called_once()
+
+    def test_fetch_ranges_with_checksum_mismatch(self):
+        """
+        If the content doesn't match its digest, the download fails with a
+        L{ChecksumError} and the ranges are discarded.
+        """
+        checksum = hashlib.sha256(b"something else").hexdigest()
+        server = FakeRangeServer(b"0123456789", checksum=checksum.encode())
+        result = self.fetch_ranges(
+            server,
+            part_size=4,
+            checksum_url=self.url + ".sha256",
+        )
+        failure = self.failureResultOf(result)
+        failure.trap(ChecksumError)
+        self.assertEqual(checksum, failure.value.expected)
+        self.assertEqual(
+            hashlib.sha256(b"0123456789").hexdigest(),
+            failure.value.actual,
+        )
+        self.assertFalse(os.path.exists(self.filename))
+        self.assertFalse(os.path.exists(self.filename + ".parts"))
@@ -1,10 +1,14 @@
 import unittest
+from unittest import mock
 
 from landscape.lib import testing
 from landscape.lib.monitor import BurstMonitor
 from landscape.lib.monitor import CoverageMonitor
 from landscape.lib.monitor import FrequencyMonitor
+from landscape.lib.monitor import HealthStats
+from landscape.lib.monitor import Histogram
 from landscape.lib.monitor import Monitor
+from landscape.lib.monitor import PhaseTimer
 from landscape.lib.monitor import Timer
 
 
@@ -40,6 +44,36 @@ class TimerTest(ReactorHavingTest):
         self.assertEqual(self.timer.since_start(), 4.0)
 
 
+class PhaseTimerTest(ReactorHavingTest):
+    def setUp(self):
+        super().setUp()
+        self.timer = PhaseTimer("Startup", create_time=self.reactor.time)
+
+    def test_phase(self):
+        """Each phase is timed from the end of the previous one."""
+        self.reactor.advance(1)
+        self.timer.phase("configuration")
+        self.reactor.advance(2.5)
+        self.timer.phase("initialization")
+        self.assertEqual(
+            self.timer.phases,
+            [("configuration", 1.0), ("initialization", 2.5)],
+        )
+
+    def test_log(self):
+        self.reactor.advance(1)
+        self.timer.phase("configuration")
+        self.reactor.advance(2)
+        self.timer.phase("start")
+        with mock.patch("time.process_time", return_value=4):
+            self.timer.log()
+        self.assertIn(
+            "Startup took 3.00s (configuration 1.00s, start 2.00s), "
+            "using 4.00s of CPU time.",
+            self.logfile.getvalue(),
+        )
+
+
 class MonitorTest(ReactorHavingTest):
     def setUp(self):
         super().setUp()
@@ -77,6 +111,93 @@ class MonitorTest(ReactorHavingTest):
         )
 
 
+class HistogramTest(ReactorHavingTest):
+    def setUp(self):
+        super().setUp()
+        self.histogram = Histogram("test", create_time=self.reactor.time)
+
+    def test_record(self):
+        """
+        Values are counted in the bucket of the lowest power of two above
+        them, or in the 0 one if they aren't positive.
+        """
+        for value in (0.3, 0.4, 1, 3, 0):
+            self.histogram.record(value)
+        self.assertEqual(
+            self.histogram.get_summary(),
+            {
+                "count": 5,
+                "sum": 4.7,
+                "min": 0,
+                "max": 3,
+                "buckets": [(0.0, 1), (0.5, 2), (2.0, 1), (4.0, 1)],
+            },
+        )
+
+    def test_reset(self):
+        self.histogram.record(3)
+        self.histogram.reset()
+        self.histogram.record(1)
+        self.assertEqual(
+            self.histogram.get_summary(),
+            {"count": 1, "sum": 1, "min": 1, "max": 1, "buckets": [(2.0, 1)]},
+        )
+        self.assertEqual(self.histogram.total_count, 2)
+
+
+class HealthStatsTest(ReactorHavingTest):
+    def setUp(self):
+        super().setUp()
+        self.stats = HealthStats(create_time=self.reactor.time)
+
+    def test_get_summary(self):
+        """
+        The summary has the histograms which recorded values since the
+        last reset, and the values.
+        """
+        self.stats.record("size", 100)
+        self.stats.set("code", 3)
+        self.reactor.advance(10)
+        self.assertEqual(
+            self.stats.get_summary(),
+            {
+                "period": 10,
+                "histograms": {
+                    "size": {
+                        "count": 1,
+                        "sum": 100,
+                        "min": 100,
+                        "max": 100,
+                        "buckets": [(128.0, 1)],
+                    },
+                },
+                "values": {"code": 3},
+            },
+        )
+
+    def test_reset(self):
+        """The histograms are reset, the values are kept."""
+        self.stats.record("size", 100)
+        self.stats.set("code", 3)
+        self.reactor.advance(10)
+        self.stats.reset()
+        self.assertEqual(
+            self.stats.get_summary(),
+            {"period": 0, "histograms": {}, "values": {"code": 3}},
+        )
+
+    def test_timed(self):
+        """The time taken by a C{with} block is recorded, even if it fails."""
+        with self.stats.timed("time"):
+            self.reactor.advance(2)
+        with self.assertRaises(ZeroDivisionError):
+            with self.stats.timed("time"):
+                self.reactor.advance(3)
+                1 / 0
+        summary = self.stats.get_summary()["histograms"]["time"]
+        self.assertEqual((summary["count"], summary["sum"]), (2, 5))
+
+
 class BurstMonitorTest(ReactorHavingTest):
     def setUp(self):
         super().setUp()
@@ -3,6 +3,7 @@ import pprint
 import unittest
 
 from landscape.lib import testing
+from landscape.lib.persist import JournalBackend
 from landscape.lib.persist import path_string_to_tuple
 from landscape.lib.persist import path_tuple_to_string
 from landscape.lib.persist import Persist
@@ -32,6 +33,13 @@ class PersistHelpersTest(unittest.TestCase):
     def test_path_string_to_tuple_error(self):
         self.assertRaises(PersistError, path_string_to_tuple, "ab[0][c]")
 
+    def test_path_string_to_tuple_cached(self):
+        """Parsed paths are cached, as the same few paths get used a lot."""
+        path_string_to_tuple.cache_clear()
+        path_string_to_tuple("ab.cd[1]")
+        path_string_to_tuple("ab.cd[1]")
+        self.assertEqual(path_string_to_tuple.cache_info().hits, 1)
+
     def test_path_tuple_to_string(self):
         for path_string, path_tuple in self.paths:
             self.assertEqual(path_tuple_to_string(path_tuple), path_string)
@@ -464,6 +472,137 @@ class PicklePersistTest(GeneralPersistTest, SaveLoadPersistTest):
         return Persist(PickleBackend(), *args, **kwargs)
 
 
+class JournalPersistTest(GeneralPersistTest, SaveLoadPersistTest):
+    def build_persist(self, *args, **kwargs):
+        return Persist(JournalBackend(), *args, **kwargs)
+
+    def save_and_reload(self, filename):
+        self.persist.save(filename)
+        persist = self.build_persist()
+        persist.load(filename)
+        return persist
+
+    def test_save_appends_changes(self):
+        """
+        Once saved, saving the persist again only appends what changed to
+        a journal, leaving the saved map untouched.
+        """
+        filename = self.makePersistFile()
+        self.persist.set("a.b", 1)
+        self.persist.set("c", 2)
+        self.persist.save(filename)
+        with open(filename, "rb") as fd:
+            content = fd.read()
+        self.persist.set("a.d", 3)
+        self.persist.save(filename)
+        with open(filename, "rb") as fd:
+            self.assertEqual(fd.read(), content)
+        self.assertTrue(os.path.exists(filename + ".journal"))
+        self.assertFalse(os.path.exists(filename + ".old"))
+
+        persist = self.build_persist()
+        persist.load(filename)
+        self.assertEqual(persist.get("a"), {"b": 1, "d": 3})
+        self.assertEqual(persist.get("c"), 2)
+
+    def test_save_appends_removals(self):
+        """
+        Removing a path is journaled too, and drops the parents it leaves
+        empty, as L{Persist.remove} does.
+        """
+        filename = self.makePersistFile()
+        self.persist.set("a.b.c", 1)
+        self.persist.set("d", 2)
+        self.persist.save(filename)
+        self.persist.remove("a.b.c")
+        self.persist.remove("d")
+        persist = self.save_and_reload(filename)
+        self.assertEqual(persist.get(".", hard=True), {})
+
+    def test_save_appends_list_changes(self):
+        """Changing a list element journals the whole list."""
+        filename = self.makePersistFile()
+        self.persist.add("a.b", 1)
+        self.persist.save(filename)
+        self.persist.add("a.b", 2)
+        self.persist.set("a.b[0]", 0)
+        persist = self.save_and_reload(filename)
+        self.assertEqual(persist.get("a.b"), [0, 2])
+
+    def test_save_to_another_file(self):
+        """Saving to another file saves the whole map there."""
+        filename = self.makePersistFile()
+        other_filename = self.makePersistFile()
+        self.persist.set("a", 1)
+        self.persist.save(filename)
+        self.persist.set("b", 2)
+        self.persist.save(other_filename)
+        self.assertFalse(os.path.exists(other_filename + ".journal"))
+
+        persist = self.build_persist()
+        persist.load(other_filename)
+        self.assertEqual(persist.get(".", hard=True), {"a": 1, "b": 2})
+
+    def test_save_compacts_journal(self):
+        """
+        Once the journal is bigger than the saved map, the whole map is
+        saved again, and the journal of the previous one is kept with its
+        backup.
+        """
+        filename = self.makePersistFile()
+        self.persist._backend = JournalBackend(min_journal_size=0)
+        self.persist.set("a", 1)
+        self.persist.save(filename)
+        for i in range(10):
+            self.persist.set("b", "x" * 10 + str(i))
+            self.persist.save(filename)
+        self.assertLess(
+            os.path.getsize(filename + ".journal"),
+            os.path.getsize(filename) * 2,
+        )
+        persist = self.build_persist()
+        persist.load(filename)
+        self.assertEqual(persist.get("b"), "x" * 10 + "9")
+
+    def test_load_with_partial_journal(self):
+        """
+        A record partly written to the journal, because a save was
+        interrupted, is ignored like the rest of that save.
+        """
+        filename = self.makePersistFile()
+        self.persist.save(filename)
+        self.persist.set("a", 1)
+        self.persist.save(filename)
+        self.persist.set("b", "value")
+        self.persist.save(filename)
+        with open(filename + ".journal", "rb+") as fd:
+            fd.truncate(os.path.getsize(filename + ".journal") - 2)
+        persist = self.build_persist()
+        persist.load(filename)
+        self.assertEqual(persist.get(".", hard=True), {"a": 1})
+
+    def test_plain_backend_reads_journal(self):
+        """
+        The journal is read by a plain L{Persist} too, which merges it in
+        the map when it saves it.
+        """
+        filename = self.makePersistFile()
+        self.persist.set("a", 1)
+        self.persist.save(filename)
+        self.persist.set("b", 2)
+        self.persist.save(filename)
+
+        persist = Persist(filename=filename)
+        self.assertEqual(persist.get("b"), 2)
+        persist.set("c", 3)
+        persist.save()
+        self.assertFalse(os.path.exists(filename + ".journal"))
+
+        persist = self.build_persist()
+        persist.load(filename)
+        self.assertEqual(persist.get(".", hard=True), {"a": 1, "b": 2, "c": 3})
+
+
 class RootedPersistTest(GeneralPersistTest):
     def build_persist(self, *args, **kwargs):
         return RootedPersist(Persist(), "root.path", *args, **kwargs)
@@ -3,9 +3,17 @@ import unittest
 from unittest import mock
 
 from landscape.lib import testing
+from landscape.lib.fs import create_binary_file
 from landscape.lib.fs import create_text_file
 from landscape.lib.process import calculate_pcpu
+from landscape.lib.process import make_process_info
 from landscape.lib.process import ProcessInformation
+from landscape.lib.testing import ProcessDataBuilder
+
+try:
+    from landscape.lib import _procscan
+except ImportError:
+    _procscan = None
 
 
 class ProcessInfoTest(testing.FSTestCase, unittest.TestCase):
@@ -133,6 +141,170 @@ class ProcessInfoTest(testing.FSTestCase, unittest.TestCase):
         self.assertEqual(b"t", info2["state"])
 
 
+class ProcessRecordsTest(testing.FSTestCase, unittest.TestCase):
+    """Tests for get_process_records, with the pure Python scanner."""
+
+    scan = None
+
+    def setUp(self):
+        super().setUp()
+        self.proc_dir = self.makeDir()
+        self.builder = ProcessDataBuilder(self.proc_dir)
+        patcher = mock.patch("landscape.lib.process._scan_proc_dir", self.scan)
+        patcher.start()
+        self.addCleanup(patcher.stop)
+        self.process_info = ProcessInformation(
+            self.proc_dir,
+            jiffies=10,
+            boot_time=1000,
+            uptime=400,
+        )
+
+    def test_get_process_records(self):
+        """
+        C{get_process_records} returns the same information as
+        C{get_all_process_info}, as compact records.
+        """
+        self.builder.create_data(
+            1,
+            self.builder.RUNNING,
+            uid=0,
+            gid=0,
+            process_name="init",
+        )
+        self.builder.create_data(
+            42,
+            self.builder.TRACING_STOP,
+            uid=1000,
+            gid=2000,
+            started_after_boot=1000,
+            process_name="blargh",
+            vmsize=4242,
+        )
+        self.builder.create_data(
+            43,
+            self.builder.SLEEPING,
+            uid=1000,
+            gid=2000,
+            process_name="blarpy",
+            generate_cmd_line=False,
+            stat_data=(
+                "43 (blarpy (x) y) S 1 0 0 0 0 0 0 0 0 0 "
+                "50 50 0 0 0 0 0 0 2000 0"
+            ),
+        )
+        records = self.process_info.get_process_records()
+        self.assertEqual(
+            records,
+            {
+                1: ("init", b"R", 0, 0, 11676, 1000, 0.0),
+                42: ("blargh", b"t", 1000, 2000, 4242, 1100, 0.0),
+                43: ("blarpy", b"S", 1000, 2000, 11676, 1200, 5.0),
+            },
+        )
+        self.assertEqual(
+            [make_process_info(pid, records[pid]) for pid in sorted(records)],
+            sorted(
+                self.process_info.get_all_process_info(),
+                key=lambda info: info["pid"],
+            ),
+        )
+
+    def test_get_process_records_without_vm_size(self):
+        """
+        Kernel threads have no C{VmSize}, and their records have C{None}
+        instead, which is left out of their process info.
+        """
+        os.mkdir(os.path.join(self.proc_dir, "2"))
+        create_text_file(os.path.join(self.proc_dir, "2", "cmdline"), "")
+        create_text_file(
+            os.path.join(self.proc_dir, "2", "status"),
+            "Name:\tkthreadd\nState:\tS (sleeping)\nUid:\t0\t0\nGid:\t0\t0\n",
+        )
+        create_text_file(
+            os.path.join(self.proc_dir, "2", "stat"),
+            "2 (kthreadd) S " + "0 " * 19,
+        )
+        records = self.process_info.get_process_records()
+        self.assertEqual(records, {2: ("kthreadd", b"S", 0, 0, None, 1000, 0)})
+        self.assertNotIn("vm-size", make_process_info(2, records[2]))
+
+    def test_get_process_records_name(self):
+        """
+        The process name is the base name of its first argument, stripped,
+        or the name in its status file if it has no command line.
+        """
+        self.builder.create_data(
+            1,
+            self.builder.RUNNING,
+            uid=0,
+            gid=0,
+            process_name="name",
+        )
+        create_binary_file(
+            os.path.join(self.proc_dir, "1", "cmdline"),
+            b"/usr/bin/ caf\xc3\xa9 \n\0--option\0",
+        )
+        records = self.process_info.get_process_records()
+        self.assertEqual(records[1][0], "caf\xe9")
+
+    def test_get_process_records_skips_invalid(self):
+        """
+        Directories which aren't process ids, and processes which went
+        away or whose files can't be parsed, are skipped.
+        """
+        self.builder.create_data(
+            1,
+            self.builder.RUNNING,
+            uid=0,
+            gid=0,
+            process_name="init",
+        )
+        self.builder.create_data(
+            2,
+            self.builder.RUNNING,
+            uid=0,
+            gid=0,
+            process_name="short",
+            stat_data="2 (short) R 1 0",
+        )
+        os.mkdir(os.path.join(self.proc_dir, "3"))
+        os.mkdir(os.path.join(self.proc_dir, "self"))
+        records = self.process_info.get_process_records()
+        self.assertEqual(list(records), [1])
+
+    def test_get_process_records_without_boot_time(self):
+        """
+        Without a boot time the processes start times can't be reported,
+        and no records are returned.
+        """
+        self.builder.create_data(
+            1,
+            self.builder.RUNNING,
+            uid=0,
+            gid=0,
+            process_name="init",
+        )
+        self.process_info._boot_time = None
+        with mock.patch("logging.warning") as warning_mock:
+            self.assertEqual(self.process_info.get_process_records(), {})
+        warning_mock.assert_called_once_with(
+            "Skipping %d processes without boot time.",
+            1,
+        )
+
+
+@unittest.skipIf(_procscan is None, "_procscan accelerator not built")
+class NativeProcessRecordsTest(ProcessRecordsTest):
+    """Tests for get_process_records, with the native scanner."""
+
+    scan = staticmethod(_procscan.scan) if _procscan else None
+
+    def test_scan_missing_directory(self):
+        """Scanning a directory which doesn't exist raises an OSError."""
+        self.assertRaises(OSError, _procscan.scan, self.makeFile())
+
+
 class CalculatePCPUTest(unittest.TestCase):
 
     """
@@ -2,9 +2,14 @@ import time
 import types
 import unittest
 
+from twisted.internet.defer import Deferred
+from twisted.internet.task import Clock
+from twisted.internet.task import LoopingCall
+
 from landscape.lib import testing
 from landscape.lib.compat import thread
 from landscape.lib.reactor import EventHandlingReactor
+from landscape.lib.reactor import TimerCoalescer
 from landscape.lib.testing import FakeReactor
 
 
@@ -458,3 +463,184 @@ class EventHandlingReactorTest(
     def test_real_time(self):
         reactor = self.get_reactor()
         self.assertTrue(reactor.time() - time.time() < 3)
+
+
+class TimerCoalescerTest(testing.HelperTestCase, unittest.TestCase):
+    def setUp(self):
+        super().setUp()
+        self.clock = Clock()
+        self.coalescer = TimerCoalescer(
+            self.clock.callLater,
+            self.clock.seconds,
+            10,
+        )
+
+    def test_call_later(self):
+        """
+        The calls due in the same slack window run at its end, from a
+        single timer.
+        """
+        called = []
+        self.coalescer.call_later(3, called.append, "first")
+        self.coalescer.call_later(7, called.append, "second")
+        self.coalescer.call_later(12, called.append, "third")
+        self.assertEqual(len(self.clock.getDelayedCalls()), 2)
+        self.clock.advance(9)
+        self.assertEqual(called, [])
+        self.clock.advance(1)
+        self.assertEqual(called, ["first", "second"])
+        self.clock.advance(10)
+        self.assertEqual(called, ["first", "second", "third"])
+        self.assertEqual(self.clock.getDelayedCalls(), [])
+
+    def test_call_every(self):
+        """
+        Repeated calls with different intervals run together once they're
+        due in the same window.
+        """
+        called = []
+        self.coalescer.call_every(10, called.append, "ten")
+        self.coalescer.call_every(20, called.append, "twenty")
+        self.clock.pump([10, 10, 10, 10])
+        self.assertEqual(
+            called,
+            ["ten", "twenty", "ten", "ten", "twenty", "ten"],
+        )
+        self.assertEqual(len(self.clock.getDelayedCalls()), 2)
+
+    def test_cancel(self):
+        """
+        A cancelled call isn't run, and the timer of its window is cancelled
+        with the last of its calls.
+        """
+        called = []
+        call = self.coalescer.call_every(5, called.append, "every")
+        other = self.coalescer.call_later(5, called.append, "later")
+        call.cancel()
+        self.assertTrue(other.active())
+        other.cancel()
+        self.assertFalse(call.active())
+        self.assertEqual(self.clock.getDelayedCalls(), [])
+        self.clock.advance(10)
+        self.assertEqual(called, [])
+
+    def test_cancel_from_batch(self):
+        """A call cancelled by one run before it in its batch isn't run."""
+        called = []
+        other = None
+
+        def cancel_other():
+            called.append("cancel")
+            other.cancel()
+
+        self.coalescer.call_later(1, cancel_other)
+        other = self.coalescer.call_later(2, called.append, "other")
+        self.clock.advance(10)
+        self.assertEqual(called, ["cancel"])
+
+    def test_call_every_error(self):
+        """
+        A repeated call raising an error is stopped, without stopping the
+        others of its batch.
+        """
+        called = []
+
+        def explode():
+            raise RuntimeError("boom")
+
+        self.log_helper.ignore_errors(RuntimeError)
+        call = self.coalescer.call_every(10, explode)
+        self.coalescer.call_every(10, called.append, "fine")
+        self.clock.pump([10, 10])
+        self.assertFalse(call.active())
+        self.assertEqual(called, ["fine", "fine"])
+        self.assertIn("boom", self.logfile.getvalue())
+
+    def test_call_every_deferred_error(self):
+        """
+        A repeated call whose deferred fails is stopped, and the failure
+        is logged rather than left unhandled.
+        """
+        deferreds = []
+
+        def run():
+            deferreds.append(Deferred())
+            return deferreds[-1]
+
+        self.log_helper.ignore_errors(RuntimeError)
+        call = self.coalescer.call_every(10, run)
+        self.clock.advance(10)
+        deferreds[0].errback(RuntimeError("boom"))
+        self.clock.pump([10, 10])
+        self.assertFalse(call.active())
+        self.assertEqual(1, len(deferreds))
+        self.assertIn("boom", self.logfile.getvalue())
+
+    def test_call_every_deferred(self):
+        """
+        A repeated call returning a deferred is run again once it fired,
+        skipping the runs missed in the meantime.
+        """
+        deferreds = []
+
+        def run():
+            deferreds.append(Deferred())
+            return deferreds[-1]
+
+        self.coalescer.call_every(10, run)
+        self.clock.advance(10)
+        self.clock.pump([10, 10, 5])
+        self.assertEqual(len(deferreds), 1)
+        deferreds[0].callback(None)
+        self.clock.advance(5)
+        self.assertEqual(len(deferreds), 2)
+
+
+class TimerSlackTest(testing.HelperTestCase, unittest.TestCase):
+    def setUp(self):
+        super().setUp()
+        self.reactor = EventHandlingReactor()
+        self.clock = Clock()
+        self.reactor._reactor = self.clock
+        self.reactor.set_timer_slack(10)
+
+    def test_coalesced_calls(self):
+        """
+        With a timer slack, repeated calls and long enough delayed calls
+        are coalesced, the shorter ones are still scheduled on their own.
+        """
+        called = []
+        self.reactor.call_every(10, called.append, "every")
+        self.reactor.call_later(15, called.append, "later")
+        self.reactor.call_later(1, called.append, "soon")
+        self.assertEqual(len(self.clock.getDelayedCalls()), 3)
+        self.clock.advance(1)
+        self.assertEqual(called, ["soon"])
+        self.clock.pump([9, 10])
+        self.assertEqual(called, ["soon", "every", "later", "every"])
+
+    def test_frequent_repeated_calls(self):
+        """
+        Calls repeated more often than the timer slack aren't coalesced,
+        they still run at their own interval.
+        """
+        called = []
+        call = self.reactor.call_every(5, called.append, "every")
+        self.assertIsInstance(call, LoopingCall)
+        self.clock.pump([5, 5, 5])
+        self.assertEqual(called, ["every"] * 3)
+        self.reactor.cancel_call(call)
+
+    def test_cancel_call(self):
+        """Coalesced calls are cancelled with L{cancel_call}."""
+        called = []
+        call = self.reactor.call_every(10, called.append, "every")
+        self.reactor.cancel_call(call)
+        self.clock.advance(10)
+        self.assertEqual(called, [])
+
+    def test_no_timer_slack(self):
+        """Without a timer slack, calls are scheduled on their own."""
+        self.reactor.set_timer_slack(0)
+        call = self.reactor.call_later(15, lambda: None)
+        self.assertIn(call, self.clock.getDelayedCalls())
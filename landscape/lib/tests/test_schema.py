@@ -31,6 +31,40 @@ class BasicTypesTest(unittest.TestCase):
         schema = Any(Constant(None), Unicode())
         self.assertRaises(InvalidError, schema.coerce, object())
 
+    def test_any_only_tries_schemas_for_the_type(self):
+        """
+        L{Any} only tries the schemas declaring the type of the value in
+        their C{types}, and the ones not declaring C{types}.
+        """
+        calls = []
+
+        class Recording:
+            def __init__(self, name, types):
+                self.name = name
+                self.types = types
+
+            def coerce(self, value):
+                calls.append(self.name)
+                raise InvalidError()
+
+        schema = Any(
+            Recording("list", (list,)),
+            Recording("any", None),
+            Int(),
+        )
+        self.assertIsNone(schema.types)
+        self.assertEqual(schema.coerce(True), True)
+        self.assertEqual(calls, ["any"])
+        self.assertRaises(InvalidError, schema.coerce, [])
+        self.assertEqual(calls, ["any", "list", "any"])
+
+    def test_any_types(self):
+        """The C{types} of L{Any} are the ones of its schemas."""
+        schema = Any(Tuple(Int(), Int()), Int())
+        self.assertEqual(schema.types, (tuple, int))
+        self.assertEqual(schema.coerce(3), 3)
+        self.assertEqual(schema.coerce((1, 2)), (1, 2))
+
     def test_constant(self):
         self.assertEqual(Constant("hello").coerce("hello"), "hello")
 
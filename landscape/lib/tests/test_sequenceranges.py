@@ -1,5 +1,6 @@
 import unittest
 
+from landscape.lib import sequenceranges
 from landscape.lib.sequenceranges import add_to_ranges
 from landscape.lib.sequenceranges import find_ranges_index
 from landscape.lib.sequenceranges import ranges_to_sequence
@@ -8,6 +9,11 @@ from landscape.lib.sequenceranges import sequence_to_ranges
 from landscape.lib.sequenceranges import SequenceError
 from landscape.lib.sequenceranges import SequenceRanges
 
+try:
+    from landscape.lib import _sequenceranges
+except ImportError:
+    _sequenceranges = None
+
 
 class SequenceRangesTest(unittest.TestCase):
     def setUp(self):
@@ -83,6 +89,18 @@ class SequenceRangesTest(unittest.TestCase):
         obj.remove(4)
         self.assertEqual(obj.to_ranges(), [])
 
+    def test_union(self):
+        obj = SequenceRanges.from_ranges([1, (5, 7)])
+        other = SequenceRanges.from_ranges([2, 8, 20])
+        self.assertEqual((obj | other).to_ranges(), [1, 2, (5, 8), 20])
+        self.assertEqual(obj.to_ranges(), [1, (5, 7)])
+
+    def test_difference(self):
+        obj = SequenceRanges.from_ranges([1, (5, 9)])
+        other = SequenceRanges.from_ranges([1, 7])
+        self.assertEqual((obj - other).to_ranges(), [5, 6, 8, 9])
+        self.assertEqual(obj.to_ranges(), [1, (5, 9)])
+
 
 class SequenceToRangesTest(unittest.TestCase):
     def test_empty(self):
@@ -294,6 +312,165 @@ class RemoveFromRangesTest(unittest.TestCase):
         self.assertEqual(ranges, [(1, 3), (5, 7)])
 
 
+class BulkRangesTest(unittest.TestCase):
+
+    sequence_to_ranges = staticmethod(sequenceranges.py_sequence_to_ranges)
+    union_ranges = staticmethod(sequenceranges.py_union_ranges)
+    difference_ranges = staticmethod(sequenceranges.py_difference_ranges)
+
+    def test_sequence_to_ranges(self):
+        sequence = [1, 2, 15, 16, 17, 19, 21, 22, 23, 24, 26, 27]
+        self.assertEqual(
+            list(self.sequence_to_ranges(sequence)),
+            [1, 2, (15, 17), 19, (21, 24), 26, 27],
+        )
+
+    def test_sequence_to_ranges_errors(self):
+        with self.assertRaises(SequenceError) as error:
+            list(self.sequence_to_ranges([1, 3, 2]))
+        self.assertEqual(str(error.exception), "Sequence is unordered (2 < 3)")
+        with self.assertRaises(SequenceError) as error:
+            list(self.sequence_to_ranges([1, 2, 2]))
+        self.assertEqual(str(error.exception), "Found duplicated item (2)")
+
+    def test_union_empty(self):
+        self.assertEqual(self.union_ranges([], []), [])
+        self.assertEqual(self.union_ranges([1, (3, 5)], []), [1, (3, 5)])
+        self.assertEqual(self.union_ranges([], [1, (3, 5)]), [1, (3, 5)])
+
+    def test_union_merges_touching(self):
+        self.assertEqual(self.union_ranges([1, 2], [3]), [(1, 3)])
+        self.assertEqual(
+            self.union_ranges([(1, 3), 10], [(4, 6), 8]),
+            [(1, 6), 8, 10],
+        )
+
+    def test_union_overlapping(self):
+        self.assertEqual(
+            self.union_ranges([(1, 10), (20, 30)], [(5, 22), 25, 40]),
+            [(1, 30), 40],
+        )
+
+    def test_union_matches_sequences(self):
+        first = [1, 2, (15, 17), 19, (21, 24), 26, 27]
+        second = [3, (10, 16), 25, (30, 32)]
+        sequence = sorted(
+            set(ranges_to_sequence(first)) | set(ranges_to_sequence(second)),
+        )
+        self.assertEqual(
+            self.union_ranges(first, second),
+            list(sequence_to_ranges(sequence)),
+        )
+
+    def test_difference_empty(self):
+        self.assertEqual(self.difference_ranges([], [1, 2]), [])
+        self.assertEqual(self.difference_ranges([1, (3, 5)], []), [1, (3, 5)])
+
+    def test_difference_splits_ranges(self):
+        self.assertEqual(
+            self.difference_ranges([(1, 10)], [5]),
+            [(1, 4), (6, 10)],
+        )
+        self.assertEqual(
+            self.difference_ranges([(1, 10)], [(2, 8)]),
+            [1, 9, 10],
+        )
+
+    def test_difference_removing_everything(self):
+        self.assertEqual(
+            self.difference_ranges([1, (3, 5), 8], [(0, 10)]),
+            [],
+        )
+
+    def test_difference_matches_sequences(self):
+        first = [1, 2, (15, 17), 19, (21, 24), 26, 27, (40, 50)]
+        second = [2, (10, 16), 22, (26, 30), 41, 43, (45, 46)]
+        sequence = sorted(
+            set(ranges_to_sequence(first)) - set(ranges_to_sequence(second)),
+        )
+        self.assertEqual(
+            self.difference_ranges(first, second),
+            list(sequence_to_ranges(sequence)),
+        )
+
+    def test_unsorted(self):
+        """Unsorted and overlapping ranges lists are sorted first."""
+        first = [(20, 25), 3, (1, 10), 30]
+        second = [(8, 21), 2, 5]
+        self.assertEqual(
+            self.union_ranges(first, second),
+            [(1, 25), 30],
+        )
+        self.assertEqual(
+            self.difference_ranges(first, second),
+            [1, 3, 4, 6, 7, (22, 25), 30],
+        )
+
+    def test_big_items(self):
+        """Items too big for the accelerator are still handled."""
+        big = 2**70
+        self.assertEqual(
+            list(sequenceranges.sequence_to_ranges([1, big, big + 1])),
+            [1, big, big + 1],
+        )
+        self.assertEqual(
+            sequenceranges.union_ranges([(big, big + 5)], [big + 6]),
+            [(big, big + 6)],
+        )
+        self.assertEqual(
+            sequenceranges.difference_ranges([(big, big + 5)], [big + 1]),
+            [big, (big + 2, big + 5)],
+        )
+
+
+@unittest.skipIf(_sequenceranges is None, "_sequenceranges not built")
+class AcceleratedBulkRangesTest(BulkRangesTest):
+
+    sequence_to_ranges = staticmethod(sequenceranges.sequence_to_ranges)
+    union_ranges = staticmethod(sequenceranges.union_ranges)
+    difference_ranges = staticmethod(sequenceranges.difference_ranges)
+
+    def test_accelerator_is_used(self):
+        sequence = list(range(10))
+        self.assertEqual(
+            _sequenceranges.sequence_to_ranges(sequence, SequenceError),
+            [(0, 9)],
+        )
+        self.assertEqual(
+            _sequenceranges.union_ranges([1], [2]),
+            [1, 2],
+        )
+
+    def test_not_ints(self):
+        """
+        The accelerator raises a C{TypeError} on items which aren't ints,
+        for the Python implementation to take them over.
+        """
+        self.assertRaises(
+            TypeError,
+            _sequenceranges.sequence_to_ranges,
+            ["a"],
+            SequenceError,
+        )
+        self.assertRaises(TypeError, _sequenceranges.union_ranges, [1], ["a"])
+
+    def test_unsorted_matches_python(self):
+        """
+        The accelerator gives the same result as the Python
+        implementation on unsorted ranges lists.
+        """
+        first = [40, (1, 5), 30, (3, 12), 21, 20, 19]
+        second = [(20, 35), 4, 2, (10, 11)]
+        self.assertEqual(
+            _sequenceranges.union_ranges(first, second),
+            sequenceranges.py_union_ranges(first, second),
+        )
+        self.assertEqual(
+            _sequenceranges.difference_ranges(first, second),
+            sequenceranges.py_difference_ranges(first, second),
+        )
+
+
 def test_suite():
     return unittest.TestSuite(
         (
@@ -303,5 +480,7 @@ def test_suite():
             unittest.makeSuite(FindRangesIndexTest),
             unittest.makeSuite(AddToRangesTest),
             unittest.makeSuite(RemoveFromRangesTest),
+            unittest.makeSuite(BulkRangesTest),
+            unittest.makeSuite(AcceleratedBulkRangesTest),
         ),
     )
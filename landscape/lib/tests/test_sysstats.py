@@ -11,6 +11,7 @@ from landscape.lib.sysstats import get_thermal_zones
 from landscape.lib.sysstats import get_uptime
 from landscape.lib.sysstats import LoginInfoReader
 from landscape.lib.sysstats import MemoryStats
+from landscape.lib.sysstats import ThermalZone
 from landscape.lib.testing import append_login_data
 
 
@@ -80,6 +81,12 @@ class MemoryStatsTest(BaseTestCase):
         self.assertEqual(type(memstats.used_swap_percentage), float)
         self.assertEqual(type(memstats.free_swap_percentage), float)
 
+    def test_get_memory_info_from_data(self):
+        """The content of the file can be passed if it was already read."""
+        memstats = MemoryStats("/non-existent", data=SAMPLE_MEMORY_INFO)
+        self.assertEqual(memstats.total_memory, 1510)
+        self.assertEqual(memstats.free_swap, 1567)
+
 
 class FakeWhoQTest(testing.HelperTestCase, BaseTestCase):
 
@@ -280,6 +287,14 @@ class GetSysfsThermalZonesTest(SysfsThermalZoneTest):
             os.path.join(self.base_path, "THM0"),
         )
 
+    def test_thermal_zone_from_data(self):
+        """The content of the file can be passed if it was already read."""
+        path = os.path.join(self.base_path, "THM0", "temp")
+        thermal_zone = ThermalZone(path, data="50000\n")
+        self.assertEqual(thermal_zone.name, "THM0")
+        self.assertEqual(thermal_zone.temperature_path, path)
+        self.assertEqual(thermal_zone.temperature_value, 50.0)
+
     def test_two_thermal_zones(self):
         self.write_thermal_zone("THM0", "50000")
         self.write_thermal_zone("THM1", "51000")
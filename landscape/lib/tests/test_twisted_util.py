@@ -151,6 +151,26 @@ class SpawnProcessTest(
         result.addCallback(callback)
         return result
 
+    def test_spawn_process_with_child_fds(self):
+        """
+        Optionally C{spawn_process} accepts a C{child_fds} argument, to pass
+        extra file descriptors to the process.
+        """
+        create_text_file(self.command, "#!/bin/sh\necho -n hello >&3")
+        extra = open(self.makeFile(), "w+b")
+        self.addCleanup(extra.close)
+
+        def callback(args):
+            extra.seek(0)
+            self.assertEqual(b"hello", extra.read())
+
+        result = spawn_process(
+            self.command,
+            child_fds={0: "w", 1: "r", 2: "r", 3: extra.fileno()},
+        )
+        result.addCallback(callback)
+        return result
+
     def test_spawn_process_with_signal(self):
         """
         In case the process gets terminated by a signal, it raises a
@@ -87,6 +87,7 @@ def spawn_process(
     wait_pipes=True,
     line_received=None,
     stdin=None,
+    child_fds=None,
 ):
     """
     Spawn a process using Twisted reactor.
@@ -98,6 +99,9 @@ def spawn_process(
         close when process ends.
     @param line_received: an optional callback called with every line of
         output from the process as parameter.
+    @param child_fds: an optional mapping of child file descriptors, as
+        accepted by reactor.spawnProcess. It must keep 0, 1 and 2 as
+        stdin, stdout and stderr pipes.
 
     @note: compared to reactor.spawnProcess, this version does NOT require the
     executable name as first element of args.
@@ -122,6 +126,7 @@ def spawn_process(
         uid=uid,
         gid=gid,
         usePTY=usePTY,
+        childFDs=child_fds,
     )
 
     if not wait_pipes:
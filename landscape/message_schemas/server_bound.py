@@ -61,6 +61,7 @@ __all__ = [
     "UBUNTU_PRO_REBOOT_REQUIRED",
     "SNAPS",
     "SNAP_INFO",
+    "CLIENT_HEALTH",
 ]
 
 
@@ -636,8 +637,13 @@ UNKNOWN_PACKAGE_HASHES = Message(
 
 PACKAGE_REPORTER_RESULT = Message(
     "package-reporter-result",
-    {"report-timestamp": Float(), "code": Int(), "err": Unicode()},
-    optional=["report-timestamp"],
+    {
+        "report-timestamp": Float(),
+        "code": Int(),
+        "err": Unicode(),
+        "stats": Dict(Unicode(), Float()),
+    },
+    optional=["report-timestamp", "stats"],
 )
 
 ADD_PACKAGES = Message(
@@ -845,6 +851,27 @@ SNAP_SERVICES = Message(
     },
 )
 
+CLIENT_HEALTH = Message(
+    "client-health",
+    {
+        "component": Unicode(),
+        "period": Float(),
+        "histograms": Dict(
+            Unicode(),
+            KeyDict(
+                {
+                    "count": Int(),
+                    "sum": Float(),
+                    "min": Float(),
+                    "max": Float(),
+                    "buckets": List(Tuple(Float(), Int())),
+                },
+            ),
+        ),
+        "values": Dict(Unicode(), Float()),
+    },
+)
+
 message_schemas = (
     ACTIVE_PROCESS_INFO,
     COMPUTER_UPTIME,
@@ -894,4 +921,5 @@ message_schemas = (
     SNAPS,
     SNAP_INFO,
     SNAP_SERVICES,
+    CLIENT_HEALTH,
 )
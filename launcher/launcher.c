@@ -0,0 +1,413 @@
+/*
+
+ Copyright (c) 2024 Canonical, Ltd.
+
+ Process launcher for the Landscape manager.
+
+ The manager starts the launcher once, passing it one end of a
+ SOCK_SEQPACKET socket pair with "--socket-fd N", and then asks it to spawn
+ processes instead of forking its own, much bigger, interpreter. Each
+ request is one packet of NUL-terminated fields:
+
+   <request-id> <uid> <gid> <path> <executable> <argc> <argv>... <envc>
+   <envp>...
+
+ carrying the stdin, stdout and stderr descriptors of the child as
+ SCM_RIGHTS ancillary data. Empty uid, gid and path fields mean no change.
+ The launcher answers each request with "started <request-id> <pid>" or
+ "failed <request-id> <errno>", the request id being 0 if it couldn't be
+ read, and, when a started child exits, sends "exited <pid> <wait
+ status>". It exits when the manager closes its end.
+
+*/
+
+#define _GNU_SOURCE
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <grp.h>
+#include <poll.h>
+#include <pwd.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifndef CLOSE_RANGE_CLOEXEC
+#define CLOSE_RANGE_CLOEXEC (1U << 2)
+#endif
+
+#define MAX_REQUEST_SIZE (256 * 1024)
+#define CHILD_FDS 3
+
+extern char **environ;
+
+// Mark every descriptor from 3 upwards close-on-exec with a single syscall.
+// Returns -1 if the running kernel (or the build headers) lack close_range().
+static int close_fds_with_close_range(void)
+{
+#ifdef SYS_close_range
+  return syscall(SYS_close_range, 3U, ~0U, CLOSE_RANGE_CLOEXEC);
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+// Close only the descriptors that are actually open, as listed in
+// /proc/self/fd, except keep_fd. Returns -1 if /proc is not available.
+static int close_fds_from_proc(int keep_fd)
+{
+  DIR *dir = opendir("/proc/self/fd");
+  if (!dir)
+    return -1;
+  int dir_fd = dirfd(dir);
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    char *end;
+    long fd = strtol(entry->d_name, &end, 10);
+    if (entry->d_name[0] == '\0' || *end != '\0')
+      continue;
+    if (fd < 3 || fd == dir_fd || fd == keep_fd)
+      continue;
+    close(fd);
+  }
+  closedir(dir);
+  return 0;
+}
+
+typedef struct {
+  char *request_id;
+  char *uid;
+  char *gid;
+  char *path;
+  char *executable;
+  char **argv;
+  char **envp;
+  int fds[CHILD_FDS];
+} Request;
+
+// Return the next NUL-terminated field of the request, or NULL if the
+// request is truncated.
+static char *next_field(char **position, char *end)
+{
+  char *field = *position;
+  char *nul = memchr(field, '\0', end - field);
+  if (!nul)
+    return NULL;
+  *position = nul + 1;
+  return field;
+}
+
+// Read a count field followed by as many fields into a NULL-terminated
+// array. Returns NULL if the request is malformed.
+static char **next_fields(char **position, char *end)
+{
+  char *count_field = next_field(position, end);
+  if (!count_field)
+    return NULL;
+  char *count_end;
+  long count = strtol(count_field, &count_end, 10);
+  if (*count_field == '\0' || *count_end != '\0' || count < 0 ||
+      count > end - *position)
+    return NULL;
+  char **fields = calloc(count + 1, sizeof(char *));
+  if (!fields)
+    return NULL;
+  for (long i = 0; i < count; i++) {
+    fields[i] = next_field(position, end);
+    if (!fields[i]) {
+      free(fields);
+      return NULL;
+    }
+  }
+  return fields;
+}
+
+static int parse_request(Request *request, char *data, size_t size)
+{
+  char *position = data;
+  char *end = data + size;
+  request->request_id = next_field(&position, end);
+  request->uid = next_field(&position, end);
+  request->gid = next_field(&position, end);
+  request->path = next_field(&position, end);
+  request->executable = next_field(&position, end);
+  if (!request->executable)
+    return -1;
+  request->argv = next_fields(&position, end);
+  if (!request->argv)
+    return -1;
+  request->envp = next_fields(&position, end);
+  if (!request->envp) {
+    free(request->argv);
+    request->argv = NULL;
+    return -1;
+  }
+  return 0;
+}
+
+// Parse an optional uid or gid field, -1 meaning it's empty.
+static int parse_id(const char *field, long *id)
+{
+  char *end;
+  if (*field == '\0') {
+    *id = -1;
+    return 0;
+  }
+  *id = strtol(field, &end, 10);
+  if (*end != '\0' || *id < 0)
+    return -1;
+  return 0;
+}
+
+// Set up the child and execute it, returning the errno on failure.
+static int exec_child(Request *request, int error_fd)
+{
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigprocmask(SIG_SETMASK, &mask, NULL);
+  signal(SIGPIPE, SIG_DFL);
+
+  for (int fd = 0; fd < CHILD_FDS; fd++) {
+    if (dup2(request->fds[fd], fd) == -1)
+      return errno;
+  }
+
+  long uid, gid;
+  if (parse_id(request->uid, &uid) == -1 ||
+      parse_id(request->gid, &gid) == -1)
+    return EINVAL;
+  if (gid != -1 && setregid(gid, gid) == -1)
+    return errno;
+  if (uid != -1) {
+    // Take the groups of the user, like twisted does when spawning a
+    // process with an uid, or none if it has no passwd entry.
+    struct passwd *pwd = getpwuid(uid);
+    int groups_set;
+    if (pwd)
+      groups_set = initgroups(pwd->pw_name, gid != -1 ? gid : getgid());
+    else
+      groups_set = setgroups(0, NULL);
+    if (groups_set == -1 || setreuid(uid, uid) == -1)
+      return errno;
+  }
+
+  // The child only inherits its standard descriptors.
+  if (close_fds_with_close_range() == -1 &&
+      close_fds_from_proc(error_fd) == -1)
+    return errno;
+
+  if (*request->path && chdir(request->path) == -1)
+    return errno;
+
+  // The child environment is the one of the request only, and it's the
+  // one searched for the executable, like os.execvpe does.
+  environ = request->envp;
+  execvp(request->executable, request->argv);
+  return errno;
+}
+
+static void send_reply(int sock, const char *reply)
+{
+  while (send(sock, reply, strlen(reply), MSG_NOSIGNAL) == -1) {
+    if (errno != EINTR) {
+      perror("error: Unable to send reply");
+      exit(1);
+    }
+  }
+}
+
+// Fork and execute the requested child. Returns the pid of the child, or
+// -1 with errno set.
+static pid_t spawn(Request *request)
+{
+  int error_pipe[2];
+  if (pipe2(error_pipe, O_CLOEXEC) == -1)
+    return -1;
+
+  pid_t pid = fork();
+  if (pid == -1) {
+    int fork_errno = errno;
+    close(error_pipe[0]);
+    close(error_pipe[1]);
+    errno = fork_errno;
+    return -1;
+  }
+  if (pid == 0) {
+    close(error_pipe[0]);
+    int child_errno = exec_child(request, error_pipe[1]);
+    while (write(error_pipe[1], &child_errno, sizeof(child_errno)) == -1 &&
+           errno == EINTR)
+      ;
+    _exit(127);
+  }
+
+  // The error pipe is closed on exec, so reading it returns nothing if the
+  // child got executed, or the errno of what failed.
+  close(error_pipe[1]);
+  int child_errno;
+  ssize_t size;
+  while ((size = read(error_pipe[0], &child_errno, sizeof(child_errno))) ==
+         -1 && errno == EINTR)
+    ;
+  close(error_pipe[0]);
+  if (size == sizeof(child_errno)) {
+    while (waitpid(pid, NULL, 0) == -1 && errno == EINTR)
+      ;
+    errno = child_errno;
+    return -1;
+  }
+  return pid;
+}
+
+// Return the id to reply to a request with, or "0" if it has no valid
+// one. Requests are answered in order, so the manager can still tell
+// which one failed.
+static const char *reply_id(const char *request_id)
+{
+  if (!request_id || *request_id == '\0' ||
+      request_id[strspn(request_id, "0123456789")] != '\0')
+    return "0";
+  return request_id;
+}
+
+static void handle_request(int sock, char *buffer)
+{
+  char control[CMSG_SPACE(sizeof(int) * CHILD_FDS)];
+  struct iovec iov = {buffer, MAX_REQUEST_SIZE};
+  struct msghdr msg = {0};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  ssize_t size = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+  if (size == -1) {
+    if (errno == EINTR)
+      return;
+    perror("error: Unable to receive request");
+    exit(1);
+  }
+  if (size == 0)
+    // The manager went away.
+    exit(0);
+
+  Request request = {0};
+  int fds_count = 0;
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  if (cmsg && cmsg->cmsg_level == SOL_SOCKET &&
+      cmsg->cmsg_type == SCM_RIGHTS) {
+    fds_count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    if (fds_count > CHILD_FDS)
+      fds_count = CHILD_FDS;
+    memcpy(request.fds, CMSG_DATA(cmsg), fds_count * sizeof(int));
+  }
+
+  char *reply = NULL;
+  int reply_size;
+  if ((msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) || fds_count != CHILD_FDS ||
+      parse_request(&request, buffer, size) == -1) {
+    reply_size = asprintf(&reply, "failed %s %d",
+                          reply_id(request.request_id), EINVAL);
+  } else {
+    pid_t pid = spawn(&request);
+    if (pid == -1)
+      reply_size = asprintf(&reply, "failed %s %d",
+                            reply_id(request.request_id), errno);
+    else
+      reply_size = asprintf(&reply, "started %s %d",
+                            reply_id(request.request_id), pid);
+  }
+  for (int fd = 0; fd < fds_count; fd++)
+    close(request.fds[fd]);
+  free(request.argv);
+  free(request.envp);
+  if (reply_size == -1) {
+    perror("error: Unable to allocate reply");
+    exit(1);
+  }
+  send_reply(sock, reply);
+  free(reply);
+}
+
+static void reap_children(int sock, int signal_fd)
+{
+  struct signalfd_siginfo info;
+  while (read(signal_fd, &info, sizeof(info)) == sizeof(info))
+    ;
+  int status;
+  pid_t pid;
+  while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+    char reply[64];
+    snprintf(reply, sizeof(reply), "exited %d %d", pid, status);
+    send_reply(sock, reply);
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  int sock = -1;
+  if (argc == 3 && strcmp(argv[1], "--socket-fd") == 0) {
+    char *end;
+    sock = strtol(argv[2], &end, 10);
+    if (*argv[2] == '\0' || *end != '\0' || sock < 3 ||
+        fcntl(sock, F_GETFD) == -1)
+      sock = -1;
+  }
+  if (sock == -1) {
+    fprintf(stderr, "usage: %s --socket-fd N\n", argv[0]);
+    exit(1);
+  }
+  if (fcntl(sock, F_SETFD, FD_CLOEXEC) == -1) {
+    perror("error: Unable to set up socket descriptor");
+    exit(1);
+  }
+
+  // Children exits are read from a signalfd, in the same loop as the
+  // requests, so that their replies never interleave.
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGCHLD);
+  if (sigprocmask(SIG_BLOCK, &mask, NULL) == -1) {
+    perror("error: Unable to block SIGCHLD");
+    exit(1);
+  }
+  int signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+  if (signal_fd == -1) {
+    perror("error: Unable to create signal descriptor");
+    exit(1);
+  }
+
+  if (chdir("/") == -1) {
+    perror("error: Unable to change working directory");
+    exit(1);
+  }
+
+  char *buffer = malloc(MAX_REQUEST_SIZE);
+  if (!buffer) {
+    perror("error: Unable to allocate request buffer");
+    exit(1);
+  }
+
+  struct pollfd fds[] = {{sock, POLLIN, 0}, {signal_fd, POLLIN, 0}};
+  while (1) {
+    if (poll(fds, 2, -1) == -1) {
+      if (errno == EINTR)
+        continue;
+      perror("error: Unable to poll");
+      exit(1);
+    }
+    if (fds[1].revents & POLLIN)
+      reap_children(sock, signal_fd);
+    if (fds[0].revents & (POLLIN | POLLHUP | POLLERR))
+      handle_request(sock, buffer);
+  }
+}
@@ -50,12 +50,14 @@ import setup_client  # noqa: E402
 PACKAGES = []
 MODULES = []
 SCRIPTS = []
+EXT_MODULES = []
 DEB_REQUIRES = []
 REQUIRES = []
 for sub in (setup_lib, setup_sysinfo, setup_client):
     PACKAGES += sub.PACKAGES
     MODULES += sub.MODULES
     SCRIPTS += sub.SCRIPTS
+    EXT_MODULES += sub.EXT_MODULES
     DEB_REQUIRES += sub.DEB_REQUIRES
     REQUIRES += sub.REQUIRES
 
@@ -67,4 +69,5 @@ if __name__ == "__main__":
         packages=PACKAGES,
         modules=MODULES,
         scripts=SCRIPTS,
+        ext_modules=EXT_MODULES,
     )
@@ -42,6 +42,8 @@ if sys.version_info[0] > 2:
         "scripts/landscape-release-upgrader",
     ]
 
+EXT_MODULES = []
+
 # Dependencies
 
 DEB_REQUIRES = [
@@ -1,4 +1,5 @@
 #!/usr/bin/python
+from distutils.core import Extension
 
 
 NAME = ("landscape-lib",)
@@ -14,6 +15,24 @@ MODULES = [
     "landscape.constants",
 ]
 SCRIPTS = []
+# Optional accelerators, the pure Python code is used if they can't be built.
+EXT_MODULES = [
+    Extension(
+        "landscape.lib._bpickle",
+        ["landscape/lib/_bpickle.c"],
+        optional=True,
+    ),
+    Extension(
+        "landscape.lib._procscan",
+        ["landscape/lib/_procscan.c"],
+        optional=True,
+    ),
+    Extension(
+        "landscape.lib._sequenceranges",
+        ["landscape/lib/_sequenceranges.c"],
+        optional=True,
+    ),
+]
 
 # Dependencies
 
@@ -37,4 +56,5 @@ if __name__ == "__main__":
         packages=PACKAGES,
         modules=MODULES,
         scripts=SCRIPTS,
+        ext_modules=EXT_MODULES,
     )
@@ -16,6 +16,8 @@ if sys.version_info[0] > 2:
         "scripts/landscape-sysinfo",
     ]
 
+EXT_MODULES = []
+
 # Dependencies
 
 DEB_REQUIRES = []